@@ -1,147 +1,171 @@
+#include <cstring>
 #include <iostream>
-#include <fstream>
+#include <string>
 #include <vector>
 
-// Enforce 1-byte structure alignment to match the standard BMP binary layout.
-#pragma pack(1)
+#include "bmp_dither.h"
+#include "bmp_image.h"
+#include "bmp_kernels.h"
+#include "bmp_palette.h"
+#include "bmp_parallel.h"
+#include "bmp_planar.h"
+#include "bmp_rle.h"
+#include "bmp_stats.h"
+#include "bmp_stream.h"
 
 using namespace std;
 
-// Standard BMP File Header
-struct BMPFileHeader {
-    uint16_t bfType;      // Magic number 'BM' (0x4D42).
-    uint32_t bfSize;      // File size in bytes.
-    uint16_t bfReserved1; // Reserved.
-    uint16_t bfReserved2; // Reserved.
-    uint32_t bfOffBits;   // Offset to the start of pixel data.
-};
+int main(int argc, char* argv[]) {
+    const char* inputFileName = "images/input2.bmp";
+    const char* outputFileName_6bit = "output2_1.bmp";
+    const char* outputFileName_4bit = "output2_2.bmp";
+    const char* outputFileName_2bit = "output2_3.bmp";
 
-// Standard BMP Information Header (DIB Header)
-struct BMPInfoHeader {
-    uint32_t biSize;          // Header size.
-    int32_t biWidth;          // Image width.
-    int32_t biHeight;         // Image height.
-    uint16_t biPlanes;        // Number of color planes (must be 1).
-    uint16_t biBitCount;      // Bits per pixel (e.g., 24, 32).
-    uint32_t biCompression;   // Compression type (0 = uncompressed).
-    uint32_t biSizeImage;     // Image size in bytes.
-    int32_t biXPelsPerMeter;  // Horizontal resolution.
-    int32_t biYPelsPerMeter;  // Vertical resolution.
-    uint32_t biClrUsed;       // Number of colors in palette.
-    uint32_t biClrImportant;  // Important colors.
-};
+    // Bit depths of the preview ladder; every entry gets its own output file
+    const vector<string> outputFileNames = { outputFileName_6bit, outputFileName_4bit, outputFileName_2bit };
+    const vector<int> quantizationBits = { 6, 4, 2 };
 
-/**
- * Quantization Function: Reduces the color depth of RGB channels.
- * * This function maps the continuous [0, 255] pixel intensity range to a smaller set of 
- * discrete levels determined by the target bit depth.
- */
-void quantizePixelData(vector<uint8_t>& pixelData, int bytesPerPixel, int width, int height, int rowSize, int quantizationBits) {
-    // Calculate the number of discrete levels based on the target bit depth (2^n)
-    int levels = 1 << quantizationBits;
-    
-    // Define the maximum pixel intensity for 8-bit channels
-    int maxValue = 255;
-    
-    // Calculate the quantization step factor (scaling factor)
-    // This maps the 0-255 range to the new reduced range.
-    int factor = maxValue / (levels - 1); 
+    // Parallel mode ("--threads <n>"): rows are split across n threads
+    int threadCount = parseThreadCountOption(argc, argv);
 
-    for (int y = 0; y < height; y++) {
-        // Get pointer to the start of the current row
-        uint8_t* row = &pixelData[y * rowSize];
-        
-        for (int x = 0; x < width; ++x) {
-            // Iterate through RGB channels (assuming BGR/BGRA order)
-            // Limit loop to 3 to process only color channels and preserve Alpha if present.
-            for (int byte = 0; byte < 3; ++byte) {
-                uint8_t& colorValue = row[x * bytesPerPixel + byte];
-                
-                // Apply uniform quantization:
-                // 1. Divide by factor to find the nearest bin index.
-                // 2. Multiply back by factor to reconstruct the quantized value.
-                colorValue = (colorValue / factor) * factor;
-            }
+    // Dither mode ("--dither <none|bayer|fs>"): plain truncation unless requested
+    QuantizationMode mode = QUANTIZE_TRUNCATE;
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (string(argv[i]) == "--dither" && !parseQuantizationMode(argv[i + 1], mode)) {
+            cerr << "Unknown dither mode: " << argv[i + 1] << " (expected none, bayer or fs)" << endl;
+            return 1;
         }
     }
-}
-
-int main() {
-    const char* inputFileName = "images/input2.bmp";
-    const char* outputFileName_6bit = "output2_1.bmp";
-    const char* outputFileName_4bit = "output2_2.bmp";
-    const char* outputFileName_2bit = "output2_3.bmp";
 
-    // Open the input BMP file in binary mode
-    ifstream inputFile(inputFileName, ios::binary);
-    if(!inputFile) {
-        cerr << "Can't open file." << endl;
-        return 1;
+    // Palette mode ("--palette"): outputs whose colors fit a color table become 4/8-bit indexed BMPs
+    // RLE mode ("--rle"): palette mode with RLE4/RLE8-compressed indexed outputs
+    bool paletteOutput = false;
+    bool rleOutput = false;
+    for (int i = 1; i < argc; ++i) {
+        rleOutput = rleOutput || string(argv[i]) == "--rle";
+        paletteOutput = paletteOutput || rleOutput || string(argv[i]) == "--palette";
     }
 
-    // Read the BMP File Header
-    BMPFileHeader fileHeader;
-    inputFile.read(reinterpret_cast<char*>(&fileHeader), sizeof(fileHeader));
+    // Statistics mode ("--stats"): histograms of every output are written to <output>.stats.json.
+    // Truncating quantization collects them while it writes the rows; the other modes count the finished output.
+    bool collectStats = false;
+    for (int i = 1; i < argc; ++i) {
+        collectStats = collectStats || string(argv[i]) == "--stats";
+    }
 
-    // Validate the BMP file signature (Magic Number 0x4D42)
-    if (fileHeader.bfType != 0x4D42) {
-        cerr << "Input file is not a BMP file." << endl;
-        return 1;
+    // Planar mode ("--planar"): the source is split into B, G, R (and A) planes once; every output is quantized
+    // or dithered with straight loops over the color planes and interleaved back into its mapped file.
+    // Error diffusion walks the interleaved pixels and keeps the regular path.
+    bool planarLayout = false;
+    for (int i = 1; i < argc; ++i) {
+        planarLayout = planarLayout || string(argv[i]) == "--planar";
     }
 
-    // Read the BMP Information Header
-    BMPInfoHeader infoHeader;
-    inputFile.read(reinterpret_cast<char*>(&infoHeader), sizeof(infoHeader));
-    int width = infoHeader.biWidth;
-    int height = infoHeader.biHeight;
-    int bitCount = infoHeader.biBitCount;
-    int bytesPerPixel = bitCount / 8;
+    // Streaming mode ("--stream <rows>"): all outputs are produced band by band from a single read.
+    // Error diffusion and palette selection need the whole image, so they always take the mapped path.
+    int bandRows = parseBandRowsOption(argc, argv);
+    if (bandRows > 0 && mode != QUANTIZE_ERROR_DIFFUSION && !paletteOutput) {
+        if (collectStats) {
+            cerr << "Statistics are not collected in streaming mode." << endl;
+        }
+        if (!streamQuantizeMulti(inputFileName, outputFileNames, quantizationBits, bandRows, threadCount, mode)) {
+            return 1;
+        }
+        cout << "Quantization successful!" << endl;
+        return 0;
+    }
 
-    // Ensure support only for 24-bit (RGB) and 32-bit (RGBA) uncompressed formats
-    if (bitCount != 24 && bitCount != 32 || infoHeader.biCompression != 0) {
-        cerr << "Only supports 24-bit or 32-bit uncompressed BMP." << endl;
+    // Map the input BMP (24-bit RGB or 32-bit RGBA uncompressed, or indexed, which is decoded to 24-bit);
+    // direct-color pixels are only read, never copied
+    Image image;
+    if (!loadBMPMapped(inputFileName, image)) {
         return 1;
     }
 
-    // Calculate row stride with 4-byte alignment (padding)
-    int rowSize = ((width * bytesPerPixel + 3) & (~3));
-
-    // Allocate buffer and read raw pixel data
-    vector<uint8_t> pixelData(rowSize * height);
-    inputFile.seekg(fileHeader.bfOffBits, ios::beg);
-    inputFile.read(reinterpret_cast<char*>(pixelData.data()), pixelData.size());
-    inputFile.close();
-
-    // Process: 6-bit Quantization
-    vector<uint8_t> pixelData_6bit = pixelData;
-    quantizePixelData(pixelData_6bit, bytesPerPixel, width, height, rowSize, 6);
-    
-    ofstream outputFile_6bit(outputFileName_6bit, ios::binary);
-    outputFile_6bit.write(reinterpret_cast<char*>(&fileHeader), sizeof(fileHeader));
-    outputFile_6bit.write(reinterpret_cast<char*>(&infoHeader), sizeof(infoHeader));
-    outputFile_6bit.write(reinterpret_cast<char*>(pixelData_6bit.data()), pixelData_6bit.size());
-    outputFile_6bit.close();
+    if (paletteOutput) {
+        for (size_t i = 0; i < outputFileNames.size(); ++i) {
+            // Quantize a pooled copy, then index it; bit depths with too many colors keep direct color
+            Image quantized(image);
+            quantizePixelDataMode(quantized.pixelData, quantized.bytesPerPixel, quantized.width, quantized.height, quantized.stride, quantizationBits[i], mode, threadCount);
+            if (collectStats) {
+                ImageStats stats;
+                computeImageStats(quantized.pixelData, quantized.width, quantized.height, quantized.stride, quantized.bytesPerPixel, stats, threadCount);
+                if (!writeStatsJSON(statsPath(outputFileNames[i]).c_str(), stats)) {
+                    return 1;
+                }
+            }
+            Image indexed;
+            if (convertToIndexed(quantized, quantizationBits[i], indexed, threadCount)) {
+                bool saved = rleOutput ? saveRLEBMP(outputFileNames[i].c_str(), indexed, threadCount)
+                                       : saveIndexedBMP(outputFileNames[i].c_str(), indexed, 0, threadCount);
+                if (!saved) {
+                    return 1;
+                }
+            } else {
+                cerr << "Writing " << outputFileNames[i] << " with direct color." << endl;
+                if (!saveBMP(outputFileNames[i].c_str(), quantized, threadCount)) {
+                    return 1;
+                }
+            }
+        }
+        cout << "Quantization successful!" << endl;
+        return 0;
+    }
 
-    // Process: 4-bit Quantization
-    vector<uint8_t> pixelData_4bit = pixelData;
-    quantizePixelData(pixelData_4bit, bytesPerPixel, width, height, rowSize, 4);
-    
-    ofstream outputFile_4bit(outputFileName_4bit, ios::binary);
-    outputFile_4bit.write(reinterpret_cast<char*>(&fileHeader), sizeof(fileHeader));
-    outputFile_4bit.write(reinterpret_cast<char*>(&infoHeader), sizeof(infoHeader));
-    outputFile_4bit.write(reinterpret_cast<char*>(pixelData_4bit.data()), pixelData_4bit.size());
-    outputFile_4bit.close();
+    // Create every output file at its final size and map its pixel region
+    vector<Image> outputImages(outputFileNames.size());
+    vector<uint8_t*> outputs(outputFileNames.size());
+    for (size_t i = 0; i < outputFileNames.size(); ++i) {
+        if (!createBMPMapped(outputFileNames[i].c_str(), image, image.width, image.height, outputImages[i])) {
+            return 1;
+        }
+        outputs[i] = outputImages[i].pixelData;
+    }
 
-    // Process: 2-bit Quantization
-    vector<uint8_t> pixelData_2bit = pixelData;
-    quantizePixelData(pixelData_2bit, bytesPerPixel, width, height, rowSize, 2);
-    
-    ofstream outputFile_2bit(outputFileName_2bit, ios::binary);
-    outputFile_2bit.write(reinterpret_cast<char*>(&fileHeader), sizeof(fileHeader));
-    outputFile_2bit.write(reinterpret_cast<char*>(&infoHeader), sizeof(infoHeader));
-    outputFile_2bit.write(reinterpret_cast<char*>(pixelData_2bit.data()), pixelData_2bit.size());
-    outputFile_2bit.close();
+    vector<ImageStats> stats(outputImages.size());
+    if (planarLayout && mode != QUANTIZE_ERROR_DIFFUSION && image.bytesPerPixel >= 3) {
+        // Process: one deinterleave of the source, then one scratch plane set reused by every output
+        PlanarImage source;
+        PlanarImage scratch;
+        if (!deinterleaveImage(viewOf(image), true, source, threadCount) || !createPlanarLike(source, scratch)) {
+            return 1;
+        }
+        for (size_t i = 0; i < outputImages.size(); ++i) {
+            if (mode == QUANTIZE_TRUNCATE) {
+                quantizePlanes(source, scratch, quantizationBits[i], threadCount, collectStats ? &stats[i] : nullptr);
+            } else {
+                orderedDitherPlanes(source, scratch, quantizationBits[i], threadCount);
+                if (collectStats) {
+                    computePlanarStats(scratch, stats[i], threadCount);
+                }
+            }
+            interleaveImage(scratch, viewOf(outputImages[i]), threadCount);
+        }
+    } else if (mode == QUANTIZE_TRUNCATE) {
+        // Process: one pass over the source quantizes to every bit depth at once
+        quantizePixelDataMulti(image.pixelData, outputs, quantizationBits, image.bytesPerPixel, image.width, image.height, image.stride, threadCount,
+                               collectStats ? &stats : nullptr);
+    } else {
+        // Dithering: copy the source into each output and dither it there in place
+        for (size_t i = 0; i < outputImages.size(); ++i) {
+            memcpy(outputImages[i].pixelBase(), image.pixelBase(), image.pixelBytes());
+            quantizePixelDataMode(outputs[i], image.bytesPerPixel, image.width, image.height, image.stride, quantizationBits[i], mode, threadCount);
+            if (collectStats) {
+                computeImageStats(outputs[i], image.width, image.height, image.stride, image.bytesPerPixel, stats[i], threadCount);
+            }
+        }
+    }
+    for (size_t i = 0; collectStats && i < stats.size(); ++i) {
+        if (!writeStatsJSON(statsPath(outputFileNames[i]).c_str(), stats[i])) {
+            return 1;
+        }
+    }
+    for (Image& outputImage : outputImages) {
+        if (!commitBMP(outputImage)) {
+            return 1;
+        }
+    }
 
     cout << "Quantization successful!" << endl;
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,226 @@
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "bmp_batch.h"
+#include "bmp_result_cache.h"
+
+using namespace std;
+
+// Print the command-line usage of the batch driver
+static void printUsage() {
+    cerr << "Usage: bmp_batch <flip|quantize|crop|resize> [options] <files or directories...>" << endl
+         << "  -o <dir>            Output directory (default: current directory)" << endl
+         << "  --list <file>       Read input paths from a file, one per line" << endl
+         << "  --jobs <n>          Images processed concurrently (default: all hardware threads)" << endl
+         << "  --threads <n>       Row-parallel threads per image (default: 1)" << endl
+         << "  --bits <a,b,...>    Quantization bit depths (default: 6,4,2)" << endl
+         << "  --rect <x,y,w,h>    Crop rectangle, repeatable for crop (resize: one, resample only this region)" << endl
+         << "  --rects <file>      Crop rectangles from a file, one x,y,w,h per line" << endl
+         << "  --grid <WxH>        Crop a grid of WxH tiles" << endl
+         << "  --step <XxY>        Grid step (default: the tile size; smaller steps overlap)" << endl
+         << "  --backend <name>    Flip/quantize/crop kernels: cpu or opencl (default: BMP_BACKEND, else cpu)" << endl
+         << "  --cache <dir>       Reuse outputs of identical inputs and parameters from a result cache" << endl
+         << "  --stats             Write <output>.stats.json (histograms, min/max/mean) next to each output" << endl
+         << "  --pack              Write all tiles of an image into one packed BMP" << endl
+         << "  --size <WxH>        Resize output size; 0 for one side keeps the aspect ratio" << endl
+         << "  --filter <name>     Resize filter: box, bilinear or lanczos (default: lanczos)" << endl;
+}
+
+// Parse a comma-separated list of integers, e.g. "6,4,2"
+static bool parseIntList(const char* text, vector<int>& values) {
+    values.clear();
+    stringstream stream(text);
+    string item;
+    while (getline(stream, item, ',')) {
+        char* end = nullptr;
+        long value = strtol(item.c_str(), &end, 10);
+        if (item.empty() || *end != '\0') {
+            return false;
+        }
+        values.push_back(static_cast<int>(value));
+    }
+    return !values.empty();
+}
+
+// Parse "WxH" into two non-negative integers
+static bool parseSize(const string& text, int& width, int& height) {
+    size_t separator = text.find('x');
+    vector<int> dimensions;
+    if (separator == string::npos || !parseIntList((text.substr(0, separator) + "," + text.substr(separator + 1)).c_str(), dimensions) ||
+        dimensions.size() != 2 || dimensions[0] < 0 || dimensions[1] < 0) {
+        return false;
+    }
+    width = dimensions[0];
+    height = dimensions[1];
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 3) {
+        printUsage();
+        return 1;
+    }
+
+    // Select the operation applied to every file
+    BatchOptions options;
+    string operation = argv[1];
+    if (operation == "flip") {
+        options.operation = BATCH_FLIP;
+    } else if (operation == "quantize") {
+        options.operation = BATCH_QUANTIZE;
+    } else if (operation == "crop") {
+        options.operation = BATCH_CROP;
+    } else if (operation == "resize") {
+        options.operation = BATCH_RESIZE;
+    } else {
+        printUsage();
+        return 1;
+    }
+
+    vector<string> paths;
+    bool hasRectList = false;
+    bool backendSelected = false;
+    for (int i = 2; i < argc; ++i) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "-o" && hasValue) {
+            options.outputDirectory = argv[++i];
+        } else if (arg == "--list" && hasValue) {
+            if (!readFileList(argv[++i], paths)) {
+                return 1;
+            }
+        } else if (arg == "--jobs" && hasValue) {
+            options.workerCount = atoi(argv[++i]);
+        } else if (arg == "--threads" && hasValue) {
+            options.threadsPerImage = max(1, atoi(argv[++i]));
+        } else if (arg == "--bits" && hasValue) {
+            if (!parseIntList(argv[++i], options.quantizationBits)) {
+                cerr << "Invalid bit depth list." << endl;
+                return 1;
+            }
+            for (int bits : options.quantizationBits) {
+                if (bits < 1 || bits > 8) {
+                    cerr << "Quantization bits must be between 1 and 8." << endl;
+                    return 1;
+                }
+            }
+        } else if (arg == "--rect" && hasValue) {
+            vector<int> rect;
+            if (!parseIntList(argv[++i], rect) || rect.size() != 4) {
+                cerr << "Crop rectangle must be x,y,w,h." << endl;
+                return 1;
+            }
+            TileRect tile;
+            tile.x = rect[0];
+            tile.y = rect[1];
+            tile.width = rect[2];
+            tile.height = rect[3];
+            options.cropRects.push_back(tile);
+        } else if (arg == "--rects" && hasValue) {
+            if (!readTileRects(argv[++i], options.cropRects)) {
+                return 1;
+            }
+            hasRectList = true;
+        } else if (arg == "--grid" && hasValue) {
+            if (!parseSize(argv[++i], options.gridWidth, options.gridHeight) || options.gridWidth == 0 || options.gridHeight == 0) {
+                cerr << "Tile grid must be WxH." << endl;
+                return 1;
+            }
+        } else if (arg == "--step" && hasValue) {
+            if (!parseSize(argv[++i], options.gridStepX, options.gridStepY) || options.gridStepX == 0 || options.gridStepY == 0) {
+                cerr << "Grid step must be XxY." << endl;
+                return 1;
+            }
+        } else if (arg == "--backend" && hasValue) {
+            if (!parseKernelBackend(argv[++i], options.backend)) {
+                cerr << "Unknown backend: " << argv[i] << " (expected cpu or opencl)" << endl;
+                return 1;
+            }
+            backendSelected = true;
+        } else if (arg == "--cache" && hasValue) {
+            options.cacheDirectory = argv[++i];
+        } else if (arg == "--stats") {
+            options.collectStats = true;
+        } else if (arg == "--pack") {
+            options.packTiles = true;
+        } else if (arg == "--size" && hasValue) {
+            if (!parseSize(argv[++i], options.resizeWidth, options.resizeHeight) || (options.resizeWidth == 0 && options.resizeHeight == 0)) {
+                cerr << "Resize size must be WxH." << endl;
+                return 1;
+            }
+        } else if (arg == "--filter" && hasValue) {
+            if (!parseResizeFilter(argv[i + 1], options.resizeFilter)) {
+                cerr << "Unknown resize filter: " << argv[i + 1] << " (expected box, bilinear or lanczos)" << endl;
+                return 1;
+            }
+            ++i;
+        } else if (!arg.empty() && arg[0] == '-') {
+            printUsage();
+            return 1;
+        } else {
+            paths.push_back(arg);
+        }
+    }
+
+    // Without --backend the environment decides; an explicit OpenCL request still needs a device
+    if (!backendSelected) {
+        options.backend = preferredKernelBackend();
+    } else if (options.backend == KERNEL_BACKEND_OPENCL && !openCLAvailable()) {
+        cerr << "No OpenCL device found; using the CPU kernels." << endl;
+        options.backend = KERNEL_BACKEND_CPU;
+    }
+
+    if (options.operation == BATCH_CROP && options.cropRects.empty() && options.gridWidth == 0) {
+        cerr << "Crop requires --rect x,y,w,h, --rects or --grid." << endl;
+        return 1;
+    }
+    if (options.gridWidth > 0 && options.gridStepX == 0) {
+        options.gridStepX = options.gridWidth;
+        options.gridStepY = options.gridHeight;
+    }
+    if (options.operation == BATCH_RESIZE && options.resizeWidth == 0 && options.resizeHeight == 0) {
+        cerr << "Resize requires --size WxH." << endl;
+        return 1;
+    }
+
+    // Only crop cuts several regions; resize resamples at most one, flip and quantize take none
+    bool regionList = options.cropRects.size() > 1 || hasRectList || options.gridWidth > 0 || options.packTiles;
+    if (options.operation == BATCH_RESIZE && regionList) {
+        cerr << "Resize takes a single --rect." << endl;
+        return 1;
+    }
+    if ((options.operation == BATCH_FLIP || options.operation == BATCH_QUANTIZE) && (regionList || !options.cropRects.empty())) {
+        cerr << "Rectangles, grids and --pack only apply to crop and resize." << endl;
+        return 1;
+    }
+
+    // A single rectangle (from --rect or a one-entry list) is the ROI of the single-region paths
+    if (options.cropRects.size() == 1) {
+        options.cropX = options.cropRects[0].x;
+        options.cropY = options.cropRects[0].y;
+        options.cropWidth = options.cropRects[0].width;
+        options.cropHeight = options.cropRects[0].height;
+        options.hasCrop = true;
+    }
+
+    // Expand directories into their BMP files
+    vector<string> files;
+    if (!collectBMPFiles(paths, files)) {
+        return 1;
+    }
+    if (files.empty()) {
+        cerr << "No BMP files to process." << endl;
+        return 1;
+    }
+
+    int failures = runBatch(files, options);
+    cout << "Processed " << files.size() - failures << " of " << files.size() << " files." << endl;
+    if (!options.cacheDirectory.empty()) {
+        ResultCacheCounters counters = resultCacheCounters();
+        cout << "Result cache: " << counters.hits << " hits, " << counters.misses << " misses." << endl;
+    }
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,612 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <x86intrin.h>
+#define BMP_HAVE_TSC
+#endif
+
+#include "bmp_image.h"
+#include "bmp_kernels.h"
+#include "bmp_resize.h"
+#include "bmp_roi.h"
+#include "bmp_parallel.h"
+#include "bmp_planar.h"
+#include "bmp_simd.h"
+#include "bmp_stream.h"
+
+using namespace std;
+
+// Untimed runs before the measured iterations (page faults, pool warm-up, CPU frequency ramp)
+const int WARMUP_ITERATIONS = 2;
+
+struct BenchmarkOptions {
+    vector<string> images = { "images/input1.bmp", "images/input2.bmp" };
+    vector<int> sizes = { 1024, 1024, 4096, 4096 };   // Synthetic images as width, height pairs.
+    vector<int> bytesPerPixel = { 3, 4 };             // Pixel sizes of the synthetic images.
+    vector<int> quantizationBits = { 6, 4, 2 };
+    vector<int> threadCounts;                         // Default: 1 and all hardware threads.
+    vector<string> cases = { "flip", "quantize", "planar", "crop", "resize", "simd", "io" };
+    int iterations = 15;
+    string scratchDirectory = ".";
+    bool json = false;
+};
+
+// One measured configuration
+struct BenchmarkResult {
+    string caseName;
+    string image;
+    int width = 0;
+    int height = 0;
+    int bitCount = 0;
+    int threads = 1;
+    string simd;
+    int quantizationBits = 0;                         // 0 when the case has no bit depth.
+    uint64_t bytes = 0;                               // Pixel bytes processed per iteration.
+    uint64_t pixels = 0;                              // Pixels processed per iteration (the ROI for crops).
+    vector<double> seconds;                           // One sample per iteration.
+    vector<double> cycles;                            // Time-stamp counter ticks per iteration (x86 only).
+};
+
+// Print the command-line usage of the benchmark
+static void printUsage() {
+    cerr << "Usage: bmp_benchmark [options]" << endl
+         << "  --images <a.bmp,...>   Fixture images (default: images/input1.bmp,images/input2.bmp)" << endl
+         << "  --sizes <WxH,...>      Synthetic image sizes (default: 1024x1024,4096x4096; \"none\" to skip)" << endl
+         << "  --bpp <24,32>          Bits per pixel of the synthetic images (default: 24,32)" << endl
+         << "  --bits <a,b,...>       Quantization bit depths (default: 6,4,2)" << endl
+         << "  --threads <a,b,...>    Thread counts (default: 1 and all hardware threads)" << endl
+         << "  --cases <a,b,...>      Any of flip, quantize, planar, crop, resize, simd, io (default: all)" << endl
+         << "  --iterations <n>       Measured iterations per configuration (default: 15)" << endl
+         << "  --scratch <dir>        Directory for the files written by the io cases (default: .)" << endl
+         << "  --json                 Print the results as JSON instead of a table" << endl;
+}
+
+// Split a comma-separated list, e.g. "flip,crop"
+static vector<string> splitList(const string& text, char separator = ',') {
+    vector<string> items;
+    stringstream stream(text);
+    string item;
+    while (getline(stream, item, separator)) {
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+// Parse a comma-separated list of positive integers
+static bool parseIntList(const string& text, vector<int>& values) {
+    values.clear();
+    for (const string& item : splitList(text)) {
+        char* end = nullptr;
+        long value = strtol(item.c_str(), &end, 10);
+        if (*end != '\0' || value <= 0) {
+            return false;
+        }
+        values.push_back(static_cast<int>(value));
+    }
+    return !values.empty();
+}
+
+// Parse "WxH,WxH,..." into width, height pairs
+static bool parseSizeList(const string& text, vector<int>& sizes) {
+    sizes.clear();
+    if (text == "none") {
+        return true;
+    }
+    for (const string& item : splitList(text)) {
+        char* end = nullptr;
+        long width = strtol(item.c_str(), &end, 10);
+        if (*end != 'x' || width <= 0) {
+            return false;
+        }
+        long height = strtol(end + 1, &end, 10);
+        if (*end != '\0' || height <= 0) {
+            return false;
+        }
+        sizes.push_back(static_cast<int>(width));
+        sizes.push_back(static_cast<int>(height));
+    }
+    return true;
+}
+
+static bool parseOptions(int argc, char* argv[], BenchmarkOptions& options) {
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--json") {
+            options.json = true;
+        } else if (arg == "--images" && hasValue) {
+            options.images = splitList(argv[++i]);
+        } else if (arg == "--sizes" && hasValue) {
+            if (!parseSizeList(argv[++i], options.sizes)) {
+                cerr << "Invalid size list." << endl;
+                return false;
+            }
+        } else if (arg == "--bpp" && hasValue) {
+            vector<int> bitCounts;
+            if (!parseIntList(argv[++i], bitCounts)) {
+                cerr << "Invalid bits-per-pixel list." << endl;
+                return false;
+            }
+            options.bytesPerPixel.clear();
+            for (int bitCount : bitCounts) {
+                if (bitCount != 24 && bitCount != 32) {
+                    cerr << "Synthetic images are 24-bit or 32-bit." << endl;
+                    return false;
+                }
+                options.bytesPerPixel.push_back(bitCount / 8);
+            }
+        } else if (arg == "--bits" && hasValue) {
+            if (!parseIntList(argv[++i], options.quantizationBits) ||
+                *max_element(options.quantizationBits.begin(), options.quantizationBits.end()) > 8) {
+                cerr << "Quantization bits must be between 1 and 8." << endl;
+                return false;
+            }
+        } else if (arg == "--threads" && hasValue) {
+            if (!parseIntList(argv[++i], options.threadCounts)) {
+                cerr << "Invalid thread count list." << endl;
+                return false;
+            }
+        } else if (arg == "--cases" && hasValue) {
+            options.cases = splitList(argv[++i]);
+        } else if (arg == "--iterations" && hasValue) {
+            options.iterations = max(1, atoi(argv[++i]));
+        } else if (arg == "--scratch" && hasValue) {
+            options.scratchDirectory = argv[++i];
+        } else {
+            printUsage();
+            return false;
+        }
+    }
+    if (options.threadCounts.empty()) {
+        options.threadCounts.push_back(1);
+        if (hardwareThreadCount() > 1) {
+            options.threadCounts.push_back(hardwareThreadCount());
+        }
+    }
+    return true;
+}
+
+// Pooled width x height image with fresh headers and a deterministic, incompressible-looking pattern
+static bool makeSyntheticImage(int width, int height, int bytesPerPixel, Image& image) {
+    Image headerSource;
+    memset(&headerSource.fileHeader, 0, sizeof(headerSource.fileHeader));
+    memset(&headerSource.infoHeader, 0, sizeof(headerSource.infoHeader));
+    headerSource.fileHeader.bfType = BMP_SIGNATURE;
+    headerSource.infoHeader.biSize = sizeof(BMPInfoHeader);
+    headerSource.infoHeader.biWidth = width;
+    headerSource.infoHeader.biHeight = height;
+    headerSource.infoHeader.biPlanes = 1;
+    headerSource.infoHeader.biBitCount = static_cast<uint16_t>(bytesPerPixel * 8);
+    if (!validateBMPHeaders(headerSource)) {
+        return false;
+    }
+    createImageLike(headerSource, width, height, image);
+    if (image.pixelData == nullptr) {
+        cerr << "Out of memory." << endl;
+        return false;
+    }
+
+    // xorshift noise over a gradient: every byte differs, but neighbouring pixels stay correlated
+    uint32_t state = 0x9E3779B9u;
+    for (int y = 0; y < height; ++y) {
+        uint8_t* row = image.row(y);
+        for (int x = 0; x < width * bytesPerPixel; ++x) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            row[x] = static_cast<uint8_t>(((x + y) >> 2) + (state & 31));
+        }
+    }
+    return true;
+}
+
+// Time-stamp counter, or 0 where none is available
+static inline uint64_t readCycleCounter() {
+#if defined(BMP_HAVE_TSC)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// Run `body` for the warm-up and measured iterations; `reset` (untimed) restores the input before each run
+static void measure(const BenchmarkOptions& options, BenchmarkResult& result, const function<void()>& body,
+                    const function<void()>& reset = nullptr) {
+    for (int i = 0; i < WARMUP_ITERATIONS + options.iterations; ++i) {
+        if (reset) {
+            reset();
+        }
+        auto start = chrono::steady_clock::now();
+        uint64_t startCycles = readCycleCounter();
+        body();
+        uint64_t endCycles = readCycleCounter();
+        auto end = chrono::steady_clock::now();
+        if (i >= WARMUP_ITERATIONS) {
+            result.seconds.push_back(chrono::duration<double>(end - start).count());
+            result.cycles.push_back(static_cast<double>(endCycles - startCycles));
+        }
+    }
+}
+
+// Nearest-rank percentile of the samples
+static double percentile(vector<double> samples, double fraction) {
+    sort(samples.begin(), samples.end());
+    size_t rank = static_cast<size_t>(ceil(fraction * samples.size()));
+    return samples[rank == 0 ? 0 : rank - 1];
+}
+
+// SIMD levels this CPU can run, from scalar up to simdLevel()
+static vector<SimdLevel> availableSimdLevels() {
+    SimdLevel best = simdLevel();
+    vector<SimdLevel> levels = { SIMD_SCALAR };
+    if (best == SIMD_NEON) {
+        levels.push_back(SIMD_NEON);
+        return levels;
+    }
+    for (SimdLevel level : { SIMD_SSE41, SIMD_AVX2, SIMD_AVX512 }) {
+        if (level <= best) {
+            levels.push_back(level);
+        }
+    }
+    return levels;
+}
+
+static bool hasCase(const BenchmarkOptions& options, const string& name) {
+    return find(options.cases.begin(), options.cases.end(), name) != options.cases.end();
+}
+
+// Benchmark every requested case on one image, appending a result per configuration
+static bool benchmarkImage(const BenchmarkOptions& options, const string& imageName, const string& fileName,
+                           Image& image, vector<BenchmarkResult>& results) {
+    BenchmarkResult base;
+    base.image = imageName;
+    base.width = image.width;
+    base.height = image.height;
+    base.bitCount = image.bytesPerPixel * 8;
+    base.pixels = static_cast<uint64_t>(image.width) * image.height;
+    base.simd = simdLevelName(simdLevel());
+
+    // Kernels as the tools call them, at every thread count
+    Image pristine(image);
+    for (int threads : options.threadCounts) {
+        base.threads = threads;
+        if (hasCase(options, "flip")) {
+            BenchmarkResult result = base;
+            result.caseName = "flip";
+            result.bytes = image.pixelBytes();
+            measure(options, result, [&]() {
+                flipHorizontally(image.pixelData, image.width, image.height, image.stride, image.bytesPerPixel, threads);
+            });
+            results.push_back(result);
+        }
+        if (hasCase(options, "quantize")) {
+            for (int bits : options.quantizationBits) {
+                BenchmarkResult result = base;
+                result.caseName = "quantize";
+                result.quantizationBits = bits;
+                result.bytes = image.pixelBytes();
+                measure(options, result, [&]() {
+                    quantizePixelData(image.pixelData, image.bytesPerPixel, image.width, image.height, image.stride, bits, threads);
+                }, [&]() {
+                    memcpy(image.pixelBase(), pristine.pixelBase(), image.pixelBytes());
+                });
+                results.push_back(result);
+            }
+        }
+        if (hasCase(options, "planar") && image.bytesPerPixel >= 3) {
+            // The planar path split into its stages: color planes only, quantized in place, alpha left in the image
+            PlanarImage planar;
+            BenchmarkResult deinterleaveResult = base;
+            deinterleaveResult.caseName = "deinterleave";
+            deinterleaveResult.bytes = image.pixelBytes();
+            measure(options, deinterleaveResult, [&]() {
+                deinterleaveImage(viewOf(image), false, planar, threads);
+            });
+            results.push_back(deinterleaveResult);
+            for (int bits : options.quantizationBits) {
+                BenchmarkResult result = base;
+                result.caseName = "quantize-planes";
+                result.quantizationBits = bits;
+                result.bytes = image.pixelBytes();
+                measure(options, result, [&]() {
+                    quantizePlanes(planar, planar, bits, threads);
+                }, [&]() {
+                    deinterleaveImage(viewOf(image), false, planar, threads);
+                });
+                results.push_back(result);
+            }
+            BenchmarkResult interleaveResult = base;
+            interleaveResult.caseName = "interleave";
+            interleaveResult.bytes = image.pixelBytes();
+            measure(options, interleaveResult, [&]() {
+                interleaveImage(planar, viewOf(image), threads);
+            }, [&]() {
+                deinterleaveImage(viewOf(image), false, planar, threads);
+            });
+            results.push_back(interleaveResult);
+        }
+        if (hasCase(options, "crop")) {
+            // Centered ROI of half the width and height
+            Image cropped;
+            createImageLike(image, max(1, image.width / 2), max(1, image.height / 2), cropped);
+            if (cropped.pixelData == nullptr) {
+                cerr << "Out of memory." << endl;
+                return false;
+            }
+            BenchmarkResult result = base;
+            result.caseName = "crop";
+            result.bytes = cropped.pixelBytes();
+            result.pixels = static_cast<uint64_t>(cropped.width) * cropped.height;
+            measure(options, result, [&]() {
+                cropImage(image.pixelData, cropped.pixelData, image.width, image.height, image.bytesPerPixel, image.stride,
+                          image.width / 4, image.height / 4, cropped.width, cropped.height, threads);
+            });
+            results.push_back(result);
+        }
+        if (hasCase(options, "resize")) {
+            // Whole image to half size with each filter (the thumbnail workload)
+            Image resized;
+            createImageLike(image, max(1, image.width / 2), max(1, image.height / 2), resized);
+            if (resized.pixelData == nullptr) {
+                cerr << "Out of memory." << endl;
+                return false;
+            }
+            const ResizeFilter filters[] = { RESIZE_BOX, RESIZE_BILINEAR, RESIZE_LANCZOS };
+            const char* filterNames[] = { "resize-box", "resize-bilinear", "resize-lanczos" };
+            for (int f = 0; f < 3; ++f) {
+                BenchmarkResult result = base;
+                result.caseName = filterNames[f];
+                result.bytes = image.pixelBytes();
+                measure(options, result, [&]() {
+                    resizeImage(image.pixelData, resized.pixelData, image.bytesPerPixel, image.stride, 0, 0, image.width, image.height,
+                                resized.width, resized.height, filters[f], threads);
+                });
+                results.push_back(result);
+            }
+        }
+    }
+
+    // Row kernels at each SIMD level, single-threaded, so vector speedups are visible on their own
+    if (hasCase(options, "simd")) {
+        base.threads = 1;
+        for (SimdLevel level : availableSimdLevels()) {
+            base.simd = simdLevelName(level);
+            FlipRowKernel flipRow = flipRowKernelFor(level, image.bytesPerPixel);
+            BenchmarkResult flipResult = base;
+            flipResult.caseName = "flip-row";
+            flipResult.bytes = image.pixelBytes();
+            measure(options, flipResult, [&]() {
+                for (int y = 0; y < image.height; ++y) {
+                    flipRow(image.row(y), image.width, image.bytesPerPixel);
+                }
+            });
+            results.push_back(flipResult);
+
+            for (int bits : options.quantizationBits) {
+                QuantizationTable table;
+                buildQuantizationTable(bits, table);
+                QuantizeRowKernel quantizeRow = quantizeRowKernelFor(level, table, image.bytesPerPixel);
+                BenchmarkResult result = base;
+                result.caseName = "quantize-row";
+                result.quantizationBits = bits;
+                result.bytes = image.pixelBytes();
+                measure(options, result, [&]() {
+                    for (int y = 0; y < image.height; ++y) {
+                        quantizeRow(image.row(y), image.row(y), image.width, image.bytesPerPixel, table);
+                    }
+                }, [&]() {
+                    memcpy(image.pixelBase(), pristine.pixelBase(), image.pixelBytes());
+                });
+                results.push_back(result);
+            }
+        }
+        base.simd = simdLevelName(simdLevel());
+    }
+
+    // Whole-file paths (page cache warm after the first iteration)
+    if (hasCase(options, "io")) {
+        base.threads = 1;
+        string outputName = options.scratchDirectory + "/bmp_benchmark_output.bmp";
+        string inputName = fileName;
+        if (inputName.empty()) {
+            // Synthetic images are written once so the load paths have a file to read
+            inputName = options.scratchDirectory + "/bmp_benchmark_input.bmp";
+            if (!saveBMP(inputName.c_str(), image)) {
+                return false;
+            }
+        }
+        bool failed = false;
+
+        BenchmarkResult loadResult = base;
+        loadResult.caseName = "load";
+        loadResult.bytes = image.pixelBytes();
+        measure(options, loadResult, [&]() {
+            Image loaded;
+            failed = !loadBMP(inputName.c_str(), loaded) || failed;
+        });
+        results.push_back(loadResult);
+
+        // Mapping faults pages in lazily, so this includes one read pass over the pixels
+        BenchmarkResult mappedResult = base;
+        mappedResult.caseName = "load-mapped";
+        mappedResult.bytes = image.pixelBytes();
+        volatile uint8_t sink = 0;
+        measure(options, mappedResult, [&]() {
+            Image loaded;
+            if (!loadBMPMapped(inputName.c_str(), loaded)) {
+                failed = true;
+                return;
+            }
+            uint8_t sum = 0;
+            for (size_t offset = 0; offset < loaded.pixelBytes(); offset += 64) {
+                sum = static_cast<uint8_t>(sum + loaded.pixelBase()[offset]);
+            }
+            sink = sum;
+        });
+        results.push_back(mappedResult);
+
+        // Positioned reads of a small centered ROI: cost follows the ROI, not the file
+        int regionWidth = min(64, image.width);
+        int regionHeight = min(64, image.height);
+        BenchmarkResult regionResult = base;
+        regionResult.caseName = "load-region";
+        regionResult.bytes = static_cast<uint64_t>(regionWidth) * image.bytesPerPixel * regionHeight;
+        regionResult.pixels = static_cast<uint64_t>(regionWidth) * regionHeight;
+        measure(options, regionResult, [&]() {
+            Image region;
+            failed = !loadBMPRegion(inputName.c_str(), (image.width - regionWidth) / 2, (image.height - regionHeight) / 2,
+                                    regionWidth, regionHeight, region) || failed;
+        });
+        results.push_back(regionResult);
+
+        BenchmarkResult saveResult = base;
+        saveResult.caseName = "save";
+        saveResult.bytes = image.pixelBytes();
+        measure(options, saveResult, [&]() {
+            failed = !saveBMP(outputName.c_str(), image) || failed;
+        });
+        results.push_back(saveResult);
+
+        BenchmarkResult streamResult = base;
+        streamResult.caseName = "stream-flip";
+        streamResult.bytes = image.pixelBytes();
+        measure(options, streamResult, [&]() {
+            failed = !streamFlipHorizontally(inputName.c_str(), outputName.c_str(), DEFAULT_BAND_ROWS) || failed;
+        });
+        results.push_back(streamResult);
+
+        remove(outputName.c_str());
+        if (fileName.empty()) {
+            remove(inputName.c_str());
+        }
+        if (failed) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Escape a string for use inside JSON quotes
+static string jsonEscape(const string& text) {
+    string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", static_cast<unsigned char>(c));
+            escaped += code;
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+// Print the results as one JSON document: run metadata plus one object per configuration
+static void printJSON(const vector<BenchmarkResult>& results, const BenchmarkOptions& options) {
+    printf("{\n  \"simd\": \"%s\",\n  \"hardware_threads\": %d,\n  \"iterations\": %d,\n  \"cycle_counter\": %s,\n  \"results\": [\n",
+           simdLevelName(simdLevel()), hardwareThreadCount(), options.iterations,
+#if defined(BMP_HAVE_TSC)
+           "\"tsc\"");
+#else
+           "null");
+#endif
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchmarkResult& result = results[i];
+        double p50 = percentile(result.seconds, 0.50);
+        printf("    {\"case\": \"%s\", \"image\": \"%s\", \"width\": %d, \"height\": %d, \"bpp\": %d, \"threads\": %d, \"simd\": \"%s\", ",
+               jsonEscape(result.caseName).c_str(), jsonEscape(result.image).c_str(), result.width, result.height, result.bitCount,
+               result.threads, jsonEscape(result.simd).c_str());
+        if (result.quantizationBits > 0) {
+            printf("\"bits\": %d, ", result.quantizationBits);
+        } else {
+            printf("\"bits\": null, ");
+        }
+        printf("\"bytes\": %llu, \"mb_per_s\": %.2f, \"pixels_per_s\": %.0f, ",
+               static_cast<unsigned long long>(result.bytes), result.bytes / p50 / 1e6,
+               static_cast<double>(result.pixels) / p50);
+#if defined(BMP_HAVE_TSC)
+        printf("\"cycles_per_byte\": %.3f, ", percentile(result.cycles, 0.50) / result.bytes);
+#else
+        printf("\"cycles_per_byte\": null, ");
+#endif
+        printf("\"p50_ms\": %.4f, \"p99_ms\": %.4f, \"min_ms\": %.4f}%s\n",
+               p50 * 1e3, percentile(result.seconds, 0.99) * 1e3, percentile(result.seconds, 0.0) * 1e3,
+               i + 1 < results.size() ? "," : "");
+    }
+    printf("  ]\n}\n");
+}
+
+// Print the results as an aligned table
+static void printTable(const vector<BenchmarkResult>& results) {
+    printf("%-15s %-22s %-11s %4s %4s %4s %-7s %10s %12s %8s %10s %10s\n",
+           "case", "image", "size", "bpp", "bits", "thr", "simd", "MB/s", "Mpixel/s", "cyc/B", "p50 ms", "p99 ms");
+    for (const BenchmarkResult& result : results) {
+        double p50 = percentile(result.seconds, 0.50);
+        string size = to_string(result.width) + "x" + to_string(result.height);
+        string bits = result.quantizationBits > 0 ? to_string(result.quantizationBits) : "-";
+#if defined(BMP_HAVE_TSC)
+        char cyclesPerByte[32];
+        snprintf(cyclesPerByte, sizeof(cyclesPerByte), "%.3f", percentile(result.cycles, 0.50) / result.bytes);
+#else
+        const char* cyclesPerByte = "-";
+#endif
+        printf("%-15s %-22s %-11s %4d %4s %4d %-7s %10.1f %12.1f %8s %10.3f %10.3f\n",
+               result.caseName.c_str(), result.image.c_str(), size.c_str(), result.bitCount, bits.c_str(), result.threads,
+               result.simd.c_str(), result.bytes / p50 / 1e6, static_cast<double>(result.pixels) / p50 / 1e6,
+               cyclesPerByte, p50 * 1e3, percentile(result.seconds, 0.99) * 1e3);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    BenchmarkOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        return 1;
+    }
+
+    vector<BenchmarkResult> results;
+
+    // Fixture images, loaded into pooled buffers so every kernel works on heap memory
+    for (const string& fileName : options.images) {
+        Image image;
+        if (!loadBMP(fileName.c_str(), image) || !benchmarkImage(options, fileName, fileName, image, results)) {
+            return 1;
+        }
+    }
+
+    // Synthetic images for every size and pixel size
+    for (size_t i = 0; i + 1 < options.sizes.size(); i += 2) {
+        for (int bytesPerPixel : options.bytesPerPixel) {
+            Image image;
+            if (!makeSyntheticImage(options.sizes[i], options.sizes[i + 1], bytesPerPixel, image)) {
+                return 1;
+            }
+            string name = "synthetic";
+            if (!benchmarkImage(options, name, "", image, results)) {
+                return 1;
+            }
+        }
+    }
+
+    if (options.json) {
+        printJSON(results, options);
+    } else {
+        printTable(results);
+    }
+    return 0;
+}
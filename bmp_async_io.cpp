@@ -0,0 +1,724 @@
+#include "bmp_async_io.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+// pwritev is in every current Linux and BSD libc; macOS only gained it in 11, so it takes the slice loop
+#if !defined(_WIN32) && !defined(__APPLE__)
+#define BMP_HAVE_PWRITEV 1
+#endif
+
+// io_uring is used through its raw syscalls, so only the kernel UAPI header is needed (no liburing)
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define BMP_HAVE_IO_URING 1
+#endif
+#endif
+#endif
+
+using namespace std;
+
+// ---------------------------------------------------------------------------
+// Blocking positional I/O (sync backend, I/O thread, and completion of short transfers)
+// ---------------------------------------------------------------------------
+
+// Transfer exactly `length` bytes at `offset`. Returns false on error or end of file.
+static bool transferFully(int fd, bool isWrite, uint8_t* buffer, size_t length, uint64_t offset) {
+#ifdef _WIN32
+    // Each file's requests are executed by one thread at a time, so seek + read/write is safe here
+    if (_lseeki64(fd, static_cast<__int64>(offset), SEEK_SET) < 0) {
+        return false;
+    }
+    while (length > 0) {
+        unsigned int chunk = static_cast<unsigned int>(min(length, static_cast<size_t>(INT_MAX)));
+        int done = isWrite ? _write(fd, buffer, chunk) : _read(fd, buffer, chunk);
+        if (done <= 0) {
+            return false;
+        }
+        buffer += done;
+        length -= done;
+    }
+#else
+    while (length > 0) {
+        ssize_t done = isWrite ? pwrite(fd, buffer, length, static_cast<off_t>(offset))
+                               : pread(fd, buffer, length, static_cast<off_t>(offset));
+        if (done < 0 && errno == EINTR) {
+            continue;
+        }
+        if (done <= 0) {
+            return false;
+        }
+        buffer += done;
+        length -= static_cast<size_t>(done);
+        offset += static_cast<uint64_t>(done);
+    }
+#endif
+    return true;
+}
+
+// One queued read or write
+struct Request {
+    bool isWrite = false;
+    uint8_t* buffer = nullptr;
+    size_t length = 0;
+    uint64_t offset = 0;
+    bool done = false;
+    bool ok = false;
+};
+
+// ---------------------------------------------------------------------------
+// io_uring ring (raw syscalls)
+// ---------------------------------------------------------------------------
+
+#if defined(BMP_HAVE_IO_URING)
+
+// Largest transfer handed to a single SQE; the remainder of longer requests is finished synchronously
+const size_t URING_MAX_TRANSFER = size_t(1) << 30;
+
+struct IoUring {
+    int fd = -1;
+    unsigned entries = 0;
+    unsigned inFlight = 0;
+
+    void* sqRing = nullptr;
+    size_t sqRingSize = 0;
+    void* cqRing = nullptr;
+    size_t cqRingSize = 0;
+    io_uring_sqe* sqes = nullptr;
+    size_t sqesSize = 0;
+
+    unsigned* sqTail = nullptr;
+    unsigned* sqArray = nullptr;
+    unsigned sqMask = 0;
+    unsigned* cqHead = nullptr;
+    unsigned* cqTail = nullptr;
+    unsigned cqMask = 0;
+    io_uring_cqe* cqes = nullptr;
+
+    bool setup(unsigned queueDepth);
+    void teardown();
+    int enter(unsigned toSubmit, unsigned minComplete, unsigned flags);
+};
+
+int IoUring::enter(unsigned toSubmit, unsigned minComplete, unsigned flags) {
+    int result;
+    do {
+        result = static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+    } while (result < 0 && (errno == EINTR || errno == EAGAIN));
+    return result;
+}
+
+bool IoUring::setup(unsigned queueDepth) {
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    fd = static_cast<int>(syscall(__NR_io_uring_setup, queueDepth, &params));
+    if (fd < 0) {
+        // ENOSYS on old kernels, EPERM when disabled by policy or a seccomp filter
+        return false;
+    }
+
+    // Map the submission ring, the completion ring (one mapping on newer kernels) and the SQE array
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMapping = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMapping) {
+        sqRingSize = cqRingSize = max(sqRingSize, cqRingSize);
+    }
+    sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED) {
+        sqRing = nullptr;
+        teardown();
+        return false;
+    }
+    if (singleMapping) {
+        cqRing = sqRing;
+    } else {
+        cqRing = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (cqRing == MAP_FAILED) {
+            cqRing = nullptr;
+            teardown();
+            return false;
+        }
+    }
+    sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void* sqeMapping = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (sqeMapping == MAP_FAILED) {
+        teardown();
+        return false;
+    }
+    sqes = static_cast<io_uring_sqe*>(sqeMapping);
+
+    uint8_t* sq = static_cast<uint8_t*>(sqRing);
+    uint8_t* cq = static_cast<uint8_t*>(cqRing);
+    sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    entries = params.sq_entries;
+    return true;
+}
+
+void IoUring::teardown() {
+    if (sqes != nullptr) {
+        munmap(sqes, sqesSize);
+    }
+    if (cqRing != nullptr && cqRing != sqRing) {
+        munmap(cqRing, cqRingSize);
+    }
+    if (sqRing != nullptr) {
+        munmap(sqRing, sqRingSize);
+    }
+    if (fd >= 0) {
+        ::close(fd);
+    }
+    *this = IoUring();
+}
+
+#endif // BMP_HAVE_IO_URING
+
+// ---------------------------------------------------------------------------
+// Backend selection
+// ---------------------------------------------------------------------------
+
+const char* asyncIOBackendName(AsyncIOBackend backend) {
+    switch (backend) {
+        case ASYNC_IO_THREAD: return "thread";
+        case ASYNC_IO_URING:  return "io_uring";
+        default:              return "sync";
+    }
+}
+
+// Whether this kernel lets us create a ring at all (probed once)
+static bool ioUringAvailable() {
+#if defined(BMP_HAVE_IO_URING)
+    static const bool available = [] {
+        IoUring probe;
+        bool created = probe.setup(1);
+        probe.teardown();
+        return created;
+    }();
+    return available;
+#else
+    return false;
+#endif
+}
+
+AsyncIOBackend preferredAsyncIOBackend() {
+    static const AsyncIOBackend backend = [] {
+        const char* requested = getenv("BMP_IO");
+        if (requested != nullptr && *requested != '\0') {
+            if (strcmp(requested, "sync") == 0) {
+                return ASYNC_IO_SYNC;
+            }
+            if (strcmp(requested, "thread") == 0) {
+                return ASYNC_IO_THREAD;
+            }
+            if (strcmp(requested, "io_uring") == 0) {
+                if (!ioUringAvailable()) {
+                    cerr << "io_uring is not available; using the I/O thread." << endl;
+                    return ASYNC_IO_THREAD;
+                }
+                return ASYNC_IO_URING;
+            }
+            cerr << "Unknown BMP_IO backend \"" << requested << "\" (expected sync, thread or io_uring); using the default." << endl;
+        }
+        return ioUringAvailable() ? ASYNC_IO_URING : ASYNC_IO_THREAD;
+    }();
+    return backend;
+}
+
+// ---------------------------------------------------------------------------
+// AsyncFile
+// ---------------------------------------------------------------------------
+
+// Requests kept in flight per ring; the streaming pipeline needs only a few per file
+const unsigned ASYNC_QUEUE_DEPTH = 16;
+
+struct AsyncFile::State {
+    AsyncIOBackend backend = ASYNC_IO_SYNC;
+    int fd = -1;
+    int nextId = 0;
+    map<int, Request> requests;   // Submitted and not yet waited for (node addresses are stable)
+
+    // I/O thread backend
+    thread worker;
+    mutex lock;
+    condition_variable wake;
+    condition_variable completed;
+    deque<int> queue;
+    bool stopping = false;
+
+#if defined(BMP_HAVE_IO_URING)
+    IoUring ring;
+#endif
+
+    void workerLoop();
+    bool submit(int id, Request& request);
+    bool waitFor(int id);
+#if defined(BMP_HAVE_IO_URING)
+    void reapCompletions();
+#endif
+};
+
+void AsyncFile::State::workerLoop() {
+    unique_lock<mutex> guard(lock);
+    while (true) {
+        wake.wait(guard, [this] { return stopping || !queue.empty(); });
+        if (queue.empty()) {
+            return;
+        }
+        int id = queue.front();
+        queue.pop_front();
+        Request& request = requests[id];
+
+        // Run the transfer without the lock so the caller can keep submitting
+        guard.unlock();
+        bool ok = transferFully(fd, request.isWrite, request.buffer, request.length, request.offset);
+        guard.lock();
+
+        request.ok = ok;
+        request.done = true;
+        completed.notify_all();
+    }
+}
+
+#if defined(BMP_HAVE_IO_URING)
+
+// Move every posted completion into its request; short or failed transfers are finished synchronously
+void AsyncFile::State::reapCompletions() {
+    unsigned head = *ring.cqHead;
+    unsigned tail = __atomic_load_n(ring.cqTail, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+        const io_uring_cqe& cqe = ring.cqes[head & ring.cqMask];
+        Request& request = requests[static_cast<int>(cqe.user_data)];
+        size_t transferred = cqe.res > 0 ? static_cast<size_t>(cqe.res) : 0;
+
+        // An error (e.g. -EINVAL from a kernel without IORING_OP_READ) redoes the whole request here
+        request.ok = transferred == request.length ||
+                     transferFully(fd, request.isWrite, request.buffer + transferred,
+                                   request.length - transferred, request.offset + transferred);
+        request.done = true;
+        --ring.inFlight;
+    }
+    __atomic_store_n(ring.cqHead, head, __ATOMIC_RELEASE);
+}
+
+#endif // BMP_HAVE_IO_URING
+
+bool AsyncFile::State::submit(int id, Request& request) {
+    switch (backend) {
+        case ASYNC_IO_THREAD: {
+            lock_guard<mutex> guard(lock);
+            queue.push_back(id);
+            wake.notify_one();
+            return true;
+        }
+#if defined(BMP_HAVE_IO_URING)
+        case ASYNC_IO_URING: {
+            // Make room first: never more requests in flight than the rings can hold
+            while (ring.inFlight >= ring.entries) {
+                if (ring.enter(0, 1, IORING_ENTER_GETEVENTS) < 0) {
+                    return false;
+                }
+                reapCompletions();
+            }
+
+            unsigned tail = *ring.sqTail;
+            unsigned index = tail & ring.sqMask;
+            io_uring_sqe& sqe = ring.sqes[index];
+            memset(&sqe, 0, sizeof(sqe));
+            sqe.opcode = request.isWrite ? IORING_OP_WRITE : IORING_OP_READ;
+            sqe.fd = fd;
+            sqe.addr = reinterpret_cast<uint64_t>(request.buffer);
+            sqe.len = static_cast<uint32_t>(min(request.length, URING_MAX_TRANSFER));
+            sqe.off = request.offset;
+            sqe.user_data = static_cast<uint64_t>(id);
+            ring.sqArray[index] = index;
+            __atomic_store_n(ring.sqTail, tail + 1, __ATOMIC_RELEASE);
+
+            if (ring.enter(1, 0, 0) < 1) {
+                // Not consumed by the kernel: withdraw the entry so it never touches the caller's buffer
+                __atomic_store_n(ring.sqTail, tail, __ATOMIC_RELEASE);
+                return false;
+            }
+            ++ring.inFlight;
+            return true;
+        }
+#endif
+        default:
+            request.ok = transferFully(fd, request.isWrite, request.buffer, request.length, request.offset);
+            request.done = true;
+            return true;
+    }
+}
+
+bool AsyncFile::State::waitFor(int id) {
+    map<int, Request>::iterator found = requests.find(id);
+    if (found == requests.end()) {
+        return false;
+    }
+    Request& request = found->second;
+
+    if (backend == ASYNC_IO_THREAD) {
+        unique_lock<mutex> guard(lock);
+        completed.wait(guard, [&request] { return request.done; });
+    }
+#if defined(BMP_HAVE_IO_URING)
+    else if (backend == ASYNC_IO_URING) {
+        reapCompletions();
+        while (!request.done) {
+            if (ring.enter(0, 1, IORING_ENTER_GETEVENTS) < 0) {
+                return false;
+            }
+            reapCompletions();
+        }
+    }
+#endif
+
+    bool ok = request.ok;
+    if (backend == ASYNC_IO_THREAD) {
+        lock_guard<mutex> guard(lock);
+        requests.erase(found);
+    } else {
+        requests.erase(found);
+    }
+    return ok;
+}
+
+AsyncFile::AsyncFile() = default;
+
+AsyncFile::~AsyncFile() {
+    close();
+}
+
+bool AsyncFile::open(const char* fileName, bool forWrite) {
+    close();
+
+#ifdef _WIN32
+    int fd = forWrite ? _open(fileName, _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE)
+                      : _open(fileName, _O_RDONLY | _O_BINARY);
+#else
+    int fd = forWrite ? ::open(fileName, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)
+                      : ::open(fileName, O_RDONLY | O_CLOEXEC);
+#endif
+    if (fd < 0) {
+        return false;
+    }
+
+    state.reset(new State());
+    state->fd = fd;
+    state->backend = preferredAsyncIOBackend();
+
+#if defined(BMP_HAVE_IO_URING)
+    if (state->backend == ASYNC_IO_URING && !state->ring.setup(ASYNC_QUEUE_DEPTH)) {
+        state->backend = ASYNC_IO_THREAD;
+    }
+#else
+    if (state->backend == ASYNC_IO_URING) {
+        state->backend = ASYNC_IO_THREAD;
+    }
+#endif
+
+    if (state->backend == ASYNC_IO_THREAD) {
+        State* owner = state.get();
+        state->worker = thread([owner] { owner->workerLoop(); });
+    }
+    return true;
+}
+
+bool AsyncFile::openRead(const char* fileName) {
+    return open(fileName, false);
+}
+
+bool AsyncFile::openWrite(const char* fileName) {
+    return open(fileName, true);
+}
+
+int AsyncFile::submit(bool isWrite, uint8_t* buffer, size_t length, uint64_t offset) {
+    if (!state) {
+        return -1;
+    }
+    int id = state->nextId++;
+    Request* request;
+    {
+        lock_guard<mutex> guard(state->lock);
+        request = &state->requests[id];
+    }
+    request->isWrite = isWrite;
+    request->buffer = buffer;
+    request->length = length;
+    request->offset = offset;
+
+    if (!state->submit(id, *request)) {
+        lock_guard<mutex> guard(state->lock);
+        state->requests.erase(id);
+        return -1;
+    }
+    return id;
+}
+
+int AsyncFile::read(void* dest, size_t length, uint64_t offset) {
+    return submit(false, static_cast<uint8_t*>(dest), length, offset);
+}
+
+int AsyncFile::write(const void* src, size_t length, uint64_t offset) {
+    // The buffer is only read from for writes
+    return submit(true, static_cast<uint8_t*>(const_cast<void*>(src)), length, offset);
+}
+
+bool AsyncFile::wait(int id) {
+    return state && state->waitFor(id);
+}
+
+bool AsyncFile::drain() {
+    if (!state) {
+        return true;
+    }
+    vector<int> pending;
+    {
+        lock_guard<mutex> guard(state->lock);
+        for (const auto& entry : state->requests) {
+            pending.push_back(entry.first);
+        }
+    }
+    bool ok = true;
+    for (int id : pending) {
+        ok = state->waitFor(id) && ok;
+    }
+    return ok;
+}
+
+bool AsyncFile::close() {
+    if (!state) {
+        return true;
+    }
+
+    // Nothing may still target caller buffers once the file is gone
+    bool ok = drain();
+
+    if (state->worker.joinable()) {
+        {
+            lock_guard<mutex> guard(state->lock);
+            state->stopping = true;
+        }
+        state->wake.notify_all();
+        state->worker.join();
+    }
+#if defined(BMP_HAVE_IO_URING)
+    state->ring.teardown();
+#endif
+
+#ifdef _WIN32
+    ok = (_close(state->fd) == 0) && ok;
+#else
+    ok = (::close(state->fd) == 0) && ok;
+#endif
+    state.reset();
+    return ok;
+}
+
+bool AsyncFile::isOpen() const {
+    return static_cast<bool>(state);
+}
+
+AsyncIOBackend AsyncFile::backend() const {
+    return state ? state->backend : ASYNC_IO_SYNC;
+}
+
+// ---------------------------------------------------------------------------
+// Blocking positional file
+// ---------------------------------------------------------------------------
+
+PositionedFile::~PositionedFile() {
+    close();
+}
+
+bool PositionedFile::openRead(const char* fileName) {
+    close();
+#ifdef _WIN32
+    fd = _open(fileName, _O_RDONLY | _O_BINARY);
+#else
+    fd = ::open(fileName, O_RDONLY | O_CLOEXEC);
+#endif
+    return fd >= 0;
+}
+
+bool PositionedFile::openWrite(const char* fileName) {
+    close();
+#ifdef _WIN32
+    fd = _open(fileName, _O_RDWR | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    fd = ::open(fileName, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+#endif
+    return fd >= 0;
+}
+
+bool PositionedFile::openDirectWrite(const char* fileName) {
+    close();
+#if !defined(_WIN32) && defined(O_DIRECT)
+    fd = ::open(fileName, O_WRONLY | O_DIRECT | O_CLOEXEC);
+    return fd >= 0;
+#else
+    (void)fileName;
+    return false;
+#endif
+}
+
+bool PositionedFile::read(void* dest, size_t length, uint64_t offset) {
+    return fd >= 0 && transferFully(fd, false, static_cast<uint8_t*>(dest), length, offset);
+}
+
+bool PositionedFile::write(const void* src, size_t length, uint64_t offset) {
+    return fd >= 0 && transferFully(fd, true, const_cast<uint8_t*>(static_cast<const uint8_t*>(src)), length, offset);
+}
+
+// Slices handed to one pwritev call (the Linux IOV_MAX)
+const size_t GATHER_MAX_SLICES = 1024;
+
+bool PositionedFile::writeGather(const WriteSlice* slices, size_t count, uint64_t offset) {
+    if (fd < 0) {
+        return false;
+    }
+#if defined(BMP_HAVE_PWRITEV)
+    // `next` is the first slice not yet fully written and `skip` the bytes of it already written
+    vector<iovec> vectors;
+    vectors.reserve(min(count, GATHER_MAX_SLICES));
+    size_t next = 0;
+    size_t skip = 0;
+    while (next < count) {
+        vectors.clear();
+        for (size_t i = next; i < count && vectors.size() < GATHER_MAX_SLICES; ++i) {
+            size_t done = i == next ? skip : 0;
+            if (slices[i].length > done) {
+                vectors.push_back(iovec{const_cast<uint8_t*>(static_cast<const uint8_t*>(slices[i].data)) + done, slices[i].length - done});
+            }
+        }
+        if (vectors.empty()) {
+            break;
+        }
+        ssize_t written = pwritev(fd, vectors.data(), static_cast<int>(vectors.size()), static_cast<off_t>(offset));
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+
+        // Advance past the written bytes; a short write resumes inside a slice
+        offset += static_cast<uint64_t>(written);
+        size_t remaining = static_cast<size_t>(written);
+        while (next < count && remaining >= slices[next].length - skip) {
+            remaining -= slices[next].length - skip;
+            ++next;
+            skip = 0;
+        }
+        skip += remaining;
+    }
+    return true;
+#else
+    for (size_t i = 0; i < count; ++i) {
+        if (!write(slices[i].data, slices[i].length, offset)) {
+            return false;
+        }
+        offset += slices[i].length;
+    }
+    return true;
+#endif
+}
+
+bool PositionedFile::resize(uint64_t size) {
+    if (fd < 0) {
+        return false;
+    }
+#ifdef _WIN32
+    return _chsize_s(fd, static_cast<__int64>(size)) == 0;
+#else
+    return ftruncate(fd, static_cast<off_t>(size)) == 0;
+#endif
+}
+
+bool PositionedFile::preallocate(uint64_t size) {
+    if (fd < 0) {
+        return false;
+    }
+#if defined(__linux__)
+    // Allocates the extents in one call; unsupported on some file systems, which then just get the size
+    if (fallocate(fd, 0, 0, static_cast<off_t>(size)) == 0) {
+        return true;
+    }
+#endif
+    return resize(size);
+}
+
+uint64_t PositionedFile::size() const {
+#ifdef _WIN32
+    struct _stat64 fileStat;
+    return (fd >= 0 && _fstat64(fd, &fileStat) == 0) ? static_cast<uint64_t>(fileStat.st_size) : 0;
+#else
+    struct stat fileStat;
+    return (fd >= 0 && fstat(fd, &fileStat) == 0) ? static_cast<uint64_t>(fileStat.st_size) : 0;
+#endif
+}
+
+bool PositionedFile::close() {
+    if (fd < 0) {
+        return true;
+    }
+#ifdef _WIN32
+    bool ok = _close(fd) == 0;
+#else
+    bool ok = ::close(fd) == 0;
+#endif
+    fd = -1;
+    return ok;
+}
+
+bool fileStamp(const char* fileName, uint64_t& size, int64_t& modified) {
+#ifdef _WIN32
+    struct _stat64 fileStat;
+    if (_stat64(fileName, &fileStat) != 0) {
+        return false;
+    }
+    modified = static_cast<int64_t>(fileStat.st_mtime) * 1000000000;
+#else
+    struct stat fileStat;
+    if (stat(fileName, &fileStat) != 0) {
+        return false;
+    }
+#if defined(__APPLE__)
+    modified = static_cast<int64_t>(fileStat.st_mtimespec.tv_sec) * 1000000000 + fileStat.st_mtimespec.tv_nsec;
+#else
+    modified = static_cast<int64_t>(fileStat.st_mtim.tv_sec) * 1000000000 + fileStat.st_mtim.tv_nsec;
+#endif
+#endif
+    size = static_cast<uint64_t>(fileStat.st_size);
+    return true;
+}
@@ -0,0 +1,131 @@
+#ifndef BMP_ASYNC_IO_H
+#define BMP_ASYNC_IO_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Mechanisms an AsyncFile can use to execute its requests.
+enum AsyncIOBackend {
+    ASYNC_IO_SYNC,      // Requests run to completion inside submit (no overlap).
+    ASYNC_IO_THREAD,    // A dedicated I/O thread per file executes positional reads/writes.
+    ASYNC_IO_URING      // Linux io_uring, driven through the raw syscalls.
+};
+
+// Backend used by newly opened files: io_uring when the kernel provides it, otherwise the I/O thread.
+// Setting BMP_IO=sync|thread|io_uring selects a backend explicitly; io_uring falls back to the I/O thread
+// when unavailable, and an unknown value keeps the default. Both are noted on stderr.
+AsyncIOBackend preferredAsyncIOBackend();
+
+// Printable name of a backend, e.g. "io_uring".
+const char* asyncIOBackendName(AsyncIOBackend backend);
+
+/**
+ * File with positional, asynchronous reads and writes.
+ * read()/write() queue a request and return its id immediately; the buffer must stay valid and
+ * untouched until wait(id) returns. Several requests may be in flight at once, and requests on
+ * the same file may complete in any order. Short transfers are completed before a request is
+ * reported done, so a successful wait means every byte was transferred.
+ * An AsyncFile is driven from one thread; the backend may complete requests on another.
+ */
+class AsyncFile {
+public:
+    AsyncFile();
+    ~AsyncFile();
+    AsyncFile(const AsyncFile&) = delete;
+    AsyncFile& operator=(const AsyncFile&) = delete;
+
+    // Open an existing file for reading.
+    bool openRead(const char* fileName);
+
+    // Create (or truncate) a file for writing.
+    bool openWrite(const char* fileName);
+
+    // Queue a read of `length` bytes at `offset` into `dest`. Returns the request id, or -1 on failure.
+    int read(void* dest, size_t length, uint64_t offset);
+
+    // Queue a write of `length` bytes from `src` at `offset`. Returns the request id, or -1 on failure.
+    int write(const void* src, size_t length, uint64_t offset);
+
+    // Block until request `id` has finished. Returns false if it failed or transferred fewer bytes.
+    bool wait(int id);
+
+    // Wait for every request still in flight. Returns false if any of them failed.
+    bool drain();
+
+    // Drain and close the file. Returns false if an outstanding request failed.
+    bool close();
+
+    bool isOpen() const;
+    AsyncIOBackend backend() const;
+
+private:
+    struct State;
+    bool open(const char* fileName, bool forWrite);
+    int submit(bool isWrite, uint8_t* buffer, size_t length, uint64_t offset);
+    std::unique_ptr<State> state;
+};
+
+// Alignment of file offsets, lengths and buffer addresses for unbuffered (O_DIRECT) writes.
+const size_t DIRECT_IO_ALIGNMENT = 4096;
+
+// One piece of a gathered write: `length` bytes at `data`.
+struct WriteSlice {
+    const void* data;
+    size_t length;
+};
+
+/**
+ * Blocking file with positional reads and writes (pread / pwrite), for a few small accesses at known
+ * offsets where the queue of an AsyncFile would only add overhead. On POSIX systems several threads
+ * may read from one file at once.
+ */
+class PositionedFile {
+public:
+    PositionedFile() = default;
+    ~PositionedFile();
+    PositionedFile(const PositionedFile&) = delete;
+    PositionedFile& operator=(const PositionedFile&) = delete;
+
+    // Open an existing file for reading.
+    bool openRead(const char* fileName);
+
+    // Create (or truncate) a file for writing.
+    bool openWrite(const char* fileName);
+
+    // Open an existing file for unbuffered writes that bypass the page cache (O_DIRECT). Offsets, lengths
+    // and buffer addresses must then be multiples of DIRECT_IO_ALIGNMENT. Returns false where the platform
+    // or the file system doesn't support it.
+    bool openDirectWrite(const char* fileName);
+
+    // Transfer exactly `length` bytes at `offset`. Returns false on error or end of file.
+    bool read(void* dest, size_t length, uint64_t offset);
+    bool write(const void* src, size_t length, uint64_t offset);
+
+    // Write the slices back to back from `offset` with as few system calls as possible (pwritev), so data
+    // spread over several buffers (headers, rows, padding) reaches the file without being staged in one.
+    bool writeGather(const WriteSlice* slices, size_t count, uint64_t offset);
+
+    // Set the file size (sparse: no blocks are allocated).
+    bool resize(uint64_t size);
+
+    // Reserve disk blocks for `size` bytes (fallocate) and extend the file to that size, so concurrent
+    // positioned writes don't contend on block allocation. Falls back to resize.
+    bool preallocate(uint64_t size);
+
+    // Current file size in bytes.
+    uint64_t size() const;
+
+    // Close the file. Returns false if the close reported an error.
+    bool close();
+
+    bool isOpen() const { return fd >= 0; }
+
+private:
+    int fd = -1;
+};
+
+// Size and modification time (nanoseconds since the epoch) of a file. Returns false if it doesn't exist.
+bool fileStamp(const char* fileName, uint64_t& size, int64_t& modified);
+
+#endif // BMP_ASYNC_IO_H
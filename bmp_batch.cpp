@@ -0,0 +1,297 @@
+#include "bmp_batch.h"
+#include "bmp_image.h"
+#include "bmp_kernels.h"
+#include "bmp_parallel.h"
+#include "bmp_resize.h"
+#include "bmp_result_cache.h"
+#include "bmp_stats.h"
+#include "bmp_tiles.h"
+#include "bmp_trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+// Case-insensitive check for the .bmp extension
+static bool hasBMPExtension(const fs::path& path) {
+    string extension = path.extension().string();
+    transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(tolower(c)); });
+    return extension == ".bmp";
+}
+
+bool collectBMPFiles(const vector<string>& paths, vector<string>& files) {
+    for (const string& path : paths) {
+        error_code error;
+        if (fs::is_directory(path, error)) {
+            // Directory: take its .bmp entries in a stable (sorted) order
+            vector<string> entries;
+            for (const fs::directory_entry& entry : fs::directory_iterator(path, error)) {
+                if (entry.is_regular_file(error) && hasBMPExtension(entry.path())) {
+                    entries.push_back(entry.path().string());
+                }
+            }
+            sort(entries.begin(), entries.end());
+            files.insert(files.end(), entries.begin(), entries.end());
+        } else if (fs::is_regular_file(path, error)) {
+            files.push_back(path);
+        } else {
+            cerr << "No such file or directory: " << path << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool readFileList(const char* listFileName, vector<string>& paths) {
+    ifstream listFile(listFileName);
+    if (!listFile) {
+        cerr << "Can't open file list: " << listFileName << endl;
+        return false;
+    }
+    string line;
+    while (getline(listFile, line)) {
+        // Tolerate Windows line endings and blank lines
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (!line.empty()) {
+            paths.push_back(line);
+        }
+    }
+    return true;
+}
+
+string batchOutputPath(const string& inputFileName, const string& outputDirectory, const string& suffix) {
+    fs::path input(inputFileName);
+    fs::path output = fs::path(outputDirectory) / (input.stem().string() + "_" + suffix + ".bmp");
+    return output.string();
+}
+
+// Statistics of an output whose kernel has no stats stage (crop, resize): one pass over the freshly written rows
+static bool writeOutputStats(const Image& output, const string& outputFileName, const BatchOptions& options) {
+    if (!options.collectStats) {
+        return true;
+    }
+    ImageStats stats;
+    computeImageStats(output.pixelData, output.width, output.height, output.stride, output.bytesPerPixel, stats, options.threadsPerImage);
+    return writeStatsJSON(statsPath(outputFileName).c_str(), stats);
+}
+
+// Output paths of one input and, for each, the description of the operation that produces it (the result
+// cache key). Separate tile files are not cached, so they leave both lists empty.
+static void describeOutputs(const string& inputFileName, const BatchOptions& options, vector<string>& outputFileNames, vector<string>& operations) {
+    string rect = to_string(options.cropX) + "," + to_string(options.cropY) + "," + to_string(options.cropWidth) + "," + to_string(options.cropHeight);
+    switch (options.operation) {
+        case BATCH_FLIP:
+            outputFileNames.push_back(batchOutputPath(inputFileName, options.outputDirectory, "flip"));
+            operations.push_back("flip");
+            break;
+        case BATCH_QUANTIZE:
+            for (int bits : options.quantizationBits) {
+                outputFileNames.push_back(batchOutputPath(inputFileName, options.outputDirectory, "q" + to_string(bits)));
+                operations.push_back("quantize:" + to_string(bits));
+            }
+            break;
+        case BATCH_CROP:
+            if (options.cropRects.size() <= 1 && options.gridWidth == 0 && !options.packTiles) {
+                outputFileNames.push_back(batchOutputPath(inputFileName, options.outputDirectory, "crop"));
+                operations.push_back("crop:" + rect);
+            }
+            break;
+        case BATCH_RESIZE:
+            outputFileNames.push_back(batchOutputPath(inputFileName, options.outputDirectory, "resize"));
+            operations.push_back("resize:" + (options.hasCrop ? rect : string("all")) + ":" + to_string(options.resizeWidth) + "x" +
+                                 to_string(options.resizeHeight) + ":" + to_string(static_cast<int>(options.resizeFilter)));
+            break;
+    }
+}
+
+// Run the operation on a loaded image and write its outputs
+static bool runOperation(Image& image, const string& inputFileName, const BatchOptions& options) {
+    const KernelSet& kernels = kernelSet(options.backend);
+    switch (options.operation) {
+        case BATCH_FLIP: {
+            ImageStats stats;
+            kernels.flipHorizontally(image.pixelData, image.width, image.height, image.stride, image.bytesPerPixel, options.threadsPerImage,
+                                     options.collectStats ? &stats : nullptr);
+            string outputFileName = batchOutputPath(inputFileName, options.outputDirectory, "flip");
+            return saveBMP(outputFileName.c_str(), image, options.threadsPerImage) &&
+                   (!options.collectStats || writeStatsJSON(statsPath(outputFileName).c_str(), stats));
+        }
+
+        case BATCH_QUANTIZE: {
+            // One mapped output per bit depth, filled in a single pass over the source
+            vector<Image> outputImages(options.quantizationBits.size());
+            vector<uint8_t*> outputs(options.quantizationBits.size());
+            vector<string> outputFileNames(options.quantizationBits.size());
+            for (size_t i = 0; i < outputImages.size(); ++i) {
+                string suffix = "q" + to_string(options.quantizationBits[i]);
+                outputFileNames[i] = batchOutputPath(inputFileName, options.outputDirectory, suffix);
+                if (!createBMPMapped(outputFileNames[i].c_str(), image, image.width, image.height, outputImages[i])) {
+                    return false;
+                }
+                outputs[i] = outputImages[i].pixelData;
+            }
+            vector<ImageStats> stats;
+            kernels.quantizePixelDataMulti(image.pixelData, outputs, options.quantizationBits, image.bytesPerPixel, image.width, image.height, image.stride, options.threadsPerImage,
+                                           options.collectStats ? &stats : nullptr);
+            bool success = true;
+            for (size_t i = 0; i < outputImages.size(); ++i) {
+                success = commitBMP(outputImages[i]) && success;
+                if (options.collectStats) {
+                    success = writeStatsJSON(statsPath(outputFileNames[i]).c_str(), stats[i]) && success;
+                }
+            }
+            return success;
+        }
+
+        case BATCH_CROP: {
+            // Several ROIs (a list or a grid): the source is mapped once and all tiles are cut in one pass
+            if (options.cropRects.size() > 1 || options.gridWidth > 0 || options.packTiles) {
+                vector<TileRect> rects = options.cropRects;
+                gridTiles(image.width, image.height, options.gridWidth, options.gridHeight, options.gridStepX, options.gridStepY, rects);
+                if (rects.empty()) {
+                    cerr << "No tile fits inside the image." << endl;
+                    return false;
+                }
+                if (options.packTiles) {
+                    string outputFileName = batchOutputPath(inputFileName, options.outputDirectory, "tiles");
+                    return savePackedTiles(image, rects, outputFileName.c_str(), options.threadsPerImage);
+                }
+                vector<string> fileNames;
+                for (size_t i = 0; i < rects.size(); ++i) {
+                    fileNames.push_back(batchOutputPath(inputFileName, options.outputDirectory, "crop" + to_string(i)));
+                }
+                return saveTiles(image, rects, fileNames, options.threadsPerImage);
+            }
+
+            // Validate that the ROI is within the source image bounds
+            if (options.cropX < 0 || options.cropY < 0 || options.cropWidth <= 0 || options.cropHeight <= 0 ||
+                options.cropX + options.cropWidth > image.width || options.cropY + options.cropHeight > image.height) {
+                cerr << "Cropping area exceeds image bounds." << endl;
+                return false;
+            }
+            Image croppedImage;
+            string outputFileName = batchOutputPath(inputFileName, options.outputDirectory, "crop");
+            if (!createBMPMapped(outputFileName.c_str(), image, options.cropWidth, options.cropHeight, croppedImage)) {
+                return false;
+            }
+            kernels.cropImage(image.pixelData, croppedImage.pixelData, image.width, image.height, image.bytesPerPixel, image.stride,
+                              options.cropX, options.cropY, options.cropWidth, options.cropHeight, options.threadsPerImage);
+            return writeOutputStats(croppedImage, outputFileName, options) && commitBMP(croppedImage);
+        }
+
+        case BATCH_RESIZE: {
+            // With a crop rectangle only the ROI is read: crop and resize are one pass over the source
+            int x = options.hasCrop ? options.cropX : 0;
+            int y = options.hasCrop ? options.cropY : 0;
+            int sourceWidth = options.hasCrop ? options.cropWidth : image.width;
+            int sourceHeight = options.hasCrop ? options.cropHeight : image.height;
+            if (x < 0 || y < 0 || sourceWidth <= 0 || sourceHeight <= 0 || x + sourceWidth > image.width || y + sourceHeight > image.height) {
+                cerr << "Cropping area exceeds image bounds." << endl;
+                return false;
+            }
+
+            // A zero side follows the aspect ratio of the source region
+            int outputWidth = options.resizeWidth;
+            int outputHeight = options.resizeHeight;
+            if (outputWidth == 0) {
+                outputWidth = max(1, static_cast<int>((static_cast<int64_t>(sourceWidth) * outputHeight + sourceHeight / 2) / sourceHeight));
+            }
+            if (outputHeight == 0) {
+                outputHeight = max(1, static_cast<int>((static_cast<int64_t>(sourceHeight) * outputWidth + sourceWidth / 2) / sourceWidth));
+            }
+
+            Image resizedImage;
+            string outputFileName = batchOutputPath(inputFileName, options.outputDirectory, "resize");
+            if (!createBMPMapped(outputFileName.c_str(), image, outputWidth, outputHeight, resizedImage)) {
+                return false;
+            }
+            resizeImage(image.pixelData, resizedImage.pixelData, image.bytesPerPixel, image.stride,
+                        x, y, sourceWidth, sourceHeight, outputWidth, outputHeight, options.resizeFilter, options.threadsPerImage);
+            return writeOutputStats(resizedImage, outputFileName, options) && commitBMP(resizedImage);
+        }
+    }
+    return false;
+}
+
+bool processBMPFile(const string& inputFileName, const BatchOptions& options) {
+    // Flip modifies the pixels in place: reading them into a pooled buffer reuses memory that earlier
+    // images already faulted in, where a private mapping would take a copy-on-write fault per page.
+    // The read-only operations map the input and never copy it.
+    // With a result cache the content hash is computed by the same load.
+    BMP_TRACE_SCOPE(trace, "batch.file", 0);
+    ResultCache cache(options.cacheDirectory);
+    vector<string> outputFileNames;
+    vector<string> operations;
+    if (cache.enabled()) {
+        describeOutputs(inputFileName, options, outputFileNames, operations);
+    }
+    uint64_t contentHash = 0;
+    uint64_t* hashTarget = operations.empty() ? nullptr : &contentHash;
+    Image image;
+    bool loaded = (options.operation == BATCH_FLIP) ? loadBMP(inputFileName.c_str(), image, hashTarget)
+                                                    : loadBMPMapped(inputFileName.c_str(), image, hashTarget);
+    if (!loaded) {
+        return false;
+    }
+    BMP_TRACE_SET_BYTES(trace, image.pixelBytes());
+
+    // Identical input and parameters: copy the earlier outputs instead of running the kernel
+    vector<uint64_t> keys;
+    uint64_t headerHash = operations.empty() ? 0 : copiedHeaderHash(image);
+    for (const string& operation : operations) {
+        keys.push_back(ResultCache::resultKey(contentHash, headerHash, operation));
+    }
+    bool cached = !keys.empty();
+    for (size_t i = 0; cached && i < keys.size(); ++i) {
+        cached = cache.fetch(keys[i], outputFileNames[i], options.collectStats);
+    }
+    if (cached) {
+        return true;
+    }
+
+    if (!runOperation(image, inputFileName, options)) {
+        return false;
+    }
+    for (size_t i = 0; i < keys.size(); ++i) {
+        cache.store(keys[i], outputFileNames[i], options.collectStats);
+    }
+    return true;
+}
+
+int runBatch(const vector<string>& files, const BatchOptions& options) {
+    // File sizes drive the largest-first ordering of the scheduler
+    vector<uint64_t> costs(files.size(), 0);
+    for (size_t i = 0; i < files.size(); ++i) {
+        error_code error;
+        uintmax_t size = fs::file_size(files[i], error);
+        costs[i] = error ? 0 : static_cast<uint64_t>(size);
+    }
+
+    int workerCount = options.workerCount > 0 ? options.workerCount : hardwareThreadCount();
+    atomic<int> failures{0};
+    mutex reportMutex;
+
+    // Concurrent images share the kernel pool, so it needs helpers for all of them at once
+    if (options.threadsPerImage > 1) {
+        int concurrentImages = min(workerCount, static_cast<int>(files.size()));
+        sharedThreadPool().reserve(concurrentImages * (options.threadsPerImage - 1));
+    }
+
+    runWorkStealing(workerCount, static_cast<int>(files.size()), costs, [&](int index) {
+        if (!processBMPFile(files[index], options)) {
+            ++failures;
+            lock_guard<mutex> lock(reportMutex);
+            cerr << "Failed: " << files[index] << endl;
+        }
+    });
+    return failures.load();
+}
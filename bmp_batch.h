@@ -0,0 +1,63 @@
+#ifndef BMP_BATCH_H
+#define BMP_BATCH_H
+
+#include <string>
+#include <vector>
+
+#include "bmp_gpu.h"
+#include "bmp_resize.h"
+#include "bmp_tiles.h"
+
+// Operation applied to every file of a batch
+enum BatchOperation {
+    BATCH_FLIP,
+    BATCH_QUANTIZE,
+    BATCH_CROP,
+    BATCH_RESIZE
+};
+
+struct BatchOptions {
+    BatchOperation operation = BATCH_FLIP;
+    std::vector<int> quantizationBits = { 6, 4, 2 };  // One output per entry (quantize).
+    int cropX = 0;                                    // ROI (crop).
+    int cropY = 0;
+    int cropWidth = 0;
+    int cropHeight = 0;
+    std::vector<TileRect> cropRects;                  // Crop: every --rect / --rects entry; more than one gives tiles.
+    int gridWidth = 0;                                // Crop: tile grid (0 = none) and its step.
+    int gridHeight = 0;
+    int gridStepX = 0;
+    int gridStepY = 0;
+    bool packTiles = false;                           // Crop: write all tiles into one packed BMP.
+    bool hasCrop = false;                             // Resize: resample the ROI instead of the whole image.
+    int resizeWidth = 0;                              // Resize: output size; 0 keeps the aspect ratio of the other side.
+    int resizeHeight = 0;
+    ResizeFilter resizeFilter = RESIZE_LANCZOS;
+    std::string cacheDirectory;                       // Result cache directory (empty = off; not for tiles).
+    bool collectStats = false;                        // Write <output>.stats.json next to every output (not for tiles).
+    std::string outputDirectory = ".";
+    int workerCount = 0;                              // Images processed concurrently (0 = hardware threads).
+    int threadsPerImage = 1;                          // Row-parallel threads inside each kernel call.
+    KernelBackend backend = KERNEL_BACKEND_CPU;       // Flip, quantize and crop kernels: CPU or OpenCL.
+};
+
+// Expand `paths` into a list of BMP files: files are taken as given, directories contribute their *.bmp entries.
+bool collectBMPFiles(const std::vector<std::string>& paths, std::vector<std::string>& files);
+
+// Append the non-empty lines of a list file to `paths`.
+bool readFileList(const char* listFileName, std::vector<std::string>& paths);
+
+// Output path for an input file: <outputDirectory>/<stem>_<suffix>.bmp
+std::string batchOutputPath(const std::string& inputFileName, const std::string& outputDirectory, const std::string& suffix);
+
+// Read, process and write a single file according to `options`. Prints the reason and returns false on failure.
+bool processBMPFile(const std::string& inputFileName, const BatchOptions& options);
+
+/**
+ * Process every file with a work-stealing pool of options.workerCount workers (largest files first).
+ * Each worker runs read -> kernel -> write for its own image, so reads, computation and writes of
+ * different images overlap. Returns the number of files that failed.
+ */
+int runBatch(const std::vector<std::string>& files, const BatchOptions& options);
+
+#endif // BMP_BATCH_H
@@ -0,0 +1,182 @@
+#include "bmp_buffer_pool.h"
+#include "bmp_trace.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+
+using namespace std;
+
+// Allocation granule: whole pages, so neighbouring buffers never share one
+const size_t POOL_PAGE_SIZE = 4096;
+const size_t HUGE_PAGE_SIZE = size_t(2) << 20;
+
+// A cached buffer is only reused for requests needing at least half of it
+const size_t POOL_REUSE_RATIO = 2;
+
+static size_t roundUp(size_t size, size_t granule) {
+    return (size + granule - 1) / granule * granule;
+}
+
+static uint8_t* allocateAligned(size_t capacity, size_t alignment) {
+#ifdef _WIN32
+    return static_cast<uint8_t*>(_aligned_malloc(capacity, alignment));
+#else
+    void* address = nullptr;
+    if (posix_memalign(&address, alignment, capacity) != 0) {
+        return nullptr;
+    }
+    return static_cast<uint8_t*>(address);
+#endif
+}
+
+static void freeAligned(uint8_t* address) {
+#ifdef _WIN32
+    _aligned_free(address);
+#else
+    free(address);
+#endif
+}
+
+// ---------------------------------------------------------------------------
+// PixelBuffer
+// ---------------------------------------------------------------------------
+
+PixelBuffer::~PixelBuffer() {
+    release();
+}
+
+PixelBuffer::PixelBuffer(PixelBuffer&& other) noexcept {
+    *this = move(other);
+}
+
+PixelBuffer& PixelBuffer::operator=(PixelBuffer&& other) noexcept {
+    if (this != &other) {
+        release();
+        pool = other.pool;
+        address = other.address;
+        length = other.length;
+        capacity = other.capacity;
+        other.pool = nullptr;
+        other.address = nullptr;
+        other.length = 0;
+        other.capacity = 0;
+    }
+    return *this;
+}
+
+void PixelBuffer::release() {
+    if (address != nullptr) {
+        pool->recycle(address, capacity);
+    }
+    pool = nullptr;
+    address = nullptr;
+    length = 0;
+    capacity = 0;
+}
+
+// ---------------------------------------------------------------------------
+// BufferPool
+// ---------------------------------------------------------------------------
+
+BufferPool::BufferPool(size_t maxCachedBytes) : maxCached(maxCachedBytes) {
+}
+
+BufferPool::~BufferPool() {
+    trim();
+}
+
+PixelBuffer BufferPool::acquire(size_t size) {
+    PixelBuffer buffer;
+    if (size == 0) {
+        return buffer;
+    }
+
+    bool useHugePages;
+    {
+        lock_guard<std::mutex> lock(mutex);
+        useHugePages = hugePages && size >= HUGE_PAGE_SIZE;
+        size_t capacity = roundUp(size, useHugePages ? HUGE_PAGE_SIZE : POOL_PAGE_SIZE);
+
+        // Smallest cached buffer that fits without wasting more than half of it
+        multimap<size_t, uint8_t*>::iterator found = freeBuffers.lower_bound(capacity);
+        if (found != freeBuffers.end() && found->first / POOL_REUSE_RATIO <= capacity) {
+            buffer.capacity = found->first;
+            buffer.address = found->second;
+            cached -= found->first;
+            freeBuffers.erase(found);
+        } else {
+            buffer.capacity = capacity;
+        }
+    }
+
+    BMP_TRACE_ALLOCATION(buffer.address == nullptr ? buffer.capacity : 0);
+    if (buffer.address == nullptr) {
+        // Cache miss: fresh memory, left uninitialized (pages are faulted in by the first write)
+        buffer.address = allocateAligned(buffer.capacity, useHugePages ? HUGE_PAGE_SIZE : PIXEL_BUFFER_ALIGNMENT);
+        if (buffer.address == nullptr) {
+            buffer.capacity = 0;
+            return buffer;
+        }
+#if defined(MADV_HUGEPAGE)
+        if (useHugePages) {
+            // Advisory only: the kernel falls back to normal pages if THP is disabled
+            madvise(buffer.address, buffer.capacity, MADV_HUGEPAGE);
+        }
+#endif
+    }
+    buffer.pool = this;
+    buffer.length = size;
+    return buffer;
+}
+
+void BufferPool::recycle(uint8_t* address, size_t capacity) {
+    {
+        lock_guard<std::mutex> lock(mutex);
+        if (cached + capacity <= maxCached) {
+            freeBuffers.emplace(capacity, address);
+            cached += capacity;
+            return;
+        }
+    }
+    freeAligned(address);
+}
+
+void BufferPool::trim() {
+    multimap<size_t, uint8_t*> released;
+    {
+        lock_guard<std::mutex> lock(mutex);
+        released.swap(freeBuffers);
+        cached = 0;
+    }
+    for (const auto& entry : released) {
+        freeAligned(entry.second);
+    }
+}
+
+void BufferPool::setHugePages(bool enabled) {
+    lock_guard<std::mutex> lock(mutex);
+    hugePages = enabled;
+}
+
+size_t BufferPool::cachedBytes() const {
+    lock_guard<std::mutex> lock(mutex);
+    return cached;
+}
+
+BufferPool& sharedBufferPool() {
+    static BufferPool pool;
+    static bool configured = [] {
+        const char* hugePages = getenv("BMP_HUGEPAGES");
+        pool.setHugePages(hugePages != nullptr && strcmp(hugePages, "1") == 0);
+        return true;
+    }();
+    (void)configured;
+    return pool;
+}
@@ -0,0 +1,226 @@
+#include "bmp_dither.h"
+#include "bmp_kernels.h"
+#include "bmp_parallel.h"
+#include "bmp_planar.h"
+#include "bmp_pixel_format.h"
+#include "bmp_simd.h"
+#include "bmp_trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// 4x4 Bayer index matrix: thresholds spread evenly over one quantization step
+static const uint8_t BAYER_MATRIX[4][4] = {
+    { 0,  8,  2, 10},
+    {12,  4, 14,  6},
+    { 3, 11,  1,  9},
+    {15,  7, 13,  5}
+};
+
+// Pixels diffused between two progress updates; rows below wait on the row above in these steps
+const int DIFFUSION_CHUNK_PIXELS = 64;
+
+bool parseQuantizationMode(const char* name, QuantizationMode& mode) {
+    if (strcmp(name, "none") == 0) {
+        mode = QUANTIZE_TRUNCATE;
+    } else if (strcmp(name, "bayer") == 0) {
+        mode = QUANTIZE_ORDERED_DITHER;
+    } else if (strcmp(name, "fs") == 0) {
+        mode = QUANTIZE_ERROR_DIFFUSION;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void orderedDitherPixelData(uint8_t* pixelData, int bytesPerPixel, int width, int height, int rowSize, int quantizationBits, int threadCount, int firstRow) {
+    BMP_TRACE_SCOPE(trace, "dither.ordered", static_cast<uint64_t>(width) * bytesPerPixel * height);
+
+    // Palette indices carry no color values to dither
+    if (bytesPerPixel < 3) {
+        quantizePixelData(pixelData, bytesPerPixel, width, height, rowSize, quantizationBits, threadCount);
+        return;
+    }
+
+    QuantizationTable table;
+    buildQuantizationTable(quantizationBits, table);
+    QuantizeRowKernel quantizeRow = quantizeRowKernel(table, bytesPerPixel);
+
+    // One threshold row per matrix row, laid out like a pixel row: the threshold of matrix entry m is
+    // (2m + 1) / 32 of a step, and alpha bytes get none. Truncating value + threshold then averages to value.
+    int rowBytes = width * bytesPerPixel;
+    vector<uint8_t> thresholds(static_cast<size_t>(4) * rowBytes, 0);
+    for (int phase = 0; phase < 4; ++phase) {
+        uint8_t* thresholdRow = &thresholds[static_cast<size_t>(phase) * rowBytes];
+        for (int x = 0; x < width; ++x) {
+            uint8_t threshold = static_cast<uint8_t>((2 * BAYER_MATRIX[phase][x & 3] + 1) * table.factor / 32);
+            for (int byte = 0; byte < 3; ++byte) {
+                thresholdRow[x * bytesPerPixel + byte] = threshold;
+            }
+        }
+    }
+
+    parallelForRows(height, rowSize, pixelData, threadCount, [&](int first, int last) {
+        for (int y = first; y < last; ++y) {
+            uint8_t* row = pixelData + static_cast<ptrdiff_t>(y) * rowSize;
+            const uint8_t* thresholdRow = &thresholds[static_cast<size_t>((firstRow + y) & 3) * rowBytes];
+
+            // Saturating add (a single vector instruction per 16+ bytes), then the uniform kernel.
+            // Saturation is exact: anything above 255 truncates to the top level anyway.
+            for (int i = 0; i < rowBytes; ++i) {
+                unsigned sum = row[i] + thresholdRow[i];
+                row[i] = static_cast<uint8_t>(sum > 255 ? 255 : sum);
+            }
+            quantizeRow(row, row, width, bytesPerPixel, table);
+        }
+    });
+}
+
+void orderedDitherPlanes(const PlanarImage& source, PlanarImage& dest, int quantizationBits, int threadCount, int firstRow) {
+    BMP_TRACE_SCOPE(trace, "dither.ordered.planes", static_cast<uint64_t>(source.width) * source.planeCount * source.height);
+
+    QuantizationTable table;
+    buildQuantizationTable(quantizationBits, table);
+    QuantizeRowKernel quantizeRun = quantizeRowKernel(table, 3);
+
+    // Thresholds of one plane row, repeated for the three color planes of a row, so the add and the
+    // quantization are each a single loop over the contiguous color run
+    int runBytes = 3 * source.planeStride;
+    vector<uint8_t> thresholds(static_cast<size_t>(4) * runBytes, 0);
+    for (int phase = 0; phase < 4; ++phase) {
+        uint8_t* thresholdRun = &thresholds[static_cast<size_t>(phase) * runBytes];
+        for (int x = 0; x < source.width; ++x) {
+            uint8_t threshold = static_cast<uint8_t>((2 * BAYER_MATRIX[phase][x & 3] + 1) * table.factor / 32);
+            for (int c = 0; c < 3; ++c) {
+                thresholdRun[c * source.planeStride + x] = threshold;
+            }
+        }
+    }
+
+    parallelForRows(source.height, dest.rowPitch, dest.storage.data(), threadCount, [&](int first, int last) {
+        for (int y = first; y < last; ++y) {
+            const uint8_t* in = source.plane(0, y);
+            uint8_t* out = dest.plane(0, y);
+            const uint8_t* thresholdRun = &thresholds[static_cast<size_t>((firstRow + y) & 3) * runBytes];
+            for (int i = 0; i < runBytes; ++i) {
+                unsigned sum = in[i] + thresholdRun[i];
+                out[i] = static_cast<uint8_t>(sum > 255 ? 255 : sum);
+            }
+            quantizeRun(out, out, source.planeStride, 3, table);
+            if (source.hasAlpha() && &dest != &source) {
+                memcpy(dest.plane(3, y), source.plane(3, y), source.planeStride);
+            }
+        }
+    });
+}
+
+void errorDiffusePixelData(uint8_t* pixelData, int bytesPerPixel, int width, int height, int rowSize, int quantizationBits, int threadCount) {
+    BMP_TRACE_SCOPE(trace, "dither.diffusion", static_cast<uint64_t>(width) * bytesPerPixel * height);
+
+    if (bytesPerPixel < 3) {
+        quantizePixelData(pixelData, bytesPerPixel, width, height, rowSize, quantizationBits, threadCount);
+        return;
+    }
+    if (height <= 0) {
+        return;
+    }
+    threadCount = max(1, min(threadCount, height));
+
+    // Nearest of the 2^bits levels k * factor for every (clamped) value
+    int factor = quantizationFactorFor(quantizationBits);
+    int maxLevel = (1 << quantizationBits) - 1;
+    uint8_t nearest[256];
+    for (int value = 0; value < 256; ++value) {
+        nearest[value] = static_cast<uint8_t>(min((value + factor / 2) / factor, maxLevel) * factor);
+    }
+
+    // Errors are accumulated in 1/16 units, three channels per pixel plus one guard pixel each side.
+    // Row t reads error row t and adds to error row t+1. At most threadCount rows are unfinished
+    // at any time and they are consecutive, so a ring of threadCount + 1 error rows suffices.
+    int errorStride = (width + 2) * 3;
+    int ringRows = threadCount + 1;
+    vector<int16_t> errors(static_cast<size_t>(ringRows) * errorStride, 0);
+
+    // progress[t]: pixels of row t already diffused (published with release semantics)
+    unique_ptr<atomic<int>[]> progress(new atomic<int>[height]);
+    for (int t = 0; t < height; ++t) {
+        progress[t].store(0, memory_order_relaxed);
+    }
+    atomic<int> nextRow{0};
+
+    auto diffuseRow = [&](int t) {
+        // Row t counts from the top: the image row is height - 1 - t
+        uint8_t* row = pixelData + static_cast<ptrdiff_t>(height - 1 - t) * rowSize;
+        const int16_t* current = &errors[static_cast<size_t>(t % ringRows) * errorStride];
+        int16_t* next = &errors[static_cast<size_t>((t + 1) % ringRows) * errorStride];
+        fill(next, next + errorStride, static_cast<int16_t>(0));
+
+        int carry[3] = {0, 0, 0};
+        for (int x0 = 0; x0 < width; x0 += DIFFUSION_CHUNK_PIXELS) {
+            int x1 = min(width, x0 + DIFFUSION_CHUNK_PIXELS);
+
+            // Pixels up to x1 of the row above must be done: they feed error slots up to x1 - 1
+            if (t > 0) {
+                int needed = min(width, x1 + 1);
+                while (progress[t - 1].load(memory_order_acquire) < needed) {
+                    this_thread::yield();
+                }
+            }
+
+            for (int x = x0; x < x1; ++x) {
+                uint8_t* pixel = row + x * bytesPerPixel;
+                const int16_t* error = current + (x + 1) * 3;
+                int16_t* below = next + x * 3;
+                for (int channel = 0; channel < 3; ++channel) {
+                    int value = pixel[channel] + ((error[channel] + carry[channel] + 8) >> 4);
+                    value = min(255, max(0, value));
+                    int quantized = nearest[value];
+                    int residual = value - quantized;
+                    pixel[channel] = static_cast<uint8_t>(quantized);
+
+                    // 7/16 right, 3/16 below-left, 5/16 below, 1/16 below-right
+                    carry[channel] = 7 * residual;
+                    below[channel] = static_cast<int16_t>(below[channel] + 3 * residual);
+                    below[channel + 3] = static_cast<int16_t>(below[channel + 3] + 5 * residual);
+                    below[channel + 6] = static_cast<int16_t>(below[channel + 6] + residual);
+                }
+            }
+            progress[t].store(x1, memory_order_release);
+        }
+    };
+
+    // Rows are claimed in order, so a waiting thread always waits on a row that is being processed;
+    // if the pool runs the tasks one after another, the first task simply does every row
+    auto worker = [&](int) {
+        for (int t = nextRow.fetch_add(1); t < height; t = nextRow.fetch_add(1)) {
+            diffuseRow(t);
+        }
+    };
+    if (threadCount == 1) {
+        worker(0);
+        return;
+    }
+    sharedThreadPool().reserve(threadCount - 1);
+    sharedThreadPool().run(threadCount, worker);
+}
+
+void quantizePixelDataMode(uint8_t* pixelData, int bytesPerPixel, int width, int height, int rowSize, int quantizationBits, QuantizationMode mode, int threadCount) {
+    switch (mode) {
+        case QUANTIZE_ORDERED_DITHER:
+            orderedDitherPixelData(pixelData, bytesPerPixel, width, height, rowSize, quantizationBits, threadCount);
+            break;
+        case QUANTIZE_ERROR_DIFFUSION:
+            errorDiffusePixelData(pixelData, bytesPerPixel, width, height, rowSize, quantizationBits, threadCount);
+            break;
+        default:
+            quantizePixelData(pixelData, bytesPerPixel, width, height, rowSize, quantizationBits, threadCount);
+            break;
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef BMP_DITHER_H
+#define BMP_DITHER_H
+
+#include <cstdint>
+
+struct PlanarImage;
+
+// How color values are mapped onto the 2^bits levels of a quantization bit depth.
+enum QuantizationMode {
+    QUANTIZE_TRUNCATE,          // Plain (value / factor) * factor; the fast default.
+    QUANTIZE_ORDERED_DITHER,    // 4x4 Bayer threshold added before truncation; row-local.
+    QUANTIZE_ERROR_DIFFUSION    // Floyd-Steinberg; each row depends on the one above it.
+};
+
+// Parse a mode name ("none", "bayer" or "fs"). Returns false for unknown names.
+bool parseQuantizationMode(const char* name, QuantizationMode& mode);
+
+/**
+ * Ordered dithering: a 4x4 Bayer threshold (between 0 and one quantization step) is added to
+ * every color byte with saturation, then the row runs through the uniform SIMD quantization kernel.
+ * Rows are independent. The threshold pattern follows the image coordinates (row 0 is the bottom
+ * row), and `firstRow` is the image row of `pixelData`, so bands of one image match the whole-image result.
+ */
+void orderedDitherPixelData(uint8_t* pixelData, int bytesPerPixel, int width, int height, int rowSize, int quantizationBits, int threadCount = 1, int firstRow = 0);
+
+/**
+ * Floyd-Steinberg error diffusion to the nearest level, top row first, left to right.
+ * Pixel (x, y) needs the finished errors of pixels x-1..x+1 of the row above, so rows are handed
+ * out to the threads in order and each one follows the row above it at a distance of a few pixels
+ * (a wavefront). The output is the same for any thread count.
+ */
+void errorDiffusePixelData(uint8_t* pixelData, int bytesPerPixel, int width, int height, int rowSize, int quantizationBits, int threadCount = 1);
+
+// Ordered dithering of the color planes of `source` into `dest` (same geometry; may be `source`), with the
+// same thresholds and output as orderedDitherPixelData. The alpha plane is copied unchanged.
+void orderedDitherPlanes(const PlanarImage& source, PlanarImage& dest, int quantizationBits, int threadCount = 1, int firstRow = 0);
+
+// Quantize in place with the given mode (QUANTIZE_TRUNCATE is quantizePixelData).
+void quantizePixelDataMode(uint8_t* pixelData, int bytesPerPixel, int width, int height, int rowSize, int quantizationBits, QuantizationMode mode, int threadCount = 1);
+
+#endif // BMP_DITHER_H
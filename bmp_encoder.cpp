@@ -0,0 +1,187 @@
+#include "bmp_encoder.h"
+#include "bmp_trace.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+using namespace std;
+
+// Row padding is at most 3 bytes; every padding slice points here
+static const uint8_t ZERO_PADDING[4] = {};
+
+// Size of the aligned bounce buffer of a direct write
+const size_t DIRECT_IO_CHUNK_BYTES = size_t(1) << 20;
+
+// Whether BMP_DIRECT_IO=1 asks for unbuffered writes of large files (read once)
+static bool directIORequested() {
+    static const bool requested = [] {
+        const char* value = getenv("BMP_DIRECT_IO");
+        return value != nullptr && strcmp(value, "1") == 0;
+    }();
+    return requested;
+}
+
+bool BMPEncoder::open(const char* fileName, const Image& headerSource, int width, int height, bool concurrentWriters) {
+    BMP_TRACE_SCOPE(trace, "encode.open", 0);
+    initImageGeometry(headerSource, width, height, layout);
+    if (!fitsBMPFileSize(layout)) {
+        return false;
+    }
+    prepareBMPHeaders(layout, layout.fileHeader, layout.infoHeader);
+    headersWritten = false;
+    failed = false;
+
+    // The final size is known before any pixel exists, so ranges can land in any order. Unbuffered writes
+    // and concurrent writers also get the blocks reserved, so they never wait on block allocation.
+    bool useDirect = directIORequested() && layout.pixelBytes() >= DIRECT_IO_MIN_BYTES;
+    bool reserve = concurrentWriters || useDirect;
+    if (!file.openWrite(fileName) || !(reserve ? file.preallocate(layout.fileHeader.bfSize) : file.resize(layout.fileHeader.bfSize))) {
+        cerr << "Can't open output file." << endl;
+        file.close();
+        return false;
+    }
+    direct.close();
+    if (useDirect) {
+        direct.openDirectWrite(fileName);
+    }
+    return true;
+}
+
+void BMPEncoder::appendHeaderSlices(vector<WriteSlice>& slices) const {
+    slices.push_back(WriteSlice{&layout.fileHeader, sizeof(layout.fileHeader)});
+    slices.push_back(WriteSlice{&layout.infoHeader, sizeof(layout.infoHeader)});
+    if (!layout.palette.empty()) {
+        slices.push_back(WriteSlice{layout.palette.data(), layout.palette.size() * sizeof(BMPPaletteEntry)});
+    }
+}
+
+bool BMPEncoder::writeRows(const ImageView& rows, int firstRow) {
+    BMP_TRACE_SCOPE(trace, "encode.rows", static_cast<uint64_t>(rows.height) * layout.rowSize);
+    if (rows.height <= 0) {
+        return true;
+    }
+
+    // The range is one contiguous block of the file: file rows count from the first stored row
+    int rowSize = layout.rowSize;
+    int firstFileRow = layout.topDown ? layout.height - (firstRow + rows.height) : firstRow;
+    uint64_t offset = layout.fileHeader.bfOffBits + static_cast<uint64_t>(firstFileRow) * rowSize;
+
+    vector<WriteSlice> slices;
+    if (firstFileRow == 0 && !headersWritten.exchange(true)) {
+        appendHeaderSlices(slices);
+        offset = 0;
+    }
+
+    // Rows already laid out like the file (a whole pixel array) go out as one slice, padding included;
+    // a strided view sends each row followed by zero padding, in file order
+    int fileStep = layout.topDown ? -1 : 1;
+    if (rows.rowSize == fileStep * rowSize) {
+        const uint8_t* block = layout.topDown ? rows.row(rows.height - 1) : rows.row(0);
+        slices.push_back(WriteSlice{block, static_cast<size_t>(rows.height) * rowSize});
+    } else {
+        size_t rowBytes = static_cast<size_t>(rows.width) * rows.bytesPerPixel;
+        size_t paddingBytes = static_cast<size_t>(rowSize) - rowBytes;
+        slices.reserve(slices.size() + static_cast<size_t>(rows.height) * 2);
+        for (int i = 0; i < rows.height; ++i) {
+            int r = layout.topDown ? rows.height - 1 - i : i;
+            slices.push_back(WriteSlice{rows.row(r), rowBytes});
+            if (paddingBytes > 0) {
+                slices.push_back(WriteSlice{ZERO_PADDING, paddingBytes});
+            }
+        }
+    }
+
+    if (!submit(slices, offset)) {
+        failed = true;
+        return false;
+    }
+    return true;
+}
+
+bool BMPEncoder::submit(const vector<WriteSlice>& slices, uint64_t offset) {
+#ifdef _WIN32
+    return file.writeGather(slices.data(), slices.size(), offset);
+#else
+    if (!direct.isOpen()) {
+        return file.writeGather(slices.data(), slices.size(), offset);
+    }
+
+    // Unaligned head and tail go through the page cache; the aligned middle is copied into an aligned
+    // buffer chunk by chunk and written unbuffered. Neighbouring ranges never share a direct-written page.
+    size_t length = 0;
+    for (const WriteSlice& slice : slices) {
+        length += slice.length;
+    }
+    uint64_t end = offset + length;
+    uint64_t middleStart = min(end, (offset + DIRECT_IO_ALIGNMENT - 1) / DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT);
+    uint64_t middleEnd = max(middleStart, end / DIRECT_IO_ALIGNMENT * DIRECT_IO_ALIGNMENT);
+
+    // Walk the slices as one byte stream: `index` is the current slice and `used` the bytes taken from it
+    size_t index = 0;
+    size_t used = 0;
+    auto take = [&](uint64_t count, vector<WriteSlice>& out) {
+        while (count > 0) {
+            const WriteSlice& slice = slices[index];
+            size_t part = static_cast<size_t>(min<uint64_t>(count, slice.length - used));
+            out.push_back(WriteSlice{static_cast<const uint8_t*>(slice.data) + used, part});
+            used += part;
+            count -= part;
+            if (used == slice.length) {
+                ++index;
+                used = 0;
+            }
+        }
+    };
+
+    vector<WriteSlice> head;
+    take(middleStart - offset, head);
+    bool ok = file.writeGather(head.data(), head.size(), offset);
+
+    if (middleEnd > middleStart) {
+        void* buffer = nullptr;
+        if (posix_memalign(&buffer, DIRECT_IO_ALIGNMENT, DIRECT_IO_CHUNK_BYTES) != 0) {
+            buffer = nullptr;
+        }
+        unique_ptr<uint8_t, decltype(&free)> bounce(static_cast<uint8_t*>(buffer), &free);
+        vector<WriteSlice> parts;
+        for (uint64_t position = middleStart; ok && position < middleEnd; position += DIRECT_IO_CHUNK_BYTES) {
+            size_t chunk = static_cast<size_t>(min<uint64_t>(DIRECT_IO_CHUNK_BYTES, middleEnd - position));
+            parts.clear();
+            take(chunk, parts);
+            if (!bounce) {
+                ok = file.writeGather(parts.data(), parts.size(), position);
+                continue;
+            }
+            uint8_t* cursor = bounce.get();
+            for (const WriteSlice& part : parts) {
+                memcpy(cursor, part.data, part.length);
+                cursor += part.length;
+            }
+
+            // A file system that rejects the transfer still gets the bytes through the page cache
+            ok = direct.write(bounce.get(), chunk, position) || file.write(bounce.get(), chunk, position);
+        }
+    }
+
+    vector<WriteSlice> tail;
+    take(end - middleEnd, tail);
+    return file.writeGather(tail.data(), tail.size(), middleEnd) && ok;
+#endif
+}
+
+bool BMPEncoder::close() {
+    // An image without rows (or a partial write) still gets its headers
+    if (file.isOpen() && !headersWritten.exchange(true)) {
+        vector<WriteSlice> slices;
+        appendHeaderSlices(slices);
+        if (!file.writeGather(slices.data(), slices.size(), 0)) {
+            failed = true;
+        }
+    }
+    direct.close();
+    bool closed = file.close();
+    return closed && !failed;
+}
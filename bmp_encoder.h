@@ -0,0 +1,66 @@
+#ifndef BMP_ENCODER_H
+#define BMP_ENCODER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "bmp_async_io.h"
+#include "bmp_image.h"
+
+// Pixel arrays of at least this size are written by several threads when a thread count allows it.
+const size_t PARALLEL_WRITE_MIN_BYTES = size_t(8) << 20;
+
+// With BMP_DIRECT_IO=1, files of at least this size bypass the page cache.
+const size_t DIRECT_IO_MIN_BYTES = size_t(64) << 20;
+
+/**
+ * Positional BMP writer. open() computes the final headers (bfSize, biSizeImage...) from the geometry
+ * and creates the file at its final size, so rows can be written in any order while they are
+ * produced. writeRows() places a range of rows at its final offset with one gathered write (pwritev):
+ * a contiguous pixel array goes out as a single slice, and the rows of a strided view (e.g. an ROI)
+ * are sent straight from their source with zero padding slices in between, never staged in a copy.
+ * The headers and the color table join the write that holds the first row of the file (or are
+ * written by close()). Disjoint row ranges may be written from several threads at once.
+ *
+ * With BMP_DIRECT_IO=1, files of at least DIRECT_IO_MIN_BYTES send the page-aligned middle of each
+ * range through O_DIRECT from an aligned bounce buffer, so large outputs stream at device bandwidth
+ * without filling the page cache; the unaligned edges still go through the page cache.
+ */
+class BMPEncoder {
+public:
+    BMPEncoder() = default;
+    BMPEncoder(const BMPEncoder&) = delete;
+    BMPEncoder& operator=(const BMPEncoder&) = delete;
+
+    // Create `fileName` for a width x height image that keeps the remaining headers, the row order and
+    // the color table of `headerSource` (as createBMPMapped). Prints the reason and returns false on failure.
+    // `concurrentWriters` reserves the disk blocks up front (fallocate), which pays off once several
+    // threads write ranges at once; a single sequential writer is faster on a file that only has its size.
+    bool open(const char* fileName, const Image& headerSource, int width, int height, bool concurrentWriters = false);
+
+    // Write image rows [firstRow, firstRow + rows.height): row r of `rows` becomes image row firstRow + r
+    // (row 0 is the bottom row). Returns false if the write failed; callers report it.
+    bool writeRows(const ImageView& rows, int firstRow);
+
+    // Write the headers if no row range included them yet and close the file. Returns false if any
+    // write failed.
+    bool close();
+
+    const BMPFileHeader& fileHeader() const { return layout.fileHeader; }
+    const BMPInfoHeader& infoHeader() const { return layout.infoHeader; }
+
+private:
+    // Write the slices at `offset`, through the direct handle where it applies
+    bool submit(const std::vector<WriteSlice>& slices, uint64_t offset);
+    void appendHeaderSlices(std::vector<WriteSlice>& slices) const;
+
+    Image layout;                  // Geometry, final headers and color table; owns no pixels.
+    PositionedFile file;
+    PositionedFile direct;         // O_DIRECT handle of the same file (closed unless enabled).
+    std::atomic<bool> headersWritten{false};
+    std::atomic<bool> failed{false};
+};
+
+#endif // BMP_ENCODER_H
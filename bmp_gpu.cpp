@@ -0,0 +1,832 @@
+#include "bmp_gpu.h"
+#include "bmp_kernels.h"
+#include "bmp_simd.h"
+#include "bmp_stats.h"
+#include "bmp_trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// OpenCL is bound at run time through the ICD loader, so only the dynamic loader is needed to build
+#if !defined(BMP_NO_GPU) && defined(__has_include)
+#if __has_include(<dlfcn.h>)
+#include <dlfcn.h>
+#define BMP_HAVE_OPENCL
+#endif
+#endif
+
+using namespace std;
+
+const char* kernelBackendName(KernelBackend backend) {
+    return backend == KERNEL_BACKEND_OPENCL ? "opencl" : "cpu";
+}
+
+bool parseKernelBackend(const char* name, KernelBackend& backend) {
+    if (strcmp(name, "cpu") == 0) {
+        backend = KERNEL_BACKEND_CPU;
+        return true;
+    }
+    if (strcmp(name, "opencl") == 0) {
+        backend = KERNEL_BACKEND_OPENCL;
+        return true;
+    }
+    return false;
+}
+
+#if defined(BMP_HAVE_OPENCL)
+
+// Lowest address of a pixel array with a signed stride: bands move through the device in address order
+static const uint8_t* lowestRow(const uint8_t* pixelData, int height, int rowSize) {
+    return rowSize < 0 ? pixelData + static_cast<ptrdiff_t>(height - 1) * rowSize : pixelData;
+}
+
+// ---------------------------------------------------------------------------
+// OpenCL 1.2 API subset
+// ---------------------------------------------------------------------------
+
+typedef int32_t cl_int;
+typedef uint32_t cl_uint;
+typedef uint32_t cl_bool;
+typedef uint64_t cl_bitfield;
+typedef intptr_t cl_context_properties;
+typedef struct _cl_platform_id* cl_platform_id;
+typedef struct _cl_device_id* cl_device_id;
+typedef struct _cl_context* cl_context;
+typedef struct _cl_command_queue* cl_command_queue;
+typedef struct _cl_program* cl_program;
+typedef struct _cl_kernel* cl_kernel;
+typedef struct _cl_mem* cl_mem;
+typedef struct _cl_event* cl_event;
+
+const cl_int CL_SUCCESS = 0;
+const cl_bool CL_FALSE = 0;
+const cl_bool CL_TRUE = 1;
+const cl_bitfield CL_DEVICE_TYPE_GPU = 1 << 2;
+const cl_bitfield CL_DEVICE_TYPE_ALL = 0xFFFFFFFF;
+const cl_bitfield CL_MEM_READ_WRITE = 1 << 0;
+const cl_bitfield CL_MEM_ALLOC_HOST_PTR = 1 << 4;
+const cl_bitfield CL_MAP_READ = 1 << 0;
+const cl_bitfield CL_MAP_WRITE = 1 << 1;
+const cl_uint CL_DEVICE_NAME = 0x102B;
+const cl_uint CL_PROGRAM_BUILD_LOG = 0x1183;
+
+// Entry points of the ICD loader
+struct OpenCLApi {
+    cl_int (*GetPlatformIDs)(cl_uint, cl_platform_id*, cl_uint*);
+    cl_int (*GetDeviceIDs)(cl_platform_id, cl_bitfield, cl_uint, cl_device_id*, cl_uint*);
+    cl_int (*GetDeviceInfo)(cl_device_id, cl_uint, size_t, void*, size_t*);
+    cl_context (*CreateContext)(const cl_context_properties*, cl_uint, const cl_device_id*,
+                                void (*)(const char*, const void*, size_t, void*), void*, cl_int*);
+    cl_command_queue (*CreateCommandQueue)(cl_context, cl_device_id, cl_bitfield, cl_int*);
+    cl_program (*CreateProgramWithSource)(cl_context, cl_uint, const char**, const size_t*, cl_int*);
+    cl_int (*BuildProgram)(cl_program, cl_uint, const cl_device_id*, const char*, void (*)(cl_program, void*), void*);
+    cl_int (*GetProgramBuildInfo)(cl_program, cl_device_id, cl_uint, size_t, void*, size_t*);
+    cl_kernel (*CreateKernel)(cl_program, const char*, cl_int*);
+    cl_mem (*CreateBuffer)(cl_context, cl_bitfield, size_t, void*, cl_int*);
+    cl_int (*SetKernelArg)(cl_kernel, cl_uint, size_t, const void*);
+    cl_int (*EnqueueWriteBuffer)(cl_command_queue, cl_mem, cl_bool, size_t, size_t, const void*, cl_uint, const cl_event*, cl_event*);
+    cl_int (*EnqueueReadBuffer)(cl_command_queue, cl_mem, cl_bool, size_t, size_t, void*, cl_uint, const cl_event*, cl_event*);
+    cl_int (*EnqueueNDRangeKernel)(cl_command_queue, cl_kernel, cl_uint, const size_t*, const size_t*, const size_t*, cl_uint, const cl_event*, cl_event*);
+    void* (*EnqueueMapBuffer)(cl_command_queue, cl_mem, cl_bool, cl_bitfield, size_t, size_t, cl_uint, const cl_event*, cl_event*, cl_int*);
+    cl_int (*EnqueueUnmapMemObject)(cl_command_queue, cl_mem, void*, cl_uint, const cl_event*, cl_event*);
+    cl_int (*Flush)(cl_command_queue);
+    cl_int (*Finish)(cl_command_queue);
+    cl_int (*WaitForEvents)(cl_uint, const cl_event*);
+    cl_int (*ReleaseEvent)(cl_event);
+    cl_int (*ReleaseMemObject)(cl_mem);
+    cl_int (*ReleaseKernel)(cl_kernel);
+    cl_int (*ReleaseCommandQueue)(cl_command_queue);
+};
+
+template <typename Function>
+static bool bindSymbol(void* library, const char* name, Function& function) {
+    function = reinterpret_cast<Function>(dlsym(library, name));
+    return function != nullptr;
+}
+
+static bool loadOpenCLApi(OpenCLApi& api) {
+    const char* const libraryNames[] = {
+#if defined(__APPLE__)
+        "/System/Library/Frameworks/OpenCL.framework/OpenCL",
+#endif
+        "libOpenCL.so.1", "libOpenCL.so"
+    };
+    void* library = nullptr;
+    for (const char* name : libraryNames) {
+        if ((library = dlopen(name, RTLD_NOW | RTLD_LOCAL)) != nullptr) {
+            break;
+        }
+    }
+    // The library stays loaded for the life of the process
+    return library != nullptr &&
+        bindSymbol(library, "clGetPlatformIDs", api.GetPlatformIDs) &&
+        bindSymbol(library, "clGetDeviceIDs", api.GetDeviceIDs) &&
+        bindSymbol(library, "clGetDeviceInfo", api.GetDeviceInfo) &&
+        bindSymbol(library, "clCreateContext", api.CreateContext) &&
+        bindSymbol(library, "clCreateCommandQueue", api.CreateCommandQueue) &&
+        bindSymbol(library, "clCreateProgramWithSource", api.CreateProgramWithSource) &&
+        bindSymbol(library, "clBuildProgram", api.BuildProgram) &&
+        bindSymbol(library, "clGetProgramBuildInfo", api.GetProgramBuildInfo) &&
+        bindSymbol(library, "clCreateKernel", api.CreateKernel) &&
+        bindSymbol(library, "clCreateBuffer", api.CreateBuffer) &&
+        bindSymbol(library, "clSetKernelArg", api.SetKernelArg) &&
+        bindSymbol(library, "clEnqueueWriteBuffer", api.EnqueueWriteBuffer) &&
+        bindSymbol(library, "clEnqueueReadBuffer", api.EnqueueReadBuffer) &&
+        bindSymbol(library, "clEnqueueNDRangeKernel", api.EnqueueNDRangeKernel) &&
+        bindSymbol(library, "clEnqueueMapBuffer", api.EnqueueMapBuffer) &&
+        bindSymbol(library, "clEnqueueUnmapMemObject", api.EnqueueUnmapMemObject) &&
+        bindSymbol(library, "clFlush", api.Flush) &&
+        bindSymbol(library, "clFinish", api.Finish) &&
+        bindSymbol(library, "clWaitForEvents", api.WaitForEvents) &&
+        bindSymbol(library, "clReleaseEvent", api.ReleaseEvent) &&
+        bindSymbol(library, "clReleaseMemObject", api.ReleaseMemObject) &&
+        bindSymbol(library, "clReleaseKernel", api.ReleaseKernel) &&
+        bindSymbol(library, "clReleaseCommandQueue", api.ReleaseCommandQueue);
+}
+
+// ---------------------------------------------------------------------------
+// Device kernels
+// ---------------------------------------------------------------------------
+
+// One work item per pixel pair (flip) or per byte (quantize, crop); dimension 1 is the row in the band.
+// Quantization uses the host-built table, so the bytes match the CPU kernels exactly.
+static const char* const KERNEL_SOURCE = R"CLC(
+__kernel void flipRows(__global uchar* pixels, int width, int rowSize, int bytesPerPixel) {
+    int x = get_global_id(0);
+    int y = get_global_id(1);
+    if (x >= width / 2) {
+        return;
+    }
+    __global uchar* left = pixels + (size_t)y * rowSize + x * bytesPerPixel;
+    __global uchar* right = pixels + (size_t)y * rowSize + (width - 1 - x) * bytesPerPixel;
+    for (int c = 0; c < bytesPerPixel; ++c) {
+        uchar value = left[c];
+        left[c] = right[c];
+        right[c] = value;
+    }
+}
+
+__kernel void quantizeRows(__global const uchar* source, __global uchar* dest, int rowBytes, int rowSize,
+                           int bytesPerPixel, __constant uchar* table) {
+    int i = get_global_id(0);
+    int y = get_global_id(1);
+    if (i >= rowSize) {
+        return;
+    }
+    // Alpha bytes and the row padding are carried over unchanged
+    size_t offset = (size_t)y * rowSize + i;
+    uchar value = source[offset];
+    bool keep = i >= rowBytes || (bytesPerPixel == 4 && (i & 3) == 3);
+    dest[offset] = keep ? value : table[value];
+}
+
+__kernel void cropRows(__global const uchar* source, __global uchar* dest, int sourceRowSize, int rowBytes, int destRowSize) {
+    int i = get_global_id(0);
+    int y = get_global_id(1);
+    if (i >= destRowSize) {
+        return;
+    }
+    dest[(size_t)y * destRowSize + i] = i < rowBytes ? source[(size_t)y * sourceRowSize + i] : 0;
+}
+)CLC";
+
+// ---------------------------------------------------------------------------
+// Device and per-thread state
+// ---------------------------------------------------------------------------
+
+// Bytes of source rows per band, and bands in flight per thread (upload, kernel, download)
+const size_t GPU_BAND_BYTES = size_t(4) << 20;
+const int GPU_BAND_SLOTS = 3;
+
+// Work-group multiple the global sizes are rounded up to (the kernels bound-check)
+const size_t GPU_GROUP_WIDTH = 64;
+
+// Process-wide device: one context and program, shared by every thread
+struct OpenCLDevice {
+    OpenCLApi api;
+    cl_device_id device = nullptr;
+    cl_context context = nullptr;
+    cl_program program = nullptr;
+    string name;
+    atomic<bool> failed{false};    // Set by the first device error: later calls go straight to the CPU.
+};
+
+// Open the first GPU of any platform, or else the first device of any type
+static OpenCLDevice* openDevice() {
+    unique_ptr<OpenCLDevice> device(new OpenCLDevice());
+    OpenCLApi& cl = device->api;
+    cl_uint platformCount = 0;
+    if (!loadOpenCLApi(cl) || cl.GetPlatformIDs(0, nullptr, &platformCount) != CL_SUCCESS || platformCount == 0) {
+        return nullptr;
+    }
+    vector<cl_platform_id> platforms(platformCount);
+    cl.GetPlatformIDs(platformCount, platforms.data(), nullptr);
+    for (cl_bitfield type : { CL_DEVICE_TYPE_GPU, CL_DEVICE_TYPE_ALL }) {
+        for (cl_platform_id platform : platforms) {
+            cl_uint deviceCount = 0;
+            if (device->device == nullptr && cl.GetDeviceIDs(platform, type, 1, &device->device, &deviceCount) != CL_SUCCESS) {
+                device->device = nullptr;
+            }
+        }
+    }
+    if (device->device == nullptr) {
+        return nullptr;
+    }
+
+    char name[256] = {};
+    cl.GetDeviceInfo(device->device, CL_DEVICE_NAME, sizeof(name) - 1, name, nullptr);
+    device->name = name;
+
+    cl_int error = CL_SUCCESS;
+    device->context = cl.CreateContext(nullptr, 1, &device->device, nullptr, nullptr, &error);
+    if (error != CL_SUCCESS) {
+        return nullptr;
+    }
+    const char* source = KERNEL_SOURCE;
+    device->program = cl.CreateProgramWithSource(device->context, 1, &source, nullptr, &error);
+    if (error != CL_SUCCESS) {
+        return nullptr;
+    }
+    if (cl.BuildProgram(device->program, 1, &device->device, "", nullptr, nullptr) != CL_SUCCESS) {
+        char log[4096] = {};
+        cl.GetProgramBuildInfo(device->program, device->device, CL_PROGRAM_BUILD_LOG, sizeof(log) - 1, log, nullptr);
+        cerr << "OpenCL kernel build failed: " << log << endl;
+        return nullptr;
+    }
+    return device.release();
+}
+
+// The device, or null when there is none (opened once, never closed)
+static OpenCLDevice* openCLDevice() {
+    static OpenCLDevice* const device = openDevice();
+    return device;
+}
+
+// Report the first device error and switch every later call to the CPU kernels
+static bool checkCL(cl_int error, const char* call) {
+    if (error == CL_SUCCESS) {
+        return true;
+    }
+    OpenCLDevice* device = openCLDevice();
+    if (!device->failed.exchange(true)) {
+        cerr << "OpenCL call " << call << " failed (" << error << "); using the CPU kernels." << endl;
+    }
+    return false;
+}
+
+// One band in flight: device buffers plus pinned host staging that stays mapped while it is owned
+struct BandSlot {
+    size_t inputCapacity = 0;
+    size_t outputCapacity = 0;
+    cl_mem deviceInput = nullptr;
+    cl_mem pinnedInput = nullptr;
+    uint8_t* hostInput = nullptr;
+    vector<cl_mem> deviceOutputs;
+    vector<cl_mem> pinnedOutputs;
+    vector<uint8_t*> hostOutputs;
+    vector<cl_event> downloads;    // Pending reads of this band, one per output.
+    int band = -1;                 // Band held by the slot, -1 when free.
+};
+
+/**
+ * State of one calling thread: its own queues (upload, compute, download, so a band's transfers and the
+ * kernels of its neighbours run concurrently), its own kernel objects (kernel arguments are per object)
+ * and its band slots. Created on first use in each thread.
+ */
+class OpenCLWorker {
+public:
+    explicit OpenCLWorker(OpenCLDevice& device);
+    ~OpenCLWorker();
+
+    bool valid() const { return ready; }
+
+    // Make every slot hold `inputBytes` of input and `outputCount` outputs of `outputBytes`
+    bool reserve(size_t inputBytes, size_t outputBytes, int outputCount);
+
+    // Allocate and map a pinned host buffer
+    bool createPinned(size_t bytes, cl_mem& buffer, uint8_t*& host);
+    void releaseSlot(BandSlot& slot);
+
+    OpenCLDevice& device;
+    OpenCLApi& cl;
+    cl_command_queue upload = nullptr;
+    cl_command_queue compute = nullptr;
+    cl_command_queue download = nullptr;
+    cl_kernel flipKernel = nullptr;
+    cl_kernel quantizeKernel = nullptr;
+    cl_kernel cropKernel = nullptr;
+    vector<cl_mem> tables;         // 256-byte quantization tables, one per output.
+    BandSlot slots[GPU_BAND_SLOTS];
+
+private:
+    bool ready = false;
+};
+
+OpenCLWorker::OpenCLWorker(OpenCLDevice& device) : device(device), cl(device.api) {
+    cl_int errors[6];
+    upload = cl.CreateCommandQueue(device.context, device.device, 0, &errors[0]);
+    compute = cl.CreateCommandQueue(device.context, device.device, 0, &errors[1]);
+    download = cl.CreateCommandQueue(device.context, device.device, 0, &errors[2]);
+    flipKernel = cl.CreateKernel(device.program, "flipRows", &errors[3]);
+    quantizeKernel = cl.CreateKernel(device.program, "quantizeRows", &errors[4]);
+    cropKernel = cl.CreateKernel(device.program, "cropRows", &errors[5]);
+    ready = true;
+    for (cl_int error : errors) {
+        ready = checkCL(error, "clCreateCommandQueue/clCreateKernel") && ready;
+    }
+}
+
+OpenCLWorker::~OpenCLWorker() {
+    for (BandSlot& slot : slots) {
+        releaseSlot(slot);
+    }
+    for (cl_mem table : tables) {
+        cl.ReleaseMemObject(table);
+    }
+    for (cl_kernel kernel : { flipKernel, quantizeKernel, cropKernel }) {
+        if (kernel != nullptr) {
+            cl.ReleaseKernel(kernel);
+        }
+    }
+    for (cl_command_queue queue : { upload, compute, download }) {
+        if (queue != nullptr) {
+            cl.ReleaseCommandQueue(queue);
+        }
+    }
+}
+
+bool OpenCLWorker::createPinned(size_t bytes, cl_mem& buffer, uint8_t*& host) {
+    cl_int error = CL_SUCCESS;
+    buffer = cl.CreateBuffer(device.context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, bytes, nullptr, &error);
+    if (!checkCL(error, "clCreateBuffer")) {
+        buffer = nullptr;
+        return false;
+    }
+    host = static_cast<uint8_t*>(cl.EnqueueMapBuffer(upload, buffer, CL_TRUE, CL_MAP_READ | CL_MAP_WRITE, 0, bytes, 0, nullptr, nullptr, &error));
+    return checkCL(error, "clEnqueueMapBuffer");
+}
+
+void OpenCLWorker::releaseSlot(BandSlot& slot) {
+    auto releasePinned = [&](cl_mem buffer, uint8_t* host) {
+        if (buffer != nullptr) {
+            if (host != nullptr) {
+                cl.EnqueueUnmapMemObject(upload, buffer, host, 0, nullptr, nullptr);
+            }
+            cl.ReleaseMemObject(buffer);
+        }
+    };
+    if (slot.deviceInput != nullptr) {
+        cl.ReleaseMemObject(slot.deviceInput);
+    }
+    releasePinned(slot.pinnedInput, slot.hostInput);
+    for (size_t i = 0; i < slot.deviceOutputs.size(); ++i) {
+        if (slot.deviceOutputs[i] != nullptr) {
+            cl.ReleaseMemObject(slot.deviceOutputs[i]);
+        }
+        releasePinned(slot.pinnedOutputs[i], slot.hostOutputs[i]);
+    }
+    if (upload != nullptr) {
+        cl.Finish(upload);
+    }
+    slot = BandSlot();
+}
+
+bool OpenCLWorker::reserve(size_t inputBytes, size_t outputBytes, int outputCount) {
+    for (BandSlot& slot : slots) {
+        // Buffers only grow, so a batch of similar images allocates and pins them once
+        bool fits = slot.inputCapacity >= inputBytes && slot.deviceOutputs.size() >= static_cast<size_t>(outputCount) &&
+                    (outputCount == 0 || slot.outputCapacity >= outputBytes);
+        if (fits) {
+            continue;
+        }
+        size_t inputCapacity = max(inputBytes, slot.inputCapacity);
+        size_t outputCapacity = max(outputBytes, slot.outputCapacity);
+        size_t outputSlots = max(static_cast<size_t>(outputCount), slot.deviceOutputs.size());
+        releaseSlot(slot);
+        cl_int error = CL_SUCCESS;
+        slot.inputCapacity = inputCapacity;
+        slot.deviceInput = cl.CreateBuffer(device.context, CL_MEM_READ_WRITE, inputCapacity, nullptr, &error);
+        if (!checkCL(error, "clCreateBuffer") || !createPinned(inputCapacity, slot.pinnedInput, slot.hostInput)) {
+            return false;
+        }
+        slot.outputCapacity = outputSlots > 0 ? outputCapacity : 0;
+        slot.deviceOutputs.assign(outputSlots, nullptr);
+        slot.pinnedOutputs.assign(outputSlots, nullptr);
+        slot.hostOutputs.assign(outputSlots, nullptr);
+        for (size_t i = 0; i < outputSlots; ++i) {
+            slot.deviceOutputs[i] = cl.CreateBuffer(device.context, CL_MEM_READ_WRITE, outputCapacity, nullptr, &error);
+            if (!checkCL(error, "clCreateBuffer") || !createPinned(outputCapacity, slot.pinnedOutputs[i], slot.hostOutputs[i])) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Worker of the calling thread, or null when the device is missing or has failed
+static OpenCLWorker* threadWorker() {
+    OpenCLDevice* device = openCLDevice();
+    if (device == nullptr || device->failed) {
+        return nullptr;
+    }
+    thread_local unique_ptr<OpenCLWorker> worker;
+    if (!worker) {
+        worker.reset(new OpenCLWorker(*device));
+    }
+    return worker->valid() ? worker.get() : nullptr;
+}
+
+// ---------------------------------------------------------------------------
+// Band pipeline
+// ---------------------------------------------------------------------------
+
+/**
+ * A pass over `rows` rows in address order. Each band of source rows (`sourceSpan` bytes of each row,
+ * `sourceStride` apart) is copied into pinned staging and uploaded; `launch` queues the kernels of the
+ * band on the compute queue and returns the event of the last one; then each output is downloaded and
+ * copied to its destination rows (`outputStride` apart). Without outputs the kernels work in place
+ * and the band is written back to the source.
+ */
+struct BandJob {
+    const uint8_t* source = nullptr;
+    size_t sourceStride = 0;
+    size_t sourceSpan = 0;
+    int rows = 0;
+    vector<uint8_t*> outputs;      // Destination of row 0 of each output (in-place: the source itself).
+    size_t outputStride = 0;
+    size_t outputRowBytes = 0;     // Bytes per row produced on the device.
+    bool inPlace = false;
+
+    // (slot, rows in this band, upload event) -> kernel event; null on failure.
+    function<cl_event(OpenCLWorker&, BandSlot&, int, cl_event)> launch;
+};
+
+// Wait for the downloads of the band a slot holds and copy them out. Without `copy` the slot is only drained.
+static bool finishBand(OpenCLWorker& worker, BandSlot& slot, const BandJob& job, int bandRows, bool copy) {
+    bool success = slot.downloads.empty() ||
+                   checkCL(worker.cl.WaitForEvents(static_cast<cl_uint>(slot.downloads.size()), slot.downloads.data()), "clWaitForEvents");
+    for (cl_event event : slot.downloads) {
+        worker.cl.ReleaseEvent(event);
+    }
+    slot.downloads.clear();
+    if (success && copy) {
+        int firstRow = slot.band * bandRows;
+        int rowCount = min(bandRows, job.rows - firstRow);
+        for (size_t j = 0; j < job.outputs.size(); ++j) {
+            const uint8_t* staged = job.inPlace ? slot.hostInput : slot.hostOutputs[j];
+            uint8_t* dest = job.outputs[j] + static_cast<size_t>(firstRow) * job.outputStride;
+            if (job.outputStride == job.outputRowBytes) {
+                memcpy(dest, staged, static_cast<size_t>(rowCount) * job.outputRowBytes);
+            } else {
+                for (int r = 0; r < rowCount; ++r) {
+                    memcpy(dest + static_cast<size_t>(r) * job.outputStride, staged + static_cast<size_t>(r) * job.outputRowBytes, job.outputRowBytes);
+                }
+            }
+        }
+    }
+    slot.band = -1;
+    return success;
+}
+
+// Run a job; returns the number of leading rows whose results were written (job.rows on success)
+static int runBands(OpenCLWorker& worker, const BandJob& job) {
+    OpenCLApi& cl = worker.cl;
+    int bandRows = static_cast<int>(max<size_t>(1, GPU_BAND_BYTES / max(job.sourceSpan, job.outputRowBytes)));
+    bandRows = min(bandRows, job.rows);
+    int bandCount = (job.rows + bandRows - 1) / bandRows;
+    size_t outputBytes = static_cast<size_t>(bandRows) * job.outputRowBytes;
+    if (!worker.reserve(static_cast<size_t>(bandRows) * max(job.sourceSpan, job.inPlace ? job.outputRowBytes : 0), outputBytes,
+                        job.inPlace ? 0 : static_cast<int>(job.outputs.size()))) {
+        return 0;
+    }
+
+    int rowsDone = 0;
+    bool success = true;
+    for (int band = 0; band < bandCount && success; ++band) {
+        // A slot is reused once the band it held three steps ago has been copied out
+        BandSlot& slot = worker.slots[band % GPU_BAND_SLOTS];
+        if (slot.band >= 0) {
+            int held = slot.band;
+            success = finishBand(worker, slot, job, bandRows, true);
+            if (!success) {
+                break;
+            }
+            rowsDone = min(job.rows, (held + 1) * bandRows);
+        }
+
+        int firstRow = band * bandRows;
+        int rowCount = min(bandRows, job.rows - firstRow);
+        const uint8_t* source = job.source + static_cast<size_t>(firstRow) * job.sourceStride;
+        if (job.sourceSpan == job.sourceStride) {
+            memcpy(slot.hostInput, source, static_cast<size_t>(rowCount) * job.sourceSpan);
+        } else {
+            for (int r = 0; r < rowCount; ++r) {
+                memcpy(slot.hostInput + static_cast<size_t>(r) * job.sourceSpan, source + static_cast<size_t>(r) * job.sourceStride, job.sourceSpan);
+            }
+        }
+
+        cl_event uploaded = nullptr;
+        success = checkCL(cl.EnqueueWriteBuffer(worker.upload, slot.deviceInput, CL_FALSE, 0, static_cast<size_t>(rowCount) * job.sourceSpan,
+                                                slot.hostInput, 0, nullptr, &uploaded), "clEnqueueWriteBuffer");
+        cl_event computed = success ? job.launch(worker, slot, rowCount, uploaded) : nullptr;
+        success = success && computed != nullptr;
+        for (size_t j = 0; success && j < job.outputs.size(); ++j) {
+            cl_mem produced = job.inPlace ? slot.deviceInput : slot.deviceOutputs[j];
+            uint8_t* staged = job.inPlace ? slot.hostInput : slot.hostOutputs[j];
+            cl_event downloaded = nullptr;
+            success = checkCL(cl.EnqueueReadBuffer(worker.download, produced, CL_FALSE, 0, static_cast<size_t>(rowCount) * job.outputRowBytes,
+                                                   staged, 1, &computed, &downloaded), "clEnqueueReadBuffer");
+            if (success) {
+                slot.downloads.push_back(downloaded);
+            }
+        }
+        for (cl_event event : { uploaded, computed }) {
+            if (event != nullptr) {
+                cl.ReleaseEvent(event);
+            }
+        }
+        slot.band = band;
+
+        // Start the device on this band while the next one is staged
+        cl.Flush(worker.upload);
+        cl.Flush(worker.compute);
+        cl.Flush(worker.download);
+    }
+
+    // Copy out the bands still in flight, in order; after a failure only drain them
+    for (int band = max(0, bandCount - GPU_BAND_SLOTS); band < bandCount; ++band) {
+        BandSlot& slot = worker.slots[band % GPU_BAND_SLOTS];
+        if (slot.band == band) {
+            bool copied = finishBand(worker, slot, job, bandRows, success);
+            success = success && copied;
+            if (success) {
+                rowsDone = min(job.rows, (band + 1) * bandRows);
+            }
+        }
+    }
+    if (!success) {
+        cl.Finish(worker.upload);
+        cl.Finish(worker.compute);
+        cl.Finish(worker.download);
+        for (BandSlot& slot : worker.slots) {
+            finishBand(worker, slot, job, bandRows, false);
+        }
+    }
+    return rowsDone;
+}
+
+// Queue one 2-D kernel over `columns` x `rows` work items after `after`
+static cl_event enqueueKernel(OpenCLWorker& worker, cl_kernel kernel, size_t columns, int rows, cl_event after) {
+    size_t global[2] = { (columns + GPU_GROUP_WIDTH - 1) / GPU_GROUP_WIDTH * GPU_GROUP_WIDTH, static_cast<size_t>(rows) };
+    cl_event done = nullptr;
+    if (!checkCL(worker.cl.EnqueueNDRangeKernel(worker.compute, kernel, 2, nullptr, global, nullptr, after ? 1 : 0, after ? &after : nullptr, &done),
+                 "clEnqueueNDRangeKernel")) {
+        return nullptr;
+    }
+    return done;
+}
+
+// Set kernel arguments in order; each value is a cl_mem or a cl_int
+template <typename... Values>
+static bool setKernelArgs(OpenCLWorker& worker, cl_kernel kernel, const Values&... values) {
+    cl_uint index = 0;
+    bool success = true;
+    for (bool set : { (worker.cl.SetKernelArg(kernel, index++, sizeof(values), &values) == CL_SUCCESS)... }) {
+        success = success && set;
+    }
+    return checkCL(success ? CL_SUCCESS : -1, "clSetKernelArg");
+}
+
+// Upload the quantization tables of a call (256 bytes each)
+static bool uploadTables(OpenCLWorker& worker, const vector<QuantizationTable>& tables) {
+    cl_int error = CL_SUCCESS;
+    while (worker.tables.size() < tables.size()) {
+        worker.tables.push_back(worker.cl.CreateBuffer(worker.device.context, CL_MEM_READ_WRITE, 256, nullptr, &error));
+        if (!checkCL(error, "clCreateBuffer")) {
+            worker.tables.pop_back();
+            return false;
+        }
+    }
+    for (size_t i = 0; i < tables.size(); ++i) {
+        if (!checkCL(worker.cl.EnqueueWriteBuffer(worker.upload, worker.tables[i], CL_TRUE, 0, 256, tables[i].table, 0, nullptr, nullptr),
+                     "clEnqueueWriteBuffer")) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool openCLAvailable() {
+    return openCLDevice() != nullptr;
+}
+
+// In-place pass of a row kernel over the whole pixel array: rows the device did not finish are
+// returned so the caller can complete them on the CPU
+static int runInPlace(OpenCLWorker& worker, uint8_t* base, size_t stride, int height,
+                      const function<cl_event(OpenCLWorker&, BandSlot&, int, cl_event)>& launch) {
+    BandJob job;
+    job.source = base;
+    job.sourceStride = stride;
+    job.sourceSpan = stride;
+    job.rows = height;
+    job.outputs = { base };
+    job.outputStride = stride;
+    job.outputRowBytes = stride;
+    job.inPlace = true;
+    job.launch = launch;
+    return runBands(worker, job);
+}
+
+#else
+
+bool openCLAvailable() {
+    return false;
+}
+
+#endif
+
+KernelBackend preferredKernelBackend() {
+    static const KernelBackend backend = [] {
+        const char* requested = getenv("BMP_BACKEND");
+        if (requested == nullptr || strcmp(requested, "opencl") != 0) {
+            return KERNEL_BACKEND_CPU;
+        }
+        if (!openCLAvailable()) {
+            cerr << "No OpenCL device found; using the CPU kernels." << endl;
+            return KERNEL_BACKEND_CPU;
+        }
+        return KERNEL_BACKEND_OPENCL;
+    }();
+    return backend;
+}
+
+// ---------------------------------------------------------------------------
+// Kernels
+// ---------------------------------------------------------------------------
+
+void gpuFlipHorizontally(uint8_t* pixelData, int width, int height, int rowSize, int bytesPerPixel, int threadCount, ImageStats* stats) {
+#if defined(BMP_HAVE_OPENCL)
+    OpenCLWorker* worker = width >= 2 ? threadWorker() : nullptr;
+    if (worker != nullptr) {
+        BMP_TRACE_SCOPE(trace, "gpu.flip", static_cast<uint64_t>(width) * bytesPerPixel * height);
+
+        // Flip is in place: each band is uploaded, mirrored on the device and written back
+        size_t stride = static_cast<size_t>(rowSize < 0 ? -rowSize : rowSize);
+        uint8_t* base = const_cast<uint8_t*>(lowestRow(pixelData, height, rowSize));
+        int rowsDone = runInPlace(*worker, base, stride, height, [&](OpenCLWorker& w, BandSlot& slot, int rows, cl_event uploaded) -> cl_event {
+            cl_int widthArg = width, rowSizeArg = static_cast<cl_int>(stride), bytesArg = bytesPerPixel;
+            if (!setKernelArgs(w, w.flipKernel, slot.deviceInput, widthArg, rowSizeArg, bytesArg)) {
+                return nullptr;
+            }
+            return enqueueKernel(w, w.flipKernel, static_cast<size_t>(width / 2), rows, uploaded);
+        });
+
+        // Rows the device did not finish are flipped on the CPU
+        if (rowsDone < height) {
+            flipHorizontally(base + static_cast<size_t>(rowsDone) * stride, width, height - rowsDone, static_cast<int>(stride), bytesPerPixel, threadCount);
+        }
+        if (stats != nullptr) {
+            computeImageStats(pixelData, width, height, rowSize, bytesPerPixel, *stats, threadCount);
+        }
+        return;
+    }
+#endif
+    flipHorizontally(pixelData, width, height, rowSize, bytesPerPixel, threadCount, stats);
+}
+
+void gpuQuantizePixelData(uint8_t* pixelData, int bytesPerPixel, int width, int height, int rowSize, int quantizationBits, int threadCount, ImageStats* stats) {
+#if defined(BMP_HAVE_OPENCL)
+    // Palette indices are not colors and are left as they are (see quantizeRowKernel): that stays on the CPU
+    OpenCLWorker* worker = bytesPerPixel >= 3 ? threadWorker() : nullptr;
+    vector<QuantizationTable> tables(1);
+    buildQuantizationTable(quantizationBits, tables[0]);
+    if (worker != nullptr && uploadTables(*worker, tables)) {
+        BMP_TRACE_SCOPE(trace, "gpu.quantize", static_cast<uint64_t>(width) * bytesPerPixel * height);
+
+        size_t stride = static_cast<size_t>(rowSize < 0 ? -rowSize : rowSize);
+        uint8_t* base = const_cast<uint8_t*>(lowestRow(pixelData, height, rowSize));
+        int rowsDone = runInPlace(*worker, base, stride, height, [&](OpenCLWorker& w, BandSlot& slot, int rows, cl_event uploaded) -> cl_event {
+            cl_int rowBytes = width * bytesPerPixel, rowSizeArg = static_cast<cl_int>(stride), bytesArg = bytesPerPixel;
+            if (!setKernelArgs(w, w.quantizeKernel, slot.deviceInput, slot.deviceInput, rowBytes, rowSizeArg, bytesArg, w.tables[0])) {
+                return nullptr;
+            }
+            return enqueueKernel(w, w.quantizeKernel, stride, rows, uploaded);
+        });
+        if (rowsDone < height) {
+            quantizePixelData(base + static_cast<size_t>(rowsDone) * stride, bytesPerPixel, width, height - rowsDone, static_cast<int>(stride), quantizationBits, threadCount);
+        }
+        if (stats != nullptr) {
+            computeImageStats(pixelData, width, height, rowSize, bytesPerPixel, *stats, threadCount);
+        }
+        return;
+    }
+#endif
+    quantizePixelData(pixelData, bytesPerPixel, width, height, rowSize, quantizationBits, threadCount, stats);
+}
+
+void gpuQuantizePixelDataMulti(const uint8_t* pixelData, const vector<uint8_t*>& outputs, const vector<int>& quantizationBits, int bytesPerPixel, int width, int height, int rowSize, int threadCount, vector<ImageStats>* stats) {
+#if defined(BMP_HAVE_OPENCL)
+    OpenCLWorker* worker = bytesPerPixel >= 3 ? threadWorker() : nullptr;
+    vector<QuantizationTable> tables(quantizationBits.size());
+    for (size_t i = 0; i < tables.size(); ++i) {
+        buildQuantizationTable(quantizationBits[i], tables[i]);
+    }
+    if (worker != nullptr && !outputs.empty() && uploadTables(*worker, tables)) {
+        BMP_TRACE_SCOPE(trace, "gpu.quantize.multi", static_cast<uint64_t>(width) * bytesPerPixel * height * (outputs.size() + 1));
+
+        // Each band is uploaded once and quantized into one device buffer per bit depth
+        size_t stride = static_cast<size_t>(rowSize < 0 ? -rowSize : rowSize);
+        BandJob job;
+        job.source = lowestRow(pixelData, height, rowSize);
+        job.sourceStride = stride;
+        job.sourceSpan = stride;
+        job.rows = height;
+        for (uint8_t* output : outputs) {
+            job.outputs.push_back(const_cast<uint8_t*>(lowestRow(output, height, rowSize)));
+        }
+        job.outputStride = stride;
+        job.outputRowBytes = stride;
+        job.launch = [&](OpenCLWorker& w, BandSlot& slot, int rows, cl_event uploaded) -> cl_event {
+            // The compute queue is in order: only the first kernel has to wait for the upload
+            cl_event last = nullptr;
+            for (size_t i = 0; i < tables.size(); ++i) {
+                cl_int rowBytes = width * bytesPerPixel, rowSizeArg = static_cast<cl_int>(stride), bytesArg = bytesPerPixel;
+                cl_event done = nullptr;
+                if (setKernelArgs(w, w.quantizeKernel, slot.deviceInput, slot.deviceOutputs[i], rowBytes, rowSizeArg, bytesArg, w.tables[i])) {
+                    done = enqueueKernel(w, w.quantizeKernel, stride, rows, i == 0 ? uploaded : nullptr);
+                }
+                if (last != nullptr) {
+                    w.cl.ReleaseEvent(last);
+                }
+                last = done;
+                if (last == nullptr) {
+                    return nullptr;
+                }
+            }
+            return last;
+        };
+
+        // The source is never modified, so a failed pass is simply redone on the CPU
+        if (runBands(*worker, job) == height) {
+            if (stats != nullptr) {
+                stats->resize(outputs.size());
+                for (size_t i = 0; i < outputs.size(); ++i) {
+                    computeImageStats(outputs[i], width, height, rowSize, bytesPerPixel, (*stats)[i], threadCount);
+                }
+            }
+            return;
+        }
+    }
+#endif
+    quantizePixelDataMulti(pixelData, outputs, quantizationBits, bytesPerPixel, width, height, rowSize, threadCount, stats);
+}
+
+void gpuCropImage(const uint8_t* inputPixelData, uint8_t* croppedPixelData, int originalWidth, int originalHeight, int bytesPerPixel, int rowSize, int x, int y, int cropWidth, int cropHeight, int threadCount) {
+#if defined(BMP_HAVE_OPENCL)
+    OpenCLWorker* worker = threadWorker();
+    if (worker != nullptr) {
+        BMP_TRACE_SCOPE(trace, "gpu.crop", static_cast<uint64_t>(cropWidth) * bytesPerPixel * cropHeight);
+
+        // Only the ROI columns are staged and uploaded; the device pads them into output rows.
+        // Source and crop rows keep the same order, so both are walked in address order.
+        size_t stride = static_cast<size_t>(rowSize < 0 ? -rowSize : rowSize);
+        int croppedRowSize = calculateRowSize(cropWidth, bytesPerPixel);
+        int croppedStride = rowSize < 0 ? -croppedRowSize : croppedRowSize;
+        size_t rowBytes = static_cast<size_t>(cropWidth) * bytesPerPixel;
+        const uint8_t* roi = inputPixelData + static_cast<ptrdiff_t>(y) * rowSize + static_cast<size_t>(x) * bytesPerPixel;
+        BandJob job;
+        job.source = lowestRow(roi, cropHeight, rowSize);
+        job.sourceStride = stride;
+        job.sourceSpan = rowBytes;
+        job.rows = cropHeight;
+        job.outputs = { const_cast<uint8_t*>(lowestRow(croppedPixelData, cropHeight, croppedStride)) };
+        job.outputStride = static_cast<size_t>(croppedRowSize);
+        job.outputRowBytes = static_cast<size_t>(croppedRowSize);
+        job.launch = [&](OpenCLWorker& w, BandSlot& slot, int rows, cl_event uploaded) -> cl_event {
+            cl_int sourceRowSize = static_cast<cl_int>(rowBytes), rowBytesArg = static_cast<cl_int>(rowBytes), destRowSize = croppedRowSize;
+            if (!setKernelArgs(w, w.cropKernel, slot.deviceInput, slot.deviceOutputs[0], sourceRowSize, rowBytesArg, destRowSize)) {
+                return nullptr;
+            }
+            return enqueueKernel(w, w.cropKernel, static_cast<size_t>(croppedRowSize), rows, uploaded);
+        };
+        if (runBands(*worker, job) == cropHeight) {
+            return;
+        }
+    }
+#endif
+    cropImage(inputPixelData, croppedPixelData, originalWidth, originalHeight, bytesPerPixel, rowSize, x, y, cropWidth, cropHeight, threadCount);
+}
+
+const KernelSet& kernelSet(KernelBackend backend) {
+    static const KernelSet cpuKernels = { flipHorizontally, quantizePixelData, quantizePixelDataMulti, cropImage };
+    static const KernelSet gpuKernels = { gpuFlipHorizontally, gpuQuantizePixelData, gpuQuantizePixelDataMulti, gpuCropImage };
+    return backend == KERNEL_BACKEND_OPENCL ? gpuKernels : cpuKernels;
+}
@@ -0,0 +1,57 @@
+#ifndef BMP_GPU_H
+#define BMP_GPU_H
+
+#include <cstdint>
+#include <vector>
+
+struct ImageStats;
+
+// Where the bulk kernels run
+enum KernelBackend {
+    KERNEL_BACKEND_CPU,
+    KERNEL_BACKEND_OPENCL
+};
+
+const char* kernelBackendName(KernelBackend backend);
+
+// Parse "cpu" or "opencl". Returns false for any other name.
+bool parseKernelBackend(const char* name, KernelBackend& backend);
+
+// Whether an OpenCL device could be opened (probed once). OpenCL is loaded at run time from the
+// system's ICD loader (libOpenCL), so no OpenCL SDK is needed to build; -DBMP_NO_GPU leaves it out.
+bool openCLAvailable();
+
+// Backend selected by BMP_BACKEND=cpu|opencl (default cpu). A request for OpenCL without a usable
+// device falls back to the CPU with a note on stderr.
+KernelBackend preferredKernelBackend();
+
+/**
+ * OpenCL versions of the bulk kernels, with the signatures of their CPU counterparts (bmp_kernels.h).
+ * The pixel array moves through the device in row bands. Each calling thread has its own command
+ * queues and pinned (page-locked) staging buffers, and a band's upload, kernel and download are
+ * separate queued commands, so the transfers of one band overlap the kernels of the others, and
+ * concurrent batch workers overlap whole images. Results are bit-identical to the CPU kernels.
+ * Without a device, or after any device error, the CPU kernels produce the result instead.
+ * `threadCount` only applies to the CPU fallback; `stats` are counted on the host after the download.
+ */
+void gpuFlipHorizontally(uint8_t* pixelData, int width, int height, int rowSize, int bytesPerPixel, int threadCount = 1, ImageStats* stats = nullptr);
+void gpuQuantizePixelData(uint8_t* pixelData, int bytesPerPixel, int width, int height, int rowSize, int quantizationBits, int threadCount = 1, ImageStats* stats = nullptr);
+void gpuQuantizePixelDataMulti(const uint8_t* pixelData, const std::vector<uint8_t*>& outputs, const std::vector<int>& quantizationBits, int bytesPerPixel, int width, int height, int rowSize, int threadCount = 1, std::vector<ImageStats>* stats = nullptr);
+void gpuCropImage(const uint8_t* inputPixelData, uint8_t* croppedPixelData, int originalWidth, int originalHeight, int bytesPerPixel, int rowSize, int x, int y, int cropWidth, int cropHeight, int threadCount = 1);
+
+// Kernel table of one backend: callers select it once and call through it.
+typedef void (*FlipKernel)(uint8_t* pixelData, int width, int height, int rowSize, int bytesPerPixel, int threadCount, ImageStats* stats);
+typedef void (*QuantizeKernel)(uint8_t* pixelData, int bytesPerPixel, int width, int height, int rowSize, int quantizationBits, int threadCount, ImageStats* stats);
+typedef void (*QuantizeMultiKernel)(const uint8_t* pixelData, const std::vector<uint8_t*>& outputs, const std::vector<int>& quantizationBits, int bytesPerPixel, int width, int height, int rowSize, int threadCount, std::vector<ImageStats>* stats);
+typedef void (*CropKernel)(const uint8_t* inputPixelData, uint8_t* croppedPixelData, int originalWidth, int originalHeight, int bytesPerPixel, int rowSize, int x, int y, int cropWidth, int cropHeight, int threadCount);
+
+struct KernelSet {
+    FlipKernel flipHorizontally;
+    QuantizeKernel quantizePixelData;
+    QuantizeMultiKernel quantizePixelDataMulti;
+    CropKernel cropImage;
+};
+
+const KernelSet& kernelSet(KernelBackend backend);
+
+#endif // BMP_GPU_H
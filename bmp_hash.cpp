@@ -0,0 +1,130 @@
+#include "bmp_hash.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+// XXH64 primes
+const uint64_t PRIME64_1 = 0x9E3779B185EBCA87ULL;
+const uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+const uint64_t PRIME64_3 = 0x165667B19E3779F9ULL;
+const uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+const uint64_t PRIME64_5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t rotateLeft(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+// Little-endian loads, unaligned
+static inline uint64_t read64(const uint8_t* p) {
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint32_t read32(const uint8_t* p) {
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline uint64_t round64(uint64_t accumulator, uint64_t input) {
+    accumulator += input * PRIME64_2;
+    accumulator = rotateLeft(accumulator, 31);
+    return accumulator * PRIME64_1;
+}
+
+static inline uint64_t mergeRound(uint64_t accumulator, uint64_t lane) {
+    accumulator ^= round64(0, lane);
+    return accumulator * PRIME64_1 + PRIME64_4;
+}
+
+Hasher64::Hasher64(uint64_t seed) : seed(seed) {
+    lanes[0] = seed + PRIME64_1 + PRIME64_2;
+    lanes[1] = seed + PRIME64_2;
+    lanes[2] = seed;
+    lanes[3] = seed - PRIME64_1;
+}
+
+void Hasher64::update(const void* data, size_t length) {
+    const uint8_t* input = static_cast<const uint8_t*>(data);
+    totalLength += length;
+
+    // Complete a stripe left over from the previous call first
+    if (buffered > 0) {
+        size_t take = min(length, sizeof(buffer) - buffered);
+        memcpy(buffer + buffered, input, take);
+        buffered += take;
+        input += take;
+        length -= take;
+        if (buffered < sizeof(buffer)) {
+            return;
+        }
+        for (int lane = 0; lane < 4; ++lane) {
+            lanes[lane] = round64(lanes[lane], read64(buffer + lane * 8));
+        }
+        buffered = 0;
+    }
+
+    // Four independent lanes of 8 bytes per stripe: the multiplies of different lanes overlap
+    uint64_t v1 = lanes[0], v2 = lanes[1], v3 = lanes[2], v4 = lanes[3];
+    for (; length >= 32; input += 32, length -= 32) {
+        v1 = round64(v1, read64(input));
+        v2 = round64(v2, read64(input + 8));
+        v3 = round64(v3, read64(input + 16));
+        v4 = round64(v4, read64(input + 24));
+    }
+    lanes[0] = v1;
+    lanes[1] = v2;
+    lanes[2] = v3;
+    lanes[3] = v4;
+
+    memcpy(buffer, input, length);
+    buffered = length;
+}
+
+uint64_t Hasher64::digest() const {
+    uint64_t hash;
+    if (totalLength >= 32) {
+        hash = rotateLeft(lanes[0], 1) + rotateLeft(lanes[1], 7) + rotateLeft(lanes[2], 12) + rotateLeft(lanes[3], 18);
+        for (int lane = 0; lane < 4; ++lane) {
+            hash = mergeRound(hash, lanes[lane]);
+        }
+    } else {
+        hash = seed + PRIME64_5;
+    }
+    hash += totalLength;
+
+    // Tail: the buffered bytes in 8-, 4- and 1-byte steps
+    const uint8_t* p = buffer;
+    size_t remaining = buffered;
+    for (; remaining >= 8; p += 8, remaining -= 8) {
+        hash ^= round64(0, read64(p));
+        hash = rotateLeft(hash, 27) * PRIME64_1 + PRIME64_4;
+    }
+    if (remaining >= 4) {
+        hash ^= static_cast<uint64_t>(read32(p)) * PRIME64_1;
+        hash = rotateLeft(hash, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+        remaining -= 4;
+    }
+    for (; remaining > 0; ++p, --remaining) {
+        hash ^= *p * PRIME64_5;
+        hash = rotateLeft(hash, 11) * PRIME64_1;
+    }
+
+    // Avalanche
+    hash ^= hash >> 33;
+    hash *= PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= PRIME64_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+uint64_t hash64(const void* data, size_t length, uint64_t seed) {
+    Hasher64 hasher(seed);
+    hasher.update(data, length);
+    return hasher.digest();
+}
@@ -0,0 +1,32 @@
+#ifndef BMP_HASH_H
+#define BMP_HASH_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Streaming 64-bit xxHash (XXH64). Feeding the bytes in any number of update() calls gives the same
+ * digest as hashing them at once, so a loader can hash each chunk right after reading it, while it is
+ * still in cache. Not a cryptographic hash: it identifies content, it does not authenticate it.
+ */
+class Hasher64 {
+public:
+    explicit Hasher64(uint64_t seed = 0);
+
+    void update(const void* data, size_t length);
+
+    // Digest of everything fed so far; update() may continue afterwards.
+    uint64_t digest() const;
+
+private:
+    uint64_t lanes[4];
+    uint64_t seed;
+    uint64_t totalLength = 0;
+    uint8_t buffer[32];             // Bytes of an incomplete 32-byte stripe.
+    size_t buffered = 0;
+};
+
+// XXH64 of one buffer.
+uint64_t hash64(const void* data, size_t length, uint64_t seed = 0);
+
+#endif // BMP_HASH_H
@@ -0,0 +1,618 @@
+#include "bmp_image.h"
+#include "bmp_encoder.h"
+#include "bmp_hash.h"
+#include "bmp_parallel.h"
+#include "bmp_rle.h"
+#include "bmp_trace.h"
+
+#include <algorithm>
+#include <iostream>
+#include <fstream>
+#include <cerrno>
+#include <climits>
+#include <cstring>
+#include <atomic>
+#include <utility>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// ---------------------------------------------------------------------------
+// MappedFile
+// ---------------------------------------------------------------------------
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept {
+    *this = move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        close();
+        address = other.address;
+        length = other.length;
+#ifdef _WIN32
+        buffer = move(other.buffer);
+        path = move(other.path);
+        writable = other.writable;
+#else
+        fd = other.fd;
+        other.fd = -1;
+        fallback = move(other.fallback);
+#endif
+        other.address = nullptr;
+        other.length = 0;
+    }
+    return *this;
+}
+
+#ifdef _WIN32
+
+bool MappedFile::openPrivate(const char* fileName) {
+    close();
+    ifstream file(fileName, ios::binary | ios::ate);
+    if (!file) {
+        return false;
+    }
+    buffer.resize(static_cast<size_t>(file.tellg()));
+    file.seekg(0, ios::beg);
+    file.read(reinterpret_cast<char*>(buffer.data()), buffer.size());
+    if (!file || buffer.empty()) {
+        buffer.clear();
+        return false;
+    }
+    address = buffer.data();
+    length = buffer.size();
+    writable = false;
+    return true;
+}
+
+bool MappedFile::create(const char* fileName, size_t size) {
+    close();
+    buffer.assign(size, 0);
+    path = fileName;
+    address = buffer.data();
+    length = size;
+    writable = true;
+    return true;
+}
+
+bool MappedFile::flush() {
+    if (!writable) {
+        return true;
+    }
+    ofstream file(path.c_str(), ios::binary);
+    file.write(reinterpret_cast<const char*>(buffer.data()), buffer.size());
+    return static_cast<bool>(file);
+}
+
+void MappedFile::close() {
+    buffer.clear();
+    path.clear();
+    address = nullptr;
+    length = 0;
+    writable = false;
+}
+
+#else
+
+bool MappedFile::openPrivate(const char* fileName) {
+    close();
+    fd = ::open(fileName, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size <= 0) {
+        close();
+        return false;
+    }
+    length = static_cast<size_t>(fileStat.st_size);
+
+    // PROT_WRITE on a MAP_PRIVATE mapping gives copy-on-write pages: in-place kernels only pay
+    // for the pages they actually touch, and the input file is never modified.
+    void* mapped = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    if (mapped == MAP_FAILED) {
+        close();
+        return false;
+    }
+    address = static_cast<uint8_t*>(mapped);
+
+    // The kernels walk the image row by row from start to end.
+    madvise(mapped, length, MADV_SEQUENTIAL);
+    return true;
+}
+
+bool MappedFile::create(const char* fileName, size_t size) {
+    close();
+    fd = ::open(fileName, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return false;
+    }
+
+    length = size;
+
+    // Reserve the blocks before mapping: a full disk must fail here, not raise SIGBUS on a later store.
+    // Without the reservation (no space, or no posix_fallocate) the pixels go to a zeroed pooled buffer
+    // that flush() writes out with checked writes instead.
+#if defined(__APPLE__)
+    // No posix_fallocate here: the file only gets its size, as before
+    bool reserved = ftruncate(fd, static_cast<off_t>(size)) == 0;
+#else
+    bool reserved = posix_fallocate(fd, 0, static_cast<off_t>(size)) == 0;
+#endif
+    if (reserved) {
+        void* mapped = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (mapped != MAP_FAILED) {
+            address = static_cast<uint8_t*>(mapped);
+            return true;
+        }
+    }
+    fallback = sharedBufferPool().acquire(size);
+    if (fallback.empty() || ftruncate(fd, 0) != 0) {
+        close();
+        return false;
+    }
+    memset(fallback.data(), 0, size);
+    address = fallback.data();
+    return true;
+}
+
+bool MappedFile::flush() {
+    if (fallback.empty()) {
+        // Dirty pages of a shared mapping reach the file through the page cache, as buffered writes do
+        return true;
+    }
+    for (size_t offset = 0; offset < length;) {
+        ssize_t written = pwrite(fd, fallback.data() + offset, length - offset, static_cast<off_t>(offset));
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written <= 0) {
+            return false;
+        }
+        offset += static_cast<size_t>(written);
+    }
+    return true;
+}
+
+void MappedFile::close() {
+    if (address != nullptr && fallback.empty()) {
+        munmap(address, length);
+    }
+    address = nullptr;
+    fallback.release();
+    if (fd >= 0) {
+        ::close(fd);
+        fd = -1;
+    }
+    length = 0;
+}
+
+#endif
+
+// ---------------------------------------------------------------------------
+// Image
+// ---------------------------------------------------------------------------
+
+Image::Image(const Image& other) {
+    *this = other;
+}
+
+Image& Image::operator=(const Image& other) {
+    if (this != &other) {
+        fileHeader = other.fileHeader;
+        infoHeader = other.infoHeader;
+        width = other.width;
+        height = other.height;
+        bytesPerPixel = other.bytesPerPixel;
+        rowSize = other.rowSize;
+        stride = other.stride;
+        topDown = other.topDown;
+        palette = other.palette;
+
+        // Always copy into a private pooled buffer, even when the source is a file mapping
+        mapping.close();
+        storage = sharedBufferPool().acquire(other.pixelBytes());
+        if (!storage.empty()) {
+            memcpy(storage.data(), other.pixelBase(), other.pixelBytes());
+        }
+        attachPixels(storage.data());
+    }
+    return *this;
+}
+
+ImageView viewOf(Image& image) {
+    ImageView view;
+    view.data = image.pixelData;
+    view.width = image.width;
+    view.height = image.height;
+    view.bytesPerPixel = image.bytesPerPixel;
+    view.rowSize = image.stride;
+    return view;
+}
+
+bool cropView(const ImageView& source, int x, int y, int width, int height, ImageView& view) {
+    // Validate that the ROI is within the source bounds
+    if (x < 0 || y < 0 || width <= 0 || height <= 0 || x + width > source.width || y + height > source.height) {
+        cerr << "Cropping area exceeds image bounds." << endl;
+        return false;
+    }
+
+    // Same stride as the source; only the origin and the extent change
+    view = source;
+    view.data = source.row(y) + static_cast<size_t>(x) * source.bytesPerPixel;
+    view.width = width;
+    view.height = height;
+    return true;
+}
+
+bool validateBMPHeaders(Image& image) {
+    // Validate the file signature (Magic Number 0x4D42)
+    if (image.fileHeader.bfType != BMP_SIGNATURE) {
+        cerr << "Input file is not a BMP file." << endl;
+        return false;
+    }
+
+    // Validate support for 24-bit and 32-bit uncompressed formats, and 4-bit or 8-bit indexed ones
+    // (uncompressed or RLE), which are decoded to 24-bit on load
+    int bitCount = image.infoHeader.biBitCount;
+    uint32_t compression = image.infoHeader.biCompression;
+    bool directColor = (bitCount == 24 || bitCount == 32) && compression == BMP_COMPRESSION_RGB;
+    bool indexed = (bitCount == 8 && (compression == BMP_COMPRESSION_RGB || compression == BMP_COMPRESSION_RLE8)) ||
+                   (bitCount == 4 && (compression == BMP_COMPRESSION_RGB || compression == BMP_COMPRESSION_RLE4));
+    if (!directColor && !indexed) {
+        cerr << "Only supports 24-bit or 32-bit uncompressed, or 4-bit or 8-bit indexed (optionally RLE) BMP." << endl;
+        return false;
+    }
+
+    // A negative height marks a top-down file: same pixel layout, rows stored top row first
+    int32_t biHeight = image.infoHeader.biHeight;
+    bool compressed = compression != BMP_COMPRESSION_RGB;
+    if (image.infoHeader.biWidth <= 0 || biHeight == 0 || biHeight == INT32_MIN || (compressed && biHeight < 0)) {
+        cerr << "Invalid BMP dimensions." << endl;
+        return false;
+    }
+    image.width = image.infoHeader.biWidth;
+    image.height = biHeight < 0 ? -biHeight : biHeight;
+    image.topDown = biHeight < 0;
+    image.bytesPerPixel = indexed ? 3 : bitCount / 8;
+
+    // Row and array sizes are computed in 64 bits first: they must fit the int stride and size_t sizes
+    int64_t rowBytes = (static_cast<int64_t>(image.width) * image.bytesPerPixel + 3) & ~int64_t(3);
+    if (rowBytes > INT_MAX || static_cast<uint64_t>(rowBytes) * static_cast<uint64_t>(image.height) > SIZE_MAX) {
+        cerr << "BMP dimensions are too large." << endl;
+        return false;
+    }
+    image.rowSize = calculateRowSize(image.width, image.bytesPerPixel);
+    image.stride = image.topDown ? -image.rowSize : image.rowSize;
+    return true;
+}
+
+// Decode an indexed pixel array (see bmp_rle.h) from the file contents into pooled 24-bit storage
+static bool decodeIndexedPixels(const uint8_t* fileData, size_t fileSize, Image& image) {
+    IndexedPixelDecoder decoder;
+    if (!decoder.open(fileData, fileSize, image.fileHeader, image.infoHeader)) {
+        return false;
+    }
+    image.storage = sharedBufferPool().acquire(image.pixelBytes());
+    if (image.storage.empty()) {
+        cerr << "Out of memory." << endl;
+        return false;
+    }
+    image.attachPixels(image.storage.data());
+
+    // Rows are decoded in file order, which is also their order in memory
+    return decoder.decodeRows(0, image.height, image.pixelBase(), image.rowSize);
+}
+
+// Chunk size of hashed reads: large enough for full-speed reads, small enough to still be in L2 when hashed
+const size_t HASHED_READ_CHUNK = 256 * 1024;
+
+// Start the content hash with everything but the pixel array
+static void hashImageLayout(const Image& image, Hasher64& hasher) {
+    int32_t layout[4] = { image.width, image.height, image.bytesPerPixel, image.topDown ? 1 : 0 };
+    hasher.update(layout, sizeof(layout));
+    hasher.update(image.palette.data(), image.palette.size() * sizeof(BMPPaletteEntry));
+}
+
+uint64_t imageContentHash(const Image& image) {
+    Hasher64 hasher;
+    hashImageLayout(image, hasher);
+    hasher.update(image.pixelBase(), image.pixelBytes());
+    return hasher.digest();
+}
+
+uint64_t copiedHeaderHash(const Image& image) {
+    // Clear what every output recomputes, so only the passed-through fields remain
+    BMPFileHeader fileHeader;
+    BMPInfoHeader infoHeader;
+    prepareBMPHeaders(image, fileHeader, infoHeader);
+    fileHeader.bfSize = 0;
+    fileHeader.bfOffBits = 0;
+    infoHeader.biWidth = 0;
+    infoHeader.biHeight = 0;
+    infoHeader.biBitCount = 0;
+    infoHeader.biCompression = 0;
+    infoHeader.biSizeImage = 0;
+    infoHeader.biClrUsed = 0;
+    Hasher64 hasher;
+    hasher.update(&fileHeader, sizeof(fileHeader));
+    hasher.update(&infoHeader, sizeof(infoHeader));
+    return hasher.digest();
+}
+
+bool loadBMP(const char* fileName, Image& image, uint64_t* contentHash) {
+    BMP_TRACE_SCOPE(trace, "load", 0);
+
+    // Open the input BMP file in binary mode
+    ifstream inputFile(fileName, ios::binary);
+    if (!inputFile) {
+        cerr << "Can't open file." << endl;
+        return false;
+    }
+
+    // Read the BMP File Header and the BMP Information Header
+    inputFile.read(reinterpret_cast<char*>(&image.fileHeader), sizeof(image.fileHeader));
+    inputFile.read(reinterpret_cast<char*>(&image.infoHeader), sizeof(image.infoHeader));
+    if (!inputFile) {
+        cerr << "Input file is not a BMP file." << endl;
+        return false;
+    }
+    if (!validateBMPHeaders(image)) {
+        return false;
+    }
+    BMP_TRACE_SET_BYTES(trace, image.pixelBytes());
+
+    // Indexed files are decoded from a mapping into a pooled buffer, which is what loadBMP returns anyway
+    if (isIndexedBMP(image.infoHeader)) {
+        inputFile.close();
+        return loadBMPMapped(fileName, image, contentHash);
+    }
+
+    // The pixel array must lie completely inside the file, checked before any storage is taken
+    inputFile.seekg(0, ios::end);
+    uint64_t fileSize = static_cast<uint64_t>(inputFile.tellg());
+    if (!inputFile || image.fileHeader.bfOffBits > fileSize || fileSize - image.fileHeader.bfOffBits < image.pixelBytes()) {
+        cerr << "BMP pixel data is truncated." << endl;
+        return false;
+    }
+
+    // Take a pooled buffer (not zero-filled: the read overwrites every byte) and read the pixel data,
+    // starting at the offset given by the file header
+    image.mapping.close();
+    image.storage = sharedBufferPool().acquire(image.pixelBytes());
+    if (image.storage.empty()) {
+        cerr << "Out of memory." << endl;
+        return false;
+    }
+    image.attachPixels(image.storage.data());
+    {
+        BMP_TRACE_SCOPE(readTrace, "load.read", image.pixelBytes());
+        inputFile.seekg(image.fileHeader.bfOffBits, ios::beg);
+        if (contentHash == nullptr) {
+            inputFile.read(reinterpret_cast<char*>(image.storage.data()), image.pixelBytes());
+        } else {
+            // Hash each chunk while it is still in cache
+            Hasher64 hasher;
+            hashImageLayout(image, hasher);
+            for (size_t offset = 0; offset < image.pixelBytes() && inputFile; offset += HASHED_READ_CHUNK) {
+                size_t length = min(HASHED_READ_CHUNK, image.pixelBytes() - offset);
+                inputFile.read(reinterpret_cast<char*>(image.storage.data() + offset), length);
+                hasher.update(image.storage.data() + offset, length);
+            }
+            *contentHash = hasher.digest();
+        }
+    }
+    if (!inputFile) {
+        cerr << "BMP pixel data is truncated." << endl;
+        return false;
+    }
+    return true;
+}
+
+bool loadBMPMapped(const char* fileName, Image& image, uint64_t* contentHash) {
+    BMP_TRACE_SCOPE(trace, "load.mapped", 0);
+
+    if (!image.mapping.openPrivate(fileName)) {
+        cerr << "Can't open file." << endl;
+        return false;
+    }
+
+    // Headers are copied out of the mapping so they stay valid independently of the pixels
+    const uint8_t* base = image.mapping.data();
+    if (image.mapping.size() < BMP_HEADERS_SIZE) {
+        cerr << "Input file is not a BMP file." << endl;
+        image.mapping.close();
+        return false;
+    }
+    memcpy(&image.fileHeader, base, sizeof(image.fileHeader));
+    memcpy(&image.infoHeader, base + sizeof(image.fileHeader), sizeof(image.infoHeader));
+    if (!validateBMPHeaders(image)) {
+        image.mapping.close();
+        return false;
+    }
+    BMP_TRACE_SET_BYTES(trace, image.pixelBytes());
+
+    // Indexed pixels cannot be used in place: decode them, then drop the mapping
+    if (isIndexedBMP(image.infoHeader)) {
+        bool decoded = decodeIndexedPixels(image.mapping.data(), image.mapping.size(), image);
+        image.mapping.close();
+        if (decoded && contentHash != nullptr) {
+            *contentHash = imageContentHash(image);
+        }
+        return decoded;
+    }
+
+    // The pixel array must lie completely inside the mapped file
+    if (image.fileHeader.bfOffBits > image.mapping.size() ||
+        image.mapping.size() - image.fileHeader.bfOffBits < image.pixelBytes()) {
+        cerr << "BMP pixel data is truncated." << endl;
+        image.mapping.close();
+        return false;
+    }
+
+    image.storage.release();
+    image.attachPixels(image.mapping.data() + image.fileHeader.bfOffBits);
+    if (contentHash != nullptr) {
+        *contentHash = imageContentHash(image);
+    }
+    return true;
+}
+
+void prepareBMPHeaders(const Image& image, BMPFileHeader& fileHeader, BMPInfoHeader& infoHeader) {
+    fileHeader = image.fileHeader;
+    infoHeader = image.infoHeader;
+
+    // Only the 40-byte info header is written, so any extended header or gap before the pixels is dropped.
+    infoHeader.biSize = sizeof(BMPInfoHeader);
+    infoHeader.biWidth = image.width;
+    infoHeader.biHeight = image.topDown ? -image.height : image.height;
+    infoHeader.biBitCount = static_cast<uint16_t>(image.bytesPerPixel * 8);
+    infoHeader.biCompression = BMP_COMPRESSION_RGB;
+    infoHeader.biSizeImage = static_cast<uint32_t>(image.pixelBytes());
+    infoHeader.biClrUsed = static_cast<uint32_t>(image.palette.size());
+    infoHeader.biClrImportant = 0;
+
+    // Recalculate total file size: Header Offset (including the color table) + Image Size
+    fileHeader.bfOffBits = BMP_HEADERS_SIZE + static_cast<uint32_t>(image.palette.size() * sizeof(BMPPaletteEntry));
+    fileHeader.bfSize = fileHeader.bfOffBits + infoHeader.biSizeImage;
+}
+
+bool fitsBMPFileSize(const Image& image) {
+    uint64_t fileSize = BMP_HEADERS_SIZE + image.palette.size() * sizeof(BMPPaletteEntry) + static_cast<uint64_t>(image.pixelBytes());
+    if (fileSize > UINT32_MAX) {
+        cerr << "Output image is too large for a BMP file (4 GiB limit)." << endl;
+        return false;
+    }
+    return true;
+}
+
+bool saveBMP(const char* fileName, const Image& image, int threadCount) {
+    BMP_TRACE_SCOPE(trace, "save", image.pixelBytes());
+
+    // Headers are final before the first byte is written, and the file is created at its full size
+    bool parallel = threadCount > 1 && image.pixelBytes() >= PARALLEL_WRITE_MIN_BYTES;
+    BMPEncoder encoder;
+    if (!encoder.open(fileName, image, image.width, image.height, parallel)) {
+        return false;
+    }
+    ImageView view;
+    view.data = image.pixelData;
+    view.width = image.width;
+    view.height = image.height;
+    view.bytesPerPixel = image.bytesPerPixel;
+    view.rowSize = image.stride;
+
+    // Small images: headers, color table and pixels in a single gathered write.
+    // Large ones: each thread writes its own range of rows at its final offset.
+    bool written = true;
+    if (parallel) {
+        atomic<bool> ok{true};
+        parallelForRows(image.height, image.stride, image.pixelData, threadCount, [&](int firstRow, int lastRow) {
+            ImageView rows = view;
+            rows.data = view.row(firstRow);
+            rows.height = lastRow - firstRow;
+            if (!encoder.writeRows(rows, firstRow)) {
+                ok = false;
+            }
+        });
+        written = ok;
+    } else {
+        written = encoder.writeRows(view, 0);
+    }
+    if (!encoder.close() || !written) {
+        cerr << "Failed to write output file." << endl;
+        return false;
+    }
+    return true;
+}
+
+void initImageGeometry(const Image& source, int width, int height, Image& image) {
+    image.fileHeader = source.fileHeader;
+    image.infoHeader = source.infoHeader;
+    image.width = width;
+    image.height = height;
+    image.bytesPerPixel = source.bytesPerPixel;
+    image.rowSize = calculateRowSize(width, source.bytesPerPixel);
+    image.topDown = source.topDown;
+    image.stride = image.topDown ? -image.rowSize : image.rowSize;
+    image.palette = source.palette;
+}
+
+void createImageLike(const Image& source, int width, int height, Image& image) {
+    initImageGeometry(source, width, height, image);
+    image.mapping.close();
+    image.storage = sharedBufferPool().acquire(image.pixelBytes());
+    image.attachPixels(image.storage.data());
+
+    // Only the padding needs defined contents; kernels overwrite the pixels
+    int pixelRowBytes = width * image.bytesPerPixel;
+    for (int y = 0; y < height && image.pixelData != nullptr; ++y) {
+        memset(image.row(y) + pixelRowBytes, 0, image.rowSize - pixelRowBytes);
+    }
+}
+
+bool createBMPMapped(const char* fileName, const Image& source, int width, int height, Image& image) {
+    initImageGeometry(source, width, height, image);
+    BMP_TRACE_SCOPE(trace, "create.mapped", image.pixelBytes());
+    if (!fitsBMPFileSize(image)) {
+        return false;
+    }
+    prepareBMPHeaders(image, image.fileHeader, image.infoHeader);
+
+    // The file is created at its final size, so kernels fill the pixel region in place
+    image.storage.release();
+    if (!image.mapping.create(fileName, image.fileHeader.bfSize)) {
+        cerr << "Can't open output file." << endl;
+        return false;
+    }
+
+    uint8_t* base = image.mapping.data();
+    memcpy(base, &image.fileHeader, sizeof(image.fileHeader));
+    memcpy(base + sizeof(image.fileHeader), &image.infoHeader, sizeof(image.infoHeader));
+    if (!image.palette.empty()) {
+        memcpy(base + BMP_HEADERS_SIZE, image.palette.data(), image.palette.size() * sizeof(BMPPaletteEntry));
+    }
+    image.attachPixels(base + image.fileHeader.bfOffBits);
+    return true;
+}
+
+bool saveBMPView(const char* fileName, const ImageView& view, const Image& headerSource) {
+    BMP_TRACE_SCOPE(trace, "save.view", static_cast<uint64_t>(view.width) * view.bytesPerPixel * view.height);
+
+    // The view rows are gathered straight from the source with zero padding between them
+    BMPEncoder encoder;
+    if (!encoder.open(fileName, headerSource, view.width, view.height)) {
+        return false;
+    }
+    bool written = encoder.writeRows(view, 0);
+    if (!encoder.close() || !written) {
+        cerr << "Failed to write output file." << endl;
+        return false;
+    }
+    return true;
+}
+
+bool commitBMP(Image& image) {
+    BMP_TRACE_SCOPE(trace, "commit", image.pixelBytes());
+
+    bool flushed = image.mapping.flush();
+    image.mapping.close();
+    image.pixelData = nullptr;
+    if (!flushed) {
+        cerr << "Failed to write output file." << endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,234 @@
+#ifndef BMP_IMAGE_H
+#define BMP_IMAGE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "bmp_buffer_pool.h"
+
+// Enforce 1-byte structure alignment so the header layout matches the binary file format.
+// push/pop keeps the packing local to the BMP headers instead of leaking into every includer.
+#pragma pack(push, 1)
+
+// Standard BMP File Header structure
+struct BMPFileHeader {
+    uint16_t bfType;      // Magic number for file type, must be 0x4D42 ('BM').
+    uint32_t bfSize;      // Total size of the file in bytes.
+    uint16_t bfReserved1; // Reserved field, must be 0.
+    uint16_t bfReserved2; // Reserved field, must be 0.
+    uint32_t bfOffBits;   // Offset to the beginning of the pixel data (bitmap bits).
+};
+
+// Standard BMP Information Header structure (DIB Header)
+struct BMPInfoHeader {
+    uint32_t biSize;          // Size of this header structure in bytes.
+    int32_t biWidth;          // Width of the image in pixels.
+    int32_t biHeight;         // Height of the image in pixels.
+    uint16_t biPlanes;        // Number of color planes, must be 1.
+    uint16_t biBitCount;      // Number of bits per pixel (BPP), e.g., 24 or 32.
+    uint32_t biCompression;   // Compression method (0 indicates uncompressed).
+    uint32_t biSizeImage;     // Size of the raw bitmap data in bytes.
+    int32_t biXPelsPerMeter;  // Horizontal resolution (pixels per meter).
+    int32_t biYPelsPerMeter;  // Vertical resolution (pixels per meter).
+    uint32_t biClrUsed;       // Number of color indexes in the color table (0 for max).
+    uint32_t biClrImportant;  // Number of important color indexes (0 for all).
+};
+
+// Color table entry (RGBQUAD) of an indexed BMP
+struct BMPPaletteEntry {
+    uint8_t blue;
+    uint8_t green;
+    uint8_t red;
+    uint8_t reserved;     // Must be 0.
+};
+
+#pragma pack(pop)
+
+// Magic number of a BMP file ('BM' in little-endian order).
+const uint16_t BMP_SIGNATURE = 0x4D42;
+
+// Size of the headers written by saveBMP; the color table (if any) and the pixel data follow them.
+const uint32_t BMP_HEADERS_SIZE = sizeof(BMPFileHeader) + sizeof(BMPInfoHeader);
+
+// Calculate the row stride (row size in bytes), ensuring 4-byte alignment (padding).
+// The formula ((width * bytesPerPixel + 3) & (~3)) aligns the size to the next multiple of 4.
+inline int calculateRowSize(int width, int bytesPerPixel) {
+    return ((width * bytesPerPixel + 3) & (~3));
+}
+
+/**
+ * RAII handle for a memory-mapped file (POSIX mmap).
+ * On platforms without mmap the same interface is backed by a heap buffer that is read on open
+ * and written back on flush, so callers do not need a separate code path.
+ */
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(MappedFile&& other) noexcept;
+    MappedFile& operator=(MappedFile&& other) noexcept;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Map an existing file as a MAP_PRIVATE copy-on-write view: writes never reach the file.
+    bool openPrivate(const char* fileName);
+
+    // Create (or truncate) a file of exactly `size` bytes, reserve its blocks and map it shared for writing.
+    // If the blocks can't be reserved, data() is a zeroed heap buffer instead, written out by flush().
+    bool create(const char* fileName, size_t size);
+
+    // Finish a created file: writes the heap buffer if one stands in for the mapping. A shared mapping is
+    // left to the page cache (no synchronous writeback). Returns false if a write failed.
+    bool flush();
+
+    // Unmap and close the file. Call flush() first for created files.
+    void close();
+
+    uint8_t* data() const { return address; }
+    size_t size() const { return length; }
+    bool isOpen() const { return address != nullptr; }
+
+private:
+    uint8_t* address = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    std::vector<uint8_t> buffer;   // Heap stand-in for the mapping.
+    std::string path;              // Written back by flush() for created files.
+    bool writable = false;
+#else
+    int fd = -1;
+    PixelBuffer fallback;          // Stands in for the mapping when create() couldn't reserve the blocks.
+#endif
+};
+
+/**
+ * BMP image: the original headers plus a stride-aware pixel buffer.
+ * Rows are always addressed bottom-up: row 0 is the bottom row and row y starts at
+ * pixelData + y * stride. For a bottom-up file stride is +rowSize; for a top-down file (negative
+ * biHeight) pixelData points at the last row in memory and stride is -rowSize, so both orientations
+ * are read in place without reordering any rows.
+ *
+ * The pixels either live in `storage` (an uninitialized, 64-byte-aligned buffer from
+ * sharedBufferPool()) or inside `mapping` (an mmap view of the input or output file).
+ * Copying an Image always produces an independent pooled copy of the pixels.
+ */
+struct Image {
+    BMPFileHeader fileHeader;
+    BMPInfoHeader infoHeader;
+    int width = 0;
+    int height = 0;
+    int bytesPerPixel = 0;
+    int rowSize = 0;               // Row size in bytes, including the 4-byte padding.
+    int stride = 0;                // Signed distance from row y to row y + 1 (-rowSize when top-down).
+    bool topDown = false;          // Rows are stored top row first (negative biHeight).
+    uint8_t* pixelData = nullptr;  // First byte of row 0 (the bottom row).
+    std::vector<BMPPaletteEntry> palette;  // Color table of an indexed image (bytesPerPixel 1); empty for direct color.
+
+    PixelBuffer storage;           // Pooled pixel buffer (empty for mapped images).
+    MappedFile mapping;            // File mapping backing pixelData (closed for heap images).
+
+    Image() = default;
+    Image(const Image& other);
+    Image& operator=(const Image& other);
+    Image(Image&& other) noexcept = default;
+    Image& operator=(Image&& other) noexcept = default;
+
+    // Size of the pixel array in bytes (rowSize * height)
+    size_t pixelBytes() const { return static_cast<size_t>(rowSize) * height; }
+
+    // Point pixelData at the pixel array whose first stored row is at `base`, honouring the row order
+    void attachPixels(uint8_t* base) {
+        pixelData = (base != nullptr && topDown) ? base + static_cast<ptrdiff_t>(height - 1) * rowSize : base;
+    }
+
+    // Lowest address of the pixel array (the first row stored in the file)
+    uint8_t* pixelBase() const { return topDown ? pixelData - static_cast<ptrdiff_t>(height - 1) * rowSize : pixelData; }
+
+    // Pointer to the beginning of row y
+    uint8_t* row(int y) { return pixelData + static_cast<ptrdiff_t>(y) * stride; }
+    const uint8_t* row(int y) const { return pixelData + static_cast<ptrdiff_t>(y) * stride; }
+};
+
+/**
+ * Non-owning, strided window into pixel memory (e.g. a region of interest of an Image).
+ * Row y of the view starts at data + y * rowSize, where rowSize is the signed stride of the underlying
+ * buffer (negative for top-down images), not of the view. The memory must outlive the view.
+ */
+struct ImageView {
+    uint8_t* data = nullptr;       // First pixel of row 0 of the view.
+    int width = 0;
+    int height = 0;
+    int bytesPerPixel = 0;
+    int rowSize = 0;               // Signed stride of the underlying buffer in bytes.
+
+    // Pointer to the beginning of row y
+    uint8_t* row(int y) const { return data + static_cast<ptrdiff_t>(y) * rowSize; }
+};
+
+// View covering the whole image.
+ImageView viewOf(Image& image);
+
+// View of the ROI (x, y, width, height) of `source`; no pixels are copied.
+// Prints the reason and returns false if the ROI exceeds the source bounds.
+bool cropView(const ImageView& source, int x, int y, int width, int height, ImageView& view);
+
+// Validate the headers stored in `image` and derive width, height, bytesPerPixel, rowSize, stride
+// and the row order from them. A negative biHeight marks a top-down file.
+bool validateBMPHeaders(Image& image);
+
+// Fill in the size-related header fields (biSizeImage, bfOffBits, bfSize...) for the image's current geometry.
+// The color table, if any, sits between the headers and the pixels; biClrUsed is its entry count.
+void prepareBMPHeaders(const Image& image, BMPFileHeader& fileHeader, BMPInfoHeader& infoHeader);
+
+// Whether an output with the image's geometry and color table fits the 32-bit bfSize / biSizeImage
+// fields. Prints the reason and returns false otherwise; writers check it before creating the file.
+bool fitsBMPFileSize(const Image& image);
+
+// Read and validate a 24-bit or 32-bit uncompressed BMP, bottom-up or top-down. Prints the reason to cerr and returns false on failure.
+// With `contentHash` set, the pixels are read in chunks and each chunk is hashed right after it arrives
+// (see imageContentHash), so the hash costs no extra pass over memory.
+bool loadBMP(const char* fileName, Image& image, uint64_t* contentHash = nullptr);
+
+// Same validation as loadBMP, but the pixels are a MAP_PRIVATE view of the file instead of a heap copy.
+// Kernels may modify the pixels in place; the changes stay private to this process.
+// `contentHash` is computed while the pages are faulted in.
+bool loadBMPMapped(const char* fileName, Image& image, uint64_t* contentHash = nullptr);
+
+// XXH64 of the image content: geometry, row order, color table and the pixel array (decoded pixels for
+// indexed files). Identical images hash equal regardless of unrelated header fields such as resolution.
+uint64_t imageContentHash(const Image& image);
+
+// XXH64 of the header fields that outputs copy from their source unchanged (reserved words, planes,
+// resolution): those prepareBMPHeaders does not recompute. Two inputs with equal content hashes can
+// still differ here, and so can their outputs.
+uint64_t copiedHeaderHash(const Image& image);
+
+// Write the image with headers updated to match its current dimensions. The row order is kept,
+// so a top-down image is written top-down (negative biHeight). Returns false on failure.
+// The file goes through BMPEncoder (bmp_encoder.h): one gathered write for headers and pixels, or,
+// with threadCount > 1 and a large image, disjoint row ranges written concurrently at their offsets.
+bool saveBMP(const char* fileName, const Image& image, int threadCount = 1);
+
+// Serialize a view: the output file is created at its final size and the view rows are written
+// straight from their source with a gathered write (no copy of the view's pixels). Headers other than
+// the geometry are taken from `headerSource`.
+bool saveBMPView(const char* fileName, const ImageView& view, const Image& headerSource);
+
+// Copy the headers of `source` and set up the geometry of a width x height image without allocating pixels.
+// The new image keeps the row order and the color table of `source`.
+void initImageGeometry(const Image& source, int width, int height, Image& image);
+
+// Allocate an image of the given size from the buffer pool that inherits the remaining header fields
+// of `source`. Pixel bytes are left uninitialized; only the row padding is zeroed.
+void createImageLike(const Image& source, int width, int height, Image& image);
+
+// Create a pre-sized output file with final headers and map it, so kernels write straight into the
+// destination pixel region. Call commitBMP once the pixels are complete.
+bool createBMPMapped(const char* fileName, const Image& source, int width, int height, Image& image);
+
+// Flush and release an image created by createBMPMapped. Returns false if the data could not be written.
+bool commitBMP(Image& image);
+
+#endif // BMP_IMAGE_H
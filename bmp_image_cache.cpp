@@ -0,0 +1,110 @@
+#include "bmp_image_cache.h"
+#include "bmp_async_io.h"
+#include "bmp_trace.h"
+
+#include <iostream>
+
+using namespace std;
+
+ImageCache::ImageCache(size_t budgetBytes) : budgetBytes(budgetBytes) {}
+
+shared_ptr<const Image> ImageCache::acquire(const string& fileName, bool* hit) {
+    BMP_TRACE_SCOPE(trace, "imagecache.acquire", 0);
+    if (hit != nullptr) {
+        *hit = false;
+    }
+
+    // A stat is enough to tell whether the cached pixels are still those of the file
+    uint64_t fileSize = 0;
+    int64_t modified = 0;
+    if (!fileStamp(fileName.c_str(), fileSize, modified)) {
+        cerr << "Can't open file." << endl;
+        return nullptr;
+    }
+    {
+        lock_guard<std::mutex> lock(mutex);
+        auto found = index.find(fileName);
+        if (found != index.end()) {
+            auto entry = found->second;
+            if (entry->fileSize == fileSize && entry->modified == modified) {
+                entries.splice(entries.begin(), entries, entry);
+                ++hits;
+                if (hit != nullptr) {
+                    *hit = true;
+                }
+                return entry->image;
+            }
+            erase(entry);
+        }
+        ++misses;
+    }
+
+    // Decode outside the lock, so other files are served meanwhile. Two concurrent misses on one file
+    // both load it; the later insert replaces the earlier.
+    auto image = make_shared<Image>();
+    if (!loadBMP(fileName.c_str(), *image)) {
+        return nullptr;
+    }
+    BMP_TRACE_SET_BYTES(trace, image->pixelBytes());
+    if (image->pixelBytes() > budgetBytes) {
+        return image;
+    }
+
+    lock_guard<std::mutex> lock(mutex);
+    auto found = index.find(fileName);
+    if (found != index.end()) {
+        erase(found->second);
+    }
+    entries.push_front(Entry{fileName, image, fileSize, modified});
+    index[fileName] = entries.begin();
+    resident += image->pixelBytes();
+    shrink();
+    return image;
+}
+
+void ImageCache::evict(const string& fileName) {
+    lock_guard<std::mutex> lock(mutex);
+    auto found = index.find(fileName);
+    if (found != index.end()) {
+        erase(found->second);
+    }
+}
+
+void ImageCache::clear() {
+    lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+    index.clear();
+    resident = 0;
+}
+
+void ImageCache::shrink() {
+    while (resident > budgetBytes && !entries.empty()) {
+        erase(prev(entries.end()));
+    }
+}
+
+void ImageCache::erase(list<Entry>::iterator entry) {
+    resident -= entry->image->pixelBytes();
+    index.erase(entry->fileName);
+    entries.erase(entry);
+}
+
+size_t ImageCache::residentBytes() const {
+    lock_guard<std::mutex> lock(mutex);
+    return resident;
+}
+
+size_t ImageCache::entryCount() const {
+    lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+}
+
+uint64_t ImageCache::hitCount() const {
+    lock_guard<std::mutex> lock(mutex);
+    return hits;
+}
+
+uint64_t ImageCache::missCount() const {
+    lock_guard<std::mutex> lock(mutex);
+    return misses;
+}
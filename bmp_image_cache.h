@@ -0,0 +1,64 @@
+#ifndef BMP_IMAGE_CACHE_H
+#define BMP_IMAGE_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "bmp_image.h"
+
+// Default memory budget of an ImageCache: decoded pixel bytes kept resident.
+const size_t DEFAULT_IMAGE_CACHE_BYTES = size_t(1) << 30;
+
+/**
+ * Thread-safe LRU cache of decoded images, keyed by file name and bounded by the bytes of their pixel
+ * arrays. Images are read into pooled heap buffers (never mapped), so a cached image stays valid while
+ * its file is rewritten. Each lookup compares the file's size and modification time with those seen
+ * at load time, and reloads an image whose file changed.
+ * Images are shared: one evicted while a caller still holds it stays alive until released, but no
+ * longer counts against the budget.
+ */
+class ImageCache {
+public:
+    explicit ImageCache(size_t budgetBytes = DEFAULT_IMAGE_CACHE_BYTES);
+
+    // Decoded image of fileName, or null if it can't be loaded. `hit` tells whether the disk was skipped.
+    // An image larger than the whole budget is returned without being cached.
+    std::shared_ptr<const Image> acquire(const std::string& fileName, bool* hit = nullptr);
+
+    // Drop the entry of one file, or every entry.
+    void evict(const std::string& fileName);
+    void clear();
+
+    size_t budget() const { return budgetBytes; }
+    size_t residentBytes() const;
+    size_t entryCount() const;
+    uint64_t hitCount() const;
+    uint64_t missCount() const;
+
+private:
+    struct Entry {
+        std::string fileName;
+        std::shared_ptr<const Image> image;
+        uint64_t fileSize = 0;
+        int64_t modified = 0;
+    };
+
+    // Remove least recently used entries until the resident bytes fit the budget. Caller holds the mutex.
+    void shrink();
+    void erase(std::list<Entry>::iterator entry);
+
+    mutable std::mutex mutex;
+    std::list<Entry> entries;      // Most recently used first.
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    size_t budgetBytes;
+    size_t resident = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+};
+
+#endif // BMP_IMAGE_CACHE_H
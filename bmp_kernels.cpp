@@ -0,0 +1,321 @@
+#include "bmp_kernels.h"
+#include "bmp_parallel.h"
+#include "bmp_pixel_format.h"
+#include "bmp_simd.h"
+#include "bmp_stats.h"
+#include "bmp_trace.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring> // Required for memcpy
+#include <iostream>
+#include <optional>
+#include <vector>
+
+using namespace std;
+
+// Function to perform an in-place horizontal flip of the image data
+void flipHorizontally(uint8_t* pixelData, int width, int height, int rowSize, int bytesPerPixel, int threadCount, ImageStats* stats) {
+    BMP_TRACE_SCOPE(trace, "flip", static_cast<uint64_t>(width) * bytesPerPixel * height);
+
+    // Pick the vector kernel once: it swaps whole blocks from both ends of the row and
+    // reverses the pixels inside each block with a byte/lane shuffle
+    FlipRowKernel flipRow = flipRowKernel(bytesPerPixel);
+
+    // Rows are independent, so each thread mirrors its own range of rows
+    if (stats != nullptr) {
+        stats->reset(bytesPerPixel);
+    }
+    parallelForRows(height, rowSize, pixelData, threadCount, [&](int firstRow, int lastRow) {
+        optional<StatsAccumulator> accumulator;
+        if (stats != nullptr) {
+            accumulator.emplace(bytesPerPixel);
+        }
+        for (int y = firstRow; y < lastRow; ++y) {
+            // Get the pointer to the beginning of the current row and mirror it
+            uint8_t* row = pixelData + static_cast<ptrdiff_t>(y) * rowSize;
+            flipRow(row, width, bytesPerPixel);
+            if (accumulator) {
+                accumulator->addRow(row, width);
+            }
+        }
+        if (accumulator) {
+            accumulator->mergeInto(*stats);
+        }
+    });
+    if (stats != nullptr) {
+        stats->finish();
+    }
+}
+
+/**
+ * Quantization Function: Reduces the color depth of RGB channels.
+ * * This function maps the continuous [0, 255] pixel intensity range to a smaller set of 
+ * discrete levels determined by the target bit depth.
+ */
+void quantizePixelData(uint8_t* pixelData, int bytesPerPixel, int width, int height, int rowSize, int quantizationBits, int threadCount, ImageStats* stats) {
+    BMP_TRACE_SCOPE(trace, "quantize", static_cast<uint64_t>(width) * bytesPerPixel * height);
+
+    // Build the 256-entry table once and pick the widest vector kernel this CPU supports.
+    // Colors are quantized as (value / factor) * factor without a per-byte divide; alpha is preserved.
+    QuantizationTable table;
+    buildQuantizationTable(quantizationBits, table);
+    QuantizeRowKernel quantizeRow = quantizeRowKernel(table, bytesPerPixel);
+
+    if (stats != nullptr) {
+        stats->reset(bytesPerPixel);
+    }
+    parallelForRows(height, rowSize, pixelData, threadCount, [&](int firstRow, int lastRow) {
+        optional<StatsAccumulator> accumulator;
+        if (stats != nullptr) {
+            accumulator.emplace(bytesPerPixel);
+        }
+        for (int y = firstRow; y < lastRow; y++) {
+            // Get pointer to the start of the current row and quantize it in place
+            uint8_t* row = pixelData + static_cast<ptrdiff_t>(y) * rowSize;
+            quantizeRow(row, row, width, bytesPerPixel, table);
+            if (accumulator) {
+                accumulator->addRow(row, width);
+            }
+        }
+        if (accumulator) {
+            accumulator->mergeInto(*stats);
+        }
+    });
+    if (stats != nullptr) {
+        stats->finish();
+    }
+}
+
+void quantizePixelDataMulti(const uint8_t* pixelData, const vector<uint8_t*>& outputs, const vector<int>& quantizationBits, int bytesPerPixel, int width, int height, int rowSize, int threadCount, vector<ImageStats>* stats) {
+    BMP_TRACE_SCOPE(trace, "quantize.multi", static_cast<uint64_t>(width) * bytesPerPixel * height * (outputs.size() + 1));
+
+    size_t outputCount = outputs.size();
+
+    // Precompute the table and kernel of every output once
+    vector<QuantizationTable> tables(outputCount);
+    vector<QuantizeRowKernel> kernels(outputCount);
+    for (size_t k = 0; k < outputCount; ++k) {
+        buildQuantizationTable(quantizationBits[k], tables[k]);
+        kernels[k] = quantizeRowKernel(tables[k], bytesPerPixel);
+    }
+
+    int pixelBytes = width * bytesPerPixel;
+    int paddingBytes = abs(rowSize) - pixelBytes;
+
+    if (stats != nullptr) {
+        stats->resize(outputCount);
+        for (ImageStats& outputStats : *stats) {
+            outputStats.reset(bytesPerPixel);
+        }
+    }
+
+    // All outputs share the source stride, so the split aligned for the first output suits them all
+    uint8_t* alignmentBase = outputCount > 0 ? outputs[0] : nullptr;
+    parallelForRows(height, rowSize, alignmentBase, threadCount, [&](int firstRow, int lastRow) {
+        vector<StatsAccumulator> accumulators;
+        if (stats != nullptr) {
+            accumulators.assign(outputCount, StatsAccumulator(bytesPerPixel));
+        }
+        for (int y = firstRow; y < lastRow; y++) {
+            // The source row is fetched from memory once; the remaining outputs re-read it from L1
+            const uint8_t* row = pixelData + static_cast<ptrdiff_t>(y) * rowSize;
+            for (size_t k = 0; k < outputCount; ++k) {
+                uint8_t* outRow = outputs[k] + static_cast<ptrdiff_t>(y) * rowSize;
+                kernels[k](row, outRow, width, bytesPerPixel, tables[k]);
+
+                // Carry the row padding over so every output matches an in-place quantized copy byte for byte
+                memcpy(outRow + pixelBytes, row + pixelBytes, paddingBytes);
+                if (!accumulators.empty()) {
+                    accumulators[k].addRow(outRow, width);
+                }
+            }
+        }
+        for (size_t k = 0; k < accumulators.size(); ++k) {
+            accumulators[k].mergeInto((*stats)[k]);
+        }
+    });
+    if (stats != nullptr) {
+        for (ImageStats& outputStats : *stats) {
+            outputStats.finish();
+        }
+    }
+}
+
+// Function to extract a Region of Interest (ROI) from the source image
+void cropImage(const uint8_t* inputPixelData, uint8_t* croppedPixelData, int originalWidth, int originalHeight, int bytesPerPixel, int rowSize, int x, int y, int cropWidth, int cropHeight, int threadCount) {
+    BMP_TRACE_SCOPE(trace, "crop", static_cast<uint64_t>(cropWidth) * bytesPerPixel * cropHeight);
+
+    // Callers validate the ROI; one outside the source is refused here rather than read out of bounds
+    if (x < 0 || y < 0 || cropWidth <= 0 || cropHeight <= 0 || x > originalWidth - cropWidth || y > originalHeight - cropHeight) {
+        cerr << "Cropping area exceeds image bounds." << endl;
+        return;
+    }
+
+    // Calculate the row stride (size in bytes) for the cropped image, ensuring 4-byte alignment (padding).
+    int croppedRowSize = ((cropWidth * bytesPerPixel + 3) & (~3));
+
+    // The crop keeps the source row order: a negative source stride yields a negative destination stride
+    int croppedStride = rowSize < 0 ? -croppedRowSize : croppedRowSize;
+
+    parallelForRows(cropHeight, croppedStride, croppedPixelData, threadCount, [&](int firstRow, int lastRow) {
+        for (int j = firstRow; j < lastRow; ++j) {
+            // Calculate the current row index in the source image
+            int srcY = y + j;
+
+            // Calculate the byte offset for the source row
+            ptrdiff_t srcOffset = static_cast<ptrdiff_t>(srcY) * rowSize + x * bytesPerPixel;
+
+            // Calculate the byte offset for the destination row
+            ptrdiff_t destOffset = static_cast<ptrdiff_t>(j) * croppedStride;
+
+            // Copy the pixel data for the current row from source to destination
+            // Using memcpy for efficient memory block copying
+            memcpy(croppedPixelData + destOffset, inputPixelData + srcOffset, cropWidth * bytesPerPixel);
+        }
+    });
+}
+
+void flipVertically(uint8_t* pixelData, int width, int height, int rowSize, int bytesPerPixel, int threadCount) {
+    BMP_TRACE_SCOPE(trace, "flip.vertical", static_cast<uint64_t>(width) * bytesPerPixel * height);
+
+    size_t rowBytes = static_cast<size_t>(width) * bytesPerPixel;
+
+    // Each thread swaps a range of rows of the lower half with their mirror rows in the upper half
+    parallelForRows(height / 2, rowSize, pixelData, threadCount, [&](int firstRow, int lastRow) {
+        uint8_t chunk[4096];
+        for (int y = firstRow; y < lastRow; ++y) {
+            uint8_t* lower = pixelData + static_cast<ptrdiff_t>(y) * rowSize;
+            uint8_t* upper = pixelData + static_cast<ptrdiff_t>(height - 1 - y) * rowSize;
+
+            // Swap through a small stack buffer instead of allocating a whole row
+            for (size_t offset = 0; offset < rowBytes; offset += sizeof(chunk)) {
+                size_t length = min(sizeof(chunk), rowBytes - offset);
+                memcpy(chunk, lower + offset, length);
+                memcpy(lower + offset, upper + offset, length);
+                memcpy(upper + offset, chunk, length);
+            }
+        }
+    });
+}
+
+OrientationMap rotationMap(int quarterTurns, int width, int height) {
+    OrientationMap map;
+    switch (((quarterTurns % 4) + 4) % 4) {
+        case 1:
+            // Clockwise: destination (x, y) comes from source column width - 1 - y, row x
+            map.xx = 0;
+            map.xy = -1;
+            map.yx = 1;
+            map.yy = 0;
+            map.originX = width - 1;
+            break;
+        case 2:
+            map.xx = -1;
+            map.yy = -1;
+            map.originX = width - 1;
+            map.originY = height - 1;
+            break;
+        case 3:
+            map.xx = 0;
+            map.xy = 1;
+            map.yx = -1;
+            map.yy = 0;
+            map.originY = height - 1;
+            break;
+        default:
+            break;
+    }
+    return map;
+}
+
+OrientationMap composeOrientation(const OrientationMap& inner, const OrientationMap& outer) {
+    // source = A * (M * p + m) + b = (A * M) * p + (A * m + b)
+    OrientationMap map;
+    map.xx = inner.xx * outer.xx + inner.xy * outer.yx;
+    map.xy = inner.xx * outer.xy + inner.xy * outer.yy;
+    map.yx = inner.yx * outer.xx + inner.yy * outer.yx;
+    map.yy = inner.yx * outer.xy + inner.yy * outer.yy;
+    map.originX = inner.xx * outer.originX + inner.xy * outer.originY + inner.originX;
+    map.originY = inner.yx * outer.originX + inner.yy * outer.originY + inner.originY;
+    return map;
+}
+
+// Transposed gather with the pixel size fixed at compile time
+template <typename Format>
+static void remapTransposedRows(const uint8_t* source, int sourceRowSize, const OrientationMap& map,
+                                uint8_t* dest, int destRowSize, int destWidth, int firstRow, int rowCount) {
+    constexpr int bpp = Format::bytesPerPixel;
+    for (int tileRow = 0; tileRow < rowCount; tileRow += TRANSPOSE_TILE) {
+        int tileRowEnd = min(rowCount, tileRow + TRANSPOSE_TILE);
+        for (int tileColumn = 0; tileColumn < destWidth; tileColumn += TRANSPOSE_TILE) {
+            int tileColumnEnd = min(destWidth, tileColumn + TRANSPOSE_TILE);
+            for (int row = tileRow; row < tileRowEnd; ++row) {
+                // A destination row walks down one source column
+                int y = firstRow + row;
+                int sourceX = map.xy * y + map.originX;
+                uint8_t* out = dest + static_cast<ptrdiff_t>(row) * destRowSize;
+                for (int x = tileColumn; x < tileColumnEnd; ++x) {
+                    int sourceY = map.yx * x + map.originY;
+                    memcpy(out + x * bpp, source + static_cast<ptrdiff_t>(sourceY) * sourceRowSize + static_cast<size_t>(sourceX) * bpp, bpp);
+                }
+            }
+        }
+    }
+}
+
+void remapRows(const uint8_t* source, int sourceRowSize, int bytesPerPixel, const OrientationMap& map,
+               uint8_t* dest, int destRowSize, int destWidth, int firstRow, int rowCount) {
+    if (map.transposed()) {
+        dispatchPixelFormat(bytesPerPixel * 8, [&](auto format) {
+            remapTransposedRows<decltype(format)>(source, sourceRowSize, map, dest, destRowSize, destWidth, firstRow, rowCount);
+        });
+        return;
+    }
+
+    // Every destination row is one contiguous source row segment, read left to right or mirrored
+    FlipRowKernel flipRow = flipRowKernel(bytesPerPixel);
+    size_t rowBytes = static_cast<size_t>(destWidth) * bytesPerPixel;
+    int firstColumn = map.xx > 0 ? map.originX : map.originX - (destWidth - 1);
+    for (int row = 0; row < rowCount; ++row) {
+        int sourceY = map.yy * (firstRow + row) + map.originY;
+        const uint8_t* src = source + static_cast<ptrdiff_t>(sourceY) * sourceRowSize + static_cast<size_t>(firstColumn) * bytesPerPixel;
+        uint8_t* out = dest + static_cast<ptrdiff_t>(row) * destRowSize;
+        memcpy(out, src, rowBytes);
+        if (map.xx < 0) {
+            flipRow(out, destWidth, bytesPerPixel);
+        }
+    }
+}
+
+void rotateImage(const uint8_t* inputPixelData, uint8_t* rotatedPixelData, int width, int height, int bytesPerPixel, int rowSize, int quarterTurns, int threadCount) {
+    BMP_TRACE_SCOPE(trace, "rotate", static_cast<uint64_t>(width) * bytesPerPixel * height);
+
+    // Odd quarter turns swap the dimensions
+    bool swapped = (((quarterTurns % 4) + 4) % 4) % 2 == 1;
+    int rotatedWidth = swapped ? height : width;
+    int rotatedHeight = swapped ? width : height;
+    int rotatedRowSize = calculateRowSize(rotatedWidth, bytesPerPixel);
+    int rotatedStride = rowSize < 0 ? -rotatedRowSize : rotatedRowSize;
+    OrientationMap map = rotationMap(quarterTurns, width, height);
+
+    parallelForRows(rotatedHeight, rotatedStride, rotatedPixelData, threadCount, [&](int firstRow, int lastRow) {
+        remapRows(inputPixelData, rowSize, bytesPerPixel, map,
+                  rotatedPixelData + static_cast<ptrdiff_t>(firstRow) * rotatedStride, rotatedStride,
+                  rotatedWidth, firstRow, lastRow - firstRow);
+    });
+}
+
+void flipHorizontally(const ImageView& view, int threadCount) {
+    flipHorizontally(view.data, view.width, view.height, view.rowSize, view.bytesPerPixel, threadCount);
+}
+
+void quantizePixelData(const ImageView& view, int quantizationBits, int threadCount) {
+    quantizePixelData(view.data, view.bytesPerPixel, view.width, view.height, view.rowSize, quantizationBits, threadCount);
+}
+
+void copyView(const ImageView& view, uint8_t* dest, int threadCount) {
+    // A view is a crop whose origin is already applied
+    cropImage(view.data, dest, view.width, view.height, view.bytesPerPixel, view.rowSize, 0, 0, view.width, view.height, threadCount);
+}
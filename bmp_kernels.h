@@ -0,0 +1,97 @@
+#ifndef BMP_KERNELS_H
+#define BMP_KERNELS_H
+
+#include <cstdint>
+#include <vector>
+
+#include "bmp_image.h"
+
+struct ImageStats;
+
+// Every kernel takes an optional trailing `threadCount`. With a value above 1 the rows are split
+// into cache-line aligned ranges and processed on the shared thread pool (see bmp_parallel.h);
+// the default of 1 keeps the call single-threaded.
+//
+// Statistics stage: flip and quantization take an optional `stats` (bmp_stats.h). When it is set, every
+// output row is counted into a thread-private histogram right after it is written, and the histograms
+// are merged and summarized at the end, so no separate pass over the image is needed.
+
+// Function to perform an in-place horizontal flip of the image data
+void flipHorizontally(uint8_t* pixelData, int width, int height, int rowSize, int bytesPerPixel, int threadCount = 1, ImageStats* stats = nullptr);
+
+/**
+ * Quantization Function: Reduces the color depth of RGB channels.
+ * * This function maps the continuous [0, 255] pixel intensity range to a smaller set of 
+ * discrete levels determined by the target bit depth.
+ */
+void quantizePixelData(uint8_t* pixelData, int bytesPerPixel, int width, int height, int rowSize, int quantizationBits, int threadCount = 1, ImageStats* stats = nullptr);
+
+/**
+ * Fan-out quantization: reads every source pixel once and writes one quantized copy per entry
+ * of `quantizationBits` into the matching `outputs` buffer (each rowSize * height bytes).
+ * Produces the same bytes as running quantizePixelData on K separate copies, with one source pass.
+ * `stats`, when set, receives one entry per output.
+ */
+void quantizePixelDataMulti(const uint8_t* pixelData, const std::vector<uint8_t*>& outputs, const std::vector<int>& quantizationBits, int bytesPerPixel, int width, int height, int rowSize, int threadCount = 1, std::vector<ImageStats>* stats = nullptr);
+
+// Function to extract a Region of Interest (ROI) from the source image.
+// The destination buffer must already hold croppedRowSize * cropHeight bytes (e.g. a mapped output file).
+// A negative rowSize (top-down source) gives a top-down crop: croppedPixelData then points at its bottom row.
+// An ROI that leaves the originalWidth x originalHeight source is reported and nothing is copied.
+void cropImage(const uint8_t* inputPixelData, uint8_t* croppedPixelData, int originalWidth, int originalHeight, int bytesPerPixel, int rowSize, int x, int y, int cropWidth, int cropHeight, int threadCount = 1);
+
+// In-place vertical flip: swaps row y with row height - 1 - y.
+// Pipelines never call this; they fold the flip into the row mapping so no pixels move.
+void flipVertically(uint8_t* pixelData, int width, int height, int rowSize, int bytesPerPixel, int threadCount = 1);
+
+/**
+ * Mapping from destination to source pixel coordinates for the eight flips/rotations of a rectangle
+ * (a signed permutation matrix plus an offset): destination pixel (x, y) reads source pixel
+ * (xx * x + xy * y + originX, yx * x + yy * y + originY). Coordinates are memory coordinates: y is the
+ * row index in file order, so row 0 is the bottom row of a bottom-up BMP.
+ */
+struct OrientationMap {
+    int xx = 1;
+    int xy = 0;
+    int yx = 0;
+    int yy = 1;
+    int originX = 0;
+    int originY = 0;
+
+    // Destination rows map to source columns (90/270 degree rotations).
+    bool transposed() const { return xx == 0; }
+};
+
+// Map of a clockwise rotation by quarterTurns * 90 degrees of a width x height image.
+OrientationMap rotationMap(int quarterTurns, int width, int height);
+
+// Map of `outer` applied to the output of `inner`: the result reads inner's source directly.
+OrientationMap composeOrientation(const OrientationMap& inner, const OrientationMap& outer);
+
+// Edge of the square tiles used for transposed copies. A tile touches TRANSPOSE_TILE source rows;
+// at 4 bytes per pixel that is 8 KiB of source and destination data, well inside L1.
+const int TRANSPOSE_TILE = 32;
+
+/**
+ * Produce `rowCount` destination rows starting at destination row `firstRow` (`dest` points at that
+ * row) by reading `source` through `map`. Rows that map to source rows are copied whole and mirrored
+ * with the flip row kernel; transposed maps are gathered in square tiles so the source rows of a
+ * tile stay in cache while its columns are read.
+ */
+void remapRows(const uint8_t* source, int sourceRowSize, int bytesPerPixel, const OrientationMap& map,
+               uint8_t* dest, int destRowSize, int destWidth, int firstRow, int rowCount);
+
+// Rotate clockwise by quarterTurns * 90 degrees into `rotatedPixelData`, whose row stride is the
+// 4-byte aligned size of the rotated width (height x width pixels for odd quarterTurns), negated
+// along with rowSize for a top-down source.
+void rotateImage(const uint8_t* inputPixelData, uint8_t* rotatedPixelData, int width, int height, int bytesPerPixel, int rowSize, int quarterTurns, int threadCount = 1);
+
+// View overloads: the kernels above already take an origin pointer and a stride, so they run on
+// any ImageView (e.g. a cropView ROI) without copying it first.
+void flipHorizontally(const ImageView& view, int threadCount = 1);
+void quantizePixelData(const ImageView& view, int quantizationBits, int threadCount = 1);
+
+// Materialize a view into a packed buffer with the 4-byte aligned stride of its own width.
+void copyView(const ImageView& view, uint8_t* dest, int threadCount = 1);
+
+#endif // BMP_KERNELS_H
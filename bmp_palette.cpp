@@ -0,0 +1,222 @@
+#include "bmp_palette.h"
+#include "bmp_parallel.h"
+#include "bmp_simd.h"
+#include "bmp_trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+// Pooled 8-bit index image with the geometry, headers and row order of `source`
+static void createIndexedLike(const Image& source, Image& indexed) {
+    initImageGeometry(source, source.width, source.height, indexed);
+    indexed.bytesPerPixel = 1;
+    indexed.rowSize = calculateRowSize(indexed.width, 1);
+    indexed.stride = indexed.topDown ? -indexed.rowSize : indexed.rowSize;
+    indexed.palette.clear();
+    indexed.mapping.close();
+    indexed.storage = sharedBufferPool().acquire(indexed.pixelBytes());
+    indexed.attachPixels(indexed.storage.data());
+
+    // Only the padding needs defined contents; every index is written by the conversion
+    for (int y = 0; y < indexed.height && indexed.pixelData != nullptr; ++y) {
+        memset(indexed.row(y) + indexed.width, 0, indexed.rowSize - indexed.width);
+    }
+}
+
+// Pack the color of a pixel as 0x00RRGGBB
+static inline uint32_t packColor(const uint8_t* pixel) {
+    return static_cast<uint32_t>(pixel[0]) | (static_cast<uint32_t>(pixel[1]) << 8) | (static_cast<uint32_t>(pixel[2]) << 16);
+}
+
+static BMPPaletteEntry paletteEntry(int red, int green, int blue) {
+    BMPPaletteEntry entry;
+    entry.blue = static_cast<uint8_t>(blue);
+    entry.green = static_cast<uint8_t>(green);
+    entry.red = static_cast<uint8_t>(red);
+    entry.reserved = 0;
+    return entry;
+}
+
+// Whether any pixel of a 32-bit image is not fully opaque
+static bool hasTranslucentPixels(const Image& source, int threadCount) {
+    atomic<bool> found{false};
+    parallelForRows(source.height, source.stride, source.pixelData, threadCount, [&](int firstRow, int lastRow) {
+        for (int y = firstRow; y < lastRow && !found.load(memory_order_relaxed); ++y) {
+            const uint8_t* row = source.row(y);
+            uint8_t opaque = 0xFF;
+            for (int x = 0; x < source.width; ++x) {
+                opaque &= row[x * 4 + 3];
+            }
+            if (opaque != 0xFF) {
+                found = true;
+            }
+        }
+    });
+    return found;
+}
+
+bool convertToIndexed(const Image& source, int quantizationBits, Image& indexed, int threadCount) {
+    BMP_TRACE_SCOPE(trace, "palette.index", source.pixelBytes());
+
+    if (source.bytesPerPixel < 3) {
+        cerr << "Image is already indexed." << endl;
+        return false;
+    }
+
+    // A color table has no alpha: only fully opaque 32-bit images can be indexed without losing it
+    if (source.bytesPerPixel == 4 && hasTranslucentPixels(source, threadCount)) {
+        cerr << "The alpha channel can't be stored in a palette." << endl;
+        return false;
+    }
+    int width = source.width;
+    int bytesPerPixel = source.bytesPerPixel;
+
+    if (quantizationBits <= MAX_UNIFORM_PALETTE_BITS) {
+        // Uniform palette: every combination of levels, indexed as blue + green * L + red * L^2
+        QuantizationTable table;
+        buildQuantizationTable(quantizationBits, table);
+        int levels = 1 << quantizationBits;
+
+        createIndexedLike(source, indexed);
+        if (indexed.pixelData == nullptr) {
+            cerr << "Out of memory." << endl;
+            return false;
+        }
+        for (int index = 0; index < levels * levels * levels; ++index) {
+            int blue = index % levels;
+            int green = (index / levels) % levels;
+            int red = index / (levels * levels);
+            indexed.palette.push_back(paletteEntry(red * table.factor, green * table.factor, blue * table.factor));
+        }
+
+        PaletteIndexRowKernel indexRow = paletteIndexRowKernel(bytesPerPixel);
+        parallelForRows(source.height, indexed.stride, indexed.pixelData, threadCount, [&](int firstRow, int lastRow) {
+            for (int y = firstRow; y < lastRow; ++y) {
+                indexRow(source.row(y), indexed.row(y), width, table);
+            }
+        });
+        return true;
+    }
+
+    // Adaptive palette: collect the distinct colors with a 2^24-bit presence bitmap, giving up past 256
+    vector<uint64_t> seen(size_t(1) << 18, 0);
+    vector<uint32_t> colors;
+    for (int y = 0; y < source.height; ++y) {
+        const uint8_t* row = source.row(y);
+        for (int x = 0; x < width; ++x) {
+            uint32_t color = packColor(row + x * bytesPerPixel);
+            uint64_t bit = uint64_t(1) << (color & 63);
+            if ((seen[color >> 6] & bit) == 0) {
+                seen[color >> 6] |= bit;
+                colors.push_back(color);
+                if (colors.size() > static_cast<size_t>(MAX_PALETTE_COLORS)) {
+                    cerr << "Too many colors for a palette (more than " << MAX_PALETTE_COLORS << ")." << endl;
+                    return false;
+                }
+            }
+        }
+    }
+
+    createIndexedLike(source, indexed);
+    if (indexed.pixelData == nullptr) {
+        cerr << "Out of memory." << endl;
+        return false;
+    }
+    sort(colors.begin(), colors.end());
+    for (uint32_t color : colors) {
+        indexed.palette.push_back(paletteEntry((color >> 16) & 0xFF, (color >> 8) & 0xFF, color & 0xFF));
+    }
+
+    // Binary search in the sorted palette; runs of one color reuse the previous answer
+    parallelForRows(source.height, indexed.stride, indexed.pixelData, threadCount, [&](int firstRow, int lastRow) {
+        for (int y = firstRow; y < lastRow; ++y) {
+            const uint8_t* row = source.row(y);
+            uint8_t* indices = indexed.row(y);
+            uint32_t previousColor = packColor(row) + 1;
+            uint8_t previousIndex = 0;
+            for (int x = 0; x < width; ++x) {
+                uint32_t color = packColor(row + x * bytesPerPixel);
+                if (color != previousColor) {
+                    previousColor = color;
+                    previousIndex = static_cast<uint8_t>(lower_bound(colors.begin(), colors.end(), color) - colors.begin());
+                }
+                indices[x] = previousIndex;
+            }
+        }
+    });
+    return true;
+}
+
+bool saveIndexedBMP(const char* fileName, const Image& image, int indexBits, int threadCount) {
+    BMP_TRACE_SCOPE(trace, "save.indexed", image.pixelBytes());
+
+    if (image.bytesPerPixel != 1 || image.palette.empty()) {
+        cerr << "Image has no color table." << endl;
+        return false;
+    }
+    if (indexBits == 0) {
+        indexBits = image.palette.size() <= 16 ? 4 : 8;
+    }
+    if (indexBits != 4 && indexBits != 8) {
+        cerr << "Indexed BMPs support 4 or 8 bits per pixel." << endl;
+        return false;
+    }
+
+    if (indexBits == 8) {
+        // The in-memory layout already is the 8-bit file layout
+        Image output;
+        if (!createBMPMapped(fileName, image, image.width, image.height, output)) {
+            return false;
+        }
+        memcpy(output.pixelBase(), image.pixelBase(), image.pixelBytes());
+        return commitBMP(output);
+    }
+
+    if (image.palette.size() > 16) {
+        cerr << "A 4-bit BMP holds at most 16 colors." << endl;
+        return false;
+    }
+
+    // Same headers and color table, with rows of two pixels per byte (still padded to 4 bytes)
+    BMPFileHeader fileHeader;
+    BMPInfoHeader infoHeader;
+    prepareBMPHeaders(image, fileHeader, infoHeader);
+    int packedRowSize = calculateRowSize((image.width + 1) / 2, 1);
+    infoHeader.biBitCount = 4;
+    infoHeader.biSizeImage = static_cast<uint32_t>(static_cast<size_t>(packedRowSize) * image.height);
+    fileHeader.bfSize = fileHeader.bfOffBits + infoHeader.biSizeImage;
+
+    MappedFile output;
+    if (!output.create(fileName, fileHeader.bfSize)) {
+        cerr << "Can't open output file." << endl;
+        return false;
+    }
+    uint8_t* base = output.data();
+    memcpy(base, &fileHeader, sizeof(fileHeader));
+    memcpy(base + sizeof(fileHeader), &infoHeader, sizeof(infoHeader));
+    memcpy(base + BMP_HEADERS_SIZE, image.palette.data(), image.palette.size() * sizeof(BMPPaletteEntry));
+
+    // Rows are packed in file order straight into the mapping; the padding stays zero from the pre-sized file
+    uint8_t* packedPixels = base + fileHeader.bfOffBits;
+    const uint8_t* indexRows = image.pixelBase();
+    PackNibblesKernel packRow = packNibblesKernel();
+    parallelForRows(image.height, packedRowSize, packedPixels, threadCount, [&](int firstRow, int lastRow) {
+        for (int y = firstRow; y < lastRow; ++y) {
+            packRow(indexRows + static_cast<size_t>(y) * image.rowSize, packedPixels + static_cast<size_t>(y) * packedRowSize, image.width);
+        }
+    });
+
+    bool flushed = output.flush();
+    output.close();
+    if (!flushed) {
+        cerr << "Failed to write output file." << endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,30 @@
+#ifndef BMP_PALETTE_H
+#define BMP_PALETTE_H
+
+#include "bmp_image.h"
+
+// Largest quantization bit depth whose full uniform palette ((2^bits)^3 colors) fits 8-bit indices.
+const int MAX_UNIFORM_PALETTE_BITS = 2;
+
+// Largest number of colors an indexed BMP can hold.
+const int MAX_PALETTE_COLORS = 256;
+
+/**
+ * Convert a direct-color image quantized to `quantizationBits` into an 8-bit indexed image with a color table.
+ * Up to MAX_UNIFORM_PALETTE_BITS the palette is the fixed grid of all level combinations and the
+ * indices are computed arithmetically by a vector kernel. Deeper quantizations get a palette of the
+ * colors actually present, which only succeeds if there are at most MAX_PALETTE_COLORS of them.
+ * `indexed` keeps the headers and row order of `source`. A palette has no alpha, so a 32-bit source
+ * is only converted when every pixel is fully opaque (alpha 0xFF).
+ * Prints the reason and returns false if the colors or the alpha do not fit a palette.
+ */
+bool convertToIndexed(const Image& source, int quantizationBits, Image& indexed, int threadCount = 1);
+
+/**
+ * Write an indexed image as a 4-bit or 8-bit BMP with its color table (biBitCount, biClrUsed and
+ * bfOffBits set accordingly). `indexBits` 0 picks 4 bits whenever the palette has at most 16 entries.
+ * Returns false on failure.
+ */
+bool saveIndexedBMP(const char* fileName, const Image& image, int indexBits = 0, int threadCount = 1);
+
+#endif // BMP_PALETTE_H
@@ -0,0 +1,241 @@
+#include "bmp_parallel.h"
+
+#include <algorithm>
+#include <deque>
+#include <numeric>
+#include <cstdlib>
+#include <string>
+
+using namespace std;
+
+// Set while a thread is executing pool tasks, to detect nested run() calls
+static thread_local bool insidePoolTask = false;
+
+ThreadPool::ThreadPool(int workerCount) {
+    reserve(workerCount);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (thread& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::reserve(int count) {
+    lock_guard<std::mutex> lock(mutex);
+    while (static_cast<int>(workers.size()) < count) {
+        workers.emplace_back(&ThreadPool::workerLoop, this);
+    }
+}
+
+int ThreadPool::workerCount() const {
+    lock_guard<std::mutex> lock(mutex);
+    return static_cast<int>(workers.size());
+}
+
+// Claim task indices of the group until none are left
+void ThreadPool::runTasks(TaskGroup& group) {
+    bool wasInside = insidePoolTask;
+    insidePoolTask = true;
+    for (int i = group.nextTask.fetch_add(1); i < group.taskCount; i = group.nextTask.fetch_add(1)) {
+        (*group.task)(i);
+    }
+    insidePoolTask = wasInside;
+}
+
+ThreadPool::TaskGroup* ThreadPool::pickGroup() const {
+    TaskGroup* best = nullptr;
+    for (TaskGroup* group : groups) {
+        if (group->hasWork() && (best == nullptr || group->activeWorkers < best->activeWorkers)) {
+            best = group;
+        }
+    }
+    return best;
+}
+
+void ThreadPool::workerLoop() {
+    unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        // Workers only join groups that are still open and have tasks left
+        TaskGroup* group = nullptr;
+        wake.wait(lock, [&] { return stopping || (group = pickGroup()) != nullptr; });
+        if (stopping) {
+            return;
+        }
+        ++group->activeWorkers;
+        lock.unlock();
+
+        runTasks(*group);
+
+        lock.lock();
+        if (--group->activeWorkers == 0) {
+            finished.notify_all();
+        }
+    }
+}
+
+void ThreadPool::run(int count, const function<void(int)>& body) {
+    // Nested or trivial calls: run inline
+    if (insidePoolTask || count <= 1 || workerCount() == 0) {
+        for (int i = 0; i < count; ++i) {
+            body(i);
+        }
+        return;
+    }
+
+    TaskGroup group;
+    group.task = &body;
+    group.taskCount = count;
+    {
+        lock_guard<std::mutex> lock(mutex);
+        groups.push_back(&group);
+    }
+    wake.notify_all();
+
+    // The caller works as well, then closes its group and waits for workers still finishing a task
+    runTasks(group);
+    unique_lock<std::mutex> lock(mutex);
+    groups.erase(find(groups.begin(), groups.end(), &group));
+    finished.wait(lock, [&] { return group.activeWorkers == 0; });
+}
+
+ThreadPool& sharedThreadPool() {
+    static ThreadPool pool(0);
+    return pool;
+}
+
+int hardwareThreadCount() {
+    return max(1, static_cast<int>(thread::hardware_concurrency()));
+}
+
+// Greatest common divisor, used to find the row period of cache-line alignment
+static int greatestCommonDivisor(int a, int b) {
+    while (b != 0) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+void parallelForRows(int height, int rowSize, const uint8_t* writeBase, int threadCount,
+                     const function<void(int firstRow, int lastRow)>& body) {
+    threadCount = min(threadCount, height);
+    if (threadCount <= 1) {
+        if (height > 0) {
+            body(0, height);
+        }
+        return;
+    }
+
+    // Every `period` rows the row start advances by a whole number of cache lines.
+    // `phase` is the first row that starts exactly on a cache line of the destination buffer
+    // (0 when no row does, e.g. for an odd base address; boundaries are then only period-aligned).
+    int period = CACHE_LINE_SIZE / greatestCommonDivisor(abs(rowSize), CACHE_LINE_SIZE);
+    uintptr_t baseAddress = reinterpret_cast<uintptr_t>(writeBase);
+    int phase = 0;
+    for (int y = 0; y < period; ++y) {
+        if ((baseAddress + static_cast<uintptr_t>(y) * rowSize) % CACHE_LINE_SIZE == 0) {
+            phase = y;
+            break;
+        }
+    }
+
+    // Even split, with each inner boundary rounded down onto an aligned row
+    vector<int> boundaries;
+    boundaries.push_back(0);
+    for (int part = 1; part < threadCount; ++part) {
+        int boundary = static_cast<int>(static_cast<int64_t>(height) * part / threadCount);
+        if (boundary >= phase) {
+            boundary = phase + (boundary - phase) / period * period;
+        } else {
+            boundary = 0;
+        }
+        if (boundary > boundaries.back() && boundary < height) {
+            boundaries.push_back(boundary);
+        }
+    }
+    boundaries.push_back(height);
+
+    sharedThreadPool().reserve(threadCount - 1);
+    sharedThreadPool().run(static_cast<int>(boundaries.size()) - 1, [&](int range) {
+        body(boundaries[range], boundaries[range + 1]);
+    });
+}
+
+void runWorkStealing(int workerCount, int taskCount, const vector<uint64_t>& costs,
+                     const function<void(int)>& task) {
+    workerCount = max(1, min(workerCount, taskCount));
+    if (taskCount <= 0) {
+        return;
+    }
+
+    // Largest tasks first, so the small ones fill the gaps at the end
+    vector<int> order(taskCount);
+    iota(order.begin(), order.end(), 0);
+    if (static_cast<int>(costs.size()) == taskCount) {
+        stable_sort(order.begin(), order.end(), [&costs](int a, int b) { return costs[a] > costs[b]; });
+    }
+
+    // One deque per worker, dealt round-robin
+    vector<deque<int>> queues(workerCount);
+    vector<std::mutex> queueMutexes(workerCount);
+    for (int i = 0; i < taskCount; ++i) {
+        queues[i % workerCount].push_back(order[i]);
+    }
+
+    auto worker = [&](int self) {
+        for (;;) {
+            int next = -1;
+
+            // Own work first (front: the largest remaining task of this worker)
+            {
+                lock_guard<std::mutex> lock(queueMutexes[self]);
+                if (!queues[self].empty()) {
+                    next = queues[self].front();
+                    queues[self].pop_front();
+                }
+            }
+
+            // Then steal the cheapest task from the back of another worker's deque
+            for (int offset = 1; next < 0 && offset < workerCount; ++offset) {
+                int victim = (self + offset) % workerCount;
+                lock_guard<std::mutex> lock(queueMutexes[victim]);
+                if (!queues[victim].empty()) {
+                    next = queues[victim].back();
+                    queues[victim].pop_back();
+                }
+            }
+
+            // No task is ever added after the start, so empty deques everywhere means done
+            if (next < 0) {
+                return;
+            }
+            task(next);
+        }
+    };
+
+    vector<thread> threads;
+    for (int i = 1; i < workerCount; ++i) {
+        threads.emplace_back(worker, i);
+    }
+    worker(0);
+    for (thread& t : threads) {
+        t.join();
+    }
+}
+
+int parseThreadCountOption(int argc, char* argv[]) {
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (string(argv[i]) == "--threads") {
+            int threads = atoi(argv[i + 1]);
+            return threads <= 0 ? hardwareThreadCount() : threads;
+        }
+    }
+    return 1;
+}
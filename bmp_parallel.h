@@ -0,0 +1,89 @@
+#ifndef BMP_PARALLEL_H
+#define BMP_PARALLEL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Size of a cache line; row ranges handed to different threads never share one.
+const int CACHE_LINE_SIZE = 64;
+
+/**
+ * Fixed set of worker threads that execute indexed tasks.
+ * Each run() call is a task group whose indices are handed out through its own atomic counter; the
+ * calling thread takes part too, so a pool of N workers runs up to N + 1 tasks of one group at once.
+ * Concurrent callers (e.g. batch workers each running a row-parallel kernel) share the workers:
+ * an idle worker joins the open group with the fewest workers, so no caller waits for another's group.
+ */
+class ThreadPool {
+public:
+    explicit ThreadPool(int workerCount);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Call task(i) for every i in [0, taskCount) and return once all of them have finished.
+    // Calls from inside a task run serially on the calling thread instead of deadlocking.
+    void run(int taskCount, const std::function<void(int)>& task);
+
+    // Start additional workers so that at least `workerCount` exist.
+    void reserve(int workerCount);
+
+    int workerCount() const;
+
+private:
+    // One run() call: its tasks and the workers currently executing them
+    struct TaskGroup {
+        const std::function<void(int)>* task = nullptr;
+        int taskCount = 0;
+        std::atomic<int> nextTask{0};
+        int activeWorkers = 0;
+        bool hasWork() const { return nextTask.load(std::memory_order_relaxed) < taskCount; }
+    };
+
+    void workerLoop();
+    static void runTasks(TaskGroup& group);
+    // Open group with remaining tasks and the fewest workers, or null. Caller holds the mutex.
+    TaskGroup* pickGroup() const;
+
+    std::vector<std::thread> workers;
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    std::vector<TaskGroup*> groups;         // Open groups; a caller removes its own before waiting.
+    bool stopping = false;
+};
+
+// Process-wide pool used by the kernels; grown on demand to the largest thread count requested.
+ThreadPool& sharedThreadPool();
+
+/**
+ * Split rows [0, height) into at most `threadCount` contiguous ranges and call body(firstRow, lastRow)
+ * for each, in parallel. Range boundaries are placed on rows whose start address in `writeBase`
+ * (the buffer being written, stride `rowSize`) falls on a cache-line boundary whenever the geometry
+ * allows it, so no two threads write the same cache line. threadCount <= 1 runs inline.
+ */
+void parallelForRows(int height, int rowSize, const uint8_t* writeBase, int threadCount,
+                     const std::function<void(int firstRow, int lastRow)>& body);
+
+/**
+ * Work-stealing scheduler for a fixed set of independent tasks with uneven cost (e.g. images of mixed size).
+ * Tasks are sorted by descending `costs` and dealt round-robin into one deque per worker. Each worker
+ * pops from the front of its own deque and, once it runs dry, steals from the back of the others.
+ * Blocks until task(i) has run for every i in [0, taskCount). `costs` may be empty (equal cost).
+ */
+void runWorkStealing(int workerCount, int taskCount, const std::vector<uint64_t>& costs,
+                     const std::function<void(int)>& task);
+
+// Number of hardware threads (at least 1).
+int hardwareThreadCount();
+
+// Parse the optional "--threads <n>" command-line flag ("--threads 0" means all hardware threads).
+// Returns 1 (single-threaded) when absent.
+int parseThreadCountOption(int argc, char* argv[]);
+
+#endif // BMP_PARALLEL_H
@@ -0,0 +1,280 @@
+#include "bmp_pipeline.h"
+#include "bmp_image.h"
+#include "bmp_parallel.h"
+#include "bmp_rle.h"
+#include "bmp_roi.h"
+#include "bmp_simd.h"
+#include "bmp_stream.h"
+#include "bmp_trace.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+
+Pipeline& Pipeline::crop(int x, int y, int width, int height) {
+    PipelineStep step;
+    step.type = STEP_CROP;
+    step.x = x;
+    step.y = y;
+    step.width = width;
+    step.height = height;
+    stepList.push_back(step);
+    return *this;
+}
+
+Pipeline& Pipeline::flipHorizontal() {
+    PipelineStep step;
+    step.type = STEP_FLIP_HORIZONTAL;
+    stepList.push_back(step);
+    return *this;
+}
+
+Pipeline& Pipeline::flipVertical() {
+    PipelineStep step;
+    step.type = STEP_FLIP_VERTICAL;
+    stepList.push_back(step);
+    return *this;
+}
+
+Pipeline& Pipeline::rotate(int degrees) {
+    PipelineStep step;
+    step.type = STEP_ROTATE;
+    step.quarterTurns = ((degrees / 90) % 4 + 4) % 4;
+    stepList.push_back(step);
+    return *this;
+}
+
+Pipeline& Pipeline::quantize(int quantizationBits) {
+    PipelineStep step;
+    step.type = STEP_QUANTIZE;
+    step.quantizationBits = quantizationBits;
+    stepList.push_back(step);
+    return *this;
+}
+
+// Split "name:a,b,c" into the name and its integer arguments
+static bool parseStepSpec(const string& spec, string& name, vector<int>& arguments) {
+    size_t colon = spec.find(':');
+    name = spec.substr(0, colon);
+    arguments.clear();
+    if (colon == string::npos) {
+        return true;
+    }
+    stringstream stream(spec.substr(colon + 1));
+    string item;
+    while (getline(stream, item, ',')) {
+        char* end = nullptr;
+        long value = strtol(item.c_str(), &end, 10);
+        if (item.empty() || *end != '\0') {
+            return false;
+        }
+        arguments.push_back(static_cast<int>(value));
+    }
+    return true;
+}
+
+bool Pipeline::addStep(const string& spec) {
+    string name;
+    vector<int> arguments;
+    if (!parseStepSpec(spec, name, arguments)) {
+        cerr << "Invalid pipeline step: " << spec << endl;
+        return false;
+    }
+
+    if (name == "crop" && arguments.size() == 4) {
+        crop(arguments[0], arguments[1], arguments[2], arguments[3]);
+    } else if (name == "flip" && arguments.empty()) {
+        flipHorizontal();
+    } else if (name == "flipv" && arguments.empty()) {
+        flipVertical();
+    } else if (name == "rotate" && arguments.size() == 1 &&
+               (arguments[0] == 90 || arguments[0] == 180 || arguments[0] == 270)) {
+        rotate(arguments[0]);
+    } else if (name == "quantize" && arguments.size() == 1 && arguments[0] >= 1 && arguments[0] <= 8) {
+        quantize(arguments[0]);
+    } else {
+        cerr << "Invalid pipeline step: " << spec << endl;
+        return false;
+    }
+    return true;
+}
+
+bool Pipeline::plan(int sourceWidth, int sourceHeight, FusedPlan& fused) const {
+    fused = FusedPlan();
+    fused.width = sourceWidth;
+    fused.height = sourceHeight;
+
+    for (const PipelineStep& step : stepList) {
+        // Map from this step's output to its input, in the coordinates of the image produced so far
+        OrientationMap stepMap;
+        switch (step.type) {
+            case STEP_CROP:
+                // Validate that the ROI is within the image produced so far
+                if (step.x < 0 || step.y < 0 || step.width <= 0 || step.height <= 0 ||
+                    step.x + step.width > fused.width || step.y + step.height > fused.height) {
+                    cerr << "Cropping area exceeds image bounds." << endl;
+                    return false;
+                }
+                stepMap.originX = step.x;
+                stepMap.originY = step.y;
+                fused.width = step.width;
+                fused.height = step.height;
+                break;
+
+            case STEP_FLIP_HORIZONTAL:
+                stepMap.xx = -1;
+                stepMap.originX = fused.width - 1;
+                break;
+
+            case STEP_FLIP_VERTICAL:
+                // Only the row mapping changes; no pixel is moved until the output is written
+                stepMap.yy = -1;
+                stepMap.originY = fused.height - 1;
+                break;
+
+            case STEP_ROTATE:
+                stepMap = rotationMap(step.quarterTurns, fused.width, fused.height);
+                if (step.quarterTurns % 2 == 1) {
+                    swap(fused.width, fused.height);
+                }
+                break;
+
+            case STEP_QUANTIZE:
+                // Per-pixel, so it commutes with the geometric steps and is applied last
+                fused.quantizationBits.push_back(step.quantizationBits);
+                break;
+        }
+        fused.map = composeOrientation(fused.map, stepMap);
+    }
+
+    // The map is affine, so the source pixels read span the rectangle between the images of the corners
+    int minX = sourceWidth, minY = sourceHeight, maxX = -1, maxY = -1;
+    for (int corner = 0; corner < 4; ++corner) {
+        int x = (corner & 1) ? fused.width - 1 : 0;
+        int y = (corner & 2) ? fused.height - 1 : 0;
+        int sourceX = fused.map.xx * x + fused.map.xy * y + fused.map.originX;
+        int sourceY = fused.map.yx * x + fused.map.yy * y + fused.map.originY;
+        minX = min(minX, sourceX);
+        maxX = max(maxX, sourceX);
+        minY = min(minY, sourceY);
+        maxY = max(maxY, sourceY);
+    }
+    fused.sourceX = minX;
+    fused.sourceY = minY;
+    fused.sourceWidth = maxX - minX + 1;
+    fused.sourceHeight = maxY - minY + 1;
+    return true;
+}
+
+void runFusedRows(const FusedPlan& fused, const uint8_t* source, int sourceRowSize, int bytesPerPixel,
+                  uint8_t* dest, int destRowSize, int firstRow, int rowCount) {
+    vector<QuantizationTable> tables(fused.quantizationBits.size());
+    vector<QuantizeRowKernel> quantizeRows(tables.size());
+    for (size_t i = 0; i < tables.size(); ++i) {
+        buildQuantizationTable(fused.quantizationBits[i], tables[i]);
+        quantizeRows[i] = quantizeRowKernel(tables[i], bytesPerPixel);
+    }
+
+    // Rows are produced in small chunks: one row when it comes from a single source row, one tile
+    // height for transposed maps. Every later step then works on rows that are still in cache.
+    int chunkRows = fused.map.transposed() ? TRANSPOSE_TILE : 1;
+    for (int chunk = 0; chunk < rowCount; chunk += chunkRows) {
+        int chunkCount = min(chunkRows, rowCount - chunk);
+        uint8_t* chunkDest = dest + static_cast<ptrdiff_t>(chunk) * destRowSize;
+        remapRows(source, sourceRowSize, bytesPerPixel, fused.map, chunkDest, destRowSize, fused.width,
+                  firstRow + chunk, chunkCount);
+        for (int y = 0; y < chunkCount; ++y) {
+            uint8_t* dst = chunkDest + static_cast<ptrdiff_t>(y) * destRowSize;
+            for (size_t i = 0; i < tables.size(); ++i) {
+                quantizeRows[i](dst, dst, fused.width, bytesPerPixel, tables[i]);
+            }
+        }
+    }
+}
+
+// Write the output of a plan whose map addresses `source` (row 0 at source.pixelData)
+static bool runFusedPlan(const FusedPlan& fused, const Image& source, const char* outputFileName, int threadCount) {
+    // The output file is the only destination: there is no intermediate image between the steps
+    Image output;
+    if (!createBMPMapped(outputFileName, source, fused.width, fused.height, output)) {
+        return false;
+    }
+    {
+        BMP_TRACE_SCOPE(trace, "pipeline.fused", output.pixelBytes());
+        parallelForRows(fused.height, output.stride, output.pixelData, threadCount, [&](int firstRow, int lastRow) {
+            runFusedRows(fused, source.pixelData, source.stride, source.bytesPerPixel,
+                         output.row(firstRow), output.stride, firstRow, lastRow - firstRow);
+        });
+    }
+    return commitBMP(output);
+}
+
+bool runPipeline(const Pipeline& pipeline, const char* inputFileName, const char* outputFileName, int threadCount) {
+    // The plan is made from the headers alone: it tells which source pixels the output needs
+    Image header;
+    FusedPlan fused;
+    if (!loadBMPHeaders(inputFileName, header) || !pipeline.plan(header.width, header.height, fused)) {
+        return false;
+    }
+
+    // Plans that need the whole source, and indexed files (decoded whole anyway), map the input
+    bool wholeSource = fused.sourceWidth == header.width && fused.sourceHeight == header.height;
+    if (wholeSource || isIndexedBMP(header.infoHeader)) {
+        Image image;
+        return loadBMPMapped(inputFileName, image) && runFusedPlan(fused, image, outputFileName, threadCount);
+    }
+
+    // Otherwise only the source rectangle is read (one positioned read per row), and the plan is rebased
+    // onto it: a crop of a flipped image reads just the mirrored columns of the source
+    Image region;
+    if (!loadBMPRegion(inputFileName, fused.sourceX, fused.sourceY, fused.sourceWidth, fused.sourceHeight, region)) {
+        return false;
+    }
+    fused.map.originX -= fused.sourceX;
+    fused.map.originY -= fused.sourceY;
+    return runFusedPlan(fused, region, outputFileName, threadCount);
+}
+
+bool runPipeline(const Pipeline& pipeline, const Image& image, const char* outputFileName, int threadCount) {
+    FusedPlan fused;
+    if (!pipeline.plan(image.width, image.height, fused)) {
+        return false;
+    }
+    return runFusedPlan(fused, image, outputFileName, threadCount);
+}
+
+bool runPipelineStreaming(const Pipeline& pipeline, const char* inputFileName, const char* outputFileName, int bandRows, int threadCount) {
+    BMPRowReader reader;
+    Image source;
+    if (!reader.open(inputFileName, source)) {
+        return false;
+    }
+
+    FusedPlan fused;
+    if (!pipeline.plan(source.width, source.height, fused)) {
+        return false;
+    }
+
+    // Vertical flips and rotations read the source rows out of order
+    if (!fused.rowSequential()) {
+        return runPipeline(pipeline, inputFileName, outputFileName, threadCount);
+    }
+
+    Image output;
+    initImageGeometry(source, fused.width, fused.height, output);
+
+    // Each band holds source rows starting at sourceY + row; the plan is rebased onto the band
+    FusedPlan bandPlan = fused;
+    bandPlan.map.originY = 0;
+    return streamBMP(reader, source, outputFileName, output, fused.sourceY, bandRows, false,
+        [&](uint8_t* srcBand, uint8_t* dstBand, int, int rowCount) {
+            parallelForRows(rowCount, output.rowSize, dstBand, threadCount, [&](int firstRow, int lastRow) {
+                runFusedRows(bandPlan, srcBand, source.rowSize, source.bytesPerPixel,
+                             dstBand + static_cast<size_t>(firstRow) * output.rowSize, output.rowSize, firstRow, lastRow - firstRow);
+            });
+        });
+}
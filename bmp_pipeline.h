@@ -0,0 +1,87 @@
+#ifndef BMP_PIPELINE_H
+#define BMP_PIPELINE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "bmp_kernels.h"
+
+// Kind of operation in a pipeline
+enum PipelineStepType {
+    STEP_CROP,
+    STEP_FLIP_HORIZONTAL,
+    STEP_FLIP_VERTICAL,
+    STEP_ROTATE,
+    STEP_QUANTIZE
+};
+
+struct PipelineStep {
+    PipelineStepType type;
+    int x = 0;                  // Crop rectangle, in the coordinates of the image produced by the previous step.
+    int y = 0;
+    int width = 0;
+    int height = 0;
+    int quantizationBits = 0;   // Quantize.
+    int quarterTurns = 0;       // Rotate: clockwise quarter turns (1..3).
+};
+
+/**
+ * A chain of operations folded into one traversal.
+ * Crops, flips and rotations compose into a single OrientationMap from output to source pixels,
+ * so the whole chain reduces to that map plus a list of per-pixel quantizations. Each output row is
+ * produced directly from the source, with no intermediate images.
+ */
+struct FusedPlan {
+    OrientationMap map;         // Output pixel -> source pixel.
+    int width = 0;              // Output size.
+    int height = 0;
+    int sourceX = 0;            // Bounding rectangle of the source pixels read.
+    int sourceY = 0;
+    int sourceWidth = 0;
+    int sourceHeight = 0;
+    std::vector<int> quantizationBits;
+
+    // Output row y reads source row sourceY + y, so the source can be streamed in row order.
+    bool rowSequential() const { return map.yx == 0 && map.yy == 1; }
+};
+
+class Pipeline {
+public:
+    Pipeline& crop(int x, int y, int width, int height);
+    Pipeline& flipHorizontal();
+    Pipeline& flipVertical();
+    Pipeline& rotate(int degrees);          // Clockwise; 90, 180 or 270.
+    Pipeline& quantize(int quantizationBits);
+
+    // Append a step from its textual form: "crop:x,y,w,h", "flip", "flipv", "rotate:<90|180|270>" or "quantize:<bits>".
+    bool addStep(const std::string& spec);
+
+    // Fold the steps for a source of the given size. Prints the reason and returns false if a crop is out of bounds.
+    bool plan(int sourceWidth, int sourceHeight, FusedPlan& fused) const;
+
+    const std::vector<PipelineStep>& steps() const { return stepList; }
+
+private:
+    std::vector<PipelineStep> stepList;
+};
+
+// Produce output rows [firstRow, firstRow + rowCount) of a fused plan. `source` points at source row 0,
+// `dest` at output row `firstRow`.
+void runFusedRows(const FusedPlan& fused, const uint8_t* source, int sourceRowSize, int bytesPerPixel,
+                  uint8_t* dest, int destRowSize, int firstRow, int rowCount);
+
+// Run a pipeline on a file: the plan is made from the headers and coordinates are propagated back to the
+// source, so only the source rectangle the output needs is read (the whole file is mapped when it needs
+// everything). Pre-sized mapped output, one fused pass.
+bool runPipeline(const Pipeline& pipeline, const char* inputFileName, const char* outputFileName, int threadCount = 1);
+
+// Same, for a source that is already in memory; `image` is only read.
+bool runPipeline(const Pipeline& pipeline, const Image& image, const char* outputFileName, int threadCount = 1);
+
+// Same result, but only the source rows inside the plan's rectangle are read, `bandRows` at a time.
+// Plans that are not row-sequential (vertical flips, rotations) need source rows out of order and
+// run on the mapped input instead, which is paged in on demand rather than held in memory.
+bool runPipelineStreaming(const Pipeline& pipeline, const char* inputFileName, const char* outputFileName, int bandRows, int threadCount = 1);
+
+#endif // BMP_PIPELINE_H
@@ -0,0 +1,104 @@
+#ifndef BMP_PIXEL_FORMAT_H
+#define BMP_PIXEL_FORMAT_H
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// Compile-time pixel format tags. Kernels templated on a format see the pixel size as a
+// constant, so their inner loops compile to fixed-stride, unrollable code.
+
+// 24-bit BGR, no alpha
+struct PixelBGR24 {
+    static constexpr int bitCount = 24;
+    static constexpr int bytesPerPixel = 3;
+    static constexpr bool hasAlpha = false;
+};
+
+// 32-bit BGRA; the alpha byte is never modified by color operations
+struct PixelBGRA32 {
+    static constexpr int bitCount = 32;
+    static constexpr int bytesPerPixel = 4;
+    static constexpr bool hasAlpha = true;
+};
+
+// 8-bit palette indices. Geometric kernels move the indices; color kernels act on the color table instead.
+struct PixelIndexed8 {
+    static constexpr int bitCount = 8;
+    static constexpr int bytesPerPixel = 1;
+    static constexpr bool hasAlpha = false;
+};
+
+/**
+ * Single dispatch point from a runtime biBitCount to a format tag: calls visitor(Format()) once
+ * and returns true, or returns false for unsupported bit counts. Call it once per image, outside the row loops.
+ */
+template <typename Visitor>
+bool dispatchPixelFormat(int bitCount, Visitor&& visitor) {
+    switch (bitCount) {
+        case 24: visitor(PixelBGR24()); return true;
+        case 32: visitor(PixelBGRA32()); return true;
+        case 8:  visitor(PixelIndexed8()); return true;
+        default: return false;
+    }
+}
+
+// Dispatch a runtime quantization bit depth (1..8) to std::integral_constant<int, Bits>.
+template <typename Visitor>
+bool dispatchQuantizationBits(int quantizationBits, Visitor&& visitor) {
+    switch (quantizationBits) {
+        case 1: visitor(std::integral_constant<int, 1>()); return true;
+        case 2: visitor(std::integral_constant<int, 2>()); return true;
+        case 3: visitor(std::integral_constant<int, 3>()); return true;
+        case 4: visitor(std::integral_constant<int, 4>()); return true;
+        case 5: visitor(std::integral_constant<int, 5>()); return true;
+        case 6: visitor(std::integral_constant<int, 6>()); return true;
+        case 7: visitor(std::integral_constant<int, 7>()); return true;
+        case 8: visitor(std::integral_constant<int, 8>()); return true;
+        default: return false;
+    }
+}
+
+// Quantization step factor for a bit depth, usable as a constant expression
+constexpr int quantizationFactorFor(int quantizationBits) {
+    return 255 / ((1 << quantizationBits) - 1);
+}
+
+// Reverse pixels [first, last] of a row with a fixed pixel size
+template <typename Format>
+inline void flipPixelsFixed(uint8_t* row, int first, int last) {
+    constexpr int bpp = Format::bytesPerPixel;
+    for (; first < last; ++first, --last) {
+        uint8_t left[bpp];
+        memcpy(left, row + first * bpp, bpp);
+        memcpy(row + first * bpp, row + last * bpp, bpp);
+        memcpy(row + last * bpp, left, bpp);
+    }
+}
+
+/**
+ * Quantize one row with the format and bit depth fixed at compile time.
+ * The factor is a constant, so the divide becomes a multiply/shift and the 24-bit loop auto-vectorizes.
+ */
+template <typename Format, int Bits>
+inline void quantizeRowFixed(const uint8_t* src, uint8_t* dst, int width) {
+    static_assert(Format::bytesPerPixel >= 3, "quantization operates on direct-color pixels");
+    constexpr unsigned factor = quantizationFactorFor(Bits);
+    constexpr int bpp = Format::bytesPerPixel;
+    if (Format::hasAlpha) {
+        for (int x = 0; x < width; ++x) {
+            for (int byte = 0; byte < 3; ++byte) {
+                dst[x * bpp + byte] = static_cast<uint8_t>((src[x * bpp + byte] / factor) * factor);
+            }
+            dst[x * bpp + 3] = src[x * bpp + 3];
+        }
+    } else {
+        // No alpha: the row is one contiguous run of color bytes
+        int byteCount = width * bpp;
+        for (int i = 0; i < byteCount; ++i) {
+            dst[i] = static_cast<uint8_t>((src[i] / factor) * factor);
+        }
+    }
+}
+
+#endif // BMP_PIXEL_FORMAT_H
@@ -0,0 +1,125 @@
+#include "bmp_planar.h"
+#include "bmp_parallel.h"
+#include "bmp_simd.h"
+#include "bmp_stats.h"
+#include "bmp_trace.h"
+
+#include <cstring>
+#include <iostream>
+#include <optional>
+
+using namespace std;
+
+bool createPlanarImage(int width, int height, int bytesPerPixel, bool withAlpha, PlanarImage& planar) {
+    if (bytesPerPixel != 3 && bytesPerPixel != 4) {
+        cerr << "Planar layout requires 24-bit or 32-bit pixels." << endl;
+        return false;
+    }
+    planar.width = width;
+    planar.height = height;
+    planar.bytesPerPixel = bytesPerPixel;
+    planar.planeCount = (bytesPerPixel == 4 && withAlpha) ? 4 : 3;
+    planar.planeStride = (width + PLANE_ALIGNMENT - 1) / PLANE_ALIGNMENT * PLANE_ALIGNMENT;
+    planar.rowPitch = planar.planeCount * planar.planeStride;
+    planar.storage = sharedBufferPool().acquire(static_cast<size_t>(planar.rowPitch) * height);
+    if (planar.storage.empty() && planar.rowPitch > 0 && height > 0) {
+        cerr << "Out of memory." << endl;
+        return false;
+    }
+
+    // Kernels run over whole plane rows, padding included, so the padding must hold defined values
+    for (int y = 0; y < height; ++y) {
+        for (int c = 0; c < planar.planeCount; ++c) {
+            memset(planar.plane(c, y) + width, 0, planar.planeStride - width);
+        }
+    }
+    return true;
+}
+
+bool createPlanarLike(const PlanarImage& source, PlanarImage& planar) {
+    return createPlanarImage(source.width, source.height, source.bytesPerPixel, source.hasAlpha(), planar);
+}
+
+bool deinterleaveImage(const ImageView& view, bool withAlpha, PlanarImage& planar, int threadCount) {
+    BMP_TRACE_SCOPE(trace, "planar.deinterleave", static_cast<uint64_t>(view.width) * view.bytesPerPixel * view.height);
+    if (!createPlanarImage(view.width, view.height, view.bytesPerPixel, withAlpha, planar)) {
+        return false;
+    }
+
+    // One shuffle kernel per pixel size, selected once; every row fills its own contiguous block of planes
+    DeinterleaveRowKernel deinterleaveRow = deinterleaveRowKernel(view.bytesPerPixel);
+    parallelForRows(planar.height, planar.rowPitch, planar.storage.data(), threadCount, [&](int firstRow, int lastRow) {
+        for (int y = firstRow; y < lastRow; ++y) {
+            uint8_t* planes[4];
+            planar.rowPlanes(y, planes);
+            deinterleaveRow(view.row(y), planes, planar.width);
+        }
+    });
+    return true;
+}
+
+void interleaveImage(const PlanarImage& planar, const ImageView& view, int threadCount) {
+    BMP_TRACE_SCOPE(trace, "planar.interleave", static_cast<uint64_t>(view.width) * view.bytesPerPixel * view.height);
+
+    InterleaveRowKernel interleaveRow = interleaveRowKernel(planar.bytesPerPixel);
+    parallelForRows(planar.height, view.rowSize, view.data, threadCount, [&](int firstRow, int lastRow) {
+        for (int y = firstRow; y < lastRow; ++y) {
+            uint8_t* planes[4];
+            planar.rowPlanes(y, planes);
+            interleaveRow(planes, view.row(y), planar.width);
+        }
+    });
+}
+
+void quantizePlanes(const PlanarImage& source, PlanarImage& dest, int quantizationBits, int threadCount, ImageStats* stats) {
+    BMP_TRACE_SCOPE(trace, "quantize.planes", static_cast<uint64_t>(source.width) * source.planeCount * source.height);
+
+    // The color planes of a row are 3 * planeStride contiguous color bytes: the 24-bit kernel, which has
+    // no alpha lanes to blend, quantizes them as planeStride "pixels" in one pass
+    QuantizationTable table;
+    buildQuantizationTable(quantizationBits, table);
+    QuantizeRowKernel quantizeRun = quantizeRowKernel(table, 3);
+
+    if (stats != nullptr) {
+        stats->reset(source.bytesPerPixel);
+    }
+    parallelForRows(source.height, dest.rowPitch, dest.storage.data(), threadCount, [&](int firstRow, int lastRow) {
+        optional<StatsAccumulator> accumulator;
+        if (stats != nullptr) {
+            accumulator.emplace(source.bytesPerPixel);
+        }
+        for (int y = firstRow; y < lastRow; ++y) {
+            quantizeRun(source.plane(0, y), dest.plane(0, y), source.planeStride, 3, table);
+            if (source.hasAlpha() && &dest != &source) {
+                memcpy(dest.plane(3, y), source.plane(3, y), source.planeStride);
+            }
+            if (accumulator) {
+                uint8_t* planes[4];
+                dest.rowPlanes(y, planes);
+                accumulator->addPlanarRow(planes, dest.width);
+            }
+        }
+        if (accumulator) {
+            accumulator->mergeInto(*stats);
+        }
+    });
+    if (stats != nullptr) {
+        stats->finish();
+    }
+}
+
+void computePlanarStats(const PlanarImage& planar, ImageStats& stats, int threadCount) {
+    BMP_TRACE_SCOPE(trace, "stats.planes", static_cast<uint64_t>(planar.width) * planar.planeCount * planar.height);
+
+    stats.reset(planar.bytesPerPixel);
+    parallelForRows(planar.height, planar.rowPitch, planar.storage.data(), threadCount, [&](int firstRow, int lastRow) {
+        StatsAccumulator accumulator(planar.bytesPerPixel);
+        for (int y = firstRow; y < lastRow; ++y) {
+            uint8_t* planes[4];
+            planar.rowPlanes(y, planes);
+            accumulator.addPlanarRow(planes, planar.width);
+        }
+        accumulator.mergeInto(stats);
+    });
+    stats.finish();
+}
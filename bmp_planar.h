@@ -0,0 +1,79 @@
+#ifndef BMP_PLANAR_H
+#define BMP_PLANAR_H
+
+#include <cstddef>
+#include <cstdint>
+
+#include "bmp_buffer_pool.h"
+#include "bmp_image.h"
+
+struct ImageStats;
+
+// Alignment of every plane row in bytes: one cache line, so each plane row starts on a vector boundary.
+const int PLANE_ALIGNMENT = 64;
+
+/**
+ * Planar (structure-of-arrays) copy of a 24-bit or 32-bit image: one byte per pixel in separate blue,
+ * green, red and, optionally, alpha planes. The planes of one image row sit next to each other, color
+ * planes first, each padded with zeros to PLANE_ALIGNMENT bytes:
+ *
+ *     row y:  B[planeStride] G[planeStride] R[planeStride] (A[planeStride])
+ *
+ * A color kernel therefore sees the color planes of a row as one contiguous run of 3 * planeStride bytes
+ * with no alpha bytes to skip, and a band of rows is still one contiguous block, as in the interleaved
+ * layout. Rows are addressed bottom-up like Image rows; the storage comes from sharedBufferPool().
+ */
+struct PlanarImage {
+    int width = 0;
+    int height = 0;
+    int bytesPerPixel = 0;     // Pixel size of the interleaved image (3 or 4).
+    int planeCount = 0;        // 3, or 4 with the alpha plane.
+    int planeStride = 0;       // Bytes per plane row: width rounded up to PLANE_ALIGNMENT.
+    int rowPitch = 0;          // Bytes from row y to row y + 1: planeCount * planeStride.
+    PixelBuffer storage;
+
+    bool hasAlpha() const { return planeCount == 4; }
+
+    // Pointer to row y of plane `channel` (0 blue, 1 green, 2 red, 3 alpha)
+    uint8_t* plane(int channel, int y) const {
+        return storage.data() + static_cast<ptrdiff_t>(y) * rowPitch + static_cast<ptrdiff_t>(channel) * planeStride;
+    }
+
+    // The four plane pointers of row y as the row kernels take them; planes[3] is null without alpha
+    void rowPlanes(int y, uint8_t* planes[4]) const {
+        for (int c = 0; c < 4; ++c) {
+            planes[c] = c < planeCount ? plane(c, y) : nullptr;
+        }
+    }
+};
+
+// Allocate a width x height planar image with zeroed plane padding. The alpha plane is only kept for
+// 32-bit pixels with `withAlpha` set. Prints the reason and returns false for other pixel sizes or
+// when out of memory.
+bool createPlanarImage(int width, int height, int bytesPerPixel, bool withAlpha, PlanarImage& planar);
+
+// Allocate a planar image with the geometry and planes of `source`; the plane contents are undefined.
+bool createPlanarLike(const PlanarImage& source, PlanarImage& planar);
+
+/**
+ * Split the pixels of `view` into planes with the SIMD deinterleave kernel (bmp_simd.h). Leave the alpha
+ * plane out (`withAlpha` false) when the operation does not need it: it is then neither read into the
+ * planes nor written back, and interleaveImage keeps the alpha already in place.
+ */
+bool deinterleaveImage(const ImageView& view, bool withAlpha, PlanarImage& planar, int threadCount = 1);
+
+// Merge the planes back into `view` (same width and height). Row padding of the view is not touched.
+void interleaveImage(const PlanarImage& planar, const ImageView& view, int threadCount = 1);
+
+/**
+ * Quantize the color planes of `source` into `dest` (same geometry; may be `source` itself) with the
+ * uniform vector kernel, run as one straight loop over the contiguous color planes of each row. The alpha
+ * plane is copied unchanged. Matches quantizePixelData byte for byte. `stats`, when set, counts every
+ * plane of `dest`, as in the interleaved kernels.
+ */
+void quantizePlanes(const PlanarImage& source, PlanarImage& dest, int quantizationBits, int threadCount = 1, ImageStats* stats = nullptr);
+
+// Statistics pass over the planes (see computeImageStats). Without an alpha plane, alpha is not counted.
+void computePlanarStats(const PlanarImage& planar, ImageStats& stats, int threadCount = 1);
+
+#endif // BMP_PLANAR_H
@@ -0,0 +1,177 @@
+#include "bmp_resize.h"
+#include "bmp_parallel.h"
+#include "bmp_simd.h"
+#include "bmp_trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+using namespace std;
+
+// Radius of each filter at scale 1, in source samples
+static double filterSupport(ResizeFilter filter) {
+    switch (filter) {
+        case RESIZE_BILINEAR: return 1.0;
+        case RESIZE_LANCZOS:  return 3.0;
+        default:              return 0.5;
+    }
+}
+
+static double sinc(double x) {
+    if (x == 0.0) {
+        return 1.0;
+    }
+    double angle = x * M_PI;
+    return sin(angle) / angle;
+}
+
+// Filter response at distance x (in filter units) from the sample center
+static double filterValue(ResizeFilter filter, double x) {
+    switch (filter) {
+        case RESIZE_BILINEAR:
+            return max(0.0, 1.0 - fabs(x));
+        case RESIZE_LANCZOS:
+            return fabs(x) < 3.0 ? sinc(x) * sinc(x / 3.0) : 0.0;
+        default:
+            // Half-open, so a sample exactly between two outputs belongs to one of them only
+            return (x >= -0.5 && x < 0.5) ? 1.0 : 0.0;
+    }
+}
+
+bool parseResizeFilter(const char* name, ResizeFilter& filter) {
+    if (strcmp(name, "box") == 0) {
+        filter = RESIZE_BOX;
+    } else if (strcmp(name, "bilinear") == 0) {
+        filter = RESIZE_BILINEAR;
+    } else if (strcmp(name, "lanczos") == 0) {
+        filter = RESIZE_LANCZOS;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void buildResampleWeights(ResizeFilter filter, int sourceSize, int outputSize, ResampleWeights& weights) {
+    // Shrinking stretches the filter over `scale` source samples per output sample
+    double scale = static_cast<double>(sourceSize) / outputSize;
+    double filterScale = max(1.0, scale);
+    double support = filterSupport(filter) * filterScale;
+    int tapCount = min(sourceSize, static_cast<int>(ceil(support)) * 2 + 1);
+    const int one = 1 << RESAMPLE_WEIGHT_BITS;
+
+    weights.tapCount = tapCount;
+    weights.first.assign(outputSize, 0);
+    weights.weights.assign(static_cast<size_t>(outputSize) * tapCount, 0);
+    vector<double> exact(tapCount);
+    for (int i = 0; i < outputSize; ++i) {
+        // Source samples [low, high) fall under the filter; the window start is clamped to keep every tap inside
+        double center = (i + 0.5) * scale;
+        int low = max(0, static_cast<int>(floor(center - support + 0.5)));
+        int high = min(sourceSize, static_cast<int>(floor(center + support + 0.5)));
+        int first = min(low, sourceSize - tapCount);
+        high = min(high, first + tapCount);
+
+        fill(exact.begin(), exact.end(), 0.0);
+        double total = 0.0;
+        for (int j = low; j < high; ++j) {
+            exact[j - first] = filterValue(filter, (j + 0.5 - center) / filterScale);
+            total += exact[j - first];
+        }
+        if (total == 0.0) {
+            // No sample under the filter (only possible at the edges): take the nearest one
+            int nearest = min(sourceSize - 1, max(0, static_cast<int>(floor(center))));
+            exact[nearest - first] = 1.0;
+            total = 1.0;
+        }
+
+        // Round to Q14 and give the rounding error to the largest weight, so flat areas stay exact
+        int16_t* fixed = &weights.weights[static_cast<size_t>(i) * tapCount];
+        int sum = 0;
+        int largest = 0;
+        for (int t = 0; t < tapCount; ++t) {
+            fixed[t] = static_cast<int16_t>(lround(exact[t] / total * one));
+            sum += fixed[t];
+            if (fixed[t] > fixed[largest]) {
+                largest = t;
+            }
+        }
+        fixed[largest] = static_cast<int16_t>(fixed[largest] + one - sum);
+        weights.first[i] = first;
+    }
+}
+
+void resizeImage(const uint8_t* inputPixelData, uint8_t* resizedPixelData, int bytesPerPixel, int rowSize,
+                 int x, int y, int cropWidth, int cropHeight, int outputWidth, int outputHeight,
+                 ResizeFilter filter, int threadCount) {
+    BMP_TRACE_SCOPE(trace, "resize", static_cast<uint64_t>(cropWidth) * bytesPerPixel * cropHeight);
+
+    // Per-column and per-row weight tables are computed once and shared by all threads
+    ResampleWeights horizontal;
+    ResampleWeights vertical;
+    buildResampleWeights(filter, cropWidth, outputWidth, horizontal);
+    buildResampleWeights(filter, cropHeight, outputHeight, vertical);
+    HorizontalResampleKernel filterRow = horizontalResampleKernel(bytesPerPixel);
+    VerticalResampleKernel combineRows = verticalResampleKernel();
+
+    // The output keeps the source row order, like cropImage
+    int resizedRowSize = calculateRowSize(outputWidth, bytesPerPixel);
+    int resizedStride = rowSize < 0 ? -resizedRowSize : resizedRowSize;
+    int filteredBytes = outputWidth * bytesPerPixel;
+    int taps = vertical.tapCount;
+
+    parallelForRows(outputHeight, resizedStride, resizedPixelData, threadCount, [&](int firstRow, int lastRow) {
+        // Ring of horizontally filtered source rows: row s lives in slot s % taps. The window of an output
+        // row only moves forward, so the rows it needs always occupy distinct slots.
+        vector<uint8_t> ring(static_cast<size_t>(taps) * filteredBytes);
+        vector<int> ringRow(taps, -1);
+        vector<const uint8_t*> rows(taps);
+
+        for (int j = firstRow; j < lastRow; ++j) {
+            int first = vertical.first[j];
+            for (int t = 0; t < taps; ++t) {
+                int sourceRow = first + t;
+                int slot = sourceRow % taps;
+                uint8_t* filtered = &ring[static_cast<size_t>(slot) * filteredBytes];
+                if (ringRow[slot] != sourceRow) {
+                    const uint8_t* src = inputPixelData + static_cast<ptrdiff_t>(y + sourceRow) * rowSize + x * bytesPerPixel;
+                    filterRow(src, filtered, outputWidth, horizontal.first.data(), horizontal.weights.data(), horizontal.tapCount);
+                    ringRow[slot] = sourceRow;
+                }
+                rows[t] = filtered;
+            }
+
+            uint8_t* dst = resizedPixelData + static_cast<ptrdiff_t>(j) * resizedStride;
+            combineRows(rows.data(), &vertical.weights[static_cast<size_t>(j) * taps], taps, dst, filteredBytes);
+            memset(dst + filteredBytes, 0, resizedRowSize - filteredBytes);
+        }
+    });
+}
+
+bool resizeToImage(const Image& source, int x, int y, int cropWidth, int cropHeight, int outputWidth, int outputHeight,
+                   ResizeFilter filter, Image& resized, int threadCount) {
+    if (source.bytesPerPixel < 3) {
+        cerr << "Only direct-color images can be resized." << endl;
+        return false;
+    }
+    if (x < 0 || y < 0 || cropWidth <= 0 || cropHeight <= 0 || x + cropWidth > source.width || y + cropHeight > source.height) {
+        cerr << "Cropping area exceeds image bounds." << endl;
+        return false;
+    }
+    if (outputWidth <= 0 || outputHeight <= 0) {
+        cerr << "Invalid output size." << endl;
+        return false;
+    }
+
+    createImageLike(source, outputWidth, outputHeight, resized);
+    if (resized.pixelData == nullptr) {
+        cerr << "Out of memory." << endl;
+        return false;
+    }
+    resizeImage(source.pixelData, resized.pixelData, source.bytesPerPixel, source.stride,
+                x, y, cropWidth, cropHeight, outputWidth, outputHeight, filter, threadCount);
+    return true;
+}
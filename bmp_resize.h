@@ -0,0 +1,52 @@
+#ifndef BMP_RESIZE_H
+#define BMP_RESIZE_H
+
+#include <cstdint>
+#include <vector>
+
+#include "bmp_image.h"
+
+// Reconstruction filters of the resampler
+enum ResizeFilter {
+    RESIZE_BOX,        // Area average when shrinking, nearest neighbour when enlarging.
+    RESIZE_BILINEAR,   // Triangle filter.
+    RESIZE_LANCZOS     // Lanczos-3 windowed sinc.
+};
+
+// Parse "box", "bilinear" or "lanczos". Returns false for an unknown name.
+bool parseResizeFilter(const char* name, ResizeFilter& filter);
+
+/**
+ * Fixed-point contributions of source samples to every output sample along one axis.
+ * Output sample i reads the `tapCount` consecutive source samples starting at first[i], weighted by
+ * weights[i * tapCount + t] (Q14, summing to 1 << RESAMPLE_WEIGHT_BITS). `first` is clamped so every
+ * tap lies inside the source, with the weights shifted along; taps that fall outside get weight 0.
+ */
+struct ResampleWeights {
+    int tapCount = 0;
+    std::vector<int32_t> first;
+    std::vector<int16_t> weights;
+};
+
+// Weights for resampling `sourceSize` samples to `outputSize`, centers aligned (pixel (i + 0.5) * scale).
+// Shrinking widens the filter by the scale factor, so every source sample contributes.
+void buildResampleWeights(ResizeFilter filter, int sourceSize, int outputSize, ResampleWeights& weights);
+
+/**
+ * Resample the ROI (x, y, cropWidth, cropHeight) of the source into an outputWidth x outputHeight image.
+ * Takes the same origin, signed stride and ROI arguments as cropImage, so a crop followed by a resize is
+ * one pass: only the ROI is read. `resizedPixelData` has the 4-byte aligned stride of outputWidth, negated
+ * along with rowSize for a top-down source. Each thread handles a band of output rows; the horizontal
+ * pass fills a ring of tapCount filtered rows, so every source row is filtered once per band, and the
+ * vertical pass combines the ring into output rows. 24-bit and 32-bit pixels (alpha is resampled too).
+ */
+void resizeImage(const uint8_t* inputPixelData, uint8_t* resizedPixelData, int bytesPerPixel, int rowSize,
+                 int x, int y, int cropWidth, int cropHeight, int outputWidth, int outputHeight,
+                 ResizeFilter filter, int threadCount = 1);
+
+// Resample a whole image (or the ROI of `source` given by x, y, cropWidth, cropHeight) into a new pooled
+// image with the headers of `source`. Prints the reason and returns false for an invalid ROI or size.
+bool resizeToImage(const Image& source, int x, int y, int cropWidth, int cropHeight, int outputWidth, int outputHeight,
+                   ResizeFilter filter, Image& resized, int threadCount = 1);
+
+#endif // BMP_RESIZE_H
@@ -0,0 +1,105 @@
+#include "bmp_result_cache.h"
+#include "bmp_hash.h"
+#include "bmp_stats.h"
+#include "bmp_trace.h"
+
+#include <atomic>
+#include <cinttypes>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <random>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+// Bumped whenever an operation starts producing different bytes for the same parameters
+const char* const RESULT_CACHE_VERSION = "bmp-result-v2";
+
+static atomic<uint64_t> cacheHits{0};
+static atomic<uint64_t> cacheMisses{0};
+
+ResultCacheCounters resultCacheCounters() {
+    ResultCacheCounters counters;
+    counters.hits = cacheHits.load();
+    counters.misses = cacheMisses.load();
+    return counters;
+}
+
+ResultCache::ResultCache(const string& directory) : directory(directory) {
+    if (!directory.empty()) {
+        error_code error;
+        fs::create_directories(directory, error);
+    }
+}
+
+uint64_t ResultCache::resultKey(uint64_t contentHash, uint64_t headerHash, const string& operation) {
+    Hasher64 hasher(contentHash);
+    hasher.update(RESULT_CACHE_VERSION, char_traits<char>::length(RESULT_CACHE_VERSION));
+    hasher.update(&headerHash, sizeof(headerHash));
+    hasher.update(operation.data(), operation.size());
+    return hasher.digest();
+}
+
+string ResultCache::entryPath(uint64_t key) const {
+    char name[32];
+    snprintf(name, sizeof(name), "%016" PRIx64 ".bmp", key);
+    return (fs::path(directory) / name).string();
+}
+
+bool ResultCache::fetch(uint64_t key, const string& outputFileName, bool withStats) const {
+    if (!enabled()) {
+        return false;
+    }
+    BMP_TRACE_SCOPE(trace, "cache.fetch", 0);
+
+    // Both files of a statistics run must be present, or the job runs again
+    string entry = entryPath(key);
+    error_code error;
+    if (!fs::is_regular_file(entry, error) || (withStats && !fs::is_regular_file(statsPath(entry), error))) {
+        ++cacheMisses;
+        return false;
+    }
+    fs::copy_file(entry, outputFileName, fs::copy_options::overwrite_existing, error);
+    if (!error && withStats) {
+        fs::copy_file(statsPath(entry), statsPath(outputFileName), fs::copy_options::overwrite_existing, error);
+    }
+    if (error) {
+        ++cacheMisses;
+        return false;
+    }
+    BMP_TRACE_SET_BYTES(trace, fs::file_size(entry, error));
+    ++cacheHits;
+    return true;
+}
+
+// Copy `source` into the cache as `target` through a temporary name no other writer uses
+static bool storeFile(const string& source, const string& target) {
+    static atomic<uint64_t> sequence{0};
+    static const uint64_t processTag = random_device()();
+    string temporary = target + ".tmp" + to_string(processTag) + "." + to_string(sequence.fetch_add(1));
+    error_code error;
+    fs::copy_file(source, temporary, fs::copy_options::overwrite_existing, error);
+    if (!error) {
+        fs::rename(temporary, target, error);
+    }
+    if (error) {
+        fs::remove(temporary, error);
+        return false;
+    }
+    return true;
+}
+
+void ResultCache::store(uint64_t key, const string& outputFileName, bool withStats) const {
+    if (!enabled()) {
+        return;
+    }
+    BMP_TRACE_SCOPE(trace, "cache.store", 0);
+
+    // The statistics go first: an entry whose image is visible is complete
+    string entry = entryPath(key);
+    bool stored = (!withStats || storeFile(statsPath(outputFileName), statsPath(entry))) && storeFile(outputFileName, entry);
+    if (!stored) {
+        cerr << "Can't store " << outputFileName << " in the result cache." << endl;
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef BMP_RESULT_CACHE_H
+#define BMP_RESULT_CACHE_H
+
+#include <cstdint>
+#include <string>
+
+/**
+ * On-disk cache of finished outputs, keyed by the content hash of the input (imageContentHash, computed
+ * during the load) combined with a description of the operation and its parameters.
+ * Entries are plain files in one directory: <key>.bmp plus <key>.bmp.stats.json when statistics were
+ * written. A hit copies the entry to the requested output path, so outputs never share storage with the
+ * cache. Entries are written to a temporary name and renamed, so concurrent jobs never see partial files.
+ */
+class ResultCache {
+public:
+    // An empty directory disables the cache (every lookup misses, stores do nothing).
+    explicit ResultCache(const std::string& directory);
+
+    bool enabled() const { return !directory.empty(); }
+
+    // Key of one output: `operation` must name the kernel and every parameter that changes its bytes, and
+    // `headerHash` (copiedHeaderHash) covers the header fields the output copies from its input.
+    static uint64_t resultKey(uint64_t contentHash, uint64_t headerHash, const std::string& operation);
+
+    // Copy the entry for `key` to outputFileName (and its statistics when `withStats`). False on a miss.
+    bool fetch(uint64_t key, const std::string& outputFileName, bool withStats) const;
+
+    // Store outputFileName (and its statistics when `withStats`) under `key`. A failed store only costs
+    // the next hit, so it is reported and otherwise ignored.
+    void store(uint64_t key, const std::string& outputFileName, bool withStats) const;
+
+private:
+    std::string entryPath(uint64_t key) const;
+
+    std::string directory;
+};
+
+// Hits and misses of all caches in this process.
+struct ResultCacheCounters {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+};
+ResultCacheCounters resultCacheCounters();
+
+#endif // BMP_RESULT_CACHE_H
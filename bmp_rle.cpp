@@ -0,0 +1,394 @@
+#include "bmp_rle.h"
+#include "bmp_async_io.h"
+#include "bmp_parallel.h"
+#include "bmp_simd.h"
+#include "bmp_trace.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+using namespace std;
+
+// Shortest run worth an encoded (count, value) pair; shorter stretches go into absolute mode
+const int MIN_ENCODED_RUN = 3;
+
+// Longest run or absolute block a single RLE code can describe
+const int MAX_RLE_COUNT = 255;
+
+// Both nibbles of every byte, high nibble (the left pixel) first
+struct NibblePairTable {
+    uint8_t pairs[256][2];
+    NibblePairTable() {
+        for (int value = 0; value < 256; ++value) {
+            pairs[value][0] = static_cast<uint8_t>(value >> 4);
+            pairs[value][1] = static_cast<uint8_t>(value & 15);
+        }
+    }
+};
+static const NibblePairTable NIBBLE_PAIRS;
+
+// Expand `width` color indices to BGR through the color table and zero the row padding.
+// Each pixel is stored as a 4-byte word whose top byte the next pixel overwrites; the last one as 3 bytes.
+static void expandIndices(const uint8_t* indices, int width, const uint32_t* colors, uint8_t* dest, int destRowSize) {
+    int x = 0;
+    for (; x + 1 < width; ++x) {
+        memcpy(dest + x * 3, &colors[indices[x]], 4);
+    }
+    if (x < width) {
+        memcpy(dest + x * 3, &colors[indices[x]], 3);
+    }
+    memset(dest + width * 3, 0, destRowSize - width * 3);
+}
+
+// Unpack a 4-bit row to one index per byte
+static void unpackNibbles(const uint8_t* packed, int width, uint8_t* indices) {
+    for (int x = 0; x + 1 < width; x += 2) {
+        memcpy(indices + x, NIBBLE_PAIRS.pairs[packed[x / 2]], 2);
+    }
+    if (width & 1) {
+        indices[width - 1] = NIBBLE_PAIRS.pairs[packed[width / 2]][0];
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Decoding
+// ---------------------------------------------------------------------------
+
+bool IndexedPixelDecoder::open(const uint8_t* fileData, size_t fileSize, const BMPFileHeader& fileHeader, const BMPInfoHeader& infoHeader) {
+    bitCount = infoHeader.biBitCount;
+    compression = infoHeader.biCompression;
+    bool supported = (bitCount == 8 && (compression == BMP_COMPRESSION_RGB || compression == BMP_COMPRESSION_RLE8)) ||
+                     (bitCount == 4 && (compression == BMP_COMPRESSION_RGB || compression == BMP_COMPRESSION_RLE4));
+    if (!supported) {
+        cerr << "Only supports 4-bit or 8-bit indexed BMP, uncompressed or RLE." << endl;
+        return false;
+    }
+    width = infoHeader.biWidth;
+    height = infoHeader.biHeight < 0 ? -infoHeader.biHeight : infoHeader.biHeight;
+
+    // The color table follows the info header (whatever its size); biClrUsed == 0 means a full table
+    size_t maxColors = size_t(1) << bitCount;
+    size_t colorCount = infoHeader.biClrUsed == 0 ? maxColors : min<size_t>(infoHeader.biClrUsed, maxColors);
+    size_t tableOffset = sizeof(BMPFileHeader) + static_cast<size_t>(infoHeader.biSize);
+    if (tableOffset > fileSize || (fileSize - tableOffset) / sizeof(BMPPaletteEntry) < colorCount) {
+        cerr << "BMP color table is truncated." << endl;
+        return false;
+    }
+    memset(colors, 0, sizeof(colors));
+    for (size_t i = 0; i < colorCount; ++i) {
+        const uint8_t* entry = fileData + tableOffset + i * sizeof(BMPPaletteEntry);
+        colors[i] = static_cast<uint32_t>(entry[0]) | (static_cast<uint32_t>(entry[1]) << 8) | (static_cast<uint32_t>(entry[2]) << 16);
+    }
+
+    if (fileHeader.bfOffBits > fileSize) {
+        cerr << "BMP pixel data is truncated." << endl;
+        return false;
+    }
+    pixels = fileData + fileHeader.bfOffBits;
+    pixelSize = fileSize - fileHeader.bfOffBits;
+
+    // An uncompressed array has a known size (the last row needs no padding, as in decodeRows), checked
+    // before the caller allocates the decoded image. RLE data can end the bitmap early: checked while decoding.
+    uint64_t packedBytes = bitCount == 8 ? static_cast<uint64_t>(width) : (static_cast<uint64_t>(width) + 1) / 2;
+    uint64_t packedRowSize = (packedBytes + 3) & ~uint64_t(3);
+    if (compression == BMP_COMPRESSION_RGB && packedRowSize * (height - 1) + packedBytes > pixelSize) {
+        cerr << "BMP pixel data is truncated." << endl;
+        return false;
+    }
+
+    // One spare entry keeps &indexRow[width] addressable for runs clipped to nothing
+    indexRow.assign(static_cast<size_t>(width) + 1, 0);
+    position = 0;
+    x = 0;
+    row = 0;
+    pendingRows = 0;
+    finished = false;
+    return true;
+}
+
+bool IndexedPixelDecoder::decodeRows(int firstRow, int rowCount, uint8_t* dest, int destRowSize) {
+    BMP_TRACE_SCOPE(trace, "decode.indexed", static_cast<uint64_t>(rowCount) * destRowSize);
+
+    if (firstRow < 0 || rowCount < 0 || firstRow + rowCount > height) {
+        cerr << "BMP row range exceeds image bounds." << endl;
+        return false;
+    }
+
+    if (compression == BMP_COMPRESSION_RGB) {
+        // Uncompressed rows sit at fixed offsets
+        size_t packedRowSize = static_cast<size_t>(calculateRowSize(bitCount == 8 ? width : (width + 1) / 2, 1));
+        size_t packedBytes = bitCount == 8 ? static_cast<size_t>(width) : static_cast<size_t>(width + 1) / 2;
+        for (int r = 0; r < rowCount; ++r) {
+            size_t offset = static_cast<size_t>(firstRow + r) * packedRowSize;
+            if (offset > pixelSize || pixelSize - offset < packedBytes) {
+                cerr << "BMP pixel data is truncated." << endl;
+                return false;
+            }
+            const uint8_t* indices = pixels + offset;
+            if (bitCount == 4) {
+                unpackNibbles(indices, width, indexRow.data());
+                indices = indexRow.data();
+            }
+            expandIndices(indices, width, colors, dest + static_cast<size_t>(r) * destRowSize, destRowSize);
+        }
+        return true;
+    }
+
+    if (firstRow < row) {
+        cerr << "RLE-compressed rows must be read in order." << endl;
+        return false;
+    }
+    return decodeRLEUntil(firstRow + rowCount, firstRow, dest, destRowSize);
+}
+
+void IndexedPixelDecoder::emitRow(int fileRow, int firstRow, uint8_t* dest, int destRowSize) {
+    // Rows before the requested range are decoded but dropped
+    if (fileRow >= firstRow) {
+        expandIndices(indexRow.data(), width, colors, dest + static_cast<size_t>(fileRow - firstRow) * destRowSize, destRowSize);
+    }
+    fill(indexRow.begin(), indexRow.end(), static_cast<uint8_t>(0));
+    ++row;
+}
+
+bool IndexedPixelDecoder::decodeRLEUntil(int endRow, int firstRow, uint8_t* dest, int destRowSize) {
+    while (row < endRow) {
+        // Rows a delta code moves past (they may reach into the next band), and after the
+        // end-of-bitmap code every remaining row: both keep only what was already decoded
+        if (pendingRows > 0) {
+            emitRow(row, firstRow, dest, destRowSize);
+            --pendingRows;
+            continue;
+        }
+        if (finished) {
+            emitRow(row, firstRow, dest, destRowSize);
+            continue;
+        }
+        if (pixelSize - position < 2) {
+            cerr << "BMP pixel data is truncated." << endl;
+            return false;
+        }
+        int count = pixels[position];
+        int value = pixels[position + 1];
+        position += 2;
+
+        if (count > 0) {
+            // Encoded run: one index (RLE8) or an alternating pair of indices (RLE4), clipped to the row
+            int n = min(count, width - x);
+            if (bitCount == 8) {
+                memset(&indexRow[x], value, n);
+            } else {
+                const uint8_t* pair = NIBBLE_PAIRS.pairs[value];
+                for (int k = 0; k < n; ++k) {
+                    indexRow[x + k] = pair[k & 1];
+                }
+            }
+            x += n;
+            continue;
+        }
+
+        switch (value) {
+            case 0:
+                // End of line
+                emitRow(row, firstRow, dest, destRowSize);
+                x = 0;
+                break;
+            case 1:
+                // End of bitmap: the current row is emitted with the blank ones on the next iterations
+                finished = true;
+                break;
+            case 2: {
+                // Delta: move right and down; the rows passed over stay at index 0
+                if (pixelSize - position < 2) {
+                    cerr << "BMP pixel data is truncated." << endl;
+                    return false;
+                }
+                int dx = pixels[position];
+                int dy = pixels[position + 1];
+                position += 2;
+                pendingRows = min(dy, height - row);
+                x = min(width, x + dx);
+                break;
+            }
+            default: {
+                // Absolute mode: `value` literal indices, padded to a 16-bit boundary
+                size_t bytes = bitCount == 8 ? static_cast<size_t>(value) : static_cast<size_t>(value + 1) / 2;
+                size_t padded = (bytes + 1) & ~size_t(1);
+                if (pixelSize - position < padded) {
+                    cerr << "BMP pixel data is truncated." << endl;
+                    return false;
+                }
+                int n = min(value, width - x);
+                const uint8_t* literal = pixels + position;
+                if (bitCount == 8) {
+                    memcpy(&indexRow[x], literal, n);
+                } else {
+                    for (int k = 0; k < n; ++k) {
+                        indexRow[x + k] = NIBBLE_PAIRS.pairs[literal[k / 2]][k & 1];
+                    }
+                }
+                x += n;
+                position += padded;
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// Encoding
+// ---------------------------------------------------------------------------
+
+size_t maxRLERowSize(int width) {
+    // Every code covers at least as many pixels as half its size, plus the end-of-line code
+    return static_cast<size_t>(width) * 2 + 6;
+}
+
+size_t encodeRLERow(const uint8_t* indices, int width, int bitCount, uint8_t* out) {
+    MatchLengthKernel matchLength = matchLengthKernel();
+
+    // RLE8 runs repeat one index; RLE4 runs repeat a pair of indices (period 2)
+    int period = bitCount == 4 ? 2 : 1;
+    auto runAt = [&](int i) {
+        int limit = min(MAX_RLE_COUNT, width - i);
+        if (limit <= period) {
+            return limit;
+        }
+        return period + matchLength(indices + i + period, indices + i, limit - period);
+    };
+    auto encodedValue = [&](int i, int count) {
+        if (bitCount == 8) {
+            return indices[i];
+        }
+        return static_cast<uint8_t>((indices[i] << 4) | (count > 1 ? indices[i + 1] : 0));
+    };
+
+    uint8_t* start = out;
+    int i = 0;
+    while (i < width) {
+        int run = runAt(i);
+        if (run >= MIN_ENCODED_RUN) {
+            out[0] = static_cast<uint8_t>(run);
+            out[1] = encodedValue(i, run);
+            out += 2;
+            i += run;
+            continue;
+        }
+
+        // Literal stretch up to the next run worth encoding
+        int end = i + 1;
+        while (end < width && end - i < MAX_RLE_COUNT && runAt(end) < MIN_ENCODED_RUN) {
+            ++end;
+        }
+        int count = end - i;
+        if (count < MIN_ENCODED_RUN) {
+            // Absolute mode needs at least 3 pixels (counts 0-2 are escape codes): emit short runs instead
+            if (bitCount == 4) {
+                out[0] = static_cast<uint8_t>(count);
+                out[1] = encodedValue(i, count);
+                out += 2;
+            } else {
+                for (int k = 0; k < count; ++k) {
+                    out[0] = 1;
+                    out[1] = indices[i + k];
+                    out += 2;
+                }
+            }
+        } else {
+            // Absolute mode: escape, count, the literal indices, padding to a 16-bit boundary
+            out[0] = 0;
+            out[1] = static_cast<uint8_t>(count);
+            out += 2;
+            size_t bytes;
+            if (bitCount == 8) {
+                memcpy(out, indices + i, count);
+                bytes = count;
+            } else {
+                bytes = (count + 1) / 2;
+                for (int k = 0; k < count; k += 2) {
+                    out[k / 2] = encodedValue(i + k, count - k);
+                }
+            }
+            if (bytes & 1) {
+                out[bytes++] = 0;
+            }
+            out += bytes;
+        }
+        i = end;
+    }
+    return static_cast<size_t>(out - start);
+}
+
+bool saveRLEBMP(const char* fileName, const Image& image, int threadCount) {
+    BMP_TRACE_SCOPE(trace, "save.rle", image.pixelBytes());
+
+    if (image.bytesPerPixel != 1 || image.palette.empty()) {
+        cerr << "Image has no color table." << endl;
+        return false;
+    }
+    int bitCount = image.palette.size() <= 16 ? 4 : 8;
+
+    // Rows are independent, so chunks of rows are encoded in parallel into their own buffers.
+    // Image rows are addressed bottom-up, which is the only row order RLE allows.
+    int chunkCount = threadCount <= 1 ? 1 : min(image.height, threadCount * 4);
+    vector<vector<uint8_t>> chunks(chunkCount);
+    auto encodeChunk = [&](int chunk) {
+        int firstRow = static_cast<int>(static_cast<int64_t>(image.height) * chunk / chunkCount);
+        int lastRow = static_cast<int>(static_cast<int64_t>(image.height) * (chunk + 1) / chunkCount);
+        vector<uint8_t>& encoded = chunks[chunk];
+        encoded.resize(static_cast<size_t>(lastRow - firstRow) * maxRLERowSize(image.width));
+        size_t used = 0;
+        for (int y = firstRow; y < lastRow; ++y) {
+            used += encodeRLERow(image.row(y), image.width, bitCount, encoded.data() + used);
+
+            // End of line, or end of bitmap after the last row
+            encoded[used++] = 0;
+            encoded[used++] = y + 1 == image.height ? 1 : 0;
+        }
+        encoded.resize(used);
+    };
+    if (chunkCount == 1) {
+        encodeChunk(0);
+    } else {
+        sharedThreadPool().reserve(threadCount - 1);
+        sharedThreadPool().run(chunkCount, encodeChunk);
+    }
+
+    size_t encodedSize = 0;
+    for (const vector<uint8_t>& chunk : chunks) {
+        encodedSize += chunk.size();
+    }
+
+    // Same headers and color table as the uncompressed file, with the compressed size
+    BMPFileHeader fileHeader;
+    BMPInfoHeader infoHeader;
+    prepareBMPHeaders(image, fileHeader, infoHeader);
+    infoHeader.biHeight = image.height;
+    infoHeader.biBitCount = static_cast<uint16_t>(bitCount);
+    infoHeader.biCompression = bitCount == 4 ? BMP_COMPRESSION_RLE4 : BMP_COMPRESSION_RLE8;
+    infoHeader.biSizeImage = static_cast<uint32_t>(encodedSize);
+    fileHeader.bfSize = fileHeader.bfOffBits + infoHeader.biSizeImage;
+
+    PositionedFile outputFile;
+    if (!outputFile.openWrite(fileName)) {
+        cerr << "Can't open output file." << endl;
+        return false;
+    }
+
+    // Headers, color table and every encoded chunk in one gathered write, without joining the chunks first
+    vector<WriteSlice> slices = {
+        WriteSlice{&fileHeader, sizeof(fileHeader)},
+        WriteSlice{&infoHeader, sizeof(infoHeader)},
+        WriteSlice{image.palette.data(), image.palette.size() * sizeof(BMPPaletteEntry)}
+    };
+    for (const vector<uint8_t>& chunk : chunks) {
+        slices.push_back(WriteSlice{chunk.data(), chunk.size()});
+    }
+    bool written = outputFile.writeGather(slices.data(), slices.size(), 0);
+    if (!outputFile.close() || !written) {
+        cerr << "Failed to write output file." << endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,73 @@
+#ifndef BMP_RLE_H
+#define BMP_RLE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "bmp_image.h"
+
+// biCompression values of the BMP format.
+const uint32_t BMP_COMPRESSION_RGB = 0;
+const uint32_t BMP_COMPRESSION_RLE8 = 1;
+const uint32_t BMP_COMPRESSION_RLE4 = 2;
+
+// True if the headers describe an indexed pixel array (4 or 8 bits per pixel, plain or RLE).
+// Such files are decoded to 24-bit BGR on load, so every kernel sees direct color.
+inline bool isIndexedBMP(const BMPInfoHeader& infoHeader) {
+    return infoHeader.biBitCount <= 8;
+}
+
+/**
+ * Decoder from the pixel array of an indexed BMP (4-bit or 8-bit, uncompressed, RLE4 or RLE8) to
+ * 24-bit BGR rows. Indices are expanded through a 256-entry color table and 4-bit pairs through a
+ * 256-entry nibble table. Rows come out in file order. Uncompressed rows can be decoded in any
+ * order; RLE data is decoded in one forward pass, so skipped rows cost a decode but no output.
+ * The file data must stay valid while the decoder is used.
+ */
+class IndexedPixelDecoder {
+public:
+    // Parse the color table and locate the pixel array. Prints the reason and returns false on failure.
+    bool open(const uint8_t* fileData, size_t fileSize, const BMPFileHeader& fileHeader, const BMPInfoHeader& infoHeader);
+
+    // Decode file rows [firstRow, firstRow + rowCount) into `dest`, `destRowSize` bytes per row (padding zeroed).
+    // Pixels an RLE stream skips (delta codes, early end of bitmap) get color index 0.
+    // For RLE data firstRow must not lie before rows already decoded. Prints the reason and returns false on failure.
+    bool decodeRows(int firstRow, int rowCount, uint8_t* dest, int destRowSize);
+
+private:
+    bool decodeRLEUntil(int endRow, int firstRow, uint8_t* dest, int destRowSize);
+    void emitRow(int fileRow, int firstRow, uint8_t* dest, int destRowSize);
+
+    const uint8_t* pixels = nullptr;   // Start of the pixel array.
+    size_t pixelSize = 0;              // Bytes available from `pixels` to the end of the file.
+    int width = 0;
+    int height = 0;
+    int bitCount = 0;
+    uint32_t compression = BMP_COMPRESSION_RGB;
+    uint32_t colors[256];              // Color table as 0x00RRGGBB; unused entries are black.
+    std::vector<uint8_t> indexRow;     // Indices of the row being decoded.
+
+    // RLE decode position
+    size_t position = 0;
+    int x = 0;
+    int row = 0;                       // Next file row to emit.
+    int pendingRows = 0;               // Rows still to emit for the last delta code.
+    bool finished = false;             // End-of-bitmap code seen.
+};
+
+// Worst-case encoded size of one row, including its end-of-line code.
+size_t maxRLERowSize(int width);
+
+// RLE-encode one row of color indices (RLE8 for 8-bit, RLE4 for 4-bit indices below 16) into `out`,
+// which needs maxRLERowSize(width) bytes. No end-of-line code is added. Returns the bytes written.
+size_t encodeRLERow(const uint8_t* indices, int width, int bitCount, uint8_t* out);
+
+/**
+ * Write an indexed image (see convertToIndexed) RLE-compressed: RLE4 when the color table has at
+ * most 16 entries, RLE8 otherwise. Rows are encoded in parallel and written bottom-up, as the format
+ * requires. Returns false on failure.
+ */
+bool saveRLEBMP(const char* fileName, const Image& image, int threadCount = 1);
+
+#endif // BMP_RLE_H
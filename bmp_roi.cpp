@@ -0,0 +1,313 @@
+#include "bmp_roi.h"
+#include "bmp_async_io.h"
+#include "bmp_buffer_pool.h"
+#include "bmp_rle.h"
+#include "bmp_trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+
+using namespace std;
+
+// Identifies a tile cache file and its layout version
+static const char TILE_CACHE_MAGIC[8] = { 'B', 'M', 'P', 'T', 'I', 'L', 'E', '1' };
+
+// Fixed header at the start of a tile cache, followed by the BMP headers of the (decoded) source
+struct TileCacheHeader {
+    char magic[8];
+    uint64_t sourceSize;        // Size and modification time of the source when the cache was built.
+    int64_t sourceModified;
+    int32_t width;
+    int32_t height;
+    int32_t bytesPerPixel;
+    int32_t tileSize;
+    int32_t tilesAcross;
+    int32_t tilesDown;
+    int32_t topDown;
+    int32_t reserved;
+    uint64_t dataOffset;        // File offset of tile (0, 0).
+};
+
+// Bounds check shared by both region loaders
+static bool validateRegion(const Image& image, int x, int y, int width, int height) {
+    if (x < 0 || y < 0 || width <= 0 || height <= 0 || width > image.width - x || height > image.height - y) {
+        cerr << "Cropping area exceeds image bounds." << endl;
+        return false;
+    }
+    return true;
+}
+
+// Copy the ROI of an image that is already in memory (indexed and RLE sources)
+static bool copyRegion(const Image& source, int x, int y, int width, int height, Image& region) {
+    createImageLike(source, width, height, region);
+    if (region.pixelData == nullptr) {
+        cerr << "Out of memory." << endl;
+        return false;
+    }
+    size_t rowBytes = static_cast<size_t>(width) * source.bytesPerPixel;
+    for (int r = 0; r < height; ++r) {
+        memcpy(region.row(r), source.row(y + r) + static_cast<size_t>(x) * source.bytesPerPixel, rowBytes);
+    }
+    return true;
+}
+
+// Read and validate the headers at the start of an open file
+static bool readHeaders(PositionedFile& file, Image& image) {
+    if (!file.read(&image.fileHeader, sizeof(image.fileHeader), 0) ||
+        !file.read(&image.infoHeader, sizeof(image.infoHeader), sizeof(image.fileHeader))) {
+        cerr << "Input file is not a BMP file." << endl;
+        return false;
+    }
+    return validateBMPHeaders(image);
+}
+
+bool loadBMPHeaders(const char* fileName, Image& image) {
+    PositionedFile file;
+    if (!file.openRead(fileName)) {
+        cerr << "Can't open file." << endl;
+        return false;
+    }
+    return readHeaders(file, image);
+}
+
+bool loadBMPRegion(const char* fileName, int x, int y, int width, int height, Image& region) {
+    BMP_TRACE_SCOPE(trace, "load.region", 0);
+
+    PositionedFile file;
+    if (!file.openRead(fileName)) {
+        cerr << "Can't open file." << endl;
+        return false;
+    }
+
+    // Only the headers are read before the ROI rows
+    Image source;
+    if (!readHeaders(file, source) || !validateRegion(source, x, y, width, height)) {
+        return false;
+    }
+
+    // Indexed rows need the color table and RLE rows can't be located without decoding: take the whole file
+    if (isIndexedBMP(source.infoHeader)) {
+        file.close();
+        Image decoded;
+        return loadBMPMapped(fileName, decoded) && copyRegion(decoded, x, y, width, height, region);
+    }
+    if (file.size() < source.fileHeader.bfOffBits + source.pixelBytes()) {
+        cerr << "BMP pixel data is truncated." << endl;
+        return false;
+    }
+
+    createImageLike(source, width, height, region);
+    if (region.pixelData == nullptr) {
+        cerr << "Out of memory." << endl;
+        return false;
+    }
+    BMP_TRACE_SET_BYTES(trace, region.pixelBytes());
+
+    // Row y of the image is stored at file row y (bottom-up) or height - 1 - y (top-down)
+    auto rowOffset = [&](int row) {
+        int storedRow = source.topDown ? source.height - 1 - row : row;
+        return static_cast<uint64_t>(source.fileHeader.bfOffBits) + static_cast<uint64_t>(storedRow) * source.rowSize;
+    };
+
+    if (x == 0 && width == source.width) {
+        // Whole rows are contiguous in the file and already padded like the region: one read
+        int firstStored = source.topDown ? y + height - 1 : y;
+        if (!file.read(region.pixelBase(), region.pixelBytes(), rowOffset(firstStored))) {
+            cerr << "BMP pixel data is truncated." << endl;
+            return false;
+        }
+        return true;
+    }
+
+    size_t rowBytes = static_cast<size_t>(width) * source.bytesPerPixel;
+    uint64_t columnOffset = static_cast<uint64_t>(x) * source.bytesPerPixel;
+    for (int r = 0; r < height; ++r) {
+        if (!file.read(region.row(r), rowBytes, rowOffset(y + r) + columnOffset)) {
+            cerr << "BMP pixel data is truncated." << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+string tileCachePath(const char* fileName) {
+    return string(fileName) + ".tiles";
+}
+
+bool buildTileCache(const char* fileName, const char* cacheFileName, int tileSize) {
+    BMP_TRACE_SCOPE(trace, "tilecache.build", 0);
+
+    if (tileSize <= 0) {
+        cerr << "Invalid tile size." << endl;
+        return false;
+    }
+    uint64_t sourceSize = 0;
+    int64_t sourceModified = 0;
+    if (!fileStamp(fileName, sourceSize, sourceModified)) {
+        cerr << "Can't open file." << endl;
+        return false;
+    }
+    Image source;
+    if (!loadBMPMapped(fileName, source)) {
+        return false;
+    }
+    BMP_TRACE_SET_BYTES(trace, source.pixelBytes());
+
+    TileCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, TILE_CACHE_MAGIC, sizeof(header.magic));
+    header.sourceSize = sourceSize;
+    header.sourceModified = sourceModified;
+    header.width = source.width;
+    header.height = source.height;
+    header.bytesPerPixel = source.bytesPerPixel;
+    header.tileSize = tileSize;
+    header.tilesAcross = (source.width + tileSize - 1) / tileSize;
+    header.tilesDown = (source.height + tileSize - 1) / tileSize;
+    header.topDown = source.topDown ? 1 : 0;
+    header.dataOffset = sizeof(TileCacheHeader) + BMP_HEADERS_SIZE;
+
+    // Written under a temporary name no other writer uses (process tag plus sequence number) and renamed,
+    // so a reader sees either no cache or a complete one, even when several processes build it at once
+    static atomic<uint64_t> sequence{0};
+    static const uint64_t processTag = random_device()();
+    string temporaryName = string(cacheFileName) + ".tmp" + to_string(processTag) + "." + to_string(sequence.fetch_add(1));
+    PositionedFile cache;
+    if (!cache.openWrite(temporaryName.c_str())) {
+        cerr << "Can't open output file." << endl;
+        return false;
+    }
+    bool ok = cache.write(&header, sizeof(header), 0) &&
+              cache.write(&source.fileHeader, sizeof(source.fileHeader), sizeof(header)) &&
+              cache.write(&source.infoHeader, sizeof(source.infoHeader), sizeof(header) + sizeof(source.fileHeader));
+
+    // One tile row at a time: its tiles are consecutive in the cache, so each tile row is a single write
+    size_t tileRowBytes = static_cast<size_t>(tileSize) * source.bytesPerPixel;
+    size_t tileBytes = tileRowBytes * tileSize;
+    size_t bandBytes = tileBytes * header.tilesAcross;
+    PixelBuffer band = sharedBufferPool().acquire(bandBytes);
+    if (band.empty()) {
+        cache.close();
+        remove(temporaryName.c_str());
+        cerr << "Out of memory." << endl;
+        return false;
+    }
+    for (int ty = 0; ok && ty < header.tilesDown; ++ty) {
+        memset(band.data(), 0, bandBytes);
+        int rows = min(tileSize, source.height - ty * tileSize);
+        for (int r = 0; r < rows; ++r) {
+            const uint8_t* sourceRow = source.row(ty * tileSize + r);
+            for (int tx = 0; tx < header.tilesAcross; ++tx) {
+                int columns = min(tileSize, source.width - tx * tileSize);
+                memcpy(band.data() + tx * tileBytes + r * tileRowBytes,
+                       sourceRow + static_cast<size_t>(tx) * tileRowBytes, static_cast<size_t>(columns) * source.bytesPerPixel);
+            }
+        }
+        ok = cache.write(band.data(), bandBytes, header.dataOffset + static_cast<uint64_t>(ty) * bandBytes);
+    }
+    ok = cache.close() && ok;
+    if (!ok || rename(temporaryName.c_str(), cacheFileName) != 0) {
+        remove(temporaryName.c_str());
+        cerr << "Failed to write tile cache." << endl;
+        return false;
+    }
+    return true;
+}
+
+// Open a tile cache and check that it still describes `fileName`. Silent: a failure just means "rebuild".
+static bool openTileCache(const char* fileName, const char* cacheFileName, int tileSize,
+                          PositionedFile& cache, TileCacheHeader& header, Image& shape) {
+    uint64_t sourceSize = 0;
+    int64_t sourceModified = 0;
+    if (!fileStamp(fileName, sourceSize, sourceModified) || !cache.openRead(cacheFileName)) {
+        return false;
+    }
+    if (!cache.read(&header, sizeof(header), 0) || memcmp(header.magic, TILE_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.sourceSize != sourceSize || header.sourceModified != sourceModified || header.tileSize != tileSize ||
+        !cache.read(&shape.fileHeader, sizeof(shape.fileHeader), sizeof(header)) ||
+        !cache.read(&shape.infoHeader, sizeof(shape.infoHeader), sizeof(header) + sizeof(shape.fileHeader))) {
+        cache.close();
+        return false;
+    }
+
+    // The geometry of the decoded source, without pixels, for the region's headers
+    shape.width = header.width;
+    shape.height = header.height;
+    shape.bytesPerPixel = header.bytesPerPixel;
+    shape.rowSize = calculateRowSize(header.width, header.bytesPerPixel);
+    shape.topDown = header.topDown != 0;
+    shape.stride = shape.topDown ? -shape.rowSize : shape.rowSize;
+    return true;
+}
+
+bool loadBMPRegionCached(const char* fileName, int x, int y, int width, int height, Image& region, int tileSize) {
+    string cacheFileName = tileCachePath(fileName);
+    PositionedFile cache;
+    TileCacheHeader header;
+    Image shape;
+    if (!openTileCache(fileName, cacheFileName.c_str(), tileSize, cache, header, shape)) {
+        // The cache is only an optimisation: where it can't be written or read (read-only directory,
+        // full disk, someone else's file), the ROI is read from the source directly
+        if (!buildTileCache(fileName, cacheFileName.c_str(), tileSize) ||
+            !openTileCache(fileName, cacheFileName.c_str(), tileSize, cache, header, shape)) {
+            cerr << "Can't use tile cache; reading the region from the source." << endl;
+            return loadBMPRegion(fileName, x, y, width, height, region);
+        }
+    }
+    if (!validateRegion(shape, x, y, width, height)) {
+        return false;
+    }
+
+    BMP_TRACE_SCOPE(trace, "load.region.cached", 0);
+    createImageLike(shape, width, height, region);
+    if (region.pixelData == nullptr) {
+        cerr << "Out of memory." << endl;
+        return false;
+    }
+    BMP_TRACE_SET_BYTES(trace, region.pixelBytes());
+
+    // Tiles covering the ROI; each tile row of them is one contiguous read
+    int bytesPerPixel = header.bytesPerPixel;
+    size_t tileRowBytes = static_cast<size_t>(tileSize) * bytesPerPixel;
+    size_t tileBytes = tileRowBytes * tileSize;
+    int firstTileX = x / tileSize;
+    int lastTileX = (x + width - 1) / tileSize;
+    int firstTileY = y / tileSize;
+    int lastTileY = (y + height - 1) / tileSize;
+    size_t spanBytes = tileBytes * (lastTileX - firstTileX + 1);
+    PixelBuffer span = sharedBufferPool().acquire(spanBytes);
+    if (span.empty()) {
+        cerr << "Out of memory." << endl;
+        return false;
+    }
+
+    for (int ty = firstTileY; ty <= lastTileY; ++ty) {
+        uint64_t offset = header.dataOffset + (static_cast<uint64_t>(ty) * header.tilesAcross + firstTileX) * tileBytes;
+        if (!cache.read(span.data(), spanBytes, offset)) {
+            cerr << "Tile cache is truncated; reading the region from the source." << endl;
+            return loadBMPRegion(fileName, x, y, width, height, region);
+        }
+
+        // Rows of this tile row inside the ROI, gathered across the tiles of the span
+        int firstRow = max(y, ty * tileSize);
+        int lastRow = min(y + height, (ty + 1) * tileSize);
+        for (int row = firstRow; row < lastRow; ++row) {
+            uint8_t* dst = region.row(row - y);
+            for (int tx = firstTileX; tx <= lastTileX; ++tx) {
+                int firstColumn = max(x, tx * tileSize);
+                int lastColumn = min(x + width, (tx + 1) * tileSize);
+                const uint8_t* tile = span.data() + (tx - firstTileX) * tileBytes;
+                memcpy(dst + static_cast<size_t>(firstColumn - x) * bytesPerPixel,
+                       tile + (row - ty * tileSize) * tileRowBytes + static_cast<size_t>(firstColumn - tx * tileSize) * bytesPerPixel,
+                       static_cast<size_t>(lastColumn - firstColumn) * bytesPerPixel);
+            }
+        }
+    }
+    return true;
+}
@@ -0,0 +1,41 @@
+#ifndef BMP_ROI_H
+#define BMP_ROI_H
+
+#include <string>
+
+#include "bmp_image.h"
+
+// Edge length in pixels of the tiles of a sidecar cache
+const int DEFAULT_TILE_CACHE_SIZE = 64;
+
+// Read and validate only the headers of a BMP file: the geometry of `image` is set, no pixels are loaded.
+bool loadBMPHeaders(const char* fileName, Image& image);
+
+/**
+ * Read only the ROI (x, y, width, height) of a BMP file into a new pooled image.
+ * Uncompressed direct-color files are read with positioned reads: one pread per ROI row, at
+ * bfOffBits + row * rowSize + x * bytesPerPixel (a single read when the ROI spans whole rows),
+ * so the cost depends on the ROI, not on the file. Indexed and RLE files are decoded whole and then
+ * cropped. The region keeps the row order of the file. Prints the reason and returns false on failure.
+ */
+bool loadBMPRegion(const char* fileName, int x, int y, int width, int height, Image& region);
+
+/**
+ * Tiled sidecar for repeated ROI queries on one source.
+ * The cache stores the decoded pixels as tileSize x tileSize tiles, each tile contiguous (rows without
+ * padding, edge tiles padded to full size), tile rows one after another. An ROI then costs one read per
+ * tile row it intersects, covering just the tiles it needs. The header records the size and modification
+ * time of the source; a cache that no longer matches its source is rebuilt.
+ */
+std::string tileCachePath(const char* fileName);
+
+// Read the whole source once and write its tile cache (to a temporary file renamed into place, so
+// concurrent readers never see a partial cache).
+bool buildTileCache(const char* fileName, const char* cacheFileName, int tileSize = DEFAULT_TILE_CACHE_SIZE);
+
+// loadBMPRegion through the tile cache of `fileName` (tileCachePath), building it first if it is
+// missing or stale. A cache that can't be built or read falls back to loadBMPRegion on the source.
+bool loadBMPRegionCached(const char* fileName, int x, int y, int width, int height, Image& region,
+                         int tileSize = DEFAULT_TILE_CACHE_SIZE);
+
+#endif // BMP_ROI_H
@@ -0,0 +1,1185 @@
+#include "bmp_simd.h"
+#include "bmp_pixel_format.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <type_traits>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define BMP_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define BMP_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+using namespace std;
+
+// ---------------------------------------------------------------------------
+// CPU detection and dispatch
+// ---------------------------------------------------------------------------
+
+const char* simdLevelName(SimdLevel level) {
+    switch (level) {
+        case SIMD_SSE41:  return "sse4.1";
+        case SIMD_AVX2:   return "avx2";
+        case SIMD_AVX512: return "avx512";
+        case SIMD_NEON:   return "neon";
+        default:          return "scalar";
+    }
+}
+
+// Highest level the CPU (and OS) can execute
+static SimdLevel detectSimdLevel() {
+#if defined(BMP_SIMD_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw")) {
+        return SIMD_AVX512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return SIMD_AVX2;
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        return SIMD_SSE41;
+    }
+    return SIMD_SCALAR;
+#elif defined(BMP_SIMD_NEON)
+    return SIMD_NEON;
+#else
+    return SIMD_SCALAR;
+#endif
+}
+
+SimdLevel simdLevel() {
+    static const SimdLevel level = [] {
+        SimdLevel detected = detectSimdLevel();
+
+        // BMP_SIMD can only select a level that is actually available, never a higher one
+        const char* requested = getenv("BMP_SIMD");
+        if (requested != nullptr) {
+            if (strcmp(requested, "scalar") == 0) {
+                return SIMD_SCALAR;
+            }
+            for (SimdLevel candidate : { SIMD_SSE41, SIMD_AVX2, SIMD_AVX512, SIMD_NEON }) {
+                bool available = (candidate == SIMD_NEON) ? (detected == SIMD_NEON)
+                                                          : (detected != SIMD_NEON && candidate <= detected);
+                if (strcmp(requested, simdLevelName(candidate)) == 0 && available) {
+                    return candidate;
+                }
+            }
+        }
+        return detected;
+    }();
+    return level;
+}
+
+// ---------------------------------------------------------------------------
+// Quantization
+// ---------------------------------------------------------------------------
+
+void buildQuantizationTable(int quantizationBits, QuantizationTable& table) {
+    // Calculate the number of discrete levels based on the target bit depth (2^n)
+    int levels = 1 << quantizationBits;
+
+    // Quantization step factor: maps the 0-255 range to the reduced range
+    int factor = 255 / (levels - 1);
+
+    table.quantizationBits = quantizationBits;
+    table.factor = factor;
+
+    // ceil(65536 / factor) is exact for every 8-bit input because 255 * error < 65536 / factor.
+    // factor == 1 is the identity and never reaches the vector kernels.
+    table.reciprocal = static_cast<uint16_t>(factor > 1 ? (65536 + factor - 1) / factor : 0);
+
+    for (int value = 0; value < 256; ++value) {
+        table.table[value] = static_cast<uint8_t>((value / factor) * factor);
+    }
+}
+
+// Scalar tail of the vector kernels: one table lookup per color byte, alpha copied through
+template <typename Format>
+static void quantizeBytesScalar(const uint8_t* src, uint8_t* dst, int firstByte, int byteCount, const QuantizationTable& table) {
+    for (int i = firstByte; i < byteCount; ++i) {
+        bool isAlpha = Format::hasAlpha && ((i & 3) == 3);
+        dst[i] = isAlpha ? src[i] : table.table[src[i]];
+    }
+}
+
+// Scalar kernel with the format and bit depth baked in: the factor is a constant, so the table is not needed
+template <typename Format, int Bits>
+static void quantizeRowScalar(const uint8_t* src, uint8_t* dst, int width, int, const QuantizationTable&) {
+    quantizeRowFixed<Format, Bits>(src, dst, width);
+}
+
+#if defined(BMP_SIMD_X86)
+
+// Each kernel widens bytes to 16-bit lanes, computes (v * reciprocal) >> 16 * factor, and packs back.
+// unpack/pack are both per 128-bit lane, so the byte order survives without extra permutes.
+// For formats with alpha, the alpha byte of every pixel is restored from the source with a blend mask.
+
+template <typename Format>
+__attribute__((target("sse4.1")))
+static void quantizeRowSSE41(const uint8_t* src, uint8_t* dst, int width, int, const QuantizationTable& table) {
+    int byteCount = width * Format::bytesPerPixel;
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i reciprocal = _mm_set1_epi16(static_cast<short>(table.reciprocal));
+    const __m128i factor = _mm_set1_epi16(static_cast<short>(table.factor));
+    const __m128i alphaMask = _mm_set1_epi32(static_cast<int>(0xFF000000u));
+
+    int i = 0;
+    for (; i + 16 <= byteCount; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i lo = _mm_unpacklo_epi8(v, zero);
+        __m128i hi = _mm_unpackhi_epi8(v, zero);
+        lo = _mm_mullo_epi16(_mm_mulhi_epu16(lo, reciprocal), factor);
+        hi = _mm_mullo_epi16(_mm_mulhi_epu16(hi, reciprocal), factor);
+        __m128i q = _mm_packus_epi16(lo, hi);
+        if (Format::hasAlpha) {
+            q = _mm_blendv_epi8(q, v, alphaMask);
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), q);
+    }
+    quantizeBytesScalar<Format>(src, dst, i, byteCount, table);
+}
+
+template <typename Format>
+__attribute__((target("avx2")))
+static void quantizeRowAVX2(const uint8_t* src, uint8_t* dst, int width, int, const QuantizationTable& table) {
+    int byteCount = width * Format::bytesPerPixel;
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i reciprocal = _mm256_set1_epi16(static_cast<short>(table.reciprocal));
+    const __m256i factor = _mm256_set1_epi16(static_cast<short>(table.factor));
+    const __m256i alphaMask = _mm256_set1_epi32(static_cast<int>(0xFF000000u));
+
+    int i = 0;
+    for (; i + 32 <= byteCount; i += 32) {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        __m256i lo = _mm256_unpacklo_epi8(v, zero);
+        __m256i hi = _mm256_unpackhi_epi8(v, zero);
+        lo = _mm256_mullo_epi16(_mm256_mulhi_epu16(lo, reciprocal), factor);
+        hi = _mm256_mullo_epi16(_mm256_mulhi_epu16(hi, reciprocal), factor);
+        __m256i q = _mm256_packus_epi16(lo, hi);
+        if (Format::hasAlpha) {
+            q = _mm256_blendv_epi8(q, v, alphaMask);
+        }
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), q);
+    }
+    quantizeBytesScalar<Format>(src, dst, i, byteCount, table);
+}
+
+template <typename Format>
+__attribute__((target("avx512f,avx512bw")))
+static void quantizeRowAVX512(const uint8_t* src, uint8_t* dst, int width, int, const QuantizationTable& table) {
+    int byteCount = width * Format::bytesPerPixel;
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i reciprocal = _mm512_set1_epi16(static_cast<short>(table.reciprocal));
+    const __m512i factor = _mm512_set1_epi16(static_cast<short>(table.factor));
+    const __mmask64 alphaMask = Format::hasAlpha ? 0x8888888888888888ull : 0;
+
+    int i = 0;
+    for (; i + 64 <= byteCount; i += 64) {
+        __m512i v = _mm512_loadu_si512(src + i);
+        __m512i lo = _mm512_unpacklo_epi8(v, zero);
+        __m512i hi = _mm512_unpackhi_epi8(v, zero);
+        lo = _mm512_mullo_epi16(_mm512_mulhi_epu16(lo, reciprocal), factor);
+        hi = _mm512_mullo_epi16(_mm512_mulhi_epu16(hi, reciprocal), factor);
+        __m512i q = _mm512_mask_blend_epi8(alphaMask, _mm512_packus_epi16(lo, hi), v);
+        _mm512_storeu_si512(dst + i, q);
+    }
+    quantizeBytesScalar<Format>(src, dst, i, byteCount, table);
+}
+
+#endif // BMP_SIMD_X86
+
+#if defined(BMP_SIMD_NEON)
+
+template <typename Format>
+static void quantizeRowNEON(const uint8_t* src, uint8_t* dst, int width, int, const QuantizationTable& table) {
+    int byteCount = width * Format::bytesPerPixel;
+    const uint16x4_t reciprocal = vdup_n_u16(table.reciprocal);
+    const uint16x8_t factor = vdupq_n_u16(static_cast<uint16_t>(table.factor));
+    const uint8x16_t alphaMask = vreinterpretq_u8_u32(vdupq_n_u32(Format::hasAlpha ? 0xFF000000u : 0u));
+
+    int i = 0;
+    for (; i + 16 <= byteCount; i += 16) {
+        uint8x16_t v = vld1q_u8(src + i);
+        uint16x8_t lo = vmovl_u8(vget_low_u8(v));
+        uint16x8_t hi = vmovl_u8(vget_high_u8(v));
+
+        // (v * reciprocal) >> 16 via widening multiply and narrowing shift
+        lo = vcombine_u16(vshrn_n_u32(vmull_u16(vget_low_u16(lo), reciprocal), 16),
+                          vshrn_n_u32(vmull_u16(vget_high_u16(lo), reciprocal), 16));
+        hi = vcombine_u16(vshrn_n_u32(vmull_u16(vget_low_u16(hi), reciprocal), 16),
+                          vshrn_n_u32(vmull_u16(vget_high_u16(hi), reciprocal), 16));
+        lo = vmulq_u16(lo, factor);
+        hi = vmulq_u16(hi, factor);
+
+        uint8x16_t q = vcombine_u8(vmovn_u16(lo), vmovn_u16(hi));
+        vst1q_u8(dst + i, vbslq_u8(alphaMask, v, q));
+    }
+    quantizeBytesScalar<Format>(src, dst, i, byteCount, table);
+}
+
+#endif // BMP_SIMD_NEON
+
+// Identity (8-bit target): nothing to quantize, just move the bytes if needed
+static void quantizeRowCopy(const uint8_t* src, uint8_t* dst, int width, int bytesPerPixel, const QuantizationTable&) {
+    if (src != dst) {
+        memmove(dst, src, static_cast<size_t>(width) * bytesPerPixel);
+    }
+}
+
+// Kernel for one direct-color format at the requested level
+template <typename Format>
+static QuantizeRowKernel quantizeRowKernelForFormat(SimdLevel level, const QuantizationTable& table) {
+    switch (level) {
+#if defined(BMP_SIMD_X86)
+        case SIMD_SSE41:  return quantizeRowSSE41<Format>;
+        case SIMD_AVX2:   return quantizeRowAVX2<Format>;
+        case SIMD_AVX512: return quantizeRowAVX512<Format>;
+#endif
+#if defined(BMP_SIMD_NEON)
+        case SIMD_NEON:   return quantizeRowNEON<Format>;
+#endif
+        default: {
+            // The scalar kernel is also specialized on the bit depth
+            QuantizeRowKernel kernel = quantizeRowCopy;
+            dispatchQuantizationBits(table.quantizationBits, [&](auto bits) {
+                kernel = quantizeRowScalar<Format, decltype(bits)::value>;
+            });
+            return kernel;
+        }
+    }
+}
+
+QuantizeRowKernel quantizeRowKernelFor(SimdLevel level, const QuantizationTable& table, int bytesPerPixel) {
+    // An 8-bit target has no reciprocal; every kernel would be the identity anyway
+    if (table.factor == 1) {
+        return quantizeRowCopy;
+    }
+
+    // Palette indices are not colors: indexed images are quantized through their color table
+    QuantizeRowKernel kernel = quantizeRowCopy;
+    dispatchPixelFormat(bytesPerPixel * 8, [&](auto format) {
+        using Format = decltype(format);
+        if constexpr (Format::bytesPerPixel >= 3) {
+            kernel = quantizeRowKernelForFormat<Format>(level, table);
+        }
+    });
+    return kernel;
+}
+
+QuantizeRowKernel quantizeRowKernel(const QuantizationTable& table, int bytesPerPixel) {
+    return quantizeRowKernelFor(simdLevel(), table, bytesPerPixel);
+}
+
+// ---------------------------------------------------------------------------
+// Horizontal flip
+// ---------------------------------------------------------------------------
+
+template <typename Format>
+static void flipRowScalar(uint8_t* row, int width, int) {
+    flipPixelsFixed<Format>(row, 0, width - 1);
+}
+
+#if defined(BMP_SIMD_X86)
+
+// Each kernel loads a block from both ends of the row, reverses the pixel order inside the
+// register and stores the blocks swapped, moving inwards; the middle is finished by the scalar path.
+
+template <typename Format>
+__attribute__((target("sse4.1")))
+static void flipRowSSE41(uint8_t* row, int width, int) {
+    int x = 0;
+    if constexpr (Format::bytesPerPixel == 4) {
+        // 4 pixels per 16-byte block: reversing the 32-bit lanes reverses the pixels
+        for (; 2 * x + 8 <= width; x += 4) {
+            uint8_t* left = row + x * 4;
+            uint8_t* right = row + (width - x - 4) * 4;
+            __m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i*>(left));
+            __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(right));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(left), _mm_shuffle_epi32(r, 0x1B));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(right), _mm_shuffle_epi32(l, 0x1B));
+        }
+    } else if constexpr (Format::bytesPerPixel == 3) {
+        // 5 pixels (15 bytes) per 16-byte block. The left block owns bytes 0..14 of its load and the
+        // right block bytes 1..15, so neither load reads outside the row. The one foreign byte of
+        // each store is blended back from its own load; the strict loop bound keeps it outside both blocks.
+        const __m128i rightToLeft = _mm_setr_epi8(13, 14, 15, 10, 11, 12, 7, 8, 9, 4, 5, 6, 1, 2, 3, -1);
+        const __m128i leftToRight = _mm_setr_epi8(-1, 12, 13, 14, 9, 10, 11, 6, 7, 8, 3, 4, 5, 0, 1, 2);
+        const __m128i keepLast = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, -1);
+        const __m128i keepFirst = _mm_setr_epi8(-1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+        for (; 2 * x + 10 < width; x += 5) {
+            uint8_t* left = row + x * 3;
+            uint8_t* right = row + (width - x - 5) * 3 - 1;
+            __m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i*>(left));
+            __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(right));
+            __m128i newLeft = _mm_blendv_epi8(_mm_shuffle_epi8(r, rightToLeft), l, keepLast);
+            __m128i newRight = _mm_blendv_epi8(_mm_shuffle_epi8(l, leftToRight), r, keepFirst);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(left), newLeft);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(right), newRight);
+        }
+    } else {
+        // 16 one-byte pixels per block: a byte shuffle reverses the whole register
+        const __m128i reverse = _mm_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+        for (; 2 * x + 32 <= width; x += 16) {
+            uint8_t* left = row + x;
+            uint8_t* right = row + (width - x - 16);
+            __m128i l = _mm_loadu_si128(reinterpret_cast<const __m128i*>(left));
+            __m128i r = _mm_loadu_si128(reinterpret_cast<const __m128i*>(right));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(left), _mm_shuffle_epi8(r, reverse));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(right), _mm_shuffle_epi8(l, reverse));
+        }
+    }
+    flipPixelsFixed<Format>(row, x, width - x - 1);
+}
+
+template <typename Format>
+__attribute__((target("avx2")))
+static void flipRowAVX2(uint8_t* row, int width, int bytesPerPixel) {
+    if constexpr (Format::bytesPerPixel != 4) {
+        // pshufb only works within 128-bit lanes, so smaller pixels gain little from 256-bit registers
+        flipRowSSE41<Format>(row, width, bytesPerPixel);
+    } else {
+        // 8 pixels per 32-byte block, reversed across lanes with a 32-bit permute
+        const __m256i reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+        int x = 0;
+        for (; 2 * x + 16 <= width; x += 8) {
+            uint8_t* left = row + x * 4;
+            uint8_t* right = row + (width - x - 8) * 4;
+            __m256i l = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(left));
+            __m256i r = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(right));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(left), _mm256_permutevar8x32_epi32(r, reverse));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(right), _mm256_permutevar8x32_epi32(l, reverse));
+        }
+        flipPixelsFixed<Format>(row, x, width - x - 1);
+    }
+}
+
+template <typename Format>
+__attribute__((target("avx512f,avx512bw")))
+static void flipRowAVX512(uint8_t* row, int width, int bytesPerPixel) {
+    if constexpr (Format::bytesPerPixel != 4) {
+        flipRowSSE41<Format>(row, width, bytesPerPixel);
+    } else {
+        // 16 pixels per 64-byte block
+        const __m512i reverse = _mm512_setr_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+        int x = 0;
+        for (; 2 * x + 32 <= width; x += 16) {
+            uint8_t* left = row + x * 4;
+            uint8_t* right = row + (width - x - 16) * 4;
+            __m512i l = _mm512_loadu_si512(left);
+            __m512i r = _mm512_loadu_si512(right);
+            _mm512_storeu_si512(left, _mm512_maskz_permutexvar_epi32(0xFFFF, reverse, r));
+            _mm512_storeu_si512(right, _mm512_maskz_permutexvar_epi32(0xFFFF, reverse, l));
+        }
+        flipPixelsFixed<Format>(row, x, width - x - 1);
+    }
+}
+
+// 24-bit flip with vpermb: 21 pixels (63 bytes) per block, using masked loads/stores so the
+// 64th byte is never read or written
+__attribute__((target("avx512f,avx512bw,avx512vbmi")))
+static void flipRow24AVX512VBMI(uint8_t* row, int width, int) {
+    alignas(64) uint8_t indices[64];
+    for (int i = 0; i < 21; ++i) {
+        for (int c = 0; c < 3; ++c) {
+            indices[i * 3 + c] = static_cast<uint8_t>((20 - i) * 3 + c);
+        }
+    }
+    indices[63] = 63;
+    const __m512i reverse = _mm512_load_si512(indices);
+    const __mmask64 blockMask = 0x7FFFFFFFFFFFFFFFull;
+
+    int x = 0;
+    for (; 2 * x + 42 <= width; x += 21) {
+        uint8_t* left = row + x * 3;
+        uint8_t* right = row + (width - x - 21) * 3;
+        __m512i l = _mm512_maskz_loadu_epi8(blockMask, left);
+        __m512i r = _mm512_maskz_loadu_epi8(blockMask, right);
+        _mm512_mask_storeu_epi8(left, blockMask, _mm512_maskz_permutexvar_epi8(blockMask, reverse, r));
+        _mm512_mask_storeu_epi8(right, blockMask, _mm512_maskz_permutexvar_epi8(blockMask, reverse, l));
+    }
+    flipPixelsFixed<PixelBGR24>(row, x, width - x - 1);
+}
+
+static bool cpuSupportsVbmi() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx512vbmi");
+}
+
+#endif // BMP_SIMD_X86
+
+#if defined(BMP_SIMD_NEON)
+
+template <typename Format>
+static void flipRowNEON(uint8_t* row, int width, int) {
+    int x = 0;
+    if constexpr (Format::bytesPerPixel == 4) {
+        // 4 pixels per block: reverse the 32-bit lanes of each half, then swap the halves
+        for (; 2 * x + 8 <= width; x += 4) {
+            uint8_t* left = row + x * 4;
+            uint8_t* right = row + (width - x - 4) * 4;
+            uint32x4_t l = vrev64q_u32(vreinterpretq_u32_u8(vld1q_u8(left)));
+            uint32x4_t r = vrev64q_u32(vreinterpretq_u32_u8(vld1q_u8(right)));
+            vst1q_u8(left, vreinterpretq_u8_u32(vextq_u32(r, r, 2)));
+            vst1q_u8(right, vreinterpretq_u8_u32(vextq_u32(l, l, 2)));
+        }
+    } else if constexpr (Format::bytesPerPixel == 3) {
+        // 16 pixels per block: vld3 splits B, G, R into separate registers, each reversed bytewise
+        for (; 2 * x + 32 <= width; x += 16) {
+            uint8_t* left = row + x * 3;
+            uint8_t* right = row + (width - x - 16) * 3;
+            uint8x16x3_t l = vld3q_u8(left);
+            uint8x16x3_t r = vld3q_u8(right);
+            for (int c = 0; c < 3; ++c) {
+                uint8x16_t lc = vrev64q_u8(l.val[c]);
+                uint8x16_t rc = vrev64q_u8(r.val[c]);
+                l.val[c] = vextq_u8(lc, lc, 8);
+                r.val[c] = vextq_u8(rc, rc, 8);
+            }
+            vst3q_u8(left, r);
+            vst3q_u8(right, l);
+        }
+    } else {
+        // 16 one-byte pixels per block, reversed like a single color plane above
+        for (; 2 * x + 32 <= width; x += 16) {
+            uint8_t* left = row + x;
+            uint8_t* right = row + (width - x - 16);
+            uint8x16_t l = vrev64q_u8(vld1q_u8(left));
+            uint8x16_t r = vrev64q_u8(vld1q_u8(right));
+            vst1q_u8(left, vextq_u8(r, r, 8));
+            vst1q_u8(right, vextq_u8(l, l, 8));
+        }
+    }
+    flipPixelsFixed<Format>(row, x, width - x - 1);
+}
+
+#endif // BMP_SIMD_NEON
+
+// Kernel for one pixel format at the requested level
+template <typename Format>
+static FlipRowKernel flipRowKernelForFormat(SimdLevel level) {
+    switch (level) {
+#if defined(BMP_SIMD_X86)
+        case SIMD_SSE41:  return flipRowSSE41<Format>;
+        case SIMD_AVX2:   return flipRowAVX2<Format>;
+        case SIMD_AVX512:
+            if (Format::bytesPerPixel == 3 && cpuSupportsVbmi()) {
+                return flipRow24AVX512VBMI;
+            }
+            return flipRowAVX512<Format>;
+#endif
+#if defined(BMP_SIMD_NEON)
+        case SIMD_NEON:   return flipRowNEON<Format>;
+#endif
+        default:          return flipRowScalar<Format>;
+    }
+}
+
+FlipRowKernel flipRowKernelFor(SimdLevel level, int bytesPerPixel) {
+    FlipRowKernel kernel = nullptr;
+    dispatchPixelFormat(bytesPerPixel * 8, [&](auto format) {
+        kernel = flipRowKernelForFormat<decltype(format)>(level);
+    });
+    return kernel;
+}
+
+FlipRowKernel flipRowKernel(int bytesPerPixel) {
+    return flipRowKernelFor(simdLevel(), bytesPerPixel);
+}
+
+// ---------------------------------------------------------------------------
+// Palette indexing
+// ---------------------------------------------------------------------------
+
+template <typename Format>
+static void paletteIndexRowScalar(const uint8_t* src, uint8_t* dst, int width, const QuantizationTable& table) {
+    int levels = 1 << table.quantizationBits;
+    for (int x = 0; x < width; ++x) {
+        const uint8_t* pixel = src + x * Format::bytesPerPixel;
+        int blue = pixel[0] / table.factor;
+        int green = pixel[1] / table.factor;
+        int red = pixel[2] / table.factor;
+        dst[x] = static_cast<uint8_t>((red * levels + green) * levels + blue);
+    }
+}
+
+static void packNibblesScalar(const uint8_t* indices, uint8_t* dst, int width) {
+    // First pixel in the high nibble, as in 4-bit BMP rows
+    for (int x = 0; x + 1 < width; x += 2) {
+        dst[x / 2] = static_cast<uint8_t>((indices[x] << 4) | indices[x + 1]);
+    }
+    if (width & 1) {
+        dst[width / 2] = static_cast<uint8_t>(indices[width - 1] << 4);
+    }
+}
+
+#if defined(BMP_SIMD_X86)
+
+// Indices of 4 pixels held in 32-bit slots (B, G, R, A/zero): the channels are widened to 16 bits,
+// reduced to their level with the reciprocal, and madd + hadd sum level * weight per pixel.
+__attribute__((target("sse4.1")))
+static inline __m128i paletteIndices4SSE41(__m128i pixels, __m128i reciprocal, __m128i weights) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_mulhi_epu16(_mm_unpacklo_epi8(pixels, zero), reciprocal);
+    __m128i hi = _mm_mulhi_epu16(_mm_unpackhi_epi8(pixels, zero), reciprocal);
+    return _mm_hadd_epi32(_mm_madd_epi16(lo, weights), _mm_madd_epi16(hi, weights));
+}
+
+template <typename Format>
+__attribute__((target("sse4.1")))
+static void paletteIndexRowSSE41(const uint8_t* src, uint8_t* dst, int width, const QuantizationTable& table) {
+    const short levels = static_cast<short>(1 << table.quantizationBits);
+    const __m128i reciprocal = _mm_set1_epi16(static_cast<short>(table.reciprocal));
+    const __m128i weights = _mm_setr_epi16(1, levels, levels * levels, 0, 1, levels, levels * levels, 0);
+
+    // 24-bit pixels are spread into 32-bit slots; the fourth byte of each slot is zero.
+    // Four 16-byte loads cover 16 pixels, and the last one reads 4 bytes past them, hence the wider bound.
+    const __m128i spread = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const int margin = Format::bytesPerPixel == 3 ? 2 : 0;
+
+    int x = 0;
+    for (; x + 16 + margin <= width; x += 16) {
+        const uint8_t* block = src + x * Format::bytesPerPixel;
+        __m128i indices[4];
+        for (int k = 0; k < 4; ++k) {
+            __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + k * 4 * Format::bytesPerPixel));
+            if (Format::bytesPerPixel == 3) {
+                pixels = _mm_shuffle_epi8(pixels, spread);
+            }
+            indices[k] = paletteIndices4SSE41(pixels, reciprocal, weights);
+        }
+        __m128i packed = _mm_packus_epi16(_mm_packs_epi32(indices[0], indices[1]), _mm_packs_epi32(indices[2], indices[3]));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), packed);
+    }
+    paletteIndexRowScalar<Format>(src + x * Format::bytesPerPixel, dst + x, width - x, table);
+}
+
+__attribute__((target("sse4.1")))
+static void packNibblesSSE41(const uint8_t* indices, uint8_t* dst, int width) {
+    // maddubs forms first * 16 + second for every byte pair; 32 indices become 16 bytes
+    const __m128i pairWeights = _mm_set1_epi16(0x0110);
+    int x = 0;
+    for (; x + 32 <= width; x += 32) {
+        __m128i lo = _mm_maddubs_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(indices + x)), pairWeights);
+        __m128i hi = _mm_maddubs_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(indices + x + 16)), pairWeights);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x / 2), _mm_packus_epi16(lo, hi));
+    }
+    packNibblesScalar(indices + x, dst + x / 2, width - x);
+}
+
+#endif // BMP_SIMD_X86
+
+PaletteIndexRowKernel paletteIndexRowKernelFor(SimdLevel level, int bytesPerPixel) {
+    PaletteIndexRowKernel kernel = nullptr;
+    dispatchPixelFormat(bytesPerPixel * 8, [&](auto format) {
+        using Format = decltype(format);
+        if constexpr (Format::bytesPerPixel >= 3) {
+            kernel = paletteIndexRowScalar<Format>;
+#if defined(BMP_SIMD_X86)
+            // One 128-bit kernel serves every x86 level: the work is dominated by the shuffles
+            if (level == SIMD_SSE41 || level == SIMD_AVX2 || level == SIMD_AVX512) {
+                kernel = paletteIndexRowSSE41<Format>;
+            }
+#endif
+        }
+    });
+    (void)level;
+    return kernel;
+}
+
+PaletteIndexRowKernel paletteIndexRowKernel(int bytesPerPixel) {
+    return paletteIndexRowKernelFor(simdLevel(), bytesPerPixel);
+}
+
+PackNibblesKernel packNibblesKernelFor(SimdLevel level) {
+#if defined(BMP_SIMD_X86)
+    if (level == SIMD_SSE41 || level == SIMD_AVX2 || level == SIMD_AVX512) {
+        return packNibblesSSE41;
+    }
+#endif
+    (void)level;
+    return packNibblesScalar;
+}
+
+PackNibblesKernel packNibblesKernel() {
+    return packNibblesKernelFor(simdLevel());
+}
+
+// ---------------------------------------------------------------------------
+// Run detection
+// ---------------------------------------------------------------------------
+
+static int matchLengthScalar(const uint8_t* a, const uint8_t* b, int maxLength) {
+    int length = 0;
+    while (length < maxLength && a[length] == b[length]) {
+        ++length;
+    }
+    return length;
+}
+
+#if defined(BMP_SIMD_X86)
+
+// 16 bytes per compare; the first clear bit of the equality mask is the first mismatch
+__attribute__((target("sse4.1")))
+static int matchLengthSSE41(const uint8_t* a, const uint8_t* b, int maxLength) {
+    int length = 0;
+    for (; length + 16 <= maxLength; length += 16) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + length));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + length));
+        unsigned mismatches = ~static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(va, vb))) & 0xFFFFu;
+        if (mismatches != 0) {
+            return length + __builtin_ctz(mismatches);
+        }
+    }
+    return length + matchLengthScalar(a + length, b + length, maxLength - length);
+}
+
+__attribute__((target("avx2")))
+static int matchLengthAVX2(const uint8_t* a, const uint8_t* b, int maxLength) {
+    int length = 0;
+    for (; length + 32 <= maxLength; length += 32) {
+        __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + length));
+        __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + length));
+        unsigned mismatches = ~static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(va, vb)));
+        if (mismatches != 0) {
+            return length + __builtin_ctz(mismatches);
+        }
+    }
+    return length + matchLengthSSE41(a + length, b + length, maxLength - length);
+}
+
+#endif // BMP_SIMD_X86
+
+#if defined(BMP_SIMD_NEON)
+
+static int matchLengthNEON(const uint8_t* a, const uint8_t* b, int maxLength) {
+    int length = 0;
+    for (; length + 16 <= maxLength; length += 16) {
+        // Narrow the byte mask to 4 bits per lane; the first zero nibble is the first mismatch
+        uint8x16_t equal = vceqq_u8(vld1q_u8(a + length), vld1q_u8(b + length));
+        uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(equal), 4)), 0);
+        if (mask != ~uint64_t(0)) {
+            return length + __builtin_ctzll(~mask) / 4;
+        }
+    }
+    return length + matchLengthScalar(a + length, b + length, maxLength - length);
+}
+
+#endif // BMP_SIMD_NEON
+
+MatchLengthKernel matchLengthKernelFor(SimdLevel level) {
+    switch (level) {
+#if defined(BMP_SIMD_X86)
+        case SIMD_SSE41:  return matchLengthSSE41;
+        case SIMD_AVX2:
+        case SIMD_AVX512: return matchLengthAVX2;
+#endif
+#if defined(BMP_SIMD_NEON)
+        case SIMD_NEON:   return matchLengthNEON;
+#endif
+        default:          return matchLengthScalar;
+    }
+}
+
+MatchLengthKernel matchLengthKernel() {
+    return matchLengthKernelFor(simdLevel());
+}
+
+// ---------------------------------------------------------------------------
+// Resampling
+// ---------------------------------------------------------------------------
+
+// Round a fixed-point sum and clamp it to a byte
+static inline uint8_t resampleClamp(int sum) {
+    int value = (sum + (1 << (RESAMPLE_WEIGHT_BITS - 1))) >> RESAMPLE_WEIGHT_BITS;
+    return static_cast<uint8_t>(value < 0 ? 0 : (value > 255 ? 255 : value));
+}
+
+template <typename Format>
+static void horizontalResampleScalar(const uint8_t* src, uint8_t* dst, int outputWidth, const int32_t* first, const int16_t* weights, int tapCount) {
+    constexpr int bpp = Format::bytesPerPixel;
+    for (int i = 0; i < outputWidth; ++i) {
+        const uint8_t* pixel = src + first[i] * bpp;
+        const int16_t* weight = weights + static_cast<ptrdiff_t>(i) * tapCount;
+        int sums[bpp] = {};
+        for (int t = 0; t < tapCount; ++t) {
+            for (int c = 0; c < bpp; ++c) {
+                sums[c] += weight[t] * pixel[t * bpp + c];
+            }
+        }
+        for (int c = 0; c < bpp; ++c) {
+            dst[i * bpp + c] = resampleClamp(sums[c]);
+        }
+    }
+}
+
+// Scalar tail of the vertical kernels: bytes [firstByte, byteCount)
+static void verticalResampleBytesScalar(const uint8_t* const* rows, const int16_t* weights, int tapCount, uint8_t* dst, int firstByte, int byteCount) {
+    for (int i = firstByte; i < byteCount; ++i) {
+        int sum = 0;
+        for (int t = 0; t < tapCount; ++t) {
+            sum += weights[t] * rows[t][i];
+        }
+        dst[i] = resampleClamp(sum);
+    }
+}
+
+static void verticalResampleScalar(const uint8_t* const* rows, const int16_t* weights, int tapCount, uint8_t* dst, int byteCount) {
+    verticalResampleBytesScalar(rows, weights, tapCount, dst, 0, byteCount);
+}
+
+#if defined(BMP_SIMD_X86)
+
+// Load exactly `count` bytes (3, 4, 6 or 8) into the low bytes of a register. Odd sizes are assembled
+// from two loads; a partial memcpy into a stack word would stall on store forwarding at every tap.
+template <int count>
+static inline uint64_t loadResampleBytes(const uint8_t* p) {
+    if constexpr (count == 8 || count == 4) {
+        typename conditional<count == 8, uint64_t, uint32_t>::type value;
+        memcpy(&value, p, count);
+        return value;
+    } else {
+        constexpr int low = count == 6 ? 4 : 2;
+        typename conditional<count == 6, uint32_t, uint16_t>::type head;
+        typename conditional<count == 6, uint16_t, uint8_t>::type tail;
+        memcpy(&head, p, low);
+        memcpy(&tail, p + low, count - low);
+        return head | (static_cast<uint64_t>(tail) << (low * 8));
+    }
+}
+
+// Two taps per madd: the channels of pixels t and t + 1 are interleaved into (t, t + 1) 16-bit pairs,
+// so one pmaddwd against the repeated weight pair yields a 32-bit partial sum per channel.
+// Loads copy exactly the tap pixels (an odd last tap pairs with zeros), never reading beyond them.
+template <typename Format>
+__attribute__((target("sse4.1")))
+static void horizontalResampleSSE41(const uint8_t* src, uint8_t* dst, int outputWidth, const int32_t* first, const int16_t* weights, int tapCount) {
+    constexpr int bpp = Format::bytesPerPixel;
+    const __m128i interleave = bpp == 4 ? _mm_setr_epi8(0, 4, 1, 5, 2, 6, 3, 7, -1, -1, -1, -1, -1, -1, -1, -1)
+                                        : _mm_setr_epi8(0, 3, 1, 4, 2, 5, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m128i rounding = _mm_set1_epi32(1 << (RESAMPLE_WEIGHT_BITS - 1));
+    for (int i = 0; i < outputWidth; ++i) {
+        const uint8_t* pixel = src + first[i] * bpp;
+        const int16_t* weight = weights + static_cast<ptrdiff_t>(i) * tapCount;
+        __m128i sums = rounding;
+        int t = 0;
+        for (; t < tapCount; t += 2) {
+            bool paired = t + 1 < tapCount;
+            uint64_t bytes = paired ? loadResampleBytes<2 * bpp>(pixel + t * bpp) : loadResampleBytes<bpp>(pixel + t * bpp);
+            uint16_t nextWeight = paired ? static_cast<uint16_t>(weight[t + 1]) : 0;
+            __m128i pair = _mm_cvtepu8_epi16(_mm_shuffle_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(&bytes)), interleave));
+            __m128i weightPair = _mm_set1_epi32(static_cast<int>(static_cast<uint16_t>(weight[t]) | (static_cast<uint32_t>(nextWeight) << 16)));
+            sums = _mm_add_epi32(sums, _mm_madd_epi16(pair, weightPair));
+        }
+        __m128i packed = _mm_packus_epi16(_mm_packs_epi32(_mm_srai_epi32(sums, RESAMPLE_WEIGHT_BITS), _mm_setzero_si128()), _mm_setzero_si128());
+        uint32_t result = static_cast<uint32_t>(_mm_cvtsi128_si32(packed));
+        memcpy(dst + i * bpp, &result, bpp);
+    }
+}
+
+// 16 bytes per step: bytes of rows t and t + 1 are interleaved and widened to 16-bit pairs, then
+// four pmaddwd per tap pair accumulate 32-bit sums that are rounded, shifted and packed with saturation
+__attribute__((target("sse4.1")))
+static void verticalResampleSSE41(const uint8_t* const* rows, const int16_t* weights, int tapCount, uint8_t* dst, int byteCount) {
+    const __m128i rounding = _mm_set1_epi32(1 << (RESAMPLE_WEIGHT_BITS - 1));
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 16 <= byteCount; i += 16) {
+        __m128i sums[4] = { rounding, rounding, rounding, rounding };
+        for (int t = 0; t < tapCount; t += 2) {
+            bool paired = t + 1 < tapCount;
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[t] + i));
+            __m128i b = paired ? _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[t + 1] + i)) : zero;
+            uint16_t nextWeight = paired ? static_cast<uint16_t>(weights[t + 1]) : 0;
+            __m128i weightPair = _mm_set1_epi32(static_cast<int>(static_cast<uint16_t>(weights[t]) | (static_cast<uint32_t>(nextWeight) << 16)));
+            __m128i lo = _mm_unpacklo_epi8(a, b);
+            __m128i hi = _mm_unpackhi_epi8(a, b);
+            sums[0] = _mm_add_epi32(sums[0], _mm_madd_epi16(_mm_unpacklo_epi8(lo, zero), weightPair));
+            sums[1] = _mm_add_epi32(sums[1], _mm_madd_epi16(_mm_unpackhi_epi8(lo, zero), weightPair));
+            sums[2] = _mm_add_epi32(sums[2], _mm_madd_epi16(_mm_unpacklo_epi8(hi, zero), weightPair));
+            sums[3] = _mm_add_epi32(sums[3], _mm_madd_epi16(_mm_unpackhi_epi8(hi, zero), weightPair));
+        }
+        __m128i lo16 = _mm_packs_epi32(_mm_srai_epi32(sums[0], RESAMPLE_WEIGHT_BITS), _mm_srai_epi32(sums[1], RESAMPLE_WEIGHT_BITS));
+        __m128i hi16 = _mm_packs_epi32(_mm_srai_epi32(sums[2], RESAMPLE_WEIGHT_BITS), _mm_srai_epi32(sums[3], RESAMPLE_WEIGHT_BITS));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(lo16, hi16));
+    }
+    verticalResampleBytesScalar(rows, weights, tapCount, dst, i, byteCount);
+}
+
+// Same scheme on 32 bytes: unpack works per 128-bit lane, and so does pack, so the byte order survives
+__attribute__((target("avx2")))
+static void verticalResampleAVX2(const uint8_t* const* rows, const int16_t* weights, int tapCount, uint8_t* dst, int byteCount) {
+    const __m256i rounding = _mm256_set1_epi32(1 << (RESAMPLE_WEIGHT_BITS - 1));
+    const __m256i zero = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 32 <= byteCount; i += 32) {
+        __m256i sums[4] = { rounding, rounding, rounding, rounding };
+        for (int t = 0; t < tapCount; t += 2) {
+            bool paired = t + 1 < tapCount;
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[t] + i));
+            __m256i b = paired ? _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows[t + 1] + i)) : zero;
+            uint16_t nextWeight = paired ? static_cast<uint16_t>(weights[t + 1]) : 0;
+            __m256i weightPair = _mm256_set1_epi32(static_cast<int>(static_cast<uint16_t>(weights[t]) | (static_cast<uint32_t>(nextWeight) << 16)));
+            __m256i lo = _mm256_unpacklo_epi8(a, b);
+            __m256i hi = _mm256_unpackhi_epi8(a, b);
+            sums[0] = _mm256_add_epi32(sums[0], _mm256_madd_epi16(_mm256_unpacklo_epi8(lo, zero), weightPair));
+            sums[1] = _mm256_add_epi32(sums[1], _mm256_madd_epi16(_mm256_unpackhi_epi8(lo, zero), weightPair));
+            sums[2] = _mm256_add_epi32(sums[2], _mm256_madd_epi16(_mm256_unpacklo_epi8(hi, zero), weightPair));
+            sums[3] = _mm256_add_epi32(sums[3], _mm256_madd_epi16(_mm256_unpackhi_epi8(hi, zero), weightPair));
+        }
+        __m256i lo16 = _mm256_packs_epi32(_mm256_srai_epi32(sums[0], RESAMPLE_WEIGHT_BITS), _mm256_srai_epi32(sums[1], RESAMPLE_WEIGHT_BITS));
+        __m256i hi16 = _mm256_packs_epi32(_mm256_srai_epi32(sums[2], RESAMPLE_WEIGHT_BITS), _mm256_srai_epi32(sums[3], RESAMPLE_WEIGHT_BITS));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_packus_epi16(lo16, hi16));
+    }
+    verticalResampleBytesScalar(rows, weights, tapCount, dst, i, byteCount);
+}
+
+#endif // BMP_SIMD_X86
+
+#if defined(BMP_SIMD_NEON)
+
+// Widen 16 bytes per row to 16-bit lanes and multiply-accumulate into four 32-bit vectors;
+// vqrshrn rounds, shifts and saturates in one step
+static void verticalResampleNEON(const uint8_t* const* rows, const int16_t* weights, int tapCount, uint8_t* dst, int byteCount) {
+    int i = 0;
+    for (; i + 16 <= byteCount; i += 16) {
+        int32x4_t sums[4] = { vdupq_n_s32(0), vdupq_n_s32(0), vdupq_n_s32(0), vdupq_n_s32(0) };
+        for (int t = 0; t < tapCount; ++t) {
+            uint8x16_t bytes = vld1q_u8(rows[t] + i);
+            int16x8_t lo = vreinterpretq_s16_u16(vmovl_u8(vget_low_u8(bytes)));
+            int16x8_t hi = vreinterpretq_s16_u16(vmovl_u8(vget_high_u8(bytes)));
+            sums[0] = vmlal_n_s16(sums[0], vget_low_s16(lo), weights[t]);
+            sums[1] = vmlal_n_s16(sums[1], vget_high_s16(lo), weights[t]);
+            sums[2] = vmlal_n_s16(sums[2], vget_low_s16(hi), weights[t]);
+            sums[3] = vmlal_n_s16(sums[3], vget_high_s16(hi), weights[t]);
+        }
+        int16x8_t lo16 = vcombine_s16(vqrshrn_n_s32(sums[0], RESAMPLE_WEIGHT_BITS), vqrshrn_n_s32(sums[1], RESAMPLE_WEIGHT_BITS));
+        int16x8_t hi16 = vcombine_s16(vqrshrn_n_s32(sums[2], RESAMPLE_WEIGHT_BITS), vqrshrn_n_s32(sums[3], RESAMPLE_WEIGHT_BITS));
+        vst1q_u8(dst + i, vcombine_u8(vqmovun_s16(lo16), vqmovun_s16(hi16)));
+    }
+    verticalResampleBytesScalar(rows, weights, tapCount, dst, i, byteCount);
+}
+
+#endif // BMP_SIMD_NEON
+
+HorizontalResampleKernel horizontalResampleKernelFor(SimdLevel level, int bytesPerPixel) {
+    HorizontalResampleKernel kernel = nullptr;
+    dispatchPixelFormat(bytesPerPixel * 8, [&](auto format) {
+        using Format = decltype(format);
+        if constexpr (Format::bytesPerPixel >= 3) {
+            kernel = horizontalResampleScalar<Format>;
+#if defined(BMP_SIMD_X86)
+            // One pixel per iteration fits a 128-bit register at every x86 level
+            if (level == SIMD_SSE41 || level == SIMD_AVX2 || level == SIMD_AVX512) {
+                kernel = horizontalResampleSSE41<Format>;
+            }
+#endif
+        }
+    });
+    (void)level;
+    return kernel;
+}
+
+HorizontalResampleKernel horizontalResampleKernel(int bytesPerPixel) {
+    return horizontalResampleKernelFor(simdLevel(), bytesPerPixel);
+}
+
+VerticalResampleKernel verticalResampleKernelFor(SimdLevel level) {
+    switch (level) {
+#if defined(BMP_SIMD_X86)
+        case SIMD_SSE41:  return verticalResampleSSE41;
+        case SIMD_AVX2:
+        case SIMD_AVX512: return verticalResampleAVX2;
+#endif
+#if defined(BMP_SIMD_NEON)
+        case SIMD_NEON:   return verticalResampleNEON;
+#endif
+        default:          return verticalResampleScalar;
+    }
+}
+
+VerticalResampleKernel verticalResampleKernel() {
+    return verticalResampleKernelFor(simdLevel());
+}
+
+// ---------------------------------------------------------------------------
+// Planar conversion
+// ---------------------------------------------------------------------------
+
+template <typename Format>
+static void deinterleaveRowScalar(const uint8_t* src, uint8_t* const* planes, int width) {
+    constexpr int bpp = Format::bytesPerPixel;
+    for (int x = 0; x < width; ++x) {
+        planes[0][x] = src[x * bpp];
+        planes[1][x] = src[x * bpp + 1];
+        planes[2][x] = src[x * bpp + 2];
+    }
+    if (Format::hasAlpha && planes[3] != nullptr) {
+        for (int x = 0; x < width; ++x) {
+            planes[3][x] = src[x * bpp + 3];
+        }
+    }
+}
+
+template <typename Format>
+static void interleaveRowScalar(const uint8_t* const* planes, uint8_t* dst, int width) {
+    constexpr int bpp = Format::bytesPerPixel;
+    for (int x = 0; x < width; ++x) {
+        dst[x * bpp] = planes[0][x];
+        dst[x * bpp + 1] = planes[1][x];
+        dst[x * bpp + 2] = planes[2][x];
+    }
+    if (Format::hasAlpha && planes[3] != nullptr) {
+        for (int x = 0; x < width; ++x) {
+            dst[x * bpp + 3] = planes[3][x];
+        }
+    }
+}
+
+#if defined(BMP_SIMD_X86)
+
+// Byte shuffles between 16 interleaved 24-bit pixels (three vectors) and 16 bytes of each plane.
+// deinterleave[c][v] gathers the channel-c bytes held by source vector v into their plane positions;
+// interleave[v][c] scatters plane c into the positions of output vector v. -1 lanes are zeroed, so each
+// result is the OR of three shuffles.
+struct Rgb24ShuffleMasks {
+    alignas(16) int8_t deinterleave[3][3][16];
+    alignas(16) int8_t interleave[3][3][16];
+
+    Rgb24ShuffleMasks() {
+        for (int c = 0; c < 3; ++c) {
+            for (int v = 0; v < 3; ++v) {
+                for (int k = 0; k < 16; ++k) {
+                    int sourceByte = 3 * k + c;
+                    deinterleave[c][v][k] = static_cast<int8_t>(sourceByte / 16 == v ? sourceByte % 16 : -1);
+                    int outputByte = 16 * v + k;
+                    interleave[v][c][k] = static_cast<int8_t>(outputByte % 3 == c ? outputByte / 3 : -1);
+                }
+            }
+        }
+    }
+};
+
+static const Rgb24ShuffleMasks& rgb24ShuffleMasks() {
+    static const Rgb24ShuffleMasks masks;
+    return masks;
+}
+
+__attribute__((target("sse4.1")))
+static inline __m128i loadMask(const int8_t* mask) {
+    return _mm_load_si128(reinterpret_cast<const __m128i*>(mask));
+}
+
+template <typename Format>
+__attribute__((target("sse4.1")))
+static void deinterleaveRowSSE41(const uint8_t* src, uint8_t* const* planes, int width) {
+    int x = 0;
+    if (Format::bytesPerPixel == 3) {
+        const Rgb24ShuffleMasks& masks = rgb24ShuffleMasks();
+        __m128i shuffles[3][3];
+        for (int c = 0; c < 3; ++c) {
+            for (int v = 0; v < 3; ++v) {
+                shuffles[c][v] = loadMask(masks.deinterleave[c][v]);
+            }
+        }
+        for (; x + 16 <= width; x += 16) {
+            const uint8_t* block = src + x * 3;
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16));
+            __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 32));
+            for (int c = 0; c < 3; ++c) {
+                __m128i plane = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, shuffles[c][0]), _mm_shuffle_epi8(b, shuffles[c][1])),
+                                             _mm_shuffle_epi8(d, shuffles[c][2]));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(planes[c] + x), plane);
+            }
+        }
+    } else {
+        // Group each channel of 4 pixels into one 32-bit lane, then transpose the 4x4 lanes of 16 pixels
+        const __m128i group = _mm_setr_epi8(0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15);
+        for (; x + 16 <= width; x += 16) {
+            const uint8_t* block = src + x * 4;
+            __m128i p0 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block)), group);
+            __m128i p1 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16)), group);
+            __m128i p2 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 32)), group);
+            __m128i p3 = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 48)), group);
+            __m128i blueGreen01 = _mm_unpacklo_epi32(p0, p1);
+            __m128i blueGreen23 = _mm_unpacklo_epi32(p2, p3);
+            __m128i redAlpha01 = _mm_unpackhi_epi32(p0, p1);
+            __m128i redAlpha23 = _mm_unpackhi_epi32(p2, p3);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(planes[0] + x), _mm_unpacklo_epi64(blueGreen01, blueGreen23));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(planes[1] + x), _mm_unpackhi_epi64(blueGreen01, blueGreen23));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(planes[2] + x), _mm_unpacklo_epi64(redAlpha01, redAlpha23));
+            if (planes[3] != nullptr) {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(planes[3] + x), _mm_unpackhi_epi64(redAlpha01, redAlpha23));
+            }
+        }
+    }
+    uint8_t* const rest[4] = { planes[0] + x, planes[1] + x, planes[2] + x, Format::hasAlpha && planes[3] ? planes[3] + x : nullptr };
+    deinterleaveRowScalar<Format>(src + x * Format::bytesPerPixel, rest, width - x);
+}
+
+template <typename Format>
+__attribute__((target("sse4.1")))
+static void interleaveRowSSE41(const uint8_t* const* planes, uint8_t* dst, int width) {
+    int x = 0;
+    if (Format::bytesPerPixel == 3) {
+        const Rgb24ShuffleMasks& masks = rgb24ShuffleMasks();
+        __m128i shuffles[3][3];
+        for (int v = 0; v < 3; ++v) {
+            for (int c = 0; c < 3; ++c) {
+                shuffles[v][c] = loadMask(masks.interleave[v][c]);
+            }
+        }
+        for (; x + 16 <= width; x += 16) {
+            __m128i blue = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes[0] + x));
+            __m128i green = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes[1] + x));
+            __m128i red = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes[2] + x));
+            uint8_t* block = dst + x * 3;
+            for (int v = 0; v < 3; ++v) {
+                __m128i pixels = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(blue, shuffles[v][0]), _mm_shuffle_epi8(green, shuffles[v][1])),
+                                              _mm_shuffle_epi8(red, shuffles[v][2]));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(block + 16 * v), pixels);
+            }
+        }
+    } else {
+        // Byte then word unpacks rebuild BGRA; without an alpha plane the destination's alpha is blended back in
+        const __m128i alphaMask = _mm_set1_epi32(static_cast<int>(0xFF000000u));
+        bool keepAlpha = planes[3] == nullptr;
+        for (; x + 16 <= width; x += 16) {
+            __m128i blue = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes[0] + x));
+            __m128i green = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes[1] + x));
+            __m128i red = _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes[2] + x));
+            __m128i alpha = keepAlpha ? _mm_setzero_si128() : _mm_loadu_si128(reinterpret_cast<const __m128i*>(planes[3] + x));
+            __m128i blueGreenLo = _mm_unpacklo_epi8(blue, green);
+            __m128i blueGreenHi = _mm_unpackhi_epi8(blue, green);
+            __m128i redAlphaLo = _mm_unpacklo_epi8(red, alpha);
+            __m128i redAlphaHi = _mm_unpackhi_epi8(red, alpha);
+            __m128i pixels[4] = {
+                _mm_unpacklo_epi16(blueGreenLo, redAlphaLo), _mm_unpackhi_epi16(blueGreenLo, redAlphaLo),
+                _mm_unpacklo_epi16(blueGreenHi, redAlphaHi), _mm_unpackhi_epi16(blueGreenHi, redAlphaHi)
+            };
+            uint8_t* block = dst + x * 4;
+            for (int k = 0; k < 4; ++k) {
+                __m128i* out = reinterpret_cast<__m128i*>(block + 16 * k);
+                if (keepAlpha) {
+                    pixels[k] = _mm_blendv_epi8(pixels[k], _mm_loadu_si128(out), alphaMask);
+                }
+                _mm_storeu_si128(out, pixels[k]);
+            }
+        }
+    }
+    const uint8_t* const rest[4] = { planes[0] + x, planes[1] + x, planes[2] + x, Format::hasAlpha && planes[3] ? planes[3] + x : nullptr };
+    interleaveRowScalar<Format>(rest, dst + x * Format::bytesPerPixel, width - x);
+}
+
+#endif // BMP_SIMD_X86
+
+#if defined(BMP_SIMD_NEON)
+
+// vld3/vld4 and vst3/vst4 (de)interleave 16 pixels in one instruction each
+template <typename Format>
+static void deinterleaveRowNEON(const uint8_t* src, uint8_t* const* planes, int width) {
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        if (Format::bytesPerPixel == 3) {
+            uint8x16x3_t pixels = vld3q_u8(src + x * 3);
+            for (int c = 0; c < 3; ++c) {
+                vst1q_u8(planes[c] + x, pixels.val[c]);
+            }
+        } else {
+            uint8x16x4_t pixels = vld4q_u8(src + x * 4);
+            for (int c = 0; c < 3; ++c) {
+                vst1q_u8(planes[c] + x, pixels.val[c]);
+            }
+            if (planes[3] != nullptr) {
+                vst1q_u8(planes[3] + x, pixels.val[3]);
+            }
+        }
+    }
+    uint8_t* const rest[4] = { planes[0] + x, planes[1] + x, planes[2] + x, Format::hasAlpha && planes[3] ? planes[3] + x : nullptr };
+    deinterleaveRowScalar<Format>(src + x * Format::bytesPerPixel, rest, width - x);
+}
+
+template <typename Format>
+static void interleaveRowNEON(const uint8_t* const* planes, uint8_t* dst, int width) {
+    int x = 0;
+    for (; x + 16 <= width; x += 16) {
+        if (Format::bytesPerPixel == 3) {
+            uint8x16x3_t pixels;
+            for (int c = 0; c < 3; ++c) {
+                pixels.val[c] = vld1q_u8(planes[c] + x);
+            }
+            vst3q_u8(dst + x * 3, pixels);
+        } else {
+            // Without an alpha plane the destination's alpha bytes are loaded and stored back unchanged
+            uint8x16x4_t pixels;
+            pixels.val[3] = planes[3] != nullptr ? vld1q_u8(planes[3] + x) : vld4q_u8(dst + x * 4).val[3];
+            for (int c = 0; c < 3; ++c) {
+                pixels.val[c] = vld1q_u8(planes[c] + x);
+            }
+            vst4q_u8(dst + x * 4, pixels);
+        }
+    }
+    const uint8_t* const rest[4] = { planes[0] + x, planes[1] + x, planes[2] + x, Format::hasAlpha && planes[3] ? planes[3] + x : nullptr };
+    interleaveRowScalar<Format>(rest, dst + x * Format::bytesPerPixel, width - x);
+}
+
+#endif // BMP_SIMD_NEON
+
+DeinterleaveRowKernel deinterleaveRowKernelFor(SimdLevel level, int bytesPerPixel) {
+    DeinterleaveRowKernel kernel = nullptr;
+    dispatchPixelFormat(bytesPerPixel * 8, [&](auto format) {
+        using Format = decltype(format);
+        if constexpr (Format::bytesPerPixel >= 3) {
+            kernel = deinterleaveRowScalar<Format>;
+#if defined(BMP_SIMD_X86)
+            // The shuffles work within 128-bit lanes, so one kernel serves every x86 level
+            if (level == SIMD_SSE41 || level == SIMD_AVX2 || level == SIMD_AVX512) {
+                kernel = deinterleaveRowSSE41<Format>;
+            }
+#endif
+#if defined(BMP_SIMD_NEON)
+            if (level == SIMD_NEON) {
+                kernel = deinterleaveRowNEON<Format>;
+            }
+#endif
+        }
+    });
+    (void)level;
+    return kernel;
+}
+
+DeinterleaveRowKernel deinterleaveRowKernel(int bytesPerPixel) {
+    return deinterleaveRowKernelFor(simdLevel(), bytesPerPixel);
+}
+
+InterleaveRowKernel interleaveRowKernelFor(SimdLevel level, int bytesPerPixel) {
+    InterleaveRowKernel kernel = nullptr;
+    dispatchPixelFormat(bytesPerPixel * 8, [&](auto format) {
+        using Format = decltype(format);
+        if constexpr (Format::bytesPerPixel >= 3) {
+            kernel = interleaveRowScalar<Format>;
+#if defined(BMP_SIMD_X86)
+            if (level == SIMD_SSE41 || level == SIMD_AVX2 || level == SIMD_AVX512) {
+                kernel = interleaveRowSSE41<Format>;
+            }
+#endif
+#if defined(BMP_SIMD_NEON)
+            if (level == SIMD_NEON) {
+                kernel = interleaveRowNEON<Format>;
+            }
+#endif
+        }
+    });
+    (void)level;
+    return kernel;
+}
+
+InterleaveRowKernel interleaveRowKernel(int bytesPerPixel) {
+    return interleaveRowKernelFor(simdLevel(), bytesPerPixel);
+}
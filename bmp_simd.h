@@ -0,0 +1,116 @@
+#ifndef BMP_SIMD_H
+#define BMP_SIMD_H
+
+#include <cstdint>
+
+// Instruction-set levels the vector kernels are compiled for, from least to most capable.
+enum SimdLevel {
+    SIMD_SCALAR,
+    SIMD_SSE41,
+    SIMD_AVX2,
+    SIMD_AVX512,
+    SIMD_NEON
+};
+
+// Best SIMD level supported by this CPU, detected once at first use.
+// Setting BMP_SIMD=scalar|sse4.1|avx2|avx512|neon lowers it to a specific level (never above what the CPU supports).
+SimdLevel simdLevel();
+
+// Printable name of a SIMD level, e.g. "avx2".
+const char* simdLevelName(SimdLevel level);
+
+/**
+ * Precomputed quantization parameters for one bit depth.
+ * `table` maps every 8-bit value to its quantized value; `reciprocal` is the 16-bit fixed-point
+ * reciprocal of `factor` used by the vector kernels ((v * reciprocal) >> 16 == v / factor for v <= 255).
+ */
+struct QuantizationTable {
+    int quantizationBits;
+    int factor;
+    uint16_t reciprocal;
+    uint8_t table[256];
+};
+
+// Build the lookup table for a target bit depth (1..8) once, before touching any pixel.
+void buildQuantizationTable(int quantizationBits, QuantizationTable& table);
+
+// Row kernel: quantize the color bytes of `width` pixels from `src` into `dst` (may alias for in-place use).
+// Alpha bytes of 32-bit pixels are copied unchanged; row padding is not touched.
+// Kernels are specialized per pixel format (see bmp_pixel_format.h), so they only handle the
+// `bytesPerPixel` they were selected for; the argument is kept for the uniform signature.
+typedef void (*QuantizeRowKernel)(const uint8_t* src, uint8_t* dst, int width, int bytesPerPixel, const QuantizationTable& table);
+
+// Best quantization row kernel for `table` and this pixel size on this CPU (uses the cached simdLevel()).
+// Select it once per image; the scalar fallback is also specialized on the table's bit depth.
+QuantizeRowKernel quantizeRowKernel(const QuantizationTable& table, int bytesPerPixel);
+
+// Quantization row kernel for an explicit level; falls back to scalar if the level is not compiled in.
+QuantizeRowKernel quantizeRowKernelFor(SimdLevel level, const QuantizationTable& table, int bytesPerPixel);
+
+// Row kernel: reverse the order of the `width` pixels of one row in place (1-, 3- or 4-byte pixels).
+// Like the quantization kernels, each one is specialized for a single pixel size.
+typedef void (*FlipRowKernel)(uint8_t* row, int width, int bytesPerPixel);
+
+// Best horizontal flip row kernel for this pixel size on this CPU, or nullptr for an unsupported size.
+FlipRowKernel flipRowKernel(int bytesPerPixel);
+
+// Horizontal flip row kernel for an explicit level; falls back to scalar if the level is not compiled in.
+FlipRowKernel flipRowKernelFor(SimdLevel level, int bytesPerPixel);
+
+// Row kernel: write the uniform-palette index of each of `width` pixels into `dst`, one byte per pixel.
+// Every channel is reduced to its level v / factor, and the index is blue + green * L + red * L^2
+// with L = 2^quantizationBits levels, so it only fits a byte for quantizationBits <= 2. Alpha is ignored.
+typedef void (*PaletteIndexRowKernel)(const uint8_t* src, uint8_t* dst, int width, const QuantizationTable& table);
+
+// Best palette index kernel for this pixel size (3 or 4 bytes), or nullptr for other sizes.
+PaletteIndexRowKernel paletteIndexRowKernel(int bytesPerPixel);
+PaletteIndexRowKernel paletteIndexRowKernelFor(SimdLevel level, int bytesPerPixel);
+
+// Row kernel: pack `width` 4-bit indices (one per byte) two per byte, first pixel in the high nibble.
+typedef void (*PackNibblesKernel)(const uint8_t* indices, uint8_t* dst, int width);
+
+PackNibblesKernel packNibblesKernel();
+PackNibblesKernel packNibblesKernelFor(SimdLevel level);
+
+// Number of leading bytes that `a` and `b` have in common, at most `maxLength`. The ranges may overlap,
+// so a run of period p starting at `row` is p + matchLength(row + p, row, ...) bytes long.
+typedef int (*MatchLengthKernel)(const uint8_t* a, const uint8_t* b, int maxLength);
+
+MatchLengthKernel matchLengthKernel();
+MatchLengthKernel matchLengthKernelFor(SimdLevel level);
+
+// Fixed-point precision of the resampling weights: the weights of every output sample sum to 1 << RESAMPLE_WEIGHT_BITS.
+const int RESAMPLE_WEIGHT_BITS = 14;
+
+// Row kernel: horizontal resampling pass. Output pixel i is the sum of the `tapCount` pixels of `src`
+// starting at pixel first[i], weighted by weights[i * tapCount + t], rounded and clamped to 0..255 for
+// every channel (alpha included). All taps must lie inside the source row; nothing past them is read.
+typedef void (*HorizontalResampleKernel)(const uint8_t* src, uint8_t* dst, int outputWidth, const int32_t* first, const int16_t* weights, int tapCount);
+
+// Best horizontal resampling kernel for this pixel size (3 or 4 bytes), or nullptr for other sizes.
+HorizontalResampleKernel horizontalResampleKernel(int bytesPerPixel);
+HorizontalResampleKernel horizontalResampleKernelFor(SimdLevel level, int bytesPerPixel);
+
+// Row kernel: vertical resampling pass. dst[i] is the sum of rows[t][i] over the `tapCount` rows, weighted
+// by weights[t], rounded and clamped, for `byteCount` bytes. Bytes are independent, so any pixel size works.
+typedef void (*VerticalResampleKernel)(const uint8_t* const* rows, const int16_t* weights, int tapCount, uint8_t* dst, int byteCount);
+
+VerticalResampleKernel verticalResampleKernel();
+VerticalResampleKernel verticalResampleKernelFor(SimdLevel level);
+
+// Row kernel: split `width` interleaved pixels of `src` into planes, one byte per pixel each:
+// planes[0..2] receive blue, green and red, and planes[3] the alpha of 32-bit pixels. `planes` always
+// has four entries; planes[3] is ignored for 24-bit pixels and may be null for 32-bit ones, which skips alpha.
+typedef void (*DeinterleaveRowKernel)(const uint8_t* src, uint8_t* const* planes, int width);
+
+// Row kernel: the inverse, merging the planes into `width` interleaved pixels of `dst`. With a null
+// planes[3] the alpha bytes already in a 32-bit `dst` are kept.
+typedef void (*InterleaveRowKernel)(const uint8_t* const* planes, uint8_t* dst, int width);
+
+// Best (de)interleave kernels for this pixel size (3 or 4 bytes), or nullptr for other sizes.
+DeinterleaveRowKernel deinterleaveRowKernel(int bytesPerPixel);
+DeinterleaveRowKernel deinterleaveRowKernelFor(SimdLevel level, int bytesPerPixel);
+InterleaveRowKernel interleaveRowKernel(int bytesPerPixel);
+InterleaveRowKernel interleaveRowKernelFor(SimdLevel level, int bytesPerPixel);
+
+#endif // BMP_SIMD_H
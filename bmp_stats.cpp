@@ -0,0 +1,189 @@
+#include "bmp_stats.h"
+#include "bmp_parallel.h"
+#include "bmp_trace.h"
+
+#include <climits>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+
+using namespace std;
+
+// Serializes the merges of the per-thread accumulators
+static mutex statsMergeMutex;
+
+static const char* const CHANNEL_NAMES[STATS_MAX_CHANNELS] = { "blue", "green", "red", "alpha" };
+
+void ImageStats::reset(int channels) {
+    channelCount = channels;
+    pixelCount = 0;
+    memset(histogram, 0, sizeof(histogram));
+    for (int c = 0; c < STATS_MAX_CHANNELS; ++c) {
+        minimum[c] = 0;
+        maximum[c] = 0;
+        mean[c] = 0.0;
+        standardDeviation[c] = 0.0;
+    }
+}
+
+void ImageStats::merge(const ImageStats& other) {
+    pixelCount += other.pixelCount;
+    for (int c = 0; c < channelCount; ++c) {
+        for (int v = 0; v < 256; ++v) {
+            histogram[c][v] += other.histogram[c][v];
+        }
+    }
+}
+
+void ImageStats::finish() {
+    for (int c = 0; c < channelCount; ++c) {
+        // Extremes are the first and last occupied bins; moments are weighted sums over the bins
+        minimum[c] = 0;
+        maximum[c] = 0;
+        bool seen = false;
+        double sum = 0.0;
+        double squares = 0.0;
+        for (int v = 0; v < 256; ++v) {
+            uint64_t count = histogram[c][v];
+            if (count == 0) {
+                continue;
+            }
+            if (!seen) {
+                minimum[c] = v;
+                seen = true;
+            }
+            maximum[c] = v;
+            sum += static_cast<double>(count) * v;
+            squares += static_cast<double>(count) * v * v;
+        }
+        mean[c] = pixelCount > 0 ? sum / pixelCount : 0.0;
+        double variance = pixelCount > 0 ? squares / pixelCount - mean[c] * mean[c] : 0.0;
+        standardDeviation[c] = sqrt(variance > 0.0 ? variance : 0.0);
+    }
+}
+
+StatsAccumulator::StatsAccumulator(int bytesPerPixel) : bytesPerPixel(bytesPerPixel) {
+    memset(counts, 0, sizeof(counts));
+    totals.reset(bytesPerPixel);
+}
+
+// Even pixels go to counts[0], odd pixels to counts[1]; the channel loop unrolls for a constant pixel size
+template <int bpp>
+static void countRow(const uint8_t* row, int width, uint32_t (&counts)[2][STATS_MAX_CHANNELS][256]) {
+    int x = 0;
+    for (; x + 2 <= width; x += 2) {
+        const uint8_t* pixel = row + static_cast<size_t>(x) * bpp;
+        for (int c = 0; c < bpp; ++c) {
+            ++counts[0][c][pixel[c]];
+            ++counts[1][c][pixel[bpp + c]];
+        }
+    }
+    if (x < width) {
+        const uint8_t* pixel = row + static_cast<size_t>(x) * bpp;
+        for (int c = 0; c < bpp; ++c) {
+            ++counts[0][c][pixel[c]];
+        }
+    }
+}
+
+void StatsAccumulator::addRow(const uint8_t* row, int width) {
+    // No bin can exceed the pixels counted since the last flush
+    if (pendingPixels > UINT32_MAX - static_cast<uint32_t>(width)) {
+        flush();
+    }
+    pendingPixels += static_cast<uint32_t>(width);
+
+    switch (bytesPerPixel) {
+        case 1:  countRow<1>(row, width, counts); break;
+        case 3:  countRow<3>(row, width, counts); break;
+        default: countRow<4>(row, width, counts); break;
+    }
+}
+
+void StatsAccumulator::addPlanarRow(const uint8_t* const* planes, int width) {
+    if (pendingPixels > UINT32_MAX - static_cast<uint32_t>(width)) {
+        flush();
+    }
+    pendingPixels += static_cast<uint32_t>(width);
+
+    // Each plane is one contiguous run of a single channel, alternating between the two histograms
+    for (int c = 0; c < bytesPerPixel; ++c) {
+        const uint8_t* plane = planes[c];
+        if (plane == nullptr) {
+            continue;
+        }
+        int x = 0;
+        for (; x + 2 <= width; x += 2) {
+            ++counts[0][c][plane[x]];
+            ++counts[1][c][plane[x + 1]];
+        }
+        if (x < width) {
+            ++counts[0][c][plane[x]];
+        }
+    }
+}
+
+void StatsAccumulator::flush() {
+    totals.pixelCount += pendingPixels;
+    for (int c = 0; c < bytesPerPixel; ++c) {
+        for (int v = 0; v < 256; ++v) {
+            totals.histogram[c][v] += static_cast<uint64_t>(counts[0][c][v]) + counts[1][c][v];
+        }
+    }
+    memset(counts, 0, sizeof(counts));
+    pendingPixels = 0;
+}
+
+void StatsAccumulator::mergeInto(ImageStats& stats) {
+    flush();
+    lock_guard<mutex> guard(statsMergeMutex);
+    stats.merge(totals);
+}
+
+void computeImageStats(const uint8_t* pixelData, int width, int height, int rowSize, int bytesPerPixel,
+                       ImageStats& stats, int threadCount) {
+    BMP_TRACE_SCOPE(trace, "stats", static_cast<uint64_t>(width) * bytesPerPixel * height);
+
+    stats.reset(bytesPerPixel);
+    parallelForRows(height, rowSize, pixelData, threadCount, [&](int firstRow, int lastRow) {
+        StatsAccumulator accumulator(bytesPerPixel);
+        for (int y = firstRow; y < lastRow; ++y) {
+            accumulator.addRow(pixelData + static_cast<ptrdiff_t>(y) * rowSize, width);
+        }
+        accumulator.mergeInto(stats);
+    });
+    stats.finish();
+}
+
+string statsPath(const string& fileName) {
+    return fileName + ".stats.json";
+}
+
+bool writeStatsJSON(const char* fileName, const ImageStats& stats) {
+    ofstream output(fileName);
+    if (!output) {
+        cerr << "Can't open statistics file." << endl;
+        return false;
+    }
+
+    output << "{\n  \"pixels\": " << stats.pixelCount << ",\n  \"channels\": [\n";
+    for (int c = 0; c < stats.channelCount; ++c) {
+        // Single-channel images have no color meaning: name the channel "index"
+        const char* name = stats.channelCount == 1 ? "index" : CHANNEL_NAMES[c];
+        output << "    {\"name\": \"" << name << "\", \"min\": " << stats.minimum[c] << ", \"max\": " << stats.maximum[c]
+               << ", \"mean\": " << stats.mean[c] << ", \"stddev\": " << stats.standardDeviation[c] << ",\n     \"histogram\": [";
+        for (int v = 0; v < 256; ++v) {
+            output << stats.histogram[c][v] << (v < 255 ? ", " : "");
+        }
+        output << "]}" << (c + 1 < stats.channelCount ? ",\n" : "\n");
+    }
+    output << "  ]\n}\n";
+    if (!output) {
+        cerr << "Failed to write statistics file." << endl;
+        return false;
+    }
+    return true;
+}
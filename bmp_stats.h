@@ -0,0 +1,77 @@
+#ifndef BMP_STATS_H
+#define BMP_STATS_H
+
+#include <cstdint>
+#include <string>
+
+#include "bmp_image.h"
+
+// Largest number of channels a pixel has (B, G, R, A)
+const int STATS_MAX_CHANNELS = 4;
+
+/**
+ * Per-channel histograms of an image, in file channel order (B, G, R and, for 32-bit pixels, A).
+ * Minimum, maximum, mean and standard deviation are derived from the histograms by finish(), so the
+ * per-pixel work is one increment per channel.
+ */
+struct ImageStats {
+    int channelCount = 0;
+    uint64_t pixelCount = 0;
+    uint64_t histogram[STATS_MAX_CHANNELS][256] = {};
+
+    // Filled in by finish()
+    int minimum[STATS_MAX_CHANNELS] = {};
+    int maximum[STATS_MAX_CHANNELS] = {};
+    double mean[STATS_MAX_CHANNELS] = {};
+    double standardDeviation[STATS_MAX_CHANNELS] = {};
+
+    // Clear everything and set the channel count (the pixel size in bytes).
+    void reset(int channels);
+
+    // Add the histograms of `other` (same channel count).
+    void merge(const ImageStats& other);
+
+    // Derive the summary values from the histograms.
+    void finish();
+};
+
+/**
+ * Thread-private accumulator for the rows one thread visits. Each channel has two 32-bit histograms,
+ * one for even and one for odd pixels, so runs of equal pixels don't chain every increment through
+ * the same counter; they are widened into the 64-bit totals before they could overflow.
+ */
+class StatsAccumulator {
+public:
+    explicit StatsAccumulator(int bytesPerPixel);
+
+    // Count the pixels of one row (called right after a kernel wrote it, while it is still in cache).
+    void addRow(const uint8_t* row, int width);
+
+    // Count one row of planar pixels (bmp_planar.h): planes[c] holds the `width` bytes of channel c.
+    // Channels whose plane is null are not counted.
+    void addPlanarRow(const uint8_t* const* planes, int width);
+
+    // Flush into `stats`; safe to call once per accumulator from several threads, merges are locked.
+    void mergeInto(ImageStats& stats);
+
+private:
+    void flush();
+
+    int bytesPerPixel;
+    uint32_t pendingPixels = 0;
+    uint32_t counts[2][STATS_MAX_CHANNELS][256];
+    ImageStats totals;
+};
+
+// Separate statistics pass over an image, for outputs not produced by a kernel with a stats stage.
+void computeImageStats(const uint8_t* pixelData, int width, int height, int rowSize, int bytesPerPixel,
+                       ImageStats& stats, int threadCount = 1);
+
+// Side-car written next to an output: <fileName>.stats.json
+std::string statsPath(const std::string& fileName);
+
+// Write the finished statistics (summary per channel plus the histograms) as JSON.
+// Prints the reason and returns false on failure.
+bool writeStatsJSON(const char* fileName, const ImageStats& stats);
+
+#endif // BMP_STATS_H
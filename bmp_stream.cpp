@@ -0,0 +1,365 @@
+#include "bmp_stream.h"
+#include "bmp_dither.h"
+#include "bmp_kernels.h"
+#include "bmp_trace.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+bool BMPRowReader::open(const char* fileName, Image& image) {
+    // Open the input BMP file; reads go through the asynchronous backend
+    if (!file.openRead(fileName)) {
+        cerr << "Can't open file." << endl;
+        return false;
+    }
+
+    // Read and validate the BMP File Header and BMP Information Header only
+    int fileHeaderRead = file.read(&image.fileHeader, sizeof(image.fileHeader), 0);
+    int infoHeaderRead = file.read(&image.infoHeader, sizeof(image.infoHeader), sizeof(image.fileHeader));
+    bool headersRead = file.wait(fileHeaderRead);
+    headersRead = file.wait(infoHeaderRead) && headersRead;
+    if (!headersRead) {
+        cerr << "Input file is not a BMP file." << endl;
+        return false;
+    }
+    if (!validateBMPHeaders(image)) {
+        return false;
+    }
+
+    pixelOffset = image.fileHeader.bfOffBits;
+    rowSize = image.rowSize;
+    image.pixelData = nullptr;
+
+    // Indexed pixels are decoded from a private mapping rather than read verbatim
+    decoding = isIndexedBMP(image.infoHeader);
+    if (decoding) {
+        if (!mapping.openPrivate(fileName)) {
+            cerr << "Can't open file." << endl;
+            return false;
+        }
+        return decoder.open(mapping.data(), mapping.size(), image.fileHeader, image.infoHeader);
+    }
+    return true;
+}
+
+bool BMPRowReader::readRows(int firstRow, int rowCount, uint8_t* dest) {
+    return wait(readRowsAsync(firstRow, rowCount, dest));
+}
+
+int BMPRowReader::readRowsAsync(int firstRow, int rowCount, uint8_t* dest) {
+    // Decoding happens right here; the request id only carries the outcome to wait()
+    if (decoding) {
+        return decoder.decodeRows(firstRow, rowCount, dest, rowSize) ? 0 : -1;
+    }
+
+    // Rows are addressed by offset, so bands can be requested out of order
+    uint64_t offset = pixelOffset + static_cast<uint64_t>(firstRow) * rowSize;
+    return file.read(dest, static_cast<size_t>(rowCount) * rowSize, offset);
+}
+
+bool BMPRowReader::wait(int request) {
+    if (decoding) {
+        // The decoder has already reported any failure of a decoded read
+        return request >= 0;
+    }
+    if (request < 0 || !file.wait(request)) {
+        cerr << "BMP pixel data is truncated." << endl;
+        return false;
+    }
+    return true;
+}
+
+bool BMPRowReader::drain() {
+    return decoding || file.drain();
+}
+
+bool BMPRowWriter::open(const char* fileName, const Image& image) {
+    // Create the output file, once its size is known to fit the headers
+    if (!fitsBMPFileSize(image)) {
+        return false;
+    }
+    if (!file.openWrite(fileName)) {
+        cerr << "Can't open output file." << endl;
+        return false;
+    }
+
+    // The geometry is fixed up front, so the final headers can be written before any pixel row
+    prepareBMPHeaders(image, fileHeader, infoHeader);
+    palette = image.palette;
+    failed = file.write(&fileHeader, sizeof(fileHeader), 0) < 0 ||
+             file.write(&infoHeader, sizeof(infoHeader), sizeof(fileHeader)) < 0 ||
+             (!palette.empty() && file.write(palette.data(), palette.size() * sizeof(BMPPaletteEntry), BMP_HEADERS_SIZE) < 0);
+    nextOffset = fileHeader.bfOffBits;
+    rowSize = image.rowSize;
+    return !failed;
+}
+
+bool BMPRowWriter::writeRows(const uint8_t* src, int rowCount) {
+    return wait(writeRowsAsync(src, rowCount));
+}
+
+int BMPRowWriter::writeRowsAsync(const uint8_t* src, int rowCount) {
+    size_t length = static_cast<size_t>(rowCount) * rowSize;
+    int request = file.write(src, length, nextOffset);
+    nextOffset += length;
+    if (request < 0) {
+        failed = true;
+    }
+    return request;
+}
+
+bool BMPRowWriter::wait(int request) {
+    if (request < 0 || !file.wait(request)) {
+        failed = true;
+        return false;
+    }
+    return true;
+}
+
+bool BMPRowWriter::close() {
+    // Outstanding appends (and the header writes) complete before the file is closed
+    bool closed = file.close();
+    if (failed || !closed) {
+        cerr << "Failed to write output file." << endl;
+        return false;
+    }
+    return true;
+}
+
+// Band kernel writing one destination band per output
+typedef function<void(uint8_t* srcBand, const vector<uint8_t*>& dstBands, int firstRow, int rowCount)> MultiBandKernel;
+
+// Buffers and in-flight requests of one band slot
+struct BandSlot {
+    PixelBuffer source;
+    vector<PixelBuffer> outputs;       // Empty for in-place kernels.
+    vector<uint8_t*> destinations;     // Band handed to each writer.
+    int readRequest = -1;
+    vector<int> writeRequests;
+};
+
+/**
+ * Shared band loop of the streaming functions: source rows [firstRow, firstRow + height) are read
+ * band by band, transformed by `kernel` and appended to every writer. Bands cycle through
+ * STREAM_BAND_SLOTS slots, so while band i is processed band i + 1 is being read and band i - 1 written.
+ * In-place kernels write their result over the source band, which then goes to the single writer.
+ */
+static bool runBandPipeline(BMPRowReader& reader, int sourceRowSize, vector<BMPRowWriter>& writers, int outputRowSize,
+                            int firstRow, int height, int bandRows, bool inPlace, const MultiBandKernel& kernel) {
+    BMP_TRACE_SCOPE(trace, "stream", static_cast<uint64_t>(height) * sourceRowSize);
+    bandRows = max(1, min(bandRows, height));
+    int bandCount = (height + bandRows - 1) / bandRows;
+    int slotCount = min(STREAM_BAND_SLOTS, bandCount);
+    size_t writerCount = writers.size();
+
+    // Band buffers: the only pixel memory held during the whole run, taken from the shared pool
+    // so consecutive runs (e.g. a batch) reuse memory that is already faulted in
+    size_t sourceBandBytes = static_cast<size_t>(bandRows) * sourceRowSize;
+    size_t outputBandBytes = static_cast<size_t>(bandRows) * outputRowSize;
+    vector<BandSlot> slots(slotCount);
+    for (BandSlot& slot : slots) {
+        slot.source = sharedBufferPool().acquire(sourceBandBytes);
+        if (slot.source.empty()) {
+            cerr << "Out of memory." << endl;
+            return false;
+        }
+        if (inPlace) {
+            slot.destinations.assign(writerCount, slot.source.data());
+        } else {
+            for (size_t k = 0; k < writerCount; ++k) {
+                slot.outputs.push_back(sharedBufferPool().acquire(outputBandBytes));
+                if (slot.outputs.back().empty()) {
+                    cerr << "Out of memory." << endl;
+                    return false;
+                }
+
+                // Zeroed once so the row padding of the output is deterministic
+                memset(slot.outputs.back().data(), 0, outputBandBytes);
+                slot.destinations.push_back(slot.outputs.back().data());
+            }
+        }
+        slot.writeRequests.assign(writerCount, -1);
+    }
+
+    auto bandRowCount = [&](int band) {
+        return min(bandRows, height - band * bandRows);
+    };
+
+    // Queue the read of `band` into its slot once the slot's previous writes have drained
+    auto startRead = [&](int band) {
+        BandSlot& slot = slots[band % slotCount];
+        bool ok = true;
+        for (size_t k = 0; k < writerCount; ++k) {
+            if (slot.writeRequests[k] >= 0) {
+                ok = writers[k].wait(slot.writeRequests[k]) && ok;
+                slot.writeRequests[k] = -1;
+            }
+        }
+        slot.readRequest = reader.readRowsAsync(firstRow + band * bandRows, bandRowCount(band), slot.source.data());
+        return ok;
+    };
+
+    bool ok = startRead(0);
+    for (int band = 0; ok && band < bandCount; ++band) {
+        BandSlot& slot = slots[band % slotCount];
+        int rowCount = bandRowCount(band);
+
+        // The next read is queued before this band is processed, so it overlaps the kernel
+        if (band + 1 < bandCount) {
+            ok = startRead(band + 1);
+        }
+        {
+            // Time spent blocked on the read: zero when I/O keeps up with the kernel
+            BMP_TRACE_SCOPE(readTrace, "stream.read.wait", static_cast<uint64_t>(rowCount) * sourceRowSize);
+            ok = ok && reader.wait(slot.readRequest);
+        }
+        slot.readRequest = -1;
+        if (!ok) {
+            break;
+        }
+
+        {
+            BMP_TRACE_SCOPE(kernelTrace, "stream.kernel", static_cast<uint64_t>(rowCount) * sourceRowSize);
+            kernel(slot.source.data(), slot.destinations, firstRow + band * bandRows, rowCount);
+        }
+
+        // Queue the writes and move on; they complete while the next band is processed
+        for (size_t k = 0; k < writerCount; ++k) {
+            slot.writeRequests[k] = writers[k].writeRowsAsync(slot.destinations[k], rowCount);
+        }
+    }
+
+    // Requests still in flight point into the slots, so they must finish before the buffers are freed
+    BMP_TRACE_SCOPE(closeTrace, "stream.close", 0);
+    ok = reader.drain() && ok;
+    for (size_t k = 0; k < writerCount; ++k) {
+        ok = writers[k].close() && ok;
+    }
+    return ok;
+}
+
+bool streamBMP(BMPRowReader& reader, const Image& source, const char* outputFileName, const Image& output,
+               int firstRow, int bandRows, bool inPlace, const BandKernel& kernel) {
+    vector<BMPRowWriter> writers(1);
+    if (!writers[0].open(outputFileName, output)) {
+        return false;
+    }
+    // Bands follow the file order; for a top-down source the bottom-up row range starts further into the file
+    int firstFileRow = source.topDown ? source.height - firstRow - output.height : firstRow;
+    return runBandPipeline(reader, source.rowSize, writers, output.rowSize, firstFileRow, output.height, bandRows, inPlace,
+        [&kernel](uint8_t* srcBand, const vector<uint8_t*>& dstBands, int bandFirstRow, int rowCount) {
+            kernel(srcBand, dstBands[0], bandFirstRow, rowCount);
+        });
+}
+
+bool streamFlipHorizontally(const char* inputFileName, const char* outputFileName, int bandRows, int threadCount) {
+    BMPRowReader reader;
+    Image source;
+    if (!reader.open(inputFileName, source)) {
+        return false;
+    }
+
+    // Flip is row-local and in place: each band is mirrored independently
+    return streamBMP(reader, source, outputFileName, source, 0, bandRows, true,
+        [&source, threadCount](uint8_t* band, uint8_t*, int, int rowCount) {
+            flipHorizontally(band, source.width, rowCount, source.rowSize, source.bytesPerPixel, threadCount);
+        });
+}
+
+bool streamQuantize(const char* inputFileName, const char* outputFileName, int quantizationBits, int bandRows, int threadCount) {
+    BMPRowReader reader;
+    Image source;
+    if (!reader.open(inputFileName, source)) {
+        return false;
+    }
+
+    return streamBMP(reader, source, outputFileName, source, 0, bandRows, true,
+        [&source, quantizationBits, threadCount](uint8_t* band, uint8_t*, int, int rowCount) {
+            quantizePixelData(band, source.bytesPerPixel, source.width, rowCount, source.rowSize, quantizationBits, threadCount);
+        });
+}
+
+bool streamQuantizeMulti(const char* inputFileName, const vector<string>& outputFileNames, const vector<int>& quantizationBits, int bandRows, int threadCount, QuantizationMode mode) {
+    // Error diffusion carries state from row to row and cannot be split into independent bands
+    if (mode == QUANTIZE_ERROR_DIFFUSION) {
+        cerr << "Error diffusion cannot be streamed." << endl;
+        return false;
+    }
+
+    BMPRowReader reader;
+    Image source;
+    if (!reader.open(inputFileName, source)) {
+        return false;
+    }
+
+    // One writer and one output band per bit depth; the source band is read only once
+    size_t outputCount = outputFileNames.size();
+    vector<BMPRowWriter> writers(outputCount);
+    for (size_t k = 0; k < outputCount; ++k) {
+        if (!writers[k].open(outputFileNames[k].c_str(), source)) {
+            return false;
+        }
+    }
+
+    if (mode == QUANTIZE_ORDERED_DITHER) {
+        // Each output band starts as a copy of the source band and is dithered in place. The threshold
+        // pattern follows image rows, so a top-down band is addressed from its bottom row upwards.
+        return runBandPipeline(reader, source.rowSize, writers, source.rowSize, 0, source.height, bandRows, false,
+            [&source, &quantizationBits, threadCount](uint8_t* srcBand, const vector<uint8_t*>& dstBands, int fileRow, int rowCount) {
+                size_t bandBytes = static_cast<size_t>(rowCount) * source.rowSize;
+                ptrdiff_t bottomOffset = source.topDown ? static_cast<ptrdiff_t>(rowCount - 1) * source.rowSize : 0;
+                int imageRow = source.topDown ? source.height - fileRow - rowCount : fileRow;
+                for (size_t k = 0; k < dstBands.size(); ++k) {
+                    memcpy(dstBands[k], srcBand, bandBytes);
+                    orderedDitherPixelData(dstBands[k] + bottomOffset, source.bytesPerPixel, source.width, rowCount, source.stride,
+                                           quantizationBits[k], threadCount, imageRow);
+                }
+            });
+    }
+
+    // Every band is read once and quantized into one destination band per bit depth
+    return runBandPipeline(reader, source.rowSize, writers, source.rowSize, 0, source.height, bandRows, false,
+        [&source, &quantizationBits, threadCount](uint8_t* srcBand, const vector<uint8_t*>& dstBands, int, int rowCount) {
+            quantizePixelDataMulti(srcBand, dstBands, quantizationBits, source.bytesPerPixel, source.width, rowCount, source.rowSize, threadCount);
+        });
+}
+
+bool streamCrop(const char* inputFileName, const char* outputFileName, int x, int y, int cropWidth, int cropHeight, int bandRows, int threadCount) {
+    BMPRowReader reader;
+    Image source;
+    if (!reader.open(inputFileName, source)) {
+        return false;
+    }
+
+    // Validate that the ROI is within the source image bounds
+    if (x < 0 || y < 0 || cropWidth <= 0 || cropHeight <= 0 ||
+        x + cropWidth > source.width || y + cropHeight > source.height) {
+        cerr << "Cropping area exceeds image bounds." << endl;
+        return false;
+    }
+
+    // Describe the output geometry; only rows [y, y + cropHeight) of the source are ever read
+    Image output;
+    initImageGeometry(source, cropWidth, cropHeight, output);
+
+    return streamBMP(reader, source, outputFileName, output, y, bandRows, false,
+        [&source, x, cropWidth, threadCount](uint8_t* srcBand, uint8_t* dstBand, int, int rowCount) {
+            cropImage(srcBand, dstBand, source.width, rowCount, source.bytesPerPixel, source.rowSize, x, 0, cropWidth, rowCount, threadCount);
+        });
+}
+
+int parseBandRowsOption(int argc, char* argv[]) {
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (string(argv[i]) == "--stream") {
+            return max(1, atoi(argv[i + 1]));
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,116 @@
+#ifndef BMP_STREAM_H
+#define BMP_STREAM_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "bmp_async_io.h"
+#include "bmp_dither.h"
+#include "bmp_image.h"
+#include "bmp_rle.h"
+
+// Default number of rows held in memory at once by the streaming functions.
+const int DEFAULT_BAND_ROWS = 256;
+
+// Band buffers cycled by the streaming pipeline: one being read, one being processed, one being written.
+const int STREAM_BAND_SLOTS = 3;
+
+/**
+ * Reader for the pixel rows of a BMP file.
+ * Only the headers are decoded on open; rows are then read band by band into caller-provided buffers,
+ * either blocking (readRows) or asynchronously through the file's AsyncFile backend (readRowsAsync + wait).
+ * Indexed files are mapped instead and decoded to 24-bit rows on request (see IndexedPixelDecoder);
+ * their "asynchronous" reads complete immediately, and RLE bands must be requested in file order.
+ */
+class BMPRowReader {
+public:
+    // Read and validate the headers. `image` receives the headers and geometry but no pixel buffer.
+    bool open(const char* fileName, Image& image);
+
+    // Read rows [firstRow, firstRow + rowCount) into `dest` (rowCount * rowSize bytes).
+    bool readRows(int firstRow, int rowCount, uint8_t* dest);
+
+    // Queue the same read without blocking. Returns a request id for wait(), or -1 on failure.
+    int readRowsAsync(int firstRow, int rowCount, uint8_t* dest);
+
+    // Block until a queued read has finished. Prints the reason and returns false if it failed.
+    bool wait(int request);
+
+    // Wait for every queued read (e.g. before releasing their buffers on an error path).
+    bool drain();
+
+private:
+    AsyncFile file;
+    uint32_t pixelOffset = 0;
+    int rowSize = 0;
+
+    // Indexed input
+    bool decoding = false;
+    MappedFile mapping;
+    IndexedPixelDecoder decoder;
+};
+
+/**
+ * Writer for a BMP file whose geometry is known up front.
+ * The final headers are written on open; rows are then appended band by band. Appends may be
+ * queued asynchronously: each one targets its own file offset, so they can complete in any order.
+ */
+class BMPRowWriter {
+public:
+    // Create the output file and write headers matching the geometry of `image` (its pixels are not used).
+    bool open(const char* fileName, const Image& image);
+
+    // Append `rowCount` rows of rowSize bytes each.
+    bool writeRows(const uint8_t* src, int rowCount);
+
+    // Queue the append without blocking; `src` must stay untouched until wait() returns.
+    // Returns a request id, or -1 on failure.
+    int writeRowsAsync(const uint8_t* src, int rowCount);
+
+    // Block until a queued append has finished. Returns false if it failed.
+    bool wait(int request);
+
+    // Wait for all queued writes and finish the file. Returns false if any write failed.
+    bool close();
+
+private:
+    AsyncFile file;
+    BMPFileHeader fileHeader;      // Kept alive (with the color table) until the header writes have completed.
+    BMPInfoHeader infoHeader;
+    std::vector<BMPPaletteEntry> palette;
+    uint64_t nextOffset = 0;
+    int rowSize = 0;
+    bool failed = false;
+};
+
+// Row-local band kernel: transforms `rowCount` source rows starting at file row `firstRow` into the
+// same number of destination rows. For in-place kernels `srcBand` and `dstBand` are the same buffer.
+// Bands are always in file order with a positive stride, so for top-down files they run top to bottom.
+typedef std::function<void(uint8_t* srcBand, uint8_t* dstBand, int firstRow, int rowCount)> BandKernel;
+
+/**
+ * Stream source rows [firstRow, firstRow + output.height) through `kernel` into `outputFileName`,
+ * `bandRows` rows at a time. `firstRow` counts from the bottom, whatever the file's row order;
+ * `output` describes the destination geometry and should share the source row order.
+ * I/O overlaps compute: while one band is processed, the next band is being read and the previous
+ * one written. Peak memory is STREAM_BAND_SLOTS bands (twice that when the kernel is not in place),
+ * independent of the image size.
+ */
+bool streamBMP(BMPRowReader& reader, const Image& source, const char* outputFileName, const Image& output,
+               int firstRow, int bandRows, bool inPlace, const BandKernel& kernel);
+
+// Streaming counterparts of the whole-image tools: same output, bounded memory.
+// `threadCount` parallelizes the kernel within each band.
+bool streamFlipHorizontally(const char* inputFileName, const char* outputFileName, int bandRows, int threadCount = 1);
+bool streamQuantize(const char* inputFileName, const char* outputFileName, int quantizationBits, int bandRows, int threadCount = 1);
+// Fan-out variant: one pass over the source bands writes one output file per bit depth.
+// `mode` may be QUANTIZE_TRUNCATE or QUANTIZE_ORDERED_DITHER; error diffusion is not row-local and is rejected.
+bool streamQuantizeMulti(const char* inputFileName, const std::vector<std::string>& outputFileNames, const std::vector<int>& quantizationBits, int bandRows, int threadCount = 1, QuantizationMode mode = QUANTIZE_TRUNCATE);
+bool streamCrop(const char* inputFileName, const char* outputFileName, int x, int y, int cropWidth, int cropHeight, int bandRows, int threadCount = 1);
+
+// Parse the optional "--stream <rows>" command-line flag. Returns the band height, or 0 when absent.
+int parseBandRowsOption(int argc, char* argv[]);
+
+#endif // BMP_STREAM_H
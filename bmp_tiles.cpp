@@ -0,0 +1,289 @@
+#include "bmp_tiles.h"
+#include "bmp_parallel.h"
+#include "bmp_trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+
+using namespace std;
+
+// Upper bound on the tiles of one group, so a single long strip of tiles still spreads over the threads
+const int MAX_TILES_PER_GROUP = 64;
+
+// Tiles sharing one row range
+struct TileGroup {
+    int y = 0;
+    int height = 0;
+    vector<int> tiles;   // Indices into the rectangle list, left to right.
+};
+
+void gridTiles(int imageWidth, int imageHeight, int tileWidth, int tileHeight, int strideX, int strideY,
+               vector<TileRect>& rects) {
+    if (tileWidth <= 0 || tileHeight <= 0 || strideX <= 0 || strideY <= 0) {
+        return;
+    }
+    for (int y = 0; y + tileHeight <= imageHeight; y += strideY) {
+        for (int x = 0; x + tileWidth <= imageWidth; x += strideX) {
+            TileRect rect;
+            rect.x = x;
+            rect.y = y;
+            rect.width = tileWidth;
+            rect.height = tileHeight;
+            rects.push_back(rect);
+        }
+    }
+}
+
+bool readTileRects(const char* fileName, vector<TileRect>& rects) {
+    ifstream listFile(fileName);
+    if (!listFile) {
+        cerr << "Can't open rectangle list: " << fileName << endl;
+        return false;
+    }
+    string line;
+    int lineNumber = 0;
+    while (getline(listFile, line)) {
+        ++lineNumber;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+
+        // Exactly four comma-separated integers
+        int values[4];
+        int count = 0;
+        stringstream stream(line);
+        string item;
+        bool valid = true;
+        while (valid && getline(stream, item, ',')) {
+            char* end = nullptr;
+            long value = strtol(item.c_str(), &end, 10);
+            valid = !item.empty() && *end == '\0' && count < 4;
+            if (valid) {
+                values[count++] = static_cast<int>(value);
+            }
+        }
+        if (!valid || count != 4) {
+            cerr << "Invalid rectangle on line " << lineNumber << " of " << fileName << " (expected x,y,w,h)." << endl;
+            return false;
+        }
+        TileRect rect;
+        rect.x = values[0];
+        rect.y = values[1];
+        rect.width = values[2];
+        rect.height = values[3];
+        rects.push_back(rect);
+    }
+    return true;
+}
+
+bool validateTileRects(const Image& source, const vector<TileRect>& rects) {
+    for (size_t i = 0; i < rects.size(); ++i) {
+        const TileRect& rect = rects[i];
+        if (rect.x < 0 || rect.y < 0 || rect.width <= 0 || rect.height <= 0 ||
+            rect.width > source.width - rect.x || rect.height > source.height - rect.y) {
+            cerr << "Tile " << i << " exceeds image bounds." << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Sort the tiles by row range and cut them into groups of identical ranges
+static void groupTiles(const vector<TileRect>& rects, vector<TileGroup>& groups) {
+    vector<int> order(rects.size());
+    iota(order.begin(), order.end(), 0);
+    stable_sort(order.begin(), order.end(), [&rects](int a, int b) {
+        if (rects[a].y != rects[b].y) {
+            return rects[a].y < rects[b].y;
+        }
+        if (rects[a].height != rects[b].height) {
+            return rects[a].height < rects[b].height;
+        }
+        return rects[a].x < rects[b].x;
+    });
+
+    groups.clear();
+    for (int index : order) {
+        const TileRect& rect = rects[index];
+        if (groups.empty() || groups.back().y != rect.y || groups.back().height != rect.height ||
+            static_cast<int>(groups.back().tiles.size()) >= MAX_TILES_PER_GROUP) {
+            TileGroup group;
+            group.y = rect.y;
+            group.height = rect.height;
+            groups.push_back(group);
+        }
+        groups.back().tiles.push_back(index);
+    }
+}
+
+// Bytes copied by each group, for largest-first scheduling
+static vector<uint64_t> groupCosts(const vector<TileRect>& rects, const vector<TileGroup>& groups) {
+    vector<uint64_t> costs(groups.size(), 0);
+    for (size_t g = 0; g < groups.size(); ++g) {
+        for (int index : groups[g].tiles) {
+            costs[g] += static_cast<uint64_t>(rects[index].width) * rects[index].height;
+        }
+    }
+    return costs;
+}
+
+// Row by row over the group's range: each source row is copied into every tile of the group while it is hot.
+// targets[i] receives the tile group.tiles[i].
+static void copyTileGroup(const Image& source, const vector<TileRect>& rects, const TileGroup& group, const vector<ImageView>& targets) {
+    int bytesPerPixel = source.bytesPerPixel;
+    for (int r = 0; r < group.height; ++r) {
+        const uint8_t* sourceRow = source.row(group.y + r);
+        for (size_t i = 0; i < group.tiles.size(); ++i) {
+            const TileRect& rect = rects[group.tiles[i]];
+            memcpy(targets[i].row(r), sourceRow + static_cast<size_t>(rect.x) * bytesPerPixel, static_cast<size_t>(rect.width) * bytesPerPixel);
+        }
+    }
+}
+
+// Destination view covering a whole image
+static ImageView targetOf(Image& image) {
+    ImageView view;
+    view.data = image.pixelData;
+    view.width = image.width;
+    view.height = image.height;
+    view.bytesPerPixel = image.bytesPerPixel;
+    view.rowSize = image.stride;
+    return view;
+}
+
+#if !defined(BMP_NO_TRACE)
+// Total pixel bytes of all tiles, for the trace (only referenced by the trace macros)
+static uint64_t tileBytes(const Image& source, const vector<TileRect>& rects) {
+    uint64_t bytes = 0;
+    for (const TileRect& rect : rects) {
+        bytes += static_cast<uint64_t>(rect.width) * source.bytesPerPixel * rect.height;
+    }
+    return bytes;
+}
+#endif
+
+bool cropTiles(const Image& source, const vector<TileRect>& rects, vector<Image>& tiles, int threadCount) {
+    if (!validateTileRects(source, rects)) {
+        return false;
+    }
+    BMP_TRACE_SCOPE(trace, "tiles", tileBytes(source, rects));
+
+    // Allocate every tile up front; the groups only copy
+    tiles.clear();
+    tiles.resize(rects.size());
+    for (size_t i = 0; i < rects.size(); ++i) {
+        createImageLike(source, rects[i].width, rects[i].height, tiles[i]);
+        if (tiles[i].pixelData == nullptr) {
+            cerr << "Out of memory." << endl;
+            tiles.clear();
+            return false;
+        }
+    }
+
+    vector<TileGroup> groups;
+    groupTiles(rects, groups);
+    runWorkStealing(threadCount, static_cast<int>(groups.size()), groupCosts(rects, groups), [&](int g) {
+        vector<ImageView> targets;
+        for (int index : groups[g].tiles) {
+            targets.push_back(targetOf(tiles[index]));
+        }
+        copyTileGroup(source, rects, groups[g], targets);
+    });
+    return true;
+}
+
+bool saveTiles(const Image& source, const vector<TileRect>& rects, const vector<string>& fileNames, int threadCount) {
+    if (fileNames.size() != rects.size()) {
+        cerr << "Expected one output file name per tile." << endl;
+        return false;
+    }
+    if (!validateTileRects(source, rects)) {
+        return false;
+    }
+    BMP_TRACE_SCOPE(trace, "tiles.save", tileBytes(source, rects));
+
+    vector<TileGroup> groups;
+    groupTiles(rects, groups);
+    atomic<bool> success{true};
+    runWorkStealing(threadCount, static_cast<int>(groups.size()), groupCosts(rects, groups), [&](int g) {
+        // Pooled buffers for the tiles of this group only; they return to the pool once written
+        const TileGroup& group = groups[g];
+        vector<Image> tiles(group.tiles.size());
+        vector<ImageView> targets;
+        for (size_t i = 0; i < group.tiles.size(); ++i) {
+            const TileRect& rect = rects[group.tiles[i]];
+            createImageLike(source, rect.width, rect.height, tiles[i]);
+            if (tiles[i].pixelData == nullptr) {
+                cerr << "Out of memory." << endl;
+                success = false;
+                return;
+            }
+            targets.push_back(targetOf(tiles[i]));
+        }
+
+        copyTileGroup(source, rects, group, targets);
+        for (size_t i = 0; i < group.tiles.size(); ++i) {
+            if (!saveBMP(fileNames[group.tiles[i]].c_str(), tiles[i])) {
+                success = false;
+            }
+        }
+    });
+    return success;
+}
+
+bool savePackedTiles(const Image& source, const vector<TileRect>& rects, const char* fileName, int threadCount) {
+    if (rects.empty()) {
+        cerr << "No tiles to pack." << endl;
+        return false;
+    }
+    if (!validateTileRects(source, rects)) {
+        return false;
+    }
+
+    // Row offset of every tile in the atlas
+    vector<int> offsets(rects.size());
+    int64_t atlasHeight = 0;
+    int atlasWidth = 0;
+    for (size_t i = 0; i < rects.size(); ++i) {
+        offsets[i] = static_cast<int>(atlasHeight);
+        atlasHeight += rects[i].height;
+        atlasWidth = max(atlasWidth, rects[i].width);
+        if (atlasHeight > INT_MAX) {
+            cerr << "Too many tiles for one packed image." << endl;
+            return false;
+        }
+    }
+    BMP_TRACE_SCOPE(trace, "tiles.pack", tileBytes(source, rects));
+
+    Image atlas;
+    if (!createBMPMapped(fileName, source, atlasWidth, static_cast<int>(atlasHeight), atlas)) {
+        return false;
+    }
+
+    // Each group writes its own rows of the mapped atlas; the column padding stays zero from the pre-sized file
+    vector<TileGroup> groups;
+    groupTiles(rects, groups);
+    runWorkStealing(threadCount, static_cast<int>(groups.size()), groupCosts(rects, groups), [&](int g) {
+        vector<ImageView> targets;
+        for (int index : groups[g].tiles) {
+            ImageView target = targetOf(atlas);
+            target.data = atlas.row(offsets[index]);
+            target.width = rects[index].width;
+            target.height = rects[index].height;
+            targets.push_back(target);
+        }
+        copyTileGroup(source, rects, groups[g], targets);
+    });
+    return commitBMP(atlas);
+}
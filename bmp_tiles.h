@@ -0,0 +1,50 @@
+#ifndef BMP_TILES_H
+#define BMP_TILES_H
+
+#include <string>
+#include <vector>
+
+#include "bmp_image.h"
+
+// Region of interest in image coordinates (rows counted like cropImage: row 0 is the bottom row)
+struct TileRect {
+    int x = 0;
+    int y = 0;
+    int width = 0;
+    int height = 0;
+};
+
+// Regular grid of tileWidth x tileHeight tiles every strideX / strideY pixels (strides smaller than the
+// tile give overlapping tiles). Only tiles that fit entirely inside the image are generated, row by row.
+void gridTiles(int imageWidth, int imageHeight, int tileWidth, int tileHeight, int strideX, int strideY,
+               std::vector<TileRect>& rects);
+
+// Append the rectangles of a list file, one "x,y,w,h" per line. Blank lines and lines starting with '#'
+// are skipped. Prints the reason and returns false on a malformed line.
+bool readTileRects(const char* fileName, std::vector<TileRect>& rects);
+
+// Check every rectangle against the image bounds. Prints the first offending index and returns false.
+bool validateTileRects(const Image& source, const std::vector<TileRect>& rects);
+
+/**
+ * Copy every rectangle of `source` into its own pooled image (tiles[i] for rects[i]).
+ * Rectangles with the same row range form a group: each source row of the range is read once and
+ * copied into all tiles of the group back to back, so overlapping tiles share the source rows while
+ * they are in cache. Groups run in parallel (work stealing, largest first) on `threadCount` threads.
+ */
+bool cropTiles(const Image& source, const std::vector<TileRect>& rects, std::vector<Image>& tiles, int threadCount = 1);
+
+// Write rects[i] to fileNames[i]. Works group by group, so only the tiles of the groups in flight are in
+// memory at once. Returns false if any tile failed (the others are still written).
+bool saveTiles(const Image& source, const std::vector<TileRect>& rects, const std::vector<std::string>& fileNames,
+               int threadCount = 1);
+
+/**
+ * Write all tiles into one packed BMP: tile i occupies rows [offset_i, offset_i + height_i) of the
+ * atlas, where offset_i is the sum of the heights of the tiles before it, and columns [0, width_i).
+ * The atlas is as wide as the widest tile (narrower tiles are padded with zeros) and keeps the row
+ * order of the source. Tiles are copied straight into the mapped output file.
+ */
+bool savePackedTiles(const Image& source, const std::vector<TileRect>& rects, const char* fileName, int threadCount = 1);
+
+#endif // BMP_TILES_H
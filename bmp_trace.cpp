@@ -0,0 +1,180 @@
+#include "bmp_trace.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// One finished stage
+struct TraceEvent {
+    const char* name;
+    int thread;
+    uint64_t start;
+    uint64_t duration;
+    uint64_t bytes;
+    uint64_t acquires;
+    uint64_t allocations;
+    uint64_t allocatedBytes;
+};
+
+// Process-wide event list. Stages are coarse (whole kernels, files or bands), so a mutex is cheap enough.
+struct TraceRecorder {
+    mutex lock;
+    vector<TraceEvent> events;
+    chrono::steady_clock::time_point origin = chrono::steady_clock::now();
+    TraceFormat format = TRACE_OFF;
+    string fileName = "bmp_trace.json";
+};
+
+static TraceRecorder& recorder() {
+    static TraceRecorder instance;
+    return instance;
+}
+
+// Allocation counters of the calling thread
+static thread_local TraceAllocations threadAllocations;
+
+// Small sequential thread ids (tid in the Chrome format)
+static atomic<int> nextThreadId{1};
+static int currentThreadId() {
+    static thread_local int id = nextThreadId.fetch_add(1);
+    return id;
+}
+
+static void writeTraceAtExit() {
+    TraceRecorder& trace = recorder();
+    writeTrace(trace.fileName.c_str(), trace.format);
+}
+
+TraceFormat traceFormat() {
+    static const TraceFormat format = [] {
+        const char* value = getenv("BMP_TRACE");
+        TraceFormat requested = TRACE_OFF;
+        if (value != nullptr && strcmp(value, "json") == 0) {
+            requested = TRACE_JSON;
+        } else if (value != nullptr && strcmp(value, "chrome") == 0) {
+            requested = TRACE_CHROME;
+        }
+        if (requested != TRACE_OFF) {
+            // The recorder is constructed before the handler is registered, so it outlives the handler
+            TraceRecorder& trace = recorder();
+            trace.format = requested;
+            const char* fileName = getenv("BMP_TRACE_FILE");
+            if (fileName != nullptr && *fileName != '\0') {
+                trace.fileName = fileName;
+            }
+            atexit(writeTraceAtExit);
+        }
+        return requested;
+    }();
+    return format;
+}
+
+uint64_t traceNow() {
+    return static_cast<uint64_t>(chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - recorder().origin).count());
+}
+
+TraceAllocations traceAllocations() {
+    return threadAllocations;
+}
+
+void traceCountAllocation(size_t allocatedBytes) {
+    ++threadAllocations.acquires;
+    if (allocatedBytes > 0) {
+        ++threadAllocations.allocations;
+        threadAllocations.allocatedBytes += allocatedBytes;
+    }
+}
+
+void traceRecord(const char* name, uint64_t start, uint64_t duration, uint64_t bytes,
+                 const TraceAllocations& before, const TraceAllocations& after) {
+    TraceEvent event;
+    event.name = name;
+    event.thread = currentThreadId();
+    event.start = start;
+    event.duration = duration;
+    event.bytes = bytes;
+    event.acquires = after.acquires - before.acquires;
+    event.allocations = after.allocations - before.allocations;
+    event.allocatedBytes = after.allocatedBytes - before.allocatedBytes;
+
+    TraceRecorder& trace = recorder();
+    lock_guard<mutex> guard(trace.lock);
+    trace.events.push_back(event);
+}
+
+// Per-stage sums for the JSON summary
+struct TraceTotal {
+    uint64_t count = 0;
+    uint64_t duration = 0;
+    uint64_t bytes = 0;
+    uint64_t allocations = 0;
+};
+
+bool writeTrace(const char* fileName, TraceFormat format) {
+    if (format == TRACE_OFF) {
+        return true;
+    }
+    TraceRecorder& trace = recorder();
+    vector<TraceEvent> events;
+    {
+        lock_guard<mutex> guard(trace.lock);
+        events = trace.events;
+    }
+
+    ofstream output(fileName);
+    if (!output) {
+        cerr << "Can't open trace file." << endl;
+        return false;
+    }
+
+    if (format == TRACE_CHROME) {
+        // Complete ("X") events; nested stages on one thread show up as a flame graph
+        output << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+        for (size_t i = 0; i < events.size(); ++i) {
+            const TraceEvent& event = events[i];
+            output << "  {\"name\": \"" << event.name << "\", \"cat\": \"bmp\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << event.thread
+                   << ", \"ts\": " << event.start << ", \"dur\": " << event.duration
+                   << ", \"args\": {\"bytes\": " << event.bytes << ", \"acquires\": " << event.acquires
+                   << ", \"allocations\": " << event.allocations << ", \"allocated_bytes\": " << event.allocatedBytes << "}}"
+                   << (i + 1 < events.size() ? ",\n" : "\n");
+        }
+        output << "]}\n";
+    } else {
+        output << "{\n  \"stages\": [\n";
+        map<string, TraceTotal> totals;
+        for (size_t i = 0; i < events.size(); ++i) {
+            const TraceEvent& event = events[i];
+            output << "    {\"name\": \"" << event.name << "\", \"thread\": " << event.thread
+                   << ", \"start_us\": " << event.start << ", \"duration_us\": " << event.duration
+                   << ", \"bytes\": " << event.bytes << ", \"acquires\": " << event.acquires
+                   << ", \"allocations\": " << event.allocations << ", \"allocated_bytes\": " << event.allocatedBytes << "}"
+                   << (i + 1 < events.size() ? ",\n" : "\n");
+            TraceTotal& total = totals[event.name];
+            ++total.count;
+            total.duration += event.duration;
+            total.bytes += event.bytes;
+            total.allocations += event.allocations;
+        }
+        output << "  ],\n  \"totals\": [\n";
+        size_t index = 0;
+        for (const auto& entry : totals) {
+            const TraceTotal& total = entry.second;
+            double megabytesPerSecond = total.duration > 0 ? static_cast<double>(total.bytes) / total.duration : 0.0;
+            output << "    {\"name\": \"" << entry.first << "\", \"count\": " << total.count
+                   << ", \"duration_us\": " << total.duration << ", \"bytes\": " << total.bytes
+                   << ", \"mb_per_s\": " << megabytesPerSecond << ", \"allocations\": " << total.allocations << "}"
+                   << (++index < totals.size() ? ",\n" : "\n");
+        }
+        output << "  ]\n}\n";
+    }
+    return static_cast<bool>(output);
+}
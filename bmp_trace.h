@@ -0,0 +1,90 @@
+#ifndef BMP_TRACE_H
+#define BMP_TRACE_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Output formats of the stage trace, selected by the environment variable BMP_TRACE.
+enum TraceFormat {
+    TRACE_OFF,
+    TRACE_JSON,      // BMP_TRACE=json: one record per stage plus per-stage totals.
+    TRACE_CHROME     // BMP_TRACE=chrome: Chrome trace-event format (chrome://tracing, Perfetto).
+};
+
+// Format requested through BMP_TRACE, read once at first use. The trace is written on exit to
+// BMP_TRACE_FILE (default bmp_trace.json).
+TraceFormat traceFormat();
+
+// True when stages are being recorded. After the first call this is a single cached load.
+inline bool traceEnabled() {
+    static const bool enabled = traceFormat() != TRACE_OFF;
+    return enabled;
+}
+
+// Microseconds since tracing started.
+uint64_t traceNow();
+
+// Pooled buffers acquired and fresh allocations made by the calling thread so far (see BMP_TRACE_ALLOCATION).
+struct TraceAllocations {
+    uint64_t acquires = 0;
+    uint64_t allocations = 0;
+    uint64_t allocatedBytes = 0;
+};
+TraceAllocations traceAllocations();
+
+// Count a buffer acquisition on the calling thread; `allocatedBytes` is 0 when the pool had a cached buffer.
+void traceCountAllocation(size_t allocatedBytes);
+
+// Append a finished stage to the trace.
+void traceRecord(const char* name, uint64_t start, uint64_t duration, uint64_t bytes,
+                 const TraceAllocations& before, const TraceAllocations& after);
+
+// Write everything recorded so far; called automatically on exit. Returns false if the file cannot be written.
+bool writeTrace(const char* fileName, TraceFormat format);
+
+/**
+ * Times one stage from construction to destruction and records its duration, the pixel bytes it
+ * moved and the buffer allocations the thread made meanwhile. When tracing is off at runtime the
+ * constructor and destructor reduce to one predictable branch each. `name` must be a string literal.
+ */
+class TraceScope {
+public:
+    TraceScope(const char* name, uint64_t bytes) : bytes(bytes) {
+        if (traceEnabled()) {
+            this->name = name;
+            before = traceAllocations();
+            start = traceNow();
+        }
+    }
+    ~TraceScope() {
+        if (name != nullptr) {
+            uint64_t end = traceNow();
+            traceRecord(name, start, end - start, bytes, before, traceAllocations());
+        }
+    }
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+    // Set the byte count once it is known (e.g. after the headers have been read).
+    void setBytes(uint64_t value) { bytes = value; }
+
+private:
+    const char* name = nullptr;
+    uint64_t start = 0;
+    uint64_t bytes;
+    TraceAllocations before;
+};
+
+// Instrumentation macros. Building with -DBMP_NO_TRACE removes them (and their arguments) entirely.
+#if defined(BMP_NO_TRACE)
+#define BMP_TRACE_SCOPE(variable, name, bytes) ((void)0)
+#define BMP_TRACE_SET_BYTES(variable, bytes) ((void)0)
+#define BMP_TRACE_ALLOCATION(allocatedBytes) ((void)0)
+#else
+#define BMP_TRACE_SCOPE(variable, name, bytes) TraceScope variable(name, bytes)
+#define BMP_TRACE_SET_BYTES(variable, bytes) variable.setBytes(bytes)
+#define BMP_TRACE_ALLOCATION(allocatedBytes) \
+    do { if (traceEnabled()) { traceCountAllocation(allocatedBytes); } } while (0)
+#endif
+
+#endif // BMP_TRACE_H
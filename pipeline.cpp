@@ -0,0 +1,45 @@
+#include <iostream>
+#include <string>
+
+#include "bmp_parallel.h"
+#include "bmp_pipeline.h"
+#include "bmp_stream.h"
+
+using namespace std;
+
+int main(int argc, char* argv[]) {
+    if (argc < 4) {
+        cerr << "Usage: bmp_pipeline <input.bmp> <output.bmp> <step>... [--stream <rows>] [--threads <n>]" << endl
+             << "  Steps: crop:x,y,w,h  flip  flipv  rotate:<90|180|270>  quantize:<bits>   (applied left to right)" << endl;
+        return 1;
+    }
+    const char* inputFileName = argv[1];
+    const char* outputFileName = argv[2];
+
+    // Collect the steps; option flags and their values are skipped
+    Pipeline pipeline;
+    for (int i = 3; i < argc; ++i) {
+        string arg = argv[i];
+        if (arg == "--stream" || arg == "--threads") {
+            ++i;
+            continue;
+        }
+        if (!pipeline.addStep(arg)) {
+            return 1;
+        }
+    }
+
+    int threadCount = parseThreadCountOption(argc, argv);
+    int bandRows = parseBandRowsOption(argc, argv);
+
+    // All steps run as one fused traversal: each output row is built straight from its source row
+    bool success = bandRows > 0
+        ? runPipelineStreaming(pipeline, inputFileName, outputFileName, bandRows, threadCount)
+        : runPipeline(pipeline, inputFileName, outputFileName, threadCount);
+    if (!success) {
+        return 1;
+    }
+
+    cout << "Pipeline completed." << endl;
+    return 0;
+}
@@ -0,0 +1,269 @@
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "bmp_image_cache.h"
+#include "bmp_parallel.h"
+#include "bmp_pipeline.h"
+#include "bmp_trace.h"
+
+using namespace std;
+
+// Print the command-line usage and the request protocol of the server
+static void printUsage() {
+    cerr << "Usage: bmp_server [--socket <path>] [--cache-mb <n>] [--threads <n>]" << endl
+         << "  Reads one request per line from stdin (or from each connection to a Unix socket) and" << endl
+         << "  answers each with one line: \"ok ...\" or \"error <reason>\"." << endl
+         << "  Requests:" << endl
+         << "    flip <input.bmp> <output.bmp>" << endl
+         << "    crop <input.bmp> <output.bmp> <x,y,w,h>" << endl
+         << "    quantize <input.bmp> <output.bmp> <bits>" << endl
+         << "    run <input.bmp> <output.bmp> <step>...      (bmp_pipeline steps, applied left to right)" << endl
+         << "    evict [<input.bmp>]                        (drop one cached image, or all)" << endl
+         << "    status" << endl
+         << "    quit                                       (close this connection)" << endl
+         << "    shutdown                                   (stop the server)" << endl;
+}
+
+// State shared by every connection
+struct Server {
+    ImageCache cache;
+    int threadCount = 1;
+    atomic<bool> stopping{false};
+
+    explicit Server(size_t budgetBytes) : cache(budgetBytes) {}
+};
+
+// What the connection does after a request
+enum RequestOutcome {
+    REQUEST_CONTINUE,
+    REQUEST_QUIT,
+    REQUEST_SHUTDOWN
+};
+
+// Execute one request line and set the response line (without the newline)
+static RequestOutcome handleRequest(const string& line, Server& server, string& response) {
+    BMP_TRACE_SCOPE(trace, "server.request", 0);
+    istringstream stream(line);
+    vector<string> words;
+    string word;
+    while (stream >> word) {
+        words.push_back(word);
+    }
+    if (words.empty()) {
+        response = "error empty request";
+        return REQUEST_CONTINUE;
+    }
+
+    const string& command = words[0];
+    if (command == "quit") {
+        response = "ok";
+        return REQUEST_QUIT;
+    }
+    if (command == "shutdown") {
+        response = "ok";
+        return REQUEST_SHUTDOWN;
+    }
+    if (command == "status") {
+        ostringstream status;
+        status << "ok entries=" << server.cache.entryCount() << " bytes=" << server.cache.residentBytes()
+               << " budget=" << server.cache.budget() << " hits=" << server.cache.hitCount()
+               << " misses=" << server.cache.missCount();
+        response = status.str();
+        return REQUEST_CONTINUE;
+    }
+    if (command == "evict") {
+        if (words.size() > 1) {
+            server.cache.evict(words[1]);
+        } else {
+            server.cache.clear();
+        }
+        response = "ok";
+        return REQUEST_CONTINUE;
+    }
+
+    // The image commands are all one fused pipeline over the cached source
+    Pipeline pipeline;
+    bool valid = words.size() >= 3;
+    if (valid && command == "flip") {
+        valid = words.size() == 3 && pipeline.addStep("flip");
+    } else if (valid && command == "crop") {
+        valid = words.size() == 4 && pipeline.addStep("crop:" + words[3]);
+    } else if (valid && command == "quantize") {
+        valid = words.size() == 4 && pipeline.addStep("quantize:" + words[3]);
+    } else if (valid && command == "run") {
+        for (size_t i = 3; valid && i < words.size(); ++i) {
+            valid = pipeline.addStep(words[i]);
+        }
+    } else {
+        response = "error unknown request";
+        return REQUEST_CONTINUE;
+    }
+    if (!valid) {
+        response = "error invalid arguments";
+        return REQUEST_CONTINUE;
+    }
+
+    auto start = chrono::steady_clock::now();
+    bool hit = false;
+    shared_ptr<const Image> image = server.cache.acquire(words[1], &hit);
+    if (!image) {
+        response = "error can't load " + words[1];
+        return REQUEST_CONTINUE;
+    }
+    BMP_TRACE_SET_BYTES(trace, image->pixelBytes());
+    if (!runPipeline(pipeline, *image, words[2].c_str(), server.threadCount)) {
+        response = "error can't process " + words[1];
+        return REQUEST_CONTINUE;
+    }
+    double milliseconds = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    char timing[64];
+    snprintf(timing, sizeof(timing), " %.3f ms", milliseconds);
+    response = string("ok ") + (hit ? "cached" : "loaded") + timing;
+    return REQUEST_CONTINUE;
+}
+
+// Answer requests from `input` on `output` until end of input, quit or shutdown
+static RequestOutcome serve(FILE* input, FILE* output, Server& server) {
+    char* buffer = nullptr;
+    size_t capacity = 0;
+    RequestOutcome outcome = REQUEST_CONTINUE;
+    while (outcome == REQUEST_CONTINUE && !server.stopping && getline(&buffer, &capacity, input) >= 0) {
+        string line(buffer);
+        string response;
+        outcome = handleRequest(line, server, response);
+        fprintf(output, "%s\n", response.c_str());
+        fflush(output);
+    }
+    free(buffer);
+    return outcome;
+}
+
+#ifndef _WIN32
+// Accept connections on a Unix socket, one thread each, until a shutdown request
+static bool serveSocket(const char* path, Server& server) {
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        cerr << "Socket path is too long." << endl;
+        return false;
+    }
+    strcpy(address.sun_path, path);
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(path);
+    if (listener < 0 || bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, 16) != 0) {
+        cerr << "Can't listen on socket." << endl;
+        if (listener >= 0) {
+            close(listener);
+        }
+        return false;
+    }
+
+    // A client that disconnects early must not kill the server with SIGPIPE
+    signal(SIGPIPE, SIG_IGN);
+
+    // Open connections are tracked so a shutdown can end their reads and wait for them
+    mutex connectionsMutex;
+    condition_variable connectionsClosed;
+    set<int> connections;
+    while (!server.stopping) {
+        int connection = accept(listener, nullptr, nullptr);
+        if (connection < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        {
+            lock_guard<mutex> lock(connectionsMutex);
+            connections.insert(connection);
+        }
+        thread([&, connection]() {
+            FILE* input = fdopen(connection, "r");
+            FILE* output = fdopen(dup(connection), "w");
+            RequestOutcome outcome = (input && output) ? serve(input, output, server) : REQUEST_QUIT;
+            if (outcome == REQUEST_SHUTDOWN) {
+                server.stopping = true;
+                shutdown(listener, SHUT_RDWR);
+            }
+            lock_guard<mutex> lock(connectionsMutex);
+            if (output) {
+                fclose(output);
+            }
+            if (input) {
+                fclose(input);
+            } else {
+                close(connection);
+            }
+            connections.erase(connection);
+            connectionsClosed.notify_all();
+        }).detach();
+    }
+
+    // Stop: unblock the reads of the remaining connections and wait for them
+    server.stopping = true;
+    {
+        unique_lock<mutex> lock(connectionsMutex);
+        for (int connection : connections) {
+            shutdown(connection, SHUT_RDWR);
+        }
+        connectionsClosed.wait(lock, [&]() { return connections.empty(); });
+    }
+    close(listener);
+    unlink(path);
+    return true;
+}
+#endif
+
+int main(int argc, char* argv[]) {
+    const char* socketPath = nullptr;
+    size_t budgetBytes = DEFAULT_IMAGE_CACHE_BYTES;
+    for (int i = 1; i < argc; ++i) {
+        string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--socket" && hasValue) {
+            socketPath = argv[++i];
+        } else if (arg == "--cache-mb" && hasValue) {
+            budgetBytes = static_cast<size_t>(strtoull(argv[++i], nullptr, 10)) << 20;
+        } else if (arg == "--threads" && hasValue) {
+            ++i;
+        } else {
+            printUsage();
+            return 1;
+        }
+    }
+
+    Server server(budgetBytes);
+    server.threadCount = parseThreadCountOption(argc, argv);
+
+    if (socketPath == nullptr) {
+        serve(stdin, stdout, server);
+        return 0;
+    }
+#ifdef _WIN32
+    cerr << "Sockets are not supported on this platform; use stdin." << endl;
+    return 1;
+#else
+    return serveSocket(socketPath, server) ? 0 : 1;
+#endif
+}